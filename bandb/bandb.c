@@ -168,6 +168,11 @@ list_bans(void)
 					    table.row[j][2], table.row[j][3]);
 
 			rb_helper_write_queue(bandb_helper, "%s", buf);
+
+			/* send as we go; queueing a big table whole costs a
+			 * linebuf line per ban before the first one is written */
+			if(j % 64 == 63)
+				rb_helper_write_flush(bandb_helper);
 		}
 
 		rsdb_exec_fetch_end(&table);
@@ -93,9 +93,6 @@ chm_nobots_can_join(void *data_)
 	struct Client *client = data->client;
 	struct Channel *chptr = data->chptr;
 	rb_dlink_node *invite = NULL;
-	struct Ban *invex = NULL;
-	struct matchset ms;
-	rb_dlink_node *ptr;
 
 	/* If join is already blocked, defer. */
 	if (data->approved)
@@ -121,14 +118,8 @@ chm_nobots_can_join(void *data_)
 	/* Check for invexes. */
 	if (ConfigChannel.use_invex)
 	{
-		matchset_for_client(client, &ms);
-		RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
-		{
-			invex = ptr->data;
-			if (matches_mask(&ms, invex->banstr) ||
-					match_extban(invex->banstr, client, chptr, CHFL_INVEX))
-				return;
-		}
+		if (banset_match(chptr, &chptr->invexlist, client, client_matchset(client), CHFL_INVEX) != NULL)
+			return;
 	}
 
 	/* If we're here, umode AND cmode +B are set, and the client is not exempt for any reason. */
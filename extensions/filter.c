@@ -88,9 +88,19 @@ static const char *cmdname[MESSAGE_TYPE_COUNT] = {
 enum filter_state {
 	FILTER_EMPTY,
 	FILTER_FILLING,
+	FILTER_APPLYING,
 	FILTER_LOADED
 };
 
+/* an APPLY being deserialised on a worker thread */
+struct filter_job {
+	char *data;
+	size_t len;
+	hs_database_t *db;
+	hs_scratch_t *scratch;
+	const char *error;
+};
+
 struct match_context {
 	unsigned int actions;
 	bool require_bypass;
@@ -157,6 +167,7 @@ moddeinit(void)
 	user_modes['u'] = 0;
 	construct_umodebuf();
 	cflag_orphan('u');
+	rb_job_drain();
 	hs_free_scratch(filter_scratch);
 	hs_free_database(filter_db);
 	rb_free(filter_data);
@@ -225,6 +236,45 @@ filter_conf_set_exit_message(void *data)
 	filter_exit_message = rb_strdup(data);
 }
 
+static void
+filter_apply_work(void *data)
+{
+	struct filter_job *job = data;
+
+	if (hs_deserialize_database(job->data, job->len, &job->db) != HS_SUCCESS) {
+		job->error = "couldn't deserialize db";
+		return;
+	}
+	/* a scratch of its own: the current one is in use by match_message */
+	if (hs_alloc_scratch(job->db, &job->scratch) != HS_SUCCESS) {
+		job->error = "couldn't allocate scratch";
+		hs_free_database(job->db);
+		job->db = NULL;
+	}
+}
+
+static void
+filter_apply_done(void *data)
+{
+	struct filter_job *job = data;
+
+	if (job->db == NULL) {
+		state = filter_db ? FILTER_LOADED : FILTER_EMPTY;
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+			"Couldn't apply new filters: %s", job->error);
+	} else {
+		hs_free_scratch(filter_scratch);
+		hs_free_database(filter_db);
+		filter_scratch = job->scratch;
+		filter_db = job->db;
+		state = FILTER_LOADED;
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+			"New filters loaded.");
+	}
+	rb_free(job->data);
+	rb_free(job);
+}
+
 static int
 setfilter(const char *check, const char *data, const char **error)
 {
@@ -243,6 +293,11 @@ setfilter(const char *check, const char *data, const char **error)
 		return 0;
 	}
 
+	if (state == FILTER_APPLYING) {
+		if (error) *error = "still applying the last database";
+		return -1;
+	}
+
 	if (strlen(check) > sizeof check_str - 1) {
 		if (error) *error = "check string too long";
 		return -1;
@@ -291,28 +346,16 @@ setfilter(const char *check, const char *data, const char **error)
 			if (error) *error = "not loading anything";
 			return -1;
 		}
-		hs_database_t *db;
-		hs_error_t r = hs_deserialize_database(filter_data, filter_data_len, &db);
-		if (r != HS_SUCCESS) {
-			if (error) *error = "couldn't deserialize db";
-			return -1;
-		}
-		r = hs_alloc_scratch(db, &filter_scratch);
-		if (r != HS_SUCCESS) {
-			if (error) *error = "couldn't allocate scratch";
-			hs_free_database(db);
-			return -1;
-		}
-		if (filter_db) {
-			hs_free_database(filter_db);
-		}
-		state = FILTER_LOADED;
-		filter_db = db;
-		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
-			"New filters loaded.");
-		rb_free(filter_data);
+		/* a large database takes a while to deserialise, so do it on
+		 * a worker thread and keep scanning with the old one until
+		 * filter_apply_done swaps it in */
+		struct filter_job *job = rb_malloc(sizeof *job);
+		job->data = filter_data;
+		job->len = filter_data_len;
 		filter_data = 0;
 		filter_data_len = 0;
+		state = FILTER_APPLYING;
+		rb_job_post(filter_apply_work, filter_apply_done, job);
 		return 0;
 	}
 
@@ -352,8 +395,8 @@ setfilter(const char *check, const char *data, const char **error)
  * NEW prepares a buffer to receive a hyperscan database
  * <data> is base64 encoded chunks of hyperscan database, which are decoded
  *   and appended to the buffer
- * APPLY deserialises the buffer and sets the resulting hyperscan database
- *   as the one to use for filtering */
+ * APPLY deserialises the buffer on a worker thread and then sets the
+ *   resulting hyperscan database as the one to use for filtering */
 static void
 mo_setfilter(struct MsgBuf *msgbuf, struct Client *client_p, struct Client *source_p, int parc, const char **parv)
 {
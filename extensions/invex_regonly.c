@@ -23,23 +23,10 @@ h_can_join(void *data_)
 	hook_data_channel *data = data_;
 	struct Client *source_p = data->client;
 	struct Channel *chptr = data->chptr;
-	struct Ban *invex = NULL;
-	struct matchset ms;
-	rb_dlink_node *ptr;
 	
 	if(data->approved != ERR_NEEDREGGEDNICK)
 		return;
 
-	matchset_for_client(source_p, &ms);
-
-	RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
-	{
-		invex = ptr->data;
-		if (matches_mask(&ms, invex->banstr) ||
-				match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
-		{
-			data->approved = 0;
-			break;
-		}
-	}
+	if (banset_match(chptr, &chptr->invexlist, source_p, client_matchset(source_p), CHFL_INVEX) != NULL)
+		data->approved = 0;
 }
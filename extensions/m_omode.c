@@ -138,12 +138,16 @@ mo_omode(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 				me.id, (long) chptr->channelts, parv[1],
 				source_p->id);
 		msptr->flags |= CHFL_CHANOP;
+		update_member_table(msptr);
 	}
 	else
 	{
 		/* Hack it so set_channel_mode() will accept */
 		if (wasonchannel)
+		{
 			msptr->flags |= CHFL_CHANOP;
+			update_member_table(msptr);
+		}
 		else
 		{
 			add_user_to_channel(chptr, source_p, CHFL_CHANOP);
@@ -155,7 +159,10 @@ mo_omode(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 		 * themselves as set_channel_mode() does not allow that
 		 * -- jilles */
 		if (wasonchannel)
+		{
 			msptr->flags &= ~CHFL_CHANOP;
+			update_member_table(msptr);
+		}
 		else
 			remove_user_from_channel(msptr);
 	}
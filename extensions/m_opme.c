@@ -77,6 +77,7 @@ mo_opme(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_
 		return;
 
 	msptr->flags |= CHFL_CHANOP;
+	update_member_table(msptr);
 
 	sendto_wallops_flags(UMODE_WALLOP, &me,
 			     "OPME called for [%s] by %s!%s@%s",
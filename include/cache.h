@@ -19,6 +19,7 @@ struct cachefile
 	char name[CACHEFILELEN];
 	rb_dlink_list contents;
 	int flags;
+	char *path;		/* help file not read yet */
 };
 
 struct cacheline
@@ -39,10 +40,12 @@ struct cachefile *cache_file(const char *, const char *, int);
 void free_cachefile(struct cachefile *);
 
 void load_help(void);
+struct cachefile *help_lookup(rb_dictionary *, const char *);
 
 void send_user_motd(struct Client *);
 void send_oper_motd(struct Client *);
 void cache_user_motd(void);
+void cache_oper_motd(void);
 
 extern rb_dictionary *help_dict_oper;
 extern rb_dictionary *help_dict_user;
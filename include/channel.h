@@ -47,6 +47,21 @@ struct Mode
 	char forward[LOC_CHANNELLEN + 1];
 };
 
+/* Local members laid out for message fan-out: one entry per local member,
+ * with the membership bits delivery filters on packed into a byte, so a
+ * send can pick recipients without touching each struct Client.
+ */
+struct member_table
+{
+	unsigned int count;
+	unsigned int size;
+	struct Client **client;
+	struct membership **msptr;
+	uint8_t *flags;		/* CHFL_CHANOP, CHFL_VOICE and MEMBER_DEAF */
+};
+
+#define MEMBER_DEAF		0x80	/* member has umode +D */
+
 /* channel structure */
 struct Channel
 {
@@ -60,12 +75,18 @@ struct Channel
 
 	rb_dlink_list members;	/* channel members */
 	rb_dlink_list locmembers;	/* local channel members */
+	rb_dlink_list links;	/* server links with members behind them */
+	struct member_table localtable;	/* locmembers again, for fan-out */
 
 	rb_dlink_list invites;
 	rb_dlink_list banlist;
 	rb_dlink_list exceptlist;
 	rb_dlink_list invexlist;
 	rb_dlink_list quietlist;
+	struct banset *ban_set;		/* the four lists above, indexed */
+	struct banset *except_set;
+	struct banset *invex_set;
+	struct banset *quiet_set;
 
 	time_t first_received_message_time;	/* channel flood control */
 	int received_number_of_privmsgs;
@@ -84,15 +105,26 @@ struct Channel
 	int last_checked_result;
 };
 
+/* a server link and the channel members reached through it */
+struct chlink
+{
+	rb_dlink_node node;
+	struct Client *server_p;
+	rb_dlink_list members;
+	unsigned int hearing[4];	/* members not deaf, by CHFL_CHANOP|CHFL_VOICE */
+};
+
 struct membership
 {
 	rb_dlink_node channode;
-	rb_dlink_node locchannode;
+	rb_dlink_node locchannode;	/* in locmembers, or the members of a chlink */
 	rb_dlink_node usernode;
 
 	struct Channel *chptr;
 	struct Client *client_p;
 	unsigned int flags;
+	unsigned int localidx;	/* position in chptr->localtable if local */
+	uint8_t linkflags;	/* member_table_flags() as counted in its chlink if remote */
 
 	time_t bants;
 };
@@ -105,6 +137,8 @@ struct Ban
 	time_t when;
 	char *forward;
 	rb_dlink_node node;
+	rb_dlink_node setnode;		/* in the list's banset */
+	rb_dlink_node cidrnode;		/* in the banset's patricia, if a CIDR mask */
 };
 
 struct mode_letter
@@ -266,9 +300,18 @@ extern void add_user_to_channel(struct Channel *, struct Client *, int flags);
 extern void remove_user_from_channel(struct membership *);
 extern void remove_user_from_channels(struct Client *);
 extern void invalidate_bancache_user(struct Client *);
+extern void update_member_table(struct membership *);
+extern void update_member_tables_user(struct Client *);
 
 extern void free_channel_list(rb_dlink_list *);
 
+struct banset;
+extern void banset_add(struct Channel *, rb_dlink_list *, struct Ban *);
+extern void banset_del(struct Channel *, rb_dlink_list *, struct Ban *);
+extern void banset_clear(struct Channel *, rb_dlink_list *);
+extern struct Ban *banset_match(struct Channel *, rb_dlink_list *, struct Client *,
+				const struct matchset *, long);
+
 extern bool check_channel_name(const char *name);
 
 extern void channel_member_names(struct Channel *chptr, struct Client *,
@@ -310,7 +353,9 @@ extern struct Ban * del_id(struct Channel *chptr, const char *banid, rb_dlink_li
 
 extern ExtbanFunc extban_table[256];
 
+extern unsigned char extban_type(const char *banstr);
 extern int match_extban(const char *banstr, struct Client *client_p, struct Channel *chptr, long mode_type);
+extern int match_extban_func(ExtbanFunc f, const char *banstr, struct Client *client_p, struct Channel *chptr, long mode_type);
 extern int valid_extban(const char *banstr, struct Client *client_p, struct Channel *chptr, long mode_type);
 const char * get_extban_string(void);
 
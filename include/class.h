@@ -45,7 +45,7 @@ struct Class
 	int cidr_ipv4_bitlen;
 	int cidr_ipv6_bitlen;
 	int cidr_amount;
-
+	buf_account_t sendq_usage;	/* sendqs of the local clients in it */
 };
 
 extern rb_dlink_list class_list;
@@ -64,6 +64,8 @@ extern struct Class *default_class;
 #define CidrIpv4Bitlen(x)   ((x)->cidr_ipv4_bitlen)
 #define CidrIpv6Bitlen(x)   ((x)->cidr_ipv6_bitlen)
 #define CidrAmount(x)	((x)->cidr_amount)
+#define SendqUsage(x)	((x)->sendq_usage)
+#define SendqBudget(x)	((x)->sendq_usage.limit)
 #define ClassPtr(x)      ((x)->c_class)
 
 #define ConfClassName(x) (ClassPtr(x)->class_name)
@@ -61,6 +61,7 @@ struct Server;
 struct LocalUser;
 struct PreClient;
 struct ListClient;
+struct matchset;
 struct scache_entry;
 
 typedef int SSL_OPEN_CB(struct Client *, int status);
@@ -153,6 +154,22 @@ struct Client
 	char *certfp; /* client certificate fingerprint */
 };
 
+/*
+ * Input read from a client but not yet parsed, kept contiguous so lines
+ * can be parsed in place; see packet.c.  Empty (buf == NULL) whenever
+ * everything read has been parsed.
+ */
+struct recvq
+{
+	char *buf;
+	size_t start;		/* first unparsed byte */
+	size_t end;		/* end of the data read */
+	size_t size;
+	unsigned int lines;	/* complete, non-empty lines waiting */
+	size_t partial;		/* length of the unterminated line at the end */
+	bool overlong;		/* dropping the rest of a truncated line */
+};
+
 struct LocalUser
 {
 	rb_dlink_node tnode;	/* This is the node for the local list type the client is on */
@@ -173,12 +190,14 @@ struct LocalUser
 					   spambot every time this gets to 0 */
 	time_t last_caller_id_time;
 
+	unsigned int sno_subscribed;	/* snomask bits we are a subscriber for */
+
 	time_t lasttime;	/* last time we parsed something */
 	time_t firsttime;	/* time client was created */
 
-	/* Send and receive linebuf queues .. */
+	/* Send linebuf queue and unparsed input */
 	buf_head_t buf_sendq;
-	buf_head_t buf_recvq;
+	struct recvq recvq;
 
 	/*
 	 * we want to use unsigned int here so the sizes have a better chance of
@@ -234,6 +253,10 @@ struct LocalUser
 	/* nicknames theyre monitoring */
 	rb_dlink_list monitor_list;
 
+	/* monitored nicks whose state changed since the last flush */
+	rb_dlink_list monitor_pending;
+	rb_dlink_node monitor_pending_node;
+
 	/*
 	 * Anti-flood stuff. We track how many messages were parsed and how
 	 * many we were allowed in the current second, and apply a simple decay
@@ -261,6 +284,7 @@ struct LocalUser
 
 	char *mangledhost; /* non-NULL if host mangling module loaded and
 			      applicable to this client */
+	struct matchset *matchset;	/* cached by client_matchset() */
 
 	struct _ssl_ctl *ssl_ctl;		/* which ssl daemon we're associate with */
 	struct _ssl_ctl *z_ctl;			/* second ctl for ssl+zlib */
@@ -440,6 +464,7 @@ struct ListClient
 #define LFLAGS_SECURE		0x00000010	/* for marking SSL clients as secure before registration */
 /* LFLAGS_FAKE: client may not have the usually expected machinery plugged in; don't assert on it. For tests only. */
 #define LFLAGS_FAKE		0x00000020
+#define LFLAGS_OPERCHECK	0x00000040	/* an OPER or CHALLENGE job is on a worker thread */
 
 /* umodes, settable flags */
 /* lots of this moved to snomask -- jilles */
@@ -619,6 +644,8 @@ extern struct Server *make_server(struct Client *);
 extern void close_connection(struct Client *);
 extern void init_uid(void);
 extern char *generate_uid(void);
+extern const char *get_current_uid(void);
+extern void set_current_uid(const char *);
 
 void allocate_away(struct Client *);
 void free_away(struct Client *);
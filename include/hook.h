@@ -5,10 +5,16 @@
 #ifndef INCLUDED_HOOK_H
 #define INCLUDED_HOOK_H
 
+typedef void (*hookfn) (void *data);
+
 typedef struct
 {
 	char *name;
 	rb_dlink_list hooks;
+	hookfn *fns;		/* functions from hooks, in call order */
+	int nfns;
+	unsigned long long calls;	/* calls that ran at least one function */
+	unsigned long long nsec;	/* time spent in those calls */
 } hook;
 
 enum hook_priority
@@ -40,8 +46,6 @@ enum message_tag_approval
 	MESSAGE_TAG_DROP = 2,
 };
 
-typedef void (*hookfn) (void *data);
-
 extern int h_burst_client;
 extern int h_burst_channel;
 extern int h_burst_finished;
@@ -74,6 +78,16 @@ void add_hook_prio(const char *name, hookfn fn, enum hook_priority priority);
 void remove_hook(const char *name, const hookfn fn);
 void call_hook(int id, void *arg);
 
+extern hook *hooks;
+extern int max_hooks;
+
+/* true if anything is hooked on id; callers may skip building hook data */
+static inline bool
+hook_subscribed(int id)
+{
+	return hooks[id].nfns != 0;
+}
+
 typedef struct
 {
 	struct Client *client;
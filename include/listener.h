@@ -29,26 +29,50 @@
 
 struct Client;
 
+/* most sockets one listener can be spread over with SO_REUSEPORT */
+#define LISTENER_MAX_SHARDS	16
+
+/* how often the accept rates shown by STATS P are worked out */
+#define LISTENER_RATE_TIME	10
+
+struct ListenerOptions
+{
+	int ssl;		/* ssl listener */
+	int defer_accept;	/* use TCP_DEFER_ACCEPT */
+	int shards;		/* sockets to open, 1 without SO_REUSEPORT */
+	int accept_budget;	/* accepts per socket per loop pass, 0 for the default */
+	int priority;		/* higher priority listeners are accepted from first */
+};
+
 struct Listener
 {
 	rb_dlink_node lnode;	/* list node */
 	const char *name;	/* listener name */
 	rb_fde_t *F;		/* file descriptor */
+	rb_fde_t *shard_F[LISTENER_MAX_SHARDS - 1];	/* the rest of the shards */
+	int shards;		/* sockets open, including F */
+	int accept_budget;
+	int priority;
 	int ref_count;		/* number of connection references */
 	int active;		/* current state of listener */
 	int ssl;		/* ssl listener */
 	int defer_accept;	/* use TCP_DEFER_ACCEPT */
 	bool sctp;		/* use SCTP */
+	unsigned long accepted;	/* connections handed on to auth */
+	unsigned long rejected;	/* connections dropped before setup */
+	unsigned long rate_mark;	/* accepted + rejected when last sampled */
+	double rate;		/* connections per second over LISTENER_RATE_TIME */
 	struct rb_sockaddr_storage addr[2];
 	char vhost[(HOSTLEN * 2) + 1];	/* virtual name of listener */
 };
 
-extern void add_tcp_listener(int port, const char *vaddr_ip, int family, int ssl, int defer_accept);
-extern void add_sctp_listener(int port, const char *vaddr_ip1, const char *vaddr_ip2, int ssl);
+extern void add_tcp_listener(int port, const char *vaddr_ip, int family, const struct ListenerOptions *opts);
+extern void add_sctp_listener(int port, const char *vaddr_ip1, const char *vaddr_ip2, const struct ListenerOptions *opts);
 extern void close_listener(struct Listener *listener);
 extern void close_listeners(void);
 extern const char *get_listener_name(const struct Listener *listener);
 extern void show_ports(struct Client *client);
+extern void update_listener_rates(void *unused);
 extern void free_listener(struct Listener *);
 
 #endif /* INCLUDED_listener_h */
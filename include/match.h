@@ -31,6 +31,7 @@
 /*
  * match - compare name with mask, mask may contain * and ? as wildcards
  * match - returns 1 on successful match, 0 otherwise
+ * match_folded - match, with name already folded by irctolower
  *
  * mask_match - compare one mask to another
  * match_esc - compare with support for escaping chars
@@ -38,6 +39,7 @@
  * match_ips - compares addr with addr/cidr in ascii form
  */
 extern int match(const char *mask, const char *name);
+extern int match_folded(const char *mask, const char *name);
 extern int mask_match(const char *oldmask, const char *newmask);
 extern int match_esc(const char *mask, const char *name);
 extern int match_cidr(const char *mask, const char *name);
@@ -59,14 +61,20 @@ int comp_with_mask_sock(struct sockaddr *addr, struct sockaddr *dest, unsigned i
 extern char *collapse(char *pattern);
 extern char *collapse_esc(char *pattern);
 
+/* the nick!user@host forms bans are matched against, folded with
+ * irctolower; host_at and ip_at are the offsets of the part after '@' */
 struct matchset {
 	char host[2][NAMELEN + USERLEN + HOSTLEN + 6];
 	char ip[2][NAMELEN + USERLEN + HOSTIPLEN + 6];
+	unsigned short host_at[2];
+	unsigned short ip_at[2];
 };
 
 struct Client;
 
 void matchset_for_client(struct Client *who, struct matchset *m);
+const struct matchset *client_matchset(struct Client *who);
+void clear_client_matchset(struct Client *who);
 bool client_matches_mask(struct Client *who, const char *mask);
 bool matches_mask(const struct matchset *m, const char *mask);
 
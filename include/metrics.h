@@ -0,0 +1,30 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  metrics.h: Timings and sizes exported on a local socket.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef INCLUDED_metrics_h
+#define INCLUDED_metrics_h
+
+/* (re)open general::metrics_socket, if it is set and has changed */
+void metrics_open(void);
+
+/* close the socket and remove it */
+void metrics_close(void);
+
+#endif
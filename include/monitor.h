@@ -9,13 +9,16 @@
 #define INCLUDED_monitor_h
 
 struct rb_bh;
+struct monitor_entry;
 
 struct monitor
 {
 	char name[NICKLEN];
-	rb_dlink_list users;
+	rb_dlink_list users;		/* local clients watching this nick */
 	rb_dlink_node node;
 	unsigned int hashv;
+	struct monitor_entry **watchers;	/* the same clients, as an open-addressed set */
+	unsigned int watchers_mask;	/* set size - 1, or 0 when unallocated */
 };
 
 #define MONITOR_HASH_BITS 16
@@ -25,6 +28,8 @@ void free_monitor(struct monitor *);
 
 void init_monitor(void);
 struct monitor *find_monitor(const char *name, int add);
+bool add_monitor_watcher(struct Client *client_p, struct monitor *monptr);
+void del_monitor_watcher(struct Client *client_p, struct monitor *monptr);
 void clear_monitor(struct Client *);
 bool is_monitoring(struct Client *client_p, const char *name);
 
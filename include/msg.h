@@ -70,6 +70,8 @@ struct Message
 	 * UNREGISTERED, CLIENT, RCLIENT, SERVER, ENCAP, OPER
 	 */
 	struct MessageEntry handlers[LAST_HANDLER_TYPE];
+
+	struct rb_hist time;	/* nanoseconds spent in the handlers */
 };
 
 /* generic handlers */
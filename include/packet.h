@@ -28,5 +28,8 @@
 extern PF read_packet;
 extern EVH flood_recalc;
 extern void flood_endgrace(struct Client *);
+extern void recvq_append(struct Client *, const char *, size_t);
+extern void recvq_discard(struct Client *);
+extern void recvq_free(struct Client *);
 
 #endif /* INCLUDED_packet_h */
@@ -50,10 +50,15 @@ enum {
 };
 typedef unsigned int PrivilegeFlags;
 
+/* privilege names are interned to small integers; 0 is never a privilege */
+typedef unsigned int PrivilegeId;
+
 struct PrivilegeSet {
 	rb_dlink_node node;
 	size_t size;
 	const char **privs;
+	uint64_t *bits;		/* bitset indexed by PrivilegeId */
+	size_t bits_words;
 	size_t stored_size, allocated_size;
 	char *priv_storage;
 	char *name;
@@ -69,6 +74,30 @@ struct privset_diff {
 	const struct PrivilegeSet *removed;
 };
 
+PrivilegeId privilege_intern(const char *priv);
+PrivilegeId privilege_find(const char *priv);
+
+/*
+ * privilege_id(): id for a privilege name, for checking against a set.
+ * Call sites naming a privilege with a string literal intern it once and
+ * cache the id; anything else is looked up on each call, and an unknown
+ * name gives 0, which no set contains.
+ */
+#if defined(__GNUC__) || defined(__INTEL_COMPILER)
+#  define privilege_id(priv)	__extension__({ static PrivilegeId _privid; \
+		__builtin_constant_p(priv) \
+			? (_privid != 0 ? _privid : (_privid = privilege_intern(priv))) \
+			: privilege_find(priv); })
+#else
+#  define privilege_id(priv)	privilege_find(priv)
+#endif
+
+static inline bool
+privilegeset_has(const struct PrivilegeSet *set, PrivilegeId id)
+{
+	return id / 64 < set->bits_words && (set->bits[id / 64] >> (id % 64)) & 1;
+}
+
 bool privilegeset_in_set(const struct PrivilegeSet *set, const char *priv);
 const char *const *privilegeset_privs(const struct PrivilegeSet *set);
 struct PrivilegeSet *privilegeset_set_new(const char *name, const char *privs, PrivilegeFlags flags);
@@ -28,7 +28,7 @@
 #define DELAYED_EXIT_TIME	10
 
 void init_reject(void);
-int check_reject(rb_fde_t *F, struct sockaddr *addr, bool ssl);
+int check_reject(int fd, struct sockaddr *addr, bool ssl);
 void add_reject(struct Client *, const char *mask1, const char *mask2, struct ConfItem *aconf, const char *reason);
 int is_reject_ip(struct sockaddr *addr);
 void flush_reject(void);
@@ -27,5 +27,6 @@
 
 void restart(const char *) __noreturn;
 void server_reboot(void) __noreturn;
+void server_exec(void) __noreturn;
 
 #endif
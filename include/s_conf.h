@@ -169,6 +169,10 @@ struct config_file_entry
 	char *fname_killlog;
 	char *fname_klinelog;
 	char *fname_ioerrorlog;
+	char *fname_whowaslog;
+
+	int whowaslog_max_size;
+	int whowaslog_max_age;
 
 	int failed_oper_notice;
 	int anti_nick_flood;
@@ -215,12 +219,17 @@ struct config_file_entry
 	int reject_duration;
 	int throttle_count;
 	int throttle_duration;
+	int throttle_aggregate_factor;
 	int target_change;
 	int default_umodes;
 	int max_ratelimit_tokens;
 	int away_interval;
 	int tls_ciphers_oper_only;
 	int oper_secure_only;
+	char *metrics_socket;
+	int worker_threads;
+	int io_threads;
+	int sendq_budget;
 
 	char **hidden_caps;
 
@@ -262,6 +271,7 @@ struct config_channel_entry
 	int disable_local_channels;
 	unsigned int autochanmodes;
 	int displayed_usercount;
+	int lossy_membership_size;
 };
 
 struct config_server_hide
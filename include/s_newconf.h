@@ -128,7 +128,8 @@ extern void cluster_generic(struct Client *, const char *, int cltype,
 #define IsOperConfEncrypted(x)	((x)->flags & OPER_ENCRYPTED)
 #define IsOperConfNeedSSL(x)	((x)->flags & OPER_NEEDSSL)
 
-#define HasPrivilege(x, y)	((x)->user != NULL && (x)->user->privset != NULL && privilegeset_in_set((x)->user->privset, (y)))
+#define HasPrivilegeId(x, y)	((x)->user != NULL && (x)->user->privset != NULL && privilegeset_has((x)->user->privset, (y)))
+#define HasPrivilege(x, y)	HasPrivilegeId((x), privilege_id(y))
 #define MayHavePrivilege(x, y)	(HasPrivilege((x), (y)) || (IsOper((x)) && (x)->user != NULL && (x)->user->privset == NULL))
 
 #define IsOperKill(x)           (HasPrivilege((x), "oper:kill"))
@@ -77,6 +77,7 @@ extern uint64_t CLICAP_MESSAGE_TAGS;
 extern uint64_t CLICAP_BATCH;
 extern uint64_t CLICAP_NO_IMPLICIT_NAMES;
 extern uint64_t CLICAP_LABELED_RESPONSE;
+extern uint64_t CLICAP_LOSSY_MEMBERSHIP;
 
 /*
  * XXX: this is kind of ugly, but this allows us to have backwards
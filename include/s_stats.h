@@ -67,6 +67,7 @@ struct ServerStatistics
 	unsigned int is_cib;    /* number of open client-initiated batches */
 	unsigned int is_cibl;   /* number of queued lines in open client-initiated batches */
 	unsigned int is_rrb;    /* number of open remote response batches */
+	struct rb_hist is_sqflush;	/* bytes written per sendq flush */
 };
 
 extern struct ServerStatistics ServerStats;
@@ -39,6 +39,13 @@ extern unsigned long current_serial;
 extern struct Client *remote_rehash_oper_p;
 
 extern void send_pop_queue(struct Client *);
+extern void send_cork(void);
+extern void send_uncork(void);
+extern void send_lossy_begin(struct Client *, struct Channel *);
+extern void send_lossy_end(void);
+
+/* all local sendqs; each class's account is charged to this one */
+extern buf_account_t sendq_total;
 
 extern void send_queued(struct Client *to);
 
@@ -53,7 +53,25 @@
 #define SNO_SPY			0x00000800
 #define SNO_BANNED		0x00002000
 
+#define SNO_BITS		32
+
+struct snomask_bit
+{
+	rb_dlink_list subscribers;	/* local opers with this bit set */
+	unsigned long long sent;	/* notices with a subscriber */
+	unsigned long long skipped;	/* notices nobody subscribed to */
+};
+
+extern struct snomask_bit snomask_bits[SNO_BITS];
+extern unsigned int snomask_subscribed;
+
+/* true if some local oper would see a notice for these snomask bits */
+#define SnomaskSubscribed(flags)	((snomask_subscribed & (flags)) != 0)
+
 char *construct_snobuf(unsigned int val);
+void snomask_update_subscriptions(struct Client *client_p);
+void snomask_unsubscribe(struct Client *client_p);
+void snomask_count(unsigned int flags, bool sent);
 unsigned int parse_snobuf_to_mask(unsigned int val, const char *sno);
 unsigned int find_snomask_slot(void);
 
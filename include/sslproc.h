@@ -41,6 +41,10 @@ void ssld_update_config(void);
 void ssld_decrement_clicount(ssl_ctl_t *ctl);
 int get_ssld_count(void);
 void ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum ssld_status status, const char *version), void *data);
+void ssld_foreach_upgrade(void (*func)(void *data, pid_t pid, int ctlfd, int pipefd, bool shutdown, const char *version), void *data);
+ssl_ctl_t *ssld_adopt(pid_t pid, int ctlfd, int pipefd, bool shutdown, const char *version);
+ssl_ctl_t *ssld_attach_pid(pid_t pid);
+pid_t ssld_get_pid(ssl_ctl_t *ctl);
 
 #endif
 
@@ -0,0 +1,41 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  upgrade.h: Re-executing the server without dropping local clients.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef INCLUDED_upgrade_h
+#define INCLUDED_upgrade_h
+
+struct Client;
+
+/* environment variable naming the state file across exec */
+#define UPGRADE_ENV	"IRCD_UPGRADE"
+
+/* save state and re-exec; only returns if the state could not be saved */
+void server_upgrade(struct Client *source_p);
+
+/* true if this process was started by server_upgrade() */
+bool upgrade_resuming(void);
+
+/* read the state file and take back the ssld helpers, early in startup */
+void upgrade_init(void);
+
+/* recreate local clients and channels, once the config is loaded */
+void upgrade_restore(void);
+
+#endif
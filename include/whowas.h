@@ -37,21 +37,26 @@ struct Client;
   also removed away information. *tough*
   - Dianora
  */
+/*
+ * Entries live in a fixed ring allocated at startup; the string fields
+ * point into a refcounted intern table shared by every entry, so a
+ * thousand quits from the same host cost one copy of the hostname.
+ */
 struct Whowas
 {
-	struct whowas_top *wtop;
+	struct whowas_top *wtop;	/* NULL if this ring slot is unused */
 	rb_dlink_node wnode;		/* for the wtop linked list */
 	rb_dlink_node cnode;		/* node for online clients */
-	rb_dlink_node whowas_node;	/* node for the whowas linked list */
 	char name[NICKLEN + 1];
-	char username[USERLEN + 1];
-	char hostname[HOSTLEN + 1];
-	char sockhost[HOSTIPLEN + 1];
-	char realname[REALLEN + 1];
-	char suser[NICKLEN + 1];
+	const char *username;
+	const char *hostname;
+	const char *sockhost;
+	const char *realname;
+	const char *suser;
 	unsigned char flags;
 	const char *servername;
 	time_t logoff;
+	uint64_t serial;		/* orders entries across RAM and the log */
 	struct Client *online;	/* Pointer to new nickname for chasing or NULL */
 };
 
@@ -95,4 +100,31 @@ struct Client *whowas_get_history(const char *, time_t);
 rb_dlink_list *whowas_get_list(const char *name);
 void whowas_memory_usage(size_t *count, size_t *memused);
 
+/*
+** whowas_log_open
+**      (Re)open the persistent whowas log named by fname_whowaslog,
+**      indexing whatever history it already holds.
+**
+** whowas_log_close
+**      Flush pending records and close the log.
+*/
+void whowas_log_open(void);
+void whowas_log_close(void);
+
+/*
+** whowas_log_add
+**      Queue an entry for the log, returning its serial.
+*/
+uint64_t whowas_log_add(struct Whowas *);
+
+/*
+** whowas_log_search
+**      Call cb, newest first, on each logged entry for nick with a
+**      serial below before, until it returns nonzero. The entry passed
+**      is only valid for the duration of the call.
+*/
+void whowas_log_search(const char *nick, uint64_t before,
+		int (*cb)(struct Whowas *, void *), void *data);
+void whowas_log_memory_usage(size_t *count, size_t *memused);
+
 #endif /* INCLUDED_whowas_h */
@@ -61,6 +61,7 @@ static int start_bandb(void);
 static void bandb_parse(rb_helper *);
 static void bandb_restart_cb(rb_helper *);
 static char *bandb_path;
+static uint64_t bandb_load_start;
 
 void
 init_bandb(void)
@@ -322,6 +323,7 @@ bandb_handle_finish(void)
 {
 	struct ConfItem *aconf;
 	rb_dlink_node *ptr, *next_ptr;
+	unsigned long count = rb_dlink_list_length(&bandb_pending);
 
 	clear_out_address_conf(AC_BANDB);
 	clear_s_newconf_bans();
@@ -376,6 +378,9 @@ bandb_handle_finish(void)
 		}
 	}
 
+	ilog(L_MAIN, "bandb - loaded %lu bans in %.1fms", count,
+			(rb_hist_now() - bandb_load_start) / 1e6);
+
 	check_banned_lines();
 }
 
@@ -430,7 +435,10 @@ void
 bandb_rehash_bans(void)
 {
 	if(bandb_helper != NULL)
+	{
+		bandb_load_start = rb_hist_now();
 		rb_helper_write(bandb_helper, "L");
+	}
 }
 
 static void
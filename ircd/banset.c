@@ -0,0 +1,463 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  banset.c: Indexed ban lists for fast ban matching.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Each ban list of a channel (+b, +e, +I, +q) is shadowed by a banset
+ * which splits the masks by what can be looked up directly:
+ *
+ *  - masks whose host part has no wildcards are hashed by that host,
+ *  - of those, masks whose host part is an address/length are also
+ *    kept in a patricia tree by network,
+ *  - extbans are grouped by type, so each type's handler is looked up
+ *    once and types with no handler loaded are skipped,
+ *  - everything else (wildcard hosts, odd masks) stays in a plain list
+ *    that is walked as before.
+ *
+ * Lookups only narrow down the candidates; every candidate is still
+ * confirmed with match_folded(), match_cidr() or match_extban(), so a banset
+ * matches exactly the masks the plain list walk would.
+ */
+
+#include "stdinc.h"
+#include "channel.h"
+#include "client.h"
+#include "match.h"
+#include "s_assert.h"
+
+#define BANSET_HOSTS_MIN	16
+
+struct banset
+{
+	rb_dlink_list *hosts;		/* literal host masks, hashed by host */
+	unsigned int hosts_size;
+	unsigned int hosts_count;
+	rb_patricia_tree_t *cidr;	/* address/length masks, also in hosts */
+	rb_dlink_list extbans;		/* struct banset_extbans, one per type */
+	rb_dlink_list other;		/* masks that have to be tried one by one */
+};
+
+/* the extbans of one type */
+struct banset_extbans
+{
+	rb_dlink_node node;
+	unsigned char type;		/* index into extban_table */
+	rb_dlink_list bans;
+};
+
+static struct banset **
+banset_slot(struct Channel *chptr, rb_dlink_list *list)
+{
+	if (list == &chptr->banlist)
+		return &chptr->ban_set;
+	if (list == &chptr->exceptlist)
+		return &chptr->except_set;
+	if (list == &chptr->invexlist)
+		return &chptr->invex_set;
+	if (list == &chptr->quietlist)
+		return &chptr->quiet_set;
+
+	s_assert(0);
+	return NULL;
+}
+
+static uint32_t
+banset_hash(const char *host)
+{
+	uint32_t h = 0x811c9dc5;
+
+	for (; *host != '\0'; host++)
+	{
+		h ^= irctolower(*host);
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+/* host part of a mask if it contains no wildcards, else NULL */
+static const char *
+banset_literal_host(const char *banstr)
+{
+	const char *host;
+
+	if (*banstr == '$')
+		return NULL;
+
+	host = strrchr(banstr, '@');
+	if (host == NULL)
+		return NULL;
+	host++;
+
+	if (strpbrk(host, "*?") != NULL)
+		return NULL;
+
+	return host;
+}
+
+/* parse the host part of a mask the way match_cidr() does */
+static bool
+banset_cidr(const char *host, struct rb_sockaddr_storage *addr, int *bitlen)
+{
+	char buf[BUFSIZE];
+	char *len;
+	int aftype;
+
+	rb_strlcpy(buf, host, sizeof buf);
+
+	len = strrchr(buf, '/');
+	if (len == NULL)
+		return false;
+	*len++ = '\0';
+
+	*bitlen = atoi(len);
+	if (*bitlen <= 0)
+		return false;
+
+	memset(addr, 0, sizeof *addr);
+	aftype = strchr(buf, ':') != NULL ? AF_INET6 : AF_INET;
+
+	if (aftype == AF_INET6)
+	{
+		if (*bitlen > 128)
+			return false;
+		if (rb_inet_pton(AF_INET6, buf, &((struct sockaddr_in6 *)addr)->sin6_addr) <= 0)
+			return false;
+	}
+	else
+	{
+		if (*bitlen > 32)
+			return false;
+		if (rb_inet_pton(AF_INET, buf, &((struct sockaddr_in *)addr)->sin_addr) <= 0)
+			return false;
+	}
+
+	SET_SS_FAMILY(addr, aftype);
+	return true;
+}
+
+static struct banset_extbans *
+banset_find_extbans(struct banset *set, unsigned char type)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, set->extbans.head)
+	{
+		struct banset_extbans *group = ptr->data;
+
+		if (group->type == type)
+			return group;
+	}
+
+	return NULL;
+}
+
+static void
+banset_rehash(struct banset *set, unsigned int size)
+{
+	rb_dlink_list *hosts = rb_malloc(size * sizeof(rb_dlink_list));
+	rb_dlink_node *ptr, *next_ptr;
+
+	for (unsigned int i = 0; i < set->hosts_size; i++)
+	{
+		RB_DLINK_FOREACH_SAFE(ptr, next_ptr, set->hosts[i].head)
+		{
+			struct Ban *banptr = ptr->data;
+			uint32_t h = banset_hash(banset_literal_host(banptr->banstr));
+
+			rb_dlinkAdd(banptr, &banptr->setnode, &hosts[h & (size - 1)]);
+		}
+	}
+
+	rb_free(set->hosts);
+	set->hosts = hosts;
+	set->hosts_size = size;
+}
+
+/* banset_add()
+ *
+ * input	- channel, ban list the ban was added to, ban
+ * output	-
+ * side effects - ban is indexed in the list's banset
+ */
+void
+banset_add(struct Channel *chptr, rb_dlink_list *list, struct Ban *banptr)
+{
+	struct banset **slot = banset_slot(chptr, list);
+	struct banset *set;
+	struct rb_sockaddr_storage addr;
+	const char *host;
+	int bitlen;
+
+	if (slot == NULL)
+		return;
+
+	if (*slot == NULL)
+		*slot = rb_malloc(sizeof(struct banset));
+	set = *slot;
+
+	if (*banptr->banstr == '$')
+	{
+		unsigned char type = extban_type(banptr->banstr);
+		struct banset_extbans *group = banset_find_extbans(set, type);
+
+		if (group == NULL)
+		{
+			group = rb_malloc(sizeof(struct banset_extbans));
+			group->type = type;
+			rb_dlinkAdd(group, &group->node, &set->extbans);
+		}
+
+		rb_dlinkAdd(banptr, &banptr->setnode, &group->bans);
+		return;
+	}
+
+	host = banset_literal_host(banptr->banstr);
+	if (host == NULL)
+	{
+		rb_dlinkAdd(banptr, &banptr->setnode, &set->other);
+		return;
+	}
+
+	if (set->hosts_count >= set->hosts_size * 2)
+		banset_rehash(set, set->hosts_size ? set->hosts_size * 2 : BANSET_HOSTS_MIN);
+
+	rb_dlinkAdd(banptr, &banptr->setnode, &set->hosts[banset_hash(host) & (set->hosts_size - 1)]);
+	set->hosts_count++;
+
+	if (banset_cidr(host, &addr, &bitlen))
+	{
+		rb_patricia_node_t *pnode;
+
+		if (set->cidr == NULL)
+			set->cidr = rb_new_patricia(PATRICIA_BITS);
+
+		pnode = make_and_lookup_ip(set->cidr, (struct sockaddr *)&addr, bitlen);
+		if (pnode == NULL)
+			return;
+
+		if (pnode->data == NULL)
+			pnode->data = rb_malloc(sizeof(rb_dlink_list));
+		rb_dlinkAdd(banptr, &banptr->cidrnode, pnode->data);
+	}
+}
+
+/* banset_del()
+ *
+ * input	- channel, ban list the ban was removed from, ban
+ * output	-
+ * side effects - ban is dropped from the list's banset
+ */
+void
+banset_del(struct Channel *chptr, rb_dlink_list *list, struct Ban *banptr)
+{
+	struct banset **slot = banset_slot(chptr, list);
+	struct banset *set;
+	struct rb_sockaddr_storage addr;
+	const char *host;
+	int bitlen;
+
+	if (slot == NULL || *slot == NULL)
+		return;
+	set = *slot;
+
+	if (*banptr->banstr == '$')
+	{
+		struct banset_extbans *group = banset_find_extbans(set, extban_type(banptr->banstr));
+
+		if (group == NULL)
+			return;
+
+		rb_dlinkDelete(&banptr->setnode, &group->bans);
+		if (rb_dlink_list_length(&group->bans) == 0)
+		{
+			rb_dlinkDelete(&group->node, &set->extbans);
+			rb_free(group);
+		}
+		return;
+	}
+
+	host = banset_literal_host(banptr->banstr);
+	if (host == NULL)
+	{
+		rb_dlinkDelete(&banptr->setnode, &set->other);
+		return;
+	}
+
+	rb_dlinkDelete(&banptr->setnode, &set->hosts[banset_hash(host) & (set->hosts_size - 1)]);
+	set->hosts_count--;
+
+	if (set->cidr != NULL && banset_cidr(host, &addr, &bitlen))
+	{
+		rb_patricia_node_t *pnode = rb_match_ip_exact(set->cidr, (struct sockaddr *)&addr, bitlen);
+		rb_dlink_list *bans;
+
+		if (pnode == NULL || pnode->data == NULL)
+			return;
+
+		bans = pnode->data;
+		rb_dlinkDelete(&banptr->cidrnode, bans);
+		if (rb_dlink_list_length(bans) == 0)
+		{
+			rb_free(bans);
+			rb_patricia_remove(set->cidr, pnode);
+		}
+	}
+}
+
+/* banset_clear()
+ *
+ * input	- channel, ban list about to be emptied
+ * output	-
+ * side effects - the list's banset is freed; the bans themselves are not
+ */
+void
+banset_clear(struct Channel *chptr, rb_dlink_list *list)
+{
+	struct banset **slot = banset_slot(chptr, list);
+	struct banset *set;
+	rb_dlink_node *ptr, *next_ptr;
+
+	if (slot == NULL || *slot == NULL)
+		return;
+	set = *slot;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, set->extbans.head)
+		rb_free(ptr->data);
+	if (set->cidr != NULL)
+		rb_destroy_patricia(set->cidr, rb_free);
+	rb_free(set->hosts);
+	rb_free(set);
+	*slot = NULL;
+}
+
+static struct Ban *
+banset_match_host(const struct banset *set, const char *mask, unsigned short at)
+{
+	rb_dlink_node *ptr;
+
+	if (set->hosts_count == 0)
+		return NULL;
+
+	RB_DLINK_FOREACH(ptr, set->hosts[banset_hash(mask + at) & (set->hosts_size - 1)].head)
+	{
+		struct Ban *banptr = ptr->data;
+
+		if (match_folded(banptr->banstr, mask))
+			return banptr;
+	}
+
+	return NULL;
+}
+
+static struct Ban *
+banset_match_cidr(const struct banset *set, const char *mask, unsigned short at)
+{
+	struct rb_sockaddr_storage addr;
+	rb_patricia_node_t *pnode;
+	rb_dlink_node *ptr;
+
+	if (set->cidr == NULL)
+		return NULL;
+
+	if (!rb_inet_pton_sock(mask + at, (struct sockaddr_storage *)&addr))
+		return NULL;
+
+	/* every network holding the address lies on the path to the best one */
+	for (pnode = rb_match_ip(set->cidr, (struct sockaddr *)&addr); pnode != NULL; pnode = pnode->parent)
+	{
+		if (pnode->prefix == NULL || pnode->data == NULL)
+			continue;
+
+		RB_DLINK_FOREACH(ptr, ((rb_dlink_list *)pnode->data)->head)
+		{
+			struct Ban *banptr = ptr->data;
+
+			if (match_cidr(banptr->banstr, mask))
+				return banptr;
+		}
+	}
+
+	return NULL;
+}
+
+/* banset_match()
+ *
+ * input	- channel, ban list, client, client's matchset, mode type
+ * output	- a ban on the list matching the client, or NULL; if more
+ *		  than one matches, which one is returned is unspecified
+ * side effects -
+ */
+struct Ban *
+banset_match(struct Channel *chptr, rb_dlink_list *list, struct Client *who,
+		const struct matchset *ms, long mode_type)
+{
+	struct banset **slot = banset_slot(chptr, list);
+	const struct banset *set;
+	struct Ban *banptr;
+	rb_dlink_node *ptr;
+
+	if (slot == NULL || *slot == NULL)
+		return NULL;
+	set = *slot;
+
+	for (int i = 0; i < ARRAY_SIZE(ms->host) && ms->host[i][0] != '\0'; i++)
+	{
+		if ((banptr = banset_match_host(set, ms->host[i], ms->host_at[i])) != NULL)
+			return banptr;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(ms->ip) && ms->ip[i][0] != '\0'; i++)
+	{
+		if ((banptr = banset_match_host(set, ms->ip[i], ms->ip_at[i])) != NULL)
+			return banptr;
+		if ((banptr = banset_match_cidr(set, ms->ip[i], ms->ip_at[i])) != NULL)
+			return banptr;
+	}
+
+	RB_DLINK_FOREACH(ptr, set->other.head)
+	{
+		banptr = ptr->data;
+
+		if (matches_mask(ms, banptr->banstr))
+			return banptr;
+	}
+
+	/* no nick starts with '$', so extbans only match through their handler */
+	RB_DLINK_FOREACH(ptr, set->extbans.head)
+	{
+		const struct banset_extbans *group = ptr->data;
+		ExtbanFunc f = extban_table[group->type];
+		rb_dlink_node *bptr;
+
+		/* an unknown type matches nothing, inverted or not */
+		if (f == NULL)
+			continue;
+
+		RB_DLINK_FOREACH(bptr, group->bans.head)
+		{
+			banptr = bptr->data;
+
+			if (match_extban_func(f, banptr->banstr, who, chptr, mode_type))
+				return banptr;
+		}
+	}
+
+	return NULL;
+}
@@ -46,6 +46,9 @@ struct cacheline *emptyline = NULL;
 rb_dlink_list links_cache_list;
 char user_motd_changed[MAX_DATE_STRING];
 
+static bool user_motd_loaded;
+static bool oper_motd_loaded;
+
 rb_dictionary *help_dict_oper = NULL;
 rb_dictionary *help_dict_user = NULL;
 
@@ -53,7 +56,7 @@ rb_dictionary *help_dict_user = NULL;
  *
  * inputs	-
  * outputs	-
- * side effects - inits the file/line cache blockheaps, loads motds
+ * side effects - inits the file/line cache blockheaps
  */
 void
 init_cache(void)
@@ -64,8 +67,7 @@ init_cache(void)
 
 	user_motd_changed[0] = '\0';
 
-	user_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_MOTD], "ircd.motd", 0);
-	oper_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_OMOTD], "opers.motd", 0);
+	/* the motds are read when they are first sent */
 	memset(&links_cache_list, 0, sizeof(links_cache_list));
 
 	help_dict_oper = rb_dictionary_create("oper help", (DCF)rb_strcasecmp);
@@ -101,31 +103,19 @@ untabify(char *dest, const char *src, size_t destlen)
 	return x;
 }
 
-/* cache_file()
+/* cache_lines()
  *
- * inputs	- file to cache, files "shortname", flags to set
- * outputs	- pointer to file cached, else NULL
- * side effects -
+ * inputs	- cachefile to fill, open file to read it from
+ * outputs	-
+ * side effects - every line of the file is added to the cachefile
  */
-struct cachefile *
-cache_file(const char *filename, const char *shortname, int flags)
+static void
+cache_lines(struct cachefile *cacheptr, FILE *in)
 {
-	FILE *in;
-	struct cachefile *cacheptr;
 	struct cacheline *lineptr;
 	char line[BUFSIZE];
 	char *p;
 
-	if((in = fopen(filename, "r")) == NULL)
-		return NULL;
-
-
-	cacheptr = rb_malloc(sizeof(struct cachefile));
-
-	rb_strlcpy(cacheptr->name, shortname, sizeof(cacheptr->name));
-	cacheptr->flags = flags;
-
-	/* cache the file... */
 	while(fgets(line, sizeof(line), in) != NULL)
 	{
 		if((p = strpbrk(line, "\r\n")) != NULL)
@@ -145,6 +135,31 @@ cache_file(const char *filename, const char *shortname, int flags)
 		else
 			rb_dlinkAddTailAlloc(emptyline, &cacheptr->contents);
 	}
+}
+
+/* cache_file()
+ *
+ * inputs	- file to cache, files "shortname", flags to set
+ * outputs	- pointer to file cached, else NULL
+ * side effects -
+ */
+struct cachefile *
+cache_file(const char *filename, const char *shortname, int flags)
+{
+	FILE *in;
+	struct cachefile *cacheptr;
+
+	if((in = fopen(filename, "r")) == NULL)
+		return NULL;
+
+
+	cacheptr = rb_malloc(sizeof(struct cachefile));
+
+	rb_strlcpy(cacheptr->name, shortname, sizeof(cacheptr->name));
+	cacheptr->flags = flags;
+
+	/* cache the file... */
+	cache_lines(cacheptr, in);
 
 	if (0 == rb_dlink_list_length(&cacheptr->contents))
 	{
@@ -157,6 +172,60 @@ cache_file(const char *filename, const char *shortname, int flags)
 	return cacheptr;
 }
 
+/* cache_help()
+ *
+ * inputs	- help file, its topic, flags to set
+ * outputs	- pointer to an empty cachefile
+ * side effects - the file is only remembered; help_lookup() reads it
+ */
+static struct cachefile *
+cache_help(const char *filename, const char *shortname, int flags)
+{
+	struct cachefile *cacheptr;
+
+	cacheptr = rb_malloc(sizeof(struct cachefile));
+
+	rb_strlcpy(cacheptr->name, shortname, sizeof(cacheptr->name));
+	cacheptr->flags = flags;
+	cacheptr->path = rb_strdup(filename);
+
+	return cacheptr;
+}
+
+/* help_lookup()
+ *
+ * inputs	- help dictionary, topic
+ * outputs	- the topic's cachefile, or NULL if there is none or it is empty
+ * side effects - the help file is read the first time it is asked for
+ */
+struct cachefile *
+help_lookup(rb_dictionary *dict, const char *topic)
+{
+	struct cachefile *cacheptr;
+	FILE *in;
+
+	cacheptr = rb_dictionary_retrieve(dict, topic);
+	if(cacheptr == NULL)
+		return NULL;
+
+	if(cacheptr->path != NULL)
+	{
+		if((in = fopen(cacheptr->path, "r")) != NULL)
+		{
+			cache_lines(cacheptr, in);
+			fclose(in);
+		}
+
+		rb_free(cacheptr->path);
+		cacheptr->path = NULL;
+	}
+
+	if(rb_dlink_list_length(&cacheptr->contents) == 0)
+		return NULL;
+
+	return cacheptr;
+}
+
 /* free_cachefile()
  *
  * inputs	- cachefile to free
@@ -186,6 +255,7 @@ free_cachefile(struct cachefile *cacheptr)
 		}
 	}
 
+	rb_free(cacheptr->path);
 	rb_free(cacheptr);
 }
 
@@ -194,7 +264,7 @@ free_cachefile(struct cachefile *cacheptr)
  * inputs	-
  * outputs	-
  * side effects - old help cache deleted
- *		- contents of help directories are loaded.
+ *		- help directories are indexed; the files are read on first use.
  */
 void
 load_help(void)
@@ -230,7 +300,7 @@ load_help(void)
 		if(ldirent->d_name[0] == '.')
 			continue;
 		snprintf(filename, sizeof(filename), "%s/%s", ircd_paths[IRCD_PATH_OPERHELP], ldirent->d_name);
-		cacheptr = cache_file(filename, ldirent->d_name, HELP_OPER);
+		cacheptr = cache_help(filename, ldirent->d_name, HELP_OPER);
 		rb_dictionary_add(help_dict_oper, cacheptr->name, cacheptr);
 	}
 
@@ -265,7 +335,7 @@ load_help(void)
 		}
 #endif
 
-		cacheptr = cache_file(filename, ldirent->d_name, HELP_USER);
+		cacheptr = cache_help(filename, ldirent->d_name, HELP_USER);
 		rb_dictionary_add(help_dict_user, cacheptr->name, cacheptr);
 	}
 
@@ -285,6 +355,13 @@ send_user_motd(struct Client *source_p)
 	rb_dlink_node *ptr;
 	const char *myname = get_id(&me, source_p);
 	const char *nick = get_id(source_p, source_p);
+
+	if(!user_motd_loaded)
+	{
+		user_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_MOTD], "ircd.motd", 0);
+		user_motd_loaded = true;
+	}
+
 	if(user_motd == NULL || rb_dlink_list_length(&user_motd->contents) == 0)
 	{
 		sendto_one(source_p, form_str(ERR_NOMOTD), myname, nick);
@@ -322,7 +399,22 @@ cache_user_motd(void)
 		}
 	}
 	free_cachefile(user_motd);
-	user_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_MOTD], "ircd.motd", 0);
+	user_motd = NULL;
+	user_motd_loaded = false;
+}
+
+/* cache_oper_motd()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - the oper motd is reread when it is next sent
+ */
+void
+cache_oper_motd(void)
+{
+	free_cachefile(oper_motd);
+	oper_motd = NULL;
+	oper_motd_loaded = false;
 }
 
 
@@ -338,6 +430,12 @@ send_oper_motd(struct Client *source_p)
 	struct cacheline *lineptr;
 	rb_dlink_node *ptr;
 
+	if(!oper_motd_loaded)
+	{
+		oper_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_OMOTD], "opers.motd", 0);
+		oper_motd_loaded = true;
+	}
+
 	if(oper_motd == NULL || rb_dlink_list_length(&oper_motd->contents) == 0)
 		return;
 
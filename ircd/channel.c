@@ -46,6 +46,7 @@ static rb_bh *channel_heap;
 static rb_bh *ban_heap;
 static rb_bh *topic_heap;
 static rb_bh *member_heap;
+static rb_bh *chlink_heap;
 
 static void free_topic(struct Channel *chptr);
 
@@ -66,6 +67,7 @@ init_channels(void)
 	ban_heap = rb_bh_create(sizeof(struct Ban), BAN_HEAP_SIZE, "ban_heap");
 	topic_heap = rb_bh_create(TOPICLEN + 1 + USERHOST_REPLYLEN, TOPIC_HEAP_SIZE, "topic_heap");
 	member_heap = rb_bh_create(sizeof(struct membership), MEMBER_HEAP_SIZE, "member_heap");
+	chlink_heap = rb_bh_create(sizeof(struct chlink), CHANNEL_HEAP_SIZE, "chlink_heap");
 
 	h_can_join = register_hook("can_join");
 	h_can_send = register_hook("can_send");
@@ -87,6 +89,9 @@ allocate_channel(const char *chname)
 void
 free_channel(struct Channel *chptr)
 {
+	rb_free(chptr->localtable.client);
+	rb_free(chptr->localtable.msptr);
+	rb_free(chptr->localtable.flags);
 	rb_free(chptr->chname);
 	rb_free(chptr->mode_lock);
 	rb_bh_free(channel_heap, chptr);
@@ -142,6 +147,7 @@ send_batched_channel_join(struct Channel *chptr, struct Client *client_p, const
 	if (!IsClient(client_p))
 		return;
 
+	send_lossy_begin(client_p, chptr);
 	sendto_channel_local_with_capability_tags(client_p, ALL_MEMBERS, NOCAPS, CLICAP_EXTENDED_JOIN, chptr,
 		n_tags, &tag, ":%s!%s@%s JOIN %s",
 		client_p->name, client_p->username, client_p->host, chptr->chname);
@@ -151,6 +157,7 @@ send_batched_channel_join(struct Channel *chptr, struct Client *client_p, const
 		client_p->name, client_p->username, client_p->host, chptr->chname,
 		EmptyString(client_p->user->suser) ? "*" : client_p->user->suser,
 		client_p->info);
+	send_lossy_end();
 
 	/* Send away message to away-notify enabled clients. */
 	if (client_p->user->away)
@@ -229,6 +236,213 @@ find_channel_status(struct membership *msptr, int combine)
 	return buffer;
 }
 
+/* member_table_flags()
+ *
+ * input	- membership
+ * output	- the delivery flags for its member table or chlink entry
+ * side effects -
+ */
+static uint8_t
+member_table_flags(struct membership *msptr)
+{
+	uint8_t flags = msptr->flags & (CHFL_CHANOP | CHFL_VOICE);
+
+	if (IsDeaf(msptr->client_p))
+		flags |= MEMBER_DEAF;
+
+	return flags;
+}
+
+/* find_chlink()
+ *
+ * input	- channel, server link
+ * output	- the channel's entry for the link, or NULL
+ * side effects -
+ */
+static struct chlink *
+find_chlink(struct Channel *chptr, struct Client *server_p)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, chptr->links.head)
+	{
+		struct chlink *link = ptr->data;
+
+		if (link->server_p == server_p)
+			return link;
+	}
+
+	return NULL;
+}
+
+/* chlink_count()
+ *
+ * input	- server link entry, member flags from member_table_flags(),
+ *		  +1 or -1
+ * output	-
+ * side effects - the link's count of members who hear messages is
+ *		  adjusted
+ */
+static void
+chlink_count(struct chlink *link, uint8_t flags, int delta)
+{
+	if ((flags & MEMBER_DEAF) == 0)
+		link->hearing[flags & (CHFL_CHANOP | CHFL_VOICE)] += delta;
+}
+
+/* add_remote_member()
+ *
+ * input	- membership of a remote client
+ * output	-
+ * side effects - membership is added to the channel's entry for the
+ *                server link the client is behind
+ */
+static void
+add_remote_member(struct membership *msptr)
+{
+	struct Channel *chptr = msptr->chptr;
+	struct Client *server_p = msptr->client_p->from;
+	struct chlink *link = find_chlink(chptr, server_p);
+
+	if (link == NULL)
+	{
+		link = rb_bh_alloc(chlink_heap);
+		link->server_p = server_p;
+		rb_dlinkAdd(link, &link->node, &chptr->links);
+	}
+
+	rb_dlinkAdd(msptr, &msptr->locchannode, &link->members);
+	msptr->linkflags = member_table_flags(msptr);
+	chlink_count(link, msptr->linkflags, 1);
+}
+
+/* del_remote_member()
+ *
+ * input	- membership of a remote client
+ * output	-
+ * side effects - membership is removed from its server link's entry,
+ *                which is freed once empty
+ */
+static void
+del_remote_member(struct membership *msptr)
+{
+	struct Channel *chptr = msptr->chptr;
+	struct chlink *link = find_chlink(chptr, msptr->client_p->from);
+
+	s_assert(link != NULL);
+	if (link == NULL)
+		return;
+
+	chlink_count(link, msptr->linkflags, -1);
+	rb_dlinkDelete(&msptr->locchannode, &link->members);
+	if (rb_dlink_list_length(&link->members) == 0)
+	{
+		rb_dlinkDelete(&link->node, &chptr->links);
+		rb_bh_free(chlink_heap, link);
+	}
+}
+
+/* add_to_member_table()
+ *
+ * input	- membership of a local client
+ * output	-
+ * side effects - membership is appended to the channel's member table
+ */
+static void
+add_to_member_table(struct membership *msptr)
+{
+	struct member_table *mt = &msptr->chptr->localtable;
+
+	if (mt->count == mt->size)
+	{
+		mt->size = mt->size ? mt->size * 2 : 8;
+		mt->client = rb_realloc(mt->client, sizeof *mt->client * mt->size);
+		mt->msptr = rb_realloc(mt->msptr, sizeof *mt->msptr * mt->size);
+		mt->flags = rb_realloc(mt->flags, sizeof *mt->flags * mt->size);
+	}
+
+	msptr->localidx = mt->count++;
+	mt->client[msptr->localidx] = msptr->client_p;
+	mt->msptr[msptr->localidx] = msptr;
+	mt->flags[msptr->localidx] = member_table_flags(msptr);
+}
+
+/* del_from_member_table()
+ *
+ * input	- membership of a local client
+ * output	-
+ * side effects - membership is removed from the channel's member table,
+ *                the last entry taking its place
+ */
+static void
+del_from_member_table(struct membership *msptr)
+{
+	struct member_table *mt = &msptr->chptr->localtable;
+	unsigned int i = msptr->localidx, last = --mt->count;
+
+	s_assert(mt->msptr[i] == msptr);
+
+	if (i != last)
+	{
+		mt->client[i] = mt->client[last];
+		mt->msptr[i] = mt->msptr[last];
+		mt->flags[i] = mt->flags[last];
+		mt->msptr[i]->localidx = i;
+	}
+}
+
+/* update_member_table()
+ *
+ * input	- membership whose flags may have changed
+ * output	-
+ * side effects - the member table entry of a local member, or the
+ *                counts of a remote member's chlink, are refreshed;
+ *                call after changing msptr->flags
+ */
+void
+update_member_table(struct membership *msptr)
+{
+	uint8_t flags = member_table_flags(msptr);
+	struct chlink *link;
+
+	if (MyClient(msptr->client_p))
+	{
+		msptr->chptr->localtable.flags[msptr->localidx] = flags;
+		return;
+	}
+
+	if (flags == msptr->linkflags)
+		return;
+
+	link = find_chlink(msptr->chptr, msptr->client_p->from);
+	s_assert(link != NULL);
+	if (link == NULL)
+		return;
+
+	chlink_count(link, msptr->linkflags, -1);
+	chlink_count(link, flags, 1);
+	msptr->linkflags = flags;
+}
+
+/* update_member_tables_user()
+ *
+ * input	- client whose umodes may have changed
+ * output	-
+ * side effects - the client's entries in all member tables or chlink
+ *                counts are refreshed
+ */
+void
+update_member_tables_user(struct Client *client_p)
+{
+	rb_dlink_node *ptr;
+
+	if (client_p->user == NULL)
+		return;
+
+	RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
+		update_member_table(ptr->data);
+}
+
 /* add_user_to_channel()
  *
  * input	- channel to add client to, client to add, channel flags
@@ -265,7 +479,12 @@ add_user_to_channel(struct Channel *chptr, struct Client *client_p, int flags)
 	rb_dlinkAdd(msptr, &msptr->channode, &chptr->members);
 
 	if(MyClient(client_p))
+	{
 		rb_dlinkAdd(msptr, &msptr->locchannode, &chptr->locmembers);
+		add_to_member_table(msptr);
+	}
+	else
+		add_remote_member(msptr);
 }
 
 /* remove_user_from_channel()
@@ -290,7 +509,12 @@ remove_user_from_channel(struct membership *msptr)
 	rb_dlinkDelete(&msptr->channode, &chptr->members);
 
 	if(client_p->servptr == &me)
+	{
 		rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
+		del_from_member_table(msptr);
+	}
+	else
+		del_remote_member(msptr);
 
 	if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) == 0)
 		destroy_channel(chptr);
@@ -325,7 +549,12 @@ remove_user_from_channels(struct Client *client_p)
 		rb_dlinkDelete(&msptr->channode, &chptr->members);
 
 		if(client_p->servptr == &me)
+		{
 			rb_dlinkDelete(&msptr->locchannode, &chptr->locmembers);
+			del_from_member_table(msptr);
+		}
+		else
+			del_remote_member(msptr);
 
 		if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) == 0)
 			destroy_channel(chptr);
@@ -359,6 +588,8 @@ invalidate_bancache_user(struct Client *client_p)
 		msptr->bants = 0;
 		msptr->flags &= ~CHFL_BANNED;
 	}
+
+	clear_client_matchset(client_p);
 }
 
 /* check_channel_name()
@@ -427,6 +658,10 @@ destroy_channel(struct Channel *chptr)
 	}
 
 	/* free all bans/exceptions/denies */
+	banset_clear(chptr, &chptr->banlist);
+	banset_clear(chptr, &chptr->exceptlist);
+	banset_clear(chptr, &chptr->invexlist);
+	banset_clear(chptr, &chptr->quietlist);
 	free_channel_list(&chptr->banlist);
 	free_channel_list(&chptr->exceptlist);
 	free_channel_list(&chptr->invexlist);
@@ -580,7 +815,6 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 	       struct Client *who, struct membership *msptr,
 	       const struct matchset *ms, const char **forward)
 {
-	struct matchset ms_;
 	rb_dlink_node *ptr;
 	struct Ban *actualBan = NULL;
 	struct Ban *actualExcept = NULL;
@@ -589,40 +823,25 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 		return 0;
 
 	if (ms == NULL)
-	{
-		matchset_for_client(who, &ms_);
-		ms = &ms_;
-	}
+		ms = client_matchset(who);
 
-	RB_DLINK_FOREACH(ptr, list->head)
-	{
-		actualBan = ptr->data;
-		if (matches_mask(ms, actualBan->banstr))
-			break;
-		if (match_extban(actualBan->banstr, who, chptr, CHFL_BAN))
-			break;
-		actualBan = NULL;
-	}
+	actualBan = banset_match(chptr, list, who, ms, CHFL_BAN);
 
 	if (actualBan != NULL)
 	{
-		RB_DLINK_FOREACH(ptr, chptr->exceptlist.head)
-		{
-			actualExcept = ptr->data;
+		actualExcept = banset_match(chptr, &chptr->exceptlist, who, ms, CHFL_EXCEPTION);
 
-			/* theyre exempted.. */
-			if (matches_mask(ms, actualExcept->banstr) ||
-					match_extban(actualExcept->banstr, who, chptr, CHFL_EXCEPTION))
+		/* theyre exempted.. */
+		if (actualExcept != NULL)
+		{
+			/* cache the fact theyre not banned */
+			if(msptr != NULL)
 			{
-				/* cache the fact theyre not banned */
-				if(msptr != NULL)
-				{
-					msptr->bants = chptr->bants;
-					msptr->flags &= ~CHFL_BANNED;
-				}
-
-				return CHFL_EXCEPTION;
+				msptr->bants = chptr->bants;
+				msptr->flags &= ~CHFL_BANNED;
 			}
+
+			return CHFL_EXCEPTION;
 		}
 	}
 
@@ -643,8 +862,21 @@ is_banned_list(struct Channel *chptr, rb_dlink_list *list,
 		}
 	}
 
-	if (actualBan && actualBan->forward && forward)
-		*forward = actualBan->forward;
+	if (actualBan && forward)
+	{
+		/* the forward comes from the first matching ban on the list,
+		 * which the banset does not keep track of */
+		RB_DLINK_FOREACH(ptr, list->head)
+		{
+			actualBan = ptr->data;
+			if (matches_mask(ms, actualBan->banstr) ||
+					match_extban(actualBan->banstr, who, chptr, CHFL_BAN))
+				break;
+		}
+
+		if (ptr != NULL && actualBan->forward)
+			*forward = actualBan->forward;
+	}
 
 	return ((actualBan ? CHFL_BAN : 0));
 }
@@ -690,7 +922,7 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 	rb_dlink_node *invite = NULL;
 	rb_dlink_node *ptr;
 	struct Ban *invex = NULL;
-	struct matchset ms;
+	const struct matchset *ms;
 	int i = 0;
 	hook_data_channel moduledata;
 
@@ -700,9 +932,9 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 	moduledata.chptr = chptr;
 	moduledata.approved = 0;
 
-	matchset_for_client(source_p, &ms);
+	ms = client_matchset(source_p);
 
-	if((is_banned(chptr, source_p, NULL, &ms, forward)) == CHFL_BAN)
+	if((is_banned(chptr, source_p, NULL, ms, forward)) == CHFL_BAN)
 	{
 		moduledata.approved = ERR_BANNEDFROMCHAN;
 		goto finish_join_check;
@@ -727,14 +959,8 @@ can_join(struct Client *source_p, struct Channel *chptr, const char *key, const
 		}
 		if(invite == NULL)
 		{
-			RB_DLINK_FOREACH(ptr, chptr->invexlist.head)
-			{
-				invex = ptr->data;
-				if (matches_mask(&ms, invex->banstr) ||
-						match_extban(invex->banstr, source_p, chptr, CHFL_INVEX))
-					break;
-			}
-			if(ptr == NULL)
+			invex = banset_match(chptr, &chptr->invexlist, source_p, ms, CHFL_INVEX);
+			if(invex == NULL)
 				moduledata.approved = ERR_INVITEONLYCHAN;
 		}
 	}
@@ -830,6 +1056,9 @@ can_send(struct Channel *chptr, struct Client *source_p, struct membership *mspt
 	if(is_chanop_voiced(msptr))
 		moduledata.approved = CAN_SEND_OPV;
 
+	if (!hook_subscribed(h_can_send))
+		return moduledata.approved;
+
 	moduledata.client = source_p;
 	moduledata.chptr = msptr->chptr;
 	moduledata.msptr = msptr;
@@ -907,12 +1136,12 @@ find_bannickchange_channel(struct Client *client_p)
 	struct Channel *chptr;
 	struct membership *msptr;
 	rb_dlink_node *ptr;
-	struct matchset ms;
+	const struct matchset *ms;
 
 	if (!MyClient(client_p))
 		return NULL;
 
-	matchset_for_client(client_p, &ms);
+	ms = client_matchset(client_p);
 
 	RB_DLINK_FOREACH(ptr, client_p->user->channel.head)
 	{
@@ -926,8 +1155,8 @@ find_bannickchange_channel(struct Client *client_p)
 			if (can_send_banned(msptr))
 				return chptr;
 		}
-		else if (is_banned(chptr, client_p, msptr, &ms, NULL) == CHFL_BAN
-			|| is_quieted(chptr, client_p, msptr, &ms) == CHFL_BAN)
+		else if (is_banned(chptr, client_p, msptr, ms, NULL) == CHFL_BAN
+			|| is_quieted(chptr, client_p, msptr, ms) == CHFL_BAN)
 			return chptr;
 	}
 	return NULL;
@@ -276,6 +276,7 @@ add_id(struct Client *source_p, struct Channel *chptr, const char *banid, const
 	actualBan->when = rb_current_time();
 
 	rb_dlinkAdd(actualBan, &actualBan->node, list);
+	banset_add(chptr, list, actualBan);
 
 	/* invalidate the can_send() cache */
 	if(mode_type == CHFL_BAN || mode_type == CHFL_QUIET || mode_type == CHFL_EXCEPTION)
@@ -306,6 +307,7 @@ del_id(struct Channel *chptr, const char *banid, rb_dlink_list * list, long mode
 		if(irccmp(banid, banptr->banstr) == 0)
 		{
 			rb_dlinkDelete(&banptr->node, list);
+			banset_del(chptr, list, banptr);
 
 			/* invalidate the can_send() cache */
 			if(mode_type == CHFL_BAN || mode_type == CHFL_QUIET || mode_type == CHFL_EXCEPTION)
@@ -964,6 +966,7 @@ chm_op(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].arg = targ_p->name;
 
 		mstptr->flags |= CHFL_CHANOP;
+		update_member_table(mstptr);
 	}
 	else
 	{
@@ -981,6 +984,7 @@ chm_op(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].arg = targ_p->name;
 
 		mstptr->flags &= ~CHFL_CHANOP;
+		update_member_table(mstptr);
 	}
 }
 
@@ -1026,6 +1030,7 @@ chm_voice(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].arg = targ_p->name;
 
 		mstptr->flags |= CHFL_VOICE;
+		update_member_table(mstptr);
 	}
 	else
 	{
@@ -1036,6 +1041,7 @@ chm_voice(struct Client *source_p, struct Channel *chptr,
 		mode_changes[mode_count++].arg = targ_p->name;
 
 		mstptr->flags &= ~CHFL_VOICE;
+		update_member_table(mstptr);
 	}
 }
 
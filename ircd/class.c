@@ -50,6 +50,7 @@ make_class(void)
 	PingFreq(tmp) = DEFAULT_PINGFREQUENCY;
 	MaxUsers(tmp) = 1;
 	MaxSendq(tmp) = DEFAULT_SENDQ;
+	SendqUsage(tmp).parent = &sendq_total;
 
 	tmp->ip_limits = rb_new_patricia(PATRICIA_BITS);
 	return tmp;
@@ -192,6 +193,7 @@ add_class(struct Class *classptr)
 		MaxGlobal(tmpptr) = MaxGlobal(classptr);
 		PingFreq(tmpptr) = PingFreq(classptr);
 		MaxSendq(tmpptr) = MaxSendq(classptr);
+		SendqBudget(tmpptr) = SendqBudget(classptr);
 		ConFreq(tmpptr) = ConFreq(classptr);
 		CidrIpv4Bitlen(tmpptr) = CidrIpv4Bitlen(classptr);
 		CidrIpv6Bitlen(tmpptr) = CidrIpv6Bitlen(classptr);
@@ -294,7 +296,8 @@ report_classes(struct Client *source_p)
 				MaxSendq(cltmp),
 				MaxLocal(cltmp), 0,
 				MaxGlobal(cltmp), 0,
-				CurrUsers(cltmp));
+				CurrUsers(cltmp),
+				SendqUsage(cltmp).len, SendqBudget(cltmp));
 	}
 
 	/* also output the default class */
@@ -304,7 +307,8 @@ report_classes(struct Client *source_p)
 			MaxSendq(default_class),
 			MaxLocal(default_class), 0,
 			MaxGlobal(default_class), 0,
-			CurrUsers(default_class));
+			CurrUsers(default_class),
+			SendqUsage(default_class).len, SendqBudget(default_class));
 }
 
 /*
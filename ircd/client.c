@@ -54,6 +54,7 @@
 #include "sslproc.h"
 #include "s_assert.h"
 #include "response.h"
+#include "snomask.h"
 
 #define DEBUG_EXITED_CLIENTS
 
@@ -227,6 +228,7 @@ make_client(struct Client *from)
 		client_p->localClient->lasttime = client_p->localClient->firsttime = rb_current_time();
 
 		client_p->localClient->F = NULL;
+		rb_linebuf_set_account(&client_p->localClient->buf_sendq, &sendq_total);
 
 		client_p->preClient = rb_bh_alloc(pclient_heap);
 
@@ -301,12 +303,15 @@ free_local_client(struct Client *client_p)
 	rb_free(client_p->localClient->challenge);
 	rb_free(client_p->localClient->fullcaps);
 	rb_free(client_p->localClient->mangledhost);
+	rb_free(client_p->localClient->matchset);
 
 	if (IsSSL(client_p))
 		ssld_decrement_clicount(client_p->localClient->ssl_ctl);
 
 	rb_free(client_p->localClient->cipher_string);
 
+	recvq_free(client_p);
+
 	rb_bh_free(lclient_heap, client_p->localClient);
 	client_p->localClient = NULL;
 }
@@ -821,6 +826,7 @@ resv_nick_fnc(const char *mask, const char *reason, int temp_time)
 			del_from_client_hash(client_p->name, client_p);
 			rb_strlcpy(client_p->name, nick, sizeof(client_p->name));
 			add_to_client_hash(nick, client_p);
+			clear_client_matchset(client_p);
 
 			monitor_signon(client_p);
 
@@ -1333,6 +1339,23 @@ dead_link(struct Client *client_p, int sendqex)
 	rb_dlinkAdd(abt, &abt->node, &abort_list);
 }
 
+/* true if a local client shares a channel with source_p */
+static bool
+has_local_common_channel(struct Client *source_p)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, source_p->user->channel.head)
+	{
+		struct membership *msptr = ptr->data;
+
+		if(rb_dlink_list_length(&msptr->chptr->locmembers) > 0)
+			return true;
+	}
+
+	return false;
+}
+
 /* This does the remove of the user from channels..local or remote */
 static inline void
 exit_generic_client(struct Client *client_p, struct Client *source_p, struct Client *from,
@@ -1353,8 +1376,11 @@ exit_generic_client(struct Client *client_p, struct Client *source_p, struct Cli
 		batch_tag.capmask = CLICAP_BATCH;
 	}
 
-	sendto_common_channels_local_tags(source_p, NOCAPS, NOCAPS, n_tags, &batch_tag,
-		":%s!%s@%s QUIT :%s", source_p->name, source_p->username, source_p->host, comment);
+	/* don't build a QUIT no one here will see; on a hub, or for most
+	 * of the users behind a split, that is nearly every exit */
+	if(MyConnect(source_p) || has_local_common_channel(source_p))
+		sendto_common_channels_local_tags(source_p, NOCAPS, NOCAPS, n_tags, &batch_tag,
+			":%s!%s@%s QUIT :%s", source_p->name, source_p->username, source_p->host, comment);
 
 	remove_user_from_channels(source_p);
 
@@ -1475,9 +1501,13 @@ exit_remote_server(struct Client *client_p, struct Client *source_p, struct Clie
 				from->name, comment);
 
 	generate_batch_id(batch_id, sizeof(batch_id));
+	/* every QUIT of the split is queued before anything is written, so
+	 * each local client gets its share in a few writes */
+	send_cork();
 	sendto_local_clients_with_capability(CLICAP_BATCH, ":%s BATCH +%s netsplit %s", me.name, batch_id, comment1);
 	remove_dependents(client_p, source_p, from, IsPerson(from) ? newcomment : comment, comment1, batch_id);
 	sendto_local_clients_with_capability(CLICAP_BATCH, ":%s BATCH -%s", me.name, batch_id);
+	send_uncork();
 
 	rb_dlinkDelete(&source_p->lnode, &source_p->servptr->serv->servers);
 
@@ -1581,9 +1611,11 @@ exit_local_server(struct Client *client_p, struct Client *source_p, struct Clien
 	if(source_p->serv != NULL)
 	{
 		generate_batch_id(batch_id, sizeof(batch_id));
+		send_cork();
 		sendto_local_clients_with_capability(CLICAP_BATCH, ":%s BATCH +%s netsplit %s", me.name, batch_id, comment1);
 		remove_dependents(client_p, source_p, from, IsPerson(from) ? newcomment : comment, comment1, batch_id);
 		sendto_local_clients_with_capability(CLICAP_BATCH, ":%s BATCH -%s", me.name, batch_id);
+		send_uncork();
 	}
 
 	sendto_realops_snomask(SNO_GENERAL, L_ALL, "%s was connected"
@@ -1626,6 +1658,7 @@ exit_local_client(struct Client *client_p, struct Client *source_p, struct Clien
 
 	if(IsOper(source_p))
 		rb_dlinkFindDestroy(source_p, &local_oper_list);
+	snomask_unsubscribe(source_p);
 
 	sendto_realops_snomask(SNO_CCONN, L_ALL,
 			     "Client exiting: %s (%s@%s) [%s] [%s]",
@@ -2013,6 +2046,18 @@ init_uid(void)
 	current_uid[9] = '\0';
 }
 
+/* the last UID handed out, and picking up from it again after an upgrade */
+const char *
+get_current_uid(void)
+{
+	return current_uid;
+}
+
+void
+set_current_uid(const char *uid)
+{
+	rb_strlcpy(current_uid, uid, sizeof(current_uid));
+}
 
 char *
 generate_uid(void)
@@ -2123,7 +2168,7 @@ close_connection(struct Client *client_p)
 	}
 
 	rb_linebuf_donebuf(&client_p->localClient->buf_sendq);
-	rb_linebuf_donebuf(&client_p->localClient->buf_recvq);
+	recvq_discard(client_p);
 	detach_conf(client_p);
 
 	/* XXX shouldnt really be done here. */
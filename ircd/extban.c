@@ -26,22 +26,38 @@
 
 ExtbanFunc extban_table[256] = { NULL };
 
+/* the extban_table index of an extban */
+unsigned char
+extban_type(const char *banstr)
+{
+	const char *p = banstr + 1;
+
+	if (*p == '~')
+		p++;
+	return irctolower(*p);
+}
+
 int
 match_extban(const char *banstr, struct Client *client_p, struct Channel *chptr, long mode_type)
+{
+	if (*banstr != '$')
+		return 0;
+	return match_extban_func(extban_table[extban_type(banstr)], banstr, client_p, chptr, mode_type);
+}
+
+/* match_extban() with the type's handler already looked up */
+int
+match_extban_func(ExtbanFunc f, const char *banstr, struct Client *client_p, struct Channel *chptr, long mode_type)
 {
 	const char *p;
 	int invert = 0, result = EXTBAN_INVALID;
-	ExtbanFunc f;
 
-	if (*banstr != '$')
-		return 0;
 	p = banstr + 1;
 	if (*p == '~')
 	{
 		invert = 1;
 		p++;
 	}
-	f = extban_table[(unsigned char) irctolower(*p)];
 	if (*p != '\0')
 	{
 		p++;
@@ -37,15 +37,17 @@
 #include "s_newconf.h"
 #include "s_assert.h"
 #include "rb_dictionary.h"
+#include "rb_hashmap.h"
 #include "rb_radixtree.h"
 
 rb_dictionary *client_connid_tree = NULL;
-rb_radixtree *client_id_tree = NULL;
-rb_radixtree *client_name_tree = NULL;
+rb_hashmap *client_id_map = NULL;
+rb_hashmap *client_name_map = NULL;
 
-rb_radixtree *channel_tree = NULL;
+rb_hashmap *channel_map = NULL;
+rb_radixtree *channel_tree = NULL;	/* ordered, for LIST */
 rb_radixtree *resv_tree = NULL;
-rb_radixtree *hostname_tree = NULL;
+rb_hashmap *hostname_map = NULL;
 
 /*
  * look in whowas.c for the missing ...[WW_MAX]; entry
@@ -59,13 +61,14 @@ void
 init_hash(void)
 {
 	client_connid_tree = rb_dictionary_create("client connid", rb_uint32cmp);
-	client_id_tree = rb_radixtree_create("client id", NULL);
-	client_name_tree = rb_radixtree_create("client name", irccasecanon);
+	client_id_map = rb_hashmap_create("client id", NULL);
+	client_name_map = rb_hashmap_create("client name", irctoupper_tab);
 
+	channel_map = rb_hashmap_create("channel", irctoupper_tab);
 	channel_tree = rb_radixtree_create("channel", irccasecanon);
 	resv_tree = rb_radixtree_create("resv", irccasecanon);
 
-	hostname_tree = rb_radixtree_create("hostname", irccasecanon);
+	hostname_map = rb_hashmap_create("hostname", irctoupper_tab);
 }
 
 uint32_t
@@ -138,7 +141,7 @@ add_to_id_hash(const char *name, struct Client *client_p)
 	if(EmptyString(name) || (client_p == NULL))
 		return;
 
-	rb_radixtree_add(client_id_tree, name, client_p);
+	rb_hashmap_add(client_id_map, name, client_p);
 }
 
 /* add_to_client_hash()
@@ -153,7 +156,7 @@ add_to_client_hash(const char *name, struct Client *client_p)
 	if(EmptyString(name) || (client_p == NULL))
 		return;
 
-	rb_radixtree_add(client_name_tree, name, client_p);
+	rb_hashmap_add(client_name_map, name, client_p);
 }
 
 /* add_to_hostname_hash()
@@ -170,7 +173,7 @@ add_to_hostname_hash(const char *hostname, struct Client *client_p)
 	if(EmptyString(hostname) || (client_p == NULL))
 		return;
 
-	list = rb_radixtree_retrieve(hostname_tree, hostname);
+	list = rb_hashmap_retrieve(hostname_map, hostname);
 	if (list != NULL)
 	{
 		rb_dlinkAddAlloc(client_p, list);
@@ -178,7 +181,7 @@ add_to_hostname_hash(const char *hostname, struct Client *client_p)
 	}
 
 	list = rb_malloc(sizeof(*list));
-	rb_radixtree_add(hostname_tree, hostname, list);
+	rb_hashmap_add(hostname_map, hostname, list);
 	rb_dlinkAddAlloc(client_p, list);
 }
 
@@ -209,7 +212,7 @@ del_from_id_hash(const char *id, const struct Client *client_p)
 	if(EmptyString(id) || client_p == NULL)
 		return;
 
-	rb_radixtree_delete(client_id_tree, id);
+	rb_hashmap_delete(client_id_map, id);
 }
 
 /* del_from_client_hash()
@@ -225,7 +228,7 @@ del_from_client_hash(const char *name, const struct Client *client_p)
 	if(EmptyString(name) || client_p == NULL)
 		return;
 
-	rb_radixtree_delete(client_name_tree, name);
+	rb_hashmap_delete(client_name_map, name);
 }
 
 /* del_from_channel_hash()
@@ -241,6 +244,7 @@ del_from_channel_hash(const char *name, const struct Channel *chptr)
 	if(EmptyString(name) || chptr == NULL)
 		return;
 
+	rb_hashmap_delete(channel_map, name);
 	rb_radixtree_delete(channel_tree, name);
 }
 
@@ -256,7 +260,7 @@ del_from_hostname_hash(const char *hostname, struct Client *client_p)
 	if(hostname == NULL || client_p == NULL)
 		return;
 
-	list = rb_radixtree_retrieve(hostname_tree, hostname);
+	list = rb_hashmap_retrieve(hostname_map, hostname);
 	if (list == NULL)
 		return;
 
@@ -264,7 +268,7 @@ del_from_hostname_hash(const char *hostname, struct Client *client_p)
 
 	if (rb_dlink_list_length(list) == 0)
 	{
-		rb_radixtree_delete(hostname_tree, hostname);
+		rb_hashmap_delete(hostname_map, hostname);
 		rb_free(list);
 	}
 }
@@ -294,7 +298,7 @@ find_id(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(client_id_tree, name);
+	return rb_hashmap_retrieve(client_id_map, name);
 }
 
 /* find_client()
@@ -312,7 +316,7 @@ find_client(const char *name)
 	if(IsDigit(*name))
 		return (find_id(name));
 
-	return rb_radixtree_retrieve(client_name_tree, name);
+	return rb_hashmap_retrieve(client_name_map, name);
 }
 
 /* find_named_client()
@@ -326,7 +330,7 @@ find_named_client(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(client_name_tree, name);
+	return rb_hashmap_retrieve(client_name_map, name);
 }
 
 /* find_server()
@@ -348,7 +352,7 @@ find_server(struct Client *source_p, const char *name)
       		return(target_p);
 	}
 
-	target_p = rb_radixtree_retrieve(client_name_tree, name);
+	target_p = rb_hashmap_retrieve(client_name_map, name);
 	if (target_p != NULL)
 	{
 		if(IsServer(target_p) || IsMe(target_p))
@@ -372,7 +376,7 @@ find_hostname(const char *hostname)
 	if(EmptyString(hostname))
 		return NULL;
 
-	hlist = rb_radixtree_retrieve(hostname_tree, hostname);
+	hlist = rb_hashmap_retrieve(hostname_map, hostname);
 	if (hlist == NULL)
 		return NULL;
 
@@ -390,7 +394,7 @@ find_channel(const char *name)
 	if(EmptyString(name))
 		return NULL;
 
-	return rb_radixtree_retrieve(channel_tree, name);
+	return rb_hashmap_retrieve(channel_map, name);
 }
 
 /*
@@ -408,6 +412,7 @@ struct Channel *
 get_or_create_channel(struct Client *client_p, const char *chname, bool *isnew)
 {
 	struct Channel *chptr;
+	uint32_t hash;
 	int len;
 	const char *s = chname;
 
@@ -430,7 +435,9 @@ get_or_create_channel(struct Client *client_p, const char *chname, bool *isnew)
 		s = t;
 	}
 
-	chptr = rb_radixtree_retrieve(channel_tree, s);
+	/* hashed once for both the lookup and the add */
+	hash = rb_hashmap_hash(channel_map, s);
+	chptr = rb_hashmap_retrieve_hashed(channel_map, s, hash);
 	if (chptr != NULL)
 	{
 		if (isnew != NULL)
@@ -445,6 +452,7 @@ get_or_create_channel(struct Client *client_p, const char *chname, bool *isnew)
 	chptr->channelts = rb_current_time();	/* doesn't hurt to set it here */
 
 	rb_dlinkAdd(chptr, &chptr->node, &global_channel_list);
+	rb_hashmap_add_hashed(channel_map, chptr->chname, hash, chptr);
 	rb_radixtree_add(channel_tree, chptr->chname, chptr);
 
 	return chptr;
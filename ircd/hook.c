@@ -53,6 +53,12 @@ int num_hooks = 0;
 int last_hook = 0;
 int max_hooks = HOOK_INCREMENT;
 
+/* call_hook() may be running when a hook is added or removed, so
+ * replaced function arrays are kept until no call is in progress
+ */
+static int hook_depth;
+static rb_dlink_list retired_fns;
+
 int h_burst_client;
 int h_burst_channel;
 int h_burst_finished;
@@ -196,6 +202,38 @@ add_hook(const char *name, hookfn fn)
 	add_hook_prio(name, fn, HOOK_NORMAL);
 }
 
+/* rebuild_hook_fns()
+ *   Rebuilds the contiguous function array of a hook from its entries.
+ */
+static void
+rebuild_hook_fns(hook *h)
+{
+	rb_dlink_node *ptr;
+	hookfn *fns = NULL;
+	int n = 0;
+
+	if (rb_dlink_list_length(&h->hooks) != 0)
+	{
+		fns = rb_malloc(sizeof *fns * rb_dlink_list_length(&h->hooks));
+		RB_DLINK_FOREACH(ptr, h->hooks.head)
+		{
+			struct hook_entry *entry = ptr->data;
+			fns[n++] = entry->fn;
+		}
+	}
+
+	if (h->fns != NULL)
+	{
+		if (hook_depth > 0)
+			rb_dlinkAddAlloc(h->fns, &retired_fns);
+		else
+			rb_free(h->fns);
+	}
+
+	h->fns = fns;
+	h->nfns = n;
+}
+
 /* add_hook_prio()
  *   Adds a hook with the specified priority
  */
@@ -216,11 +254,13 @@ add_hook_prio(const char *name, hookfn fn, enum hook_priority priority)
 		if (entry->priority <= o->priority)
 		{
 			rb_dlinkAddBefore(ptr, entry, &entry->node, &hooks[i].hooks);
+			rebuild_hook_fns(&hooks[i]);
 			return;
 		}
 	}
 
 	rb_dlinkAddTail(entry, &entry->node, &hooks[i].hooks);
+	rebuild_hook_fns(&hooks[i]);
 }
 
 /* remove_hook()
@@ -241,6 +281,8 @@ remove_hook(const char *name, const hookfn fn)
 		if (entry->fn == fn)
 		{
 			rb_dlinkDelete(ptr, &hooks[i].hooks);
+			rb_free(entry);
+			rebuild_hook_fns(&hooks[i]);
 			return;
 		}
 	}
@@ -252,15 +294,36 @@ remove_hook(const char *name, const hookfn fn)
 void
 call_hook(int id, void *arg)
 {
-	rb_dlink_node *ptr;
+	struct timespec start, end;
+	hookfn *fns;
+	int i, n;
 
 	/* The ID we were passed is the position in the hook table of this
 	 * hook
 	 */
-	RB_DLINK_FOREACH(ptr, hooks[id].hooks.head)
+	n = hooks[id].nfns;
+	if (n == 0)
+		return;
+
+	fns = hooks[id].fns;
+	hook_depth++;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < n; i++)
+		fns[i](arg);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	hooks[id].calls++;
+	hooks[id].nsec += (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+	if (--hook_depth == 0 && rb_dlink_list_length(&retired_fns) != 0)
 	{
-		struct hook_entry *entry = ptr->data;
-		entry->fn(arg);
+		rb_dlink_node *ptr, *next;
+
+		RB_DLINK_FOREACH_SAFE(ptr, next, retired_fns.head)
+		{
+			rb_free(ptr->data);
+			rb_dlinkDestroy(ptr, &retired_fns);
+		}
 	}
 }
-
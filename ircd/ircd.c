@@ -65,6 +65,9 @@
 #include "authproc.h"
 #include "operhash.h"
 #include "response.h"
+#include "upgrade.h"
+#include "metrics.h"
+#include "listener.h"
 
 static void
 ircd_die_cb(const char *str) __noreturn;
@@ -184,6 +187,8 @@ ircd_shutdown(const char *reason)
 
 	ilog(L_MAIN, "Server Terminating. %s", reason);
 	close_logfiles();
+	whowas_log_close();
+	metrics_close();
 
 	unlink(pidFileName);
 	exit(0);
@@ -519,6 +524,21 @@ seed_random(void *unused)
 	srand(seed);
 }
 
+/* how long each part of startup took, logged once the server is ready */
+static uint64_t startup_begin, startup_mark;
+static char startup_phases[BUFSIZE];
+
+static void
+startup_phase(const char *name)
+{
+	uint64_t now = rb_hist_now();
+	size_t len = strlen(startup_phases);
+
+	snprintf(startup_phases + len, sizeof startup_phases - len, " %s %.1fms",
+			name, (now - startup_mark) / 1e6);
+	startup_mark = now;
+}
+
 /*
  * main
  *
@@ -623,12 +643,15 @@ solanum_main(int argc, char * const argv[])
 		inotice("starting %s ...", ircd_version);
 		inotice("%s", rb_lib_version());
 
-		if(!server_state_foreground)
+		/* an upgrade carries on in the same process */
+		if(!server_state_foreground && !upgrade_resuming())
 			make_daemon();
 	}
 
+	startup_begin = startup_mark = rb_hist_now();
+
 	/* Init the event subsystem */
-	rb_lib_init(ircd_log_cb, ircd_restart_cb, ircd_die_cb, !server_state_foreground, maxconnections, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_lib_init(ircd_log_cb, ircd_restart_cb, ircd_die_cb, !server_state_foreground && !upgrade_resuming(), maxconnections, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
 	rb_linebuf_init(LINEBUF_HEAP_SIZE);
 
 	rb_init_prng(NULL, RB_PRNG_DEFAULT);
@@ -640,6 +663,7 @@ solanum_main(int argc, char * const argv[])
 
 	init_hook();
 	init_main_logfile();
+	upgrade_init();
 	newconf_init();
 	init_s_conf();
 	init_s_newconf();
@@ -667,8 +691,11 @@ solanum_main(int argc, char * const argv[])
 	if (testing_conf)
 		fprintf(stderr, "\nBeginning config test\n");
 
+	startup_phase("init");
 	load_all_modules(1);
+	startup_phase("modules");
 	read_conf_files(true);	/* cold start init conf files */
+	startup_phase("conf");
 
 	init_isupport();
 
@@ -676,6 +703,7 @@ solanum_main(int argc, char * const argv[])
 	init_ssld();
 
 	rehash_bans();
+	startup_phase("helpers");
 
 	initialize_global_set_options();
 
@@ -713,6 +741,7 @@ solanum_main(int argc, char * const argv[])
 		else
 			ircd_ssl_ok = true;
 	}
+	startup_phase("ssl");
 
 	me.from = &me;
 	me.servptr = &me;
@@ -738,10 +767,19 @@ solanum_main(int argc, char * const argv[])
 	write_pidfile(pidFileName);
 	load_help();
 	open_logfiles();
+	whowas_log_open();
+	metrics_open();
+	rb_job_init(ConfigFileEntry.worker_threads);
+	rb_iothread_init(ConfigFileEntry.io_threads);
 
 	configure_authd();
+	startup_phase("files");
+
+	upgrade_restore();
+	startup_phase("upgrade");
 
-	ilog(L_MAIN, "Server Ready");
+	ilog(L_MAIN, "Server Ready in %.1fms:%s",
+			(rb_hist_now() - startup_begin) / 1e6, startup_phases);
 
 	/* We want try_connections to be called as soon as possible now! -- adrian */
 	/* No, 'cause after a restart it would cause all sorts of nick collides */
@@ -751,14 +789,19 @@ solanum_main(int argc, char * const argv[])
 	rb_event_addish("try_connections", try_connections, NULL, STARTUP_CONNECTIONS_TIME);
 	rb_event_addonce("try_connections_startup", try_connections, NULL, 2);
 	rb_event_add("check_rehash", check_rehash, NULL, 3);
+	rb_event_add("update_listener_rates", update_listener_rates, NULL, LISTENER_RATE_TIME);
 	rb_event_addish("reseed_srand", seed_random, NULL, 300); /* reseed every 10 minutes */
 
 	if(splitmode)
 		check_splitmode_ev = rb_event_add("check_splitmode", check_splitmode, NULL, 5);
 
 	if(server_state_foreground)
+	{
+		inotice("startup took %.1fms:%s", (rb_hist_now() - startup_begin) / 1e6,
+			startup_phases);
 		inotice("now running in foreground mode from %s as pid %ld ...",
 		        ConfigFileEntry.dpath, (long)getpid());
+	}
 
 	rb_lib_loop(0);
 
@@ -44,7 +44,7 @@
 #include "logger.h"
 
 static rb_dlink_list listener_list = {};
-static int accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, void *data);
+static int accept_precallback(int fd, struct sockaddr *addr, rb_socklen_t addrlen, void *data);
 static void accept_callback(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t addrlen, void *data);
 static SSL_OPEN_CB accept_sslcallback;
 
@@ -109,6 +109,23 @@ show_ports(struct Client *source_p)
 	RB_DLINK_FOREACH(n, listener_list.head)
 	{
 		struct Listener *listener = n->data;
+		unsigned long deferred = rb_get_accept_deferred(listener->F);
+		unsigned int queued = 0, limit = 0, q, l;
+		bool have_backlog = rb_get_accept_backlog(listener->F, &queued, &limit) == 0;
+		char backlog[32] = "";
+
+		for(int i = 0; i < listener->shards - 1; i++)
+		{
+			deferred += rb_get_accept_deferred(listener->shard_F[i]);
+			if(have_backlog && rb_get_accept_backlog(listener->shard_F[i], &q, &l) == 0)
+			{
+				queued += q;
+				limit += l;
+			}
+		}
+
+		if(have_backlog)
+			snprintf(backlog, sizeof backlog, ", backlog %u/%u", queued, limit);
 
 		sendto_one_numeric(source_p, RPL_STATSPLINE,
 			   form_str(RPL_STATSPLINE), 'P',
@@ -116,18 +133,40 @@ show_ports(struct Client *source_p)
 			   IsOperAdmin(source_p) ? listener->name : me.name,
 			   listener->ref_count, (listener->active) ? "active" : "disabled",
 			   listener->sctp ? " sctp" : " tcp",
-			   listener->ssl ? " ssl" : "");
+			   listener->ssl ? " ssl" : "",
+			   listener->shards, listener->priority,
+			   listener->accept_budget,
+			   listener->accepted, listener->rejected, deferred,
+			   listener->rate, backlog);
 	}
 }
 
 /*
- * inetport - create a listener socket in the AF_INET or AF_INET6 domain,
- * bind it to the port given in 'port' and listen to it
- * returns true (1) if successful false (0) on error.
+ * update_listener_rates - work out how many connections per second
+ * each listener has seen since the last run
  */
+void
+update_listener_rates(void *unused)
+{
+	rb_dlink_node *n;
 
-static int
-inetport(struct Listener *listener)
+	RB_DLINK_FOREACH(n, listener_list.head)
+	{
+		struct Listener *listener = n->data;
+		unsigned long total = listener->accepted + listener->rejected;
+
+		listener->rate = (double)(total - listener->rate_mark) / LISTENER_RATE_TIME;
+		listener->rate_mark = total;
+	}
+}
+
+/*
+ * listener_socket - open, bind and listen on one socket for a listener,
+ * with SO_REUSEPORT if it is one of several shards
+ * returns the socket, or NULL after reporting the error
+ */
+static rb_fde_t *
+listener_socket(struct Listener *listener, bool reuseport)
 {
 	rb_fde_t *F;
 	const char *errstr;
@@ -144,30 +183,6 @@ inetport(struct Listener *listener)
 		F = rb_socket(GET_SS_FAMILY(&listener->addr[0]), SOCK_STREAM, IPPROTO_TCP, "Listener socket");
 	}
 
-	memset(listener->vhost, 0, sizeof(listener->vhost));
-
-	if (GET_SS_FAMILY(&listener->addr[0]) == AF_INET6) {
-		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&listener->addr[0];
-		rb_inet_ntop(AF_INET6, &in6->sin6_addr, listener->vhost, sizeof(listener->vhost));
-	} else if (GET_SS_FAMILY(&listener->addr[0]) == AF_INET) {
-		struct sockaddr_in *in = (struct sockaddr_in *)&listener->addr[0];
-		rb_inet_ntop(AF_INET, &in->sin_addr, listener->vhost, sizeof(listener->vhost));
-	}
-
-	if (GET_SS_FAMILY(&listener->addr[1]) == AF_INET6) {
-		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&listener->addr[1];
-		strncat(listener->vhost, "&", sizeof(listener->vhost));
-		rb_inet_ntop(AF_INET6, &in6->sin6_addr, &listener->vhost[strlen(listener->vhost)], sizeof(listener->vhost) - strlen(listener->vhost));
-	} else if (GET_SS_FAMILY(&listener->addr[1]) == AF_INET) {
-		struct sockaddr_in *in = (struct sockaddr_in *)&listener->addr[1];
-		strncat(listener->vhost, "&", sizeof(listener->vhost));
-		rb_inet_ntop(AF_INET, &in->sin_addr, &listener->vhost[strlen(listener->vhost)], sizeof(listener->vhost) - strlen(listener->vhost));
-	}
-
-	if (listener->vhost[0] != '\0') {
-		listener->name = listener->vhost;
-	}
-
 	if (F == NULL) {
 		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
 				"Cannot open socket for listener on %s port %d",
@@ -176,7 +191,20 @@ inetport(struct Listener *listener)
 		ilog(L_MAIN, "Cannot open socket for %s listener %s",
 				listener->sctp ? "SCTP" : "TCP",
 				get_listener_name(listener));
-		return 0;
+		return NULL;
+	}
+
+	if (reuseport && rb_set_reuseport(F)) {
+		errstr = strerror(errno);
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE,
+				"Cannot shard listener on %s port %d: %s",
+				listener->sctp ? "SCTP" : "TCP",
+				get_listener_port(listener), errstr);
+		ilog(L_MAIN, "Cannot set SO_REUSEPORT for %s listener %s: %s",
+				listener->sctp ? "SCTP" : "TCP",
+				get_listener_name(listener), errstr);
+		rb_close(F);
+		return NULL;
 	}
 
 	if (listener->sctp) {
@@ -195,7 +223,7 @@ inetport(struct Listener *listener)
 				listener->sctp ? "SCTP" : "TCP",
 				get_listener_name(listener), errstr);
 		rb_close(F);
-		return 0;
+		return NULL;
 	}
 
 	if(rb_listen(F, SOMAXCONN, listener->defer_accept))
@@ -209,12 +237,72 @@ inetport(struct Listener *listener)
 				listener->sctp ? "SCTP" : "TCP",
 				get_listener_name(listener), errstr);
 		rb_close(F);
-		return 0;
+		return NULL;
 	}
 
-	listener->F = F;
+	rb_accept_tcp(F, accept_precallback, accept_callback, listener);
+	rb_set_accept_budget(F, listener->accept_budget, listener->priority);
+	return F;
+}
+
+/*
+ * inetport - create a listener socket in the AF_INET or AF_INET6 domain,
+ * bind it to the port given in 'port' and listen to it
+ * returns true (1) if successful false (0) on error.
+ */
+
+static int
+inetport(struct Listener *listener)
+{
+	int shards = listener->shards;
+
+	memset(listener->vhost, 0, sizeof(listener->vhost));
+
+	if (GET_SS_FAMILY(&listener->addr[0]) == AF_INET6) {
+		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&listener->addr[0];
+		rb_inet_ntop(AF_INET6, &in6->sin6_addr, listener->vhost, sizeof(listener->vhost));
+	} else if (GET_SS_FAMILY(&listener->addr[0]) == AF_INET) {
+		struct sockaddr_in *in = (struct sockaddr_in *)&listener->addr[0];
+		rb_inet_ntop(AF_INET, &in->sin_addr, listener->vhost, sizeof(listener->vhost));
+	}
+
+	if (GET_SS_FAMILY(&listener->addr[1]) == AF_INET6) {
+		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&listener->addr[1];
+		strncat(listener->vhost, "&", sizeof(listener->vhost));
+		rb_inet_ntop(AF_INET6, &in6->sin6_addr, &listener->vhost[strlen(listener->vhost)], sizeof(listener->vhost) - strlen(listener->vhost));
+	} else if (GET_SS_FAMILY(&listener->addr[1]) == AF_INET) {
+		struct sockaddr_in *in = (struct sockaddr_in *)&listener->addr[1];
+		strncat(listener->vhost, "&", sizeof(listener->vhost));
+		rb_inet_ntop(AF_INET, &in->sin_addr, &listener->vhost[strlen(listener->vhost)], sizeof(listener->vhost) - strlen(listener->vhost));
+	}
+
+	if (listener->vhost[0] != '\0') {
+		listener->name = listener->vhost;
+	}
+
+	/* a single socket keeps the usual protection against another
+	 * process binding the same port; only shards use SO_REUSEPORT,
+	 * and if that is refused the listener still gets one socket.
+	 */
+	listener->shards = 0;
+	if (shards > 1)
+		listener->F = listener_socket(listener, true);
+	if (listener->F == NULL) {
+		shards = 1;
+		listener->F = listener_socket(listener, false);
+	}
+	if (listener->F == NULL)
+		return 0;
+	listener->shards = 1;
+
+	while (listener->shards < shards) {
+		rb_fde_t *F = listener_socket(listener, true);
+
+		if (F == NULL)
+			break;
+		listener->shard_F[listener->shards++ - 1] = F;
+	}
 
-	rb_accept_tcp(listener->F, accept_precallback, accept_callback, listener);
 	return 1;
 }
 
@@ -282,9 +370,10 @@ next:
  * port - the port number to listen on
  * vhost_ip - if non-null must contain a valid IP address string in
  * the format "255.255.255.255"
+ * opts - how to open and accept from it
  */
 void
-add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_accept)
+add_tcp_listener(int port, const char *vhost_ip, int family, const struct ListenerOptions *opts)
 {
 	struct Listener *listener;
 	struct rb_sockaddr_storage vaddr[ARRAY_SIZE(listener->addr)];
@@ -343,9 +432,12 @@ add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_
 	}
 
 	listener->F = NULL;
-	listener->ssl = ssl;
-	listener->defer_accept = defer_accept;
+	listener->ssl = opts->ssl;
+	listener->defer_accept = opts->defer_accept;
 	listener->sctp = 0;
+	listener->shards = MAX(1, MIN(opts->shards, LISTENER_MAX_SHARDS));
+	listener->accept_budget = opts->accept_budget;
+	listener->priority = opts->priority;
 
 	if (inetport(listener)) {
 		listener->active = 1;
@@ -358,9 +450,10 @@ add_tcp_listener(int port, const char *vhost_ip, int family, int ssl, int defer_
  * add_sctp_listener- create a new listener
  * port - the port number to listen on
  * vhost_ip1/2 - if non-null must contain a valid IP address string
+ * opts - how to open and accept from it
  */
 void
-add_sctp_listener(int port, const char *vhost_ip1, const char *vhost_ip2, int ssl)
+add_sctp_listener(int port, const char *vhost_ip1, const char *vhost_ip2, const struct ListenerOptions *opts)
 {
 	struct Listener *listener;
 	struct rb_sockaddr_storage vaddr[ARRAY_SIZE(listener->addr)];
@@ -412,9 +505,12 @@ add_sctp_listener(int port, const char *vhost_ip1, const char *vhost_ip2, int ss
 	}
 
 	listener->F = NULL;
-	listener->ssl = ssl;
+	listener->ssl = opts->ssl;
 	listener->defer_accept = 0;
 	listener->sctp = 1;
+	listener->shards = MAX(1, MIN(opts->shards, LISTENER_MAX_SHARDS));
+	listener->accept_budget = opts->accept_budget;
+	listener->priority = opts->priority;
 
 	if (inetport(listener)) {
 		listener->active = 1;
@@ -437,6 +533,9 @@ close_listener(struct Listener *listener)
 		rb_close(listener->F);
 		listener->F = NULL;
 	}
+	for(int i = 0; i < listener->shards - 1; i++)
+		rb_close(listener->shard_F[i]);
+	listener->shards = 0;
 
 	listener->active = 0;
 
@@ -539,6 +638,10 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 
 	++listener->ref_count;
 
+	/* reads on the client's socket (or its ssld socketpair) from here on
+	 * come from an I/O thread, if there are any */
+	rb_iothread_attach(F);
+
 	authd_initiate_client(new_client, defer);
 }
 
@@ -549,8 +652,20 @@ accept_sslcallback(struct Client *client_p, int status)
 	return 0; /* use default handler if status != RB_OK */
 }
 
+/*
+ * reject_fd - write a last message to a connection that was never set up,
+ * and close it
+ */
+static void
+reject_fd(int fd, const void *msg, size_t len)
+{
+	/* best effort, the socket is freshly accepted and non-blocking */
+	(void) send(fd, msg, len, MSG_NOSIGNAL);
+	close(fd);
+}
+
 static int
-accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, void *data)
+accept_precallback(int fd, struct sockaddr *addr, rb_socklen_t addrlen, void *data)
 {
 	struct Listener *listener = (struct Listener *)data;
 	char buf[BUFSIZE];
@@ -573,11 +688,12 @@ accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, voi
 
 	if(listener->ssl && (!ircd_ssl_ok || !get_ssld_count()))
 	{
-		rb_close(F);
+		listener->rejected++;
+		close(fd);
 		return 0;
 	}
 
-	if((maxconnections - 10) < rb_get_fd(F)) /* XXX this is kinda bogus */
+	if((maxconnections - 10) < fd) /* XXX this is kinda bogus */
 	{
 		++ServerStats.is_ref;
 		/*
@@ -591,12 +707,11 @@ accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, voi
 			last_oper_notice = rb_current_time();
 		}
 
+		listener->rejected++;
 		if(listener->ssl)
-			rb_write(F, sslinternalerrcode, sizeof(sslinternalerrcode));
+			reject_fd(fd, sslinternalerrcode, sizeof(sslinternalerrcode));
 		else
-			rb_write(F, allinuse, strlen(allinuse));
-
-		rb_close(F);
+			reject_fd(fd, allinuse, strlen(allinuse));
 		return 0;
 	}
 
@@ -609,10 +724,11 @@ accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, voi
 	if(aconf != NULL)
 	{
 		ServerStats.is_ref++;
+		listener->rejected++;
 
 		if(listener->ssl)
 		{
-			rb_write(F, ssldeniederrcode, sizeof(ssldeniederrcode));
+			reject_fd(fd, ssldeniederrcode, sizeof(ssldeniederrcode));
 		}
 		else if(ConfigFileEntry.dline_with_reason)
 		{
@@ -623,32 +739,30 @@ accept_precallback(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t addrlen, voi
 				buf[sizeof(buf) - 2] = '\n';
 				buf[sizeof(buf) - 1] = '\0';
 			}
-			rb_write(F, buf, strlen(buf));
+			reject_fd(fd, buf, strlen(buf));
 		}
 		else
 		{
 			strcpy(buf, "ERROR :You have been D-lined.\r\n");
-			rb_write(F, buf, strlen(buf));
+			reject_fd(fd, buf, strlen(buf));
 		}
-
-		rb_close(F);
 		return 0;
 	}
 
-	if(check_reject(F, addr, listener->ssl)) {
+	if(check_reject(fd, addr, listener->ssl)) {
 		/* Reject the connection without closing the socket
 		 * because it is now on the delay_exit list. */
+		listener->rejected++;
 		return 0;
 	}
 
 	if(throttle_add(addr))
 	{
+		listener->rejected++;
 		if(listener->ssl)
-			rb_write(F, ssldeniederrcode, sizeof(ssldeniederrcode));
+			reject_fd(fd, ssldeniederrcode, sizeof(ssldeniederrcode));
 		else
-			rb_write(F, toofast, strlen(toofast));
-
-		rb_close(F);
+			reject_fd(fd, toofast, strlen(toofast));
 		return 0;
 	}
 
@@ -663,6 +777,7 @@ accept_callback(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t add
 	unsigned int locallen = sizeof(struct rb_sockaddr_storage);
 
 	ServerStats.is_ac++;
+	listener->accepted++;
 
 	if(getsockname(rb_get_fd(F), (struct sockaddr *) &lip, &locallen) < 0)
 	{
@@ -37,16 +37,14 @@
  *  Rewritten by Timothy Vogelsang (netski), net@astrolink.org
  */
 
-/** Check a string against a mask.
- * This test checks using traditional IRC wildcards only: '*' means
- * match zero or more characters of any type; '?' means match exactly
- * one character of any type.
- *
- * @param[in] mask Wildcard-containing mask.
- * @param[in] name String to check against \a mask.
- * @return Zero if \a mask matches \a name, non-zero if no match.
- */
-int match(const char *mask, const char *name)
+static inline unsigned char
+fold_name(char c, bool folded)
+{
+	return folded ? (unsigned char)c : irctolower(c);
+}
+
+static inline int
+match_internal(const char *mask, const char *name, bool folded)
 {
 	const char *m = mask, *n = name;
 	const char *m_tmp = mask, *n_tmp = name;
@@ -89,14 +87,14 @@ int match(const char *mask, const char *name)
 				  else
 				  {
 					  m_tmp = m;
-					  for (n_tmp = n; *n && irctolower(*n) != irctolower(*m); n++);
+					  for (n_tmp = n; *n && fold_name(*n, folded) != irctolower(*m); n++);
 				  }
 			  }
 			  /* and fall through */
 		  default:
 			  if (!*n)
 				  return (*m != '\0' ? 0 : 1);
-			  if (irctolower(*m) != irctolower(*n))
+			  if (irctolower(*m) != fold_name(*n, folded))
 				  goto backtrack;
 			  m++;
 			  n++;
@@ -105,6 +103,27 @@ int match(const char *mask, const char *name)
 	}
 }
 
+/** Check a string against a mask.
+ * This test checks using traditional IRC wildcards only: '*' means
+ * match zero or more characters of any type; '?' means match exactly
+ * one character of any type.
+ *
+ * @param[in] mask Wildcard-containing mask.
+ * @param[in] name String to check against \a mask.
+ * @return Zero if \a mask matches \a name, non-zero if no match.
+ */
+int match(const char *mask, const char *name)
+{
+	return match_internal(mask, name, false);
+}
+
+/* match() for a name that has already been through irctolower, such as
+ * the strings of a matchset; only the mask is folded */
+int match_folded(const char *mask, const char *name)
+{
+	return match_internal(mask, name, true);
+}
+
 /* Reorder runs of [?*] in mask to the form  ``**...??...'' */
 void
 match_arrange_stars(char *mask)
@@ -621,6 +640,22 @@ int ircncmp(const void *s1, const void *s2, int n)
 	return (res);
 }
 
+/* fold one matchset string in place, returning where its host part starts */
+static unsigned short
+matchset_fold(char *s)
+{
+	unsigned short at = 0;
+
+	for (unsigned short i = 0; s[i] != '\0'; i++)
+	{
+		s[i] = irctolower(s[i]);
+		if (s[i] == '@')
+			at = i + 1;
+	}
+
+	return at;
+}
+
 void matchset_for_client(struct Client *who, struct matchset *m)
 {
 	bool hide_ip = IsIPSpoof(who);
@@ -659,6 +694,14 @@ void matchset_for_client(struct Client *who, struct matchset *m)
 		ipn++;
 	}
 
+	for (int i = 0; i < hostn; i++)
+	{
+		m->host_at[i] = matchset_fold(m->host[i]);
+	}
+	for (int i = 0; i < ipn; i++)
+	{
+		m->ip_at[i] = matchset_fold(m->ip[i]);
+	}
 	for (int i = hostn; i < ARRAY_SIZE(m->host); i++)
 	{
 		m->host[i][0] = '\0';
@@ -669,11 +712,42 @@ void matchset_for_client(struct Client *who, struct matchset *m)
 	}
 }
 
+/* client_matchset()
+ *
+ * input	- local client
+ * output	- the client's matchset, built on first use and kept until
+ *		  clear_client_matchset()
+ * side effects -
+ */
+const struct matchset *client_matchset(struct Client *who)
+{
+	if (who->localClient->matchset == NULL)
+	{
+		who->localClient->matchset = rb_malloc(sizeof(struct matchset));
+		matchset_for_client(who, who->localClient->matchset);
+	}
+
+	return who->localClient->matchset;
+}
+
+/* clear_client_matchset()
+ *
+ * input	- client whose nick, user, host or spoofing changed
+ * output	-
+ * side effects - the cached matchset, if any, is dropped
+ */
+void clear_client_matchset(struct Client *who)
+{
+	if (who->localClient == NULL)
+		return;
+
+	rb_free(who->localClient->matchset);
+	who->localClient->matchset = NULL;
+}
+
 bool client_matches_mask(struct Client *who, const char *mask)
 {
-	static struct matchset ms;
-	matchset_for_client(who, &ms);
-	return matches_mask(&ms, mask);
+	return matches_mask(client_matchset(who), mask);
 }
 
 bool matches_mask(const struct matchset *m, const char *mask)
@@ -682,14 +756,14 @@ bool matches_mask(const struct matchset *m, const char *mask)
 	{
 		if (m->host[i][0] == '\0')
 			break;
-		if (match(mask, m->host[i]))
+		if (match_folded(mask, m->host[i]))
 			return true;
 	}
 	for (int i = 0; i < ARRAY_SIZE(m->ip); i++)
 	{
 		if (m->ip[i][0] == '\0')
 			break;
-		if (match(mask, m->ip[i]))
+		if (match_folded(mask, m->ip[i]))
 			return true;
 		if (match_cidr(mask, m->ip[i]))
 			return true;
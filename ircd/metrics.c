@@ -0,0 +1,318 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  metrics.c: Timings and sizes exported on a local socket.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Every connection to general::metrics_socket gets one HTTP response in
+ * the Prometheus text format and is closed.  Whatever the client sends
+ * first is read and ignored, so both curl --unix-socket and a bare
+ * socat work.  The histograms are the same ones STATS H shows.
+ */
+
+#include "stdinc.h"
+#include "metrics.h"
+#include "client.h"
+#include "ircd.h"
+#include "logger.h"
+#include "msg.h"
+#include "parse.h"
+#include "s_conf.h"
+#include "s_stats.h"
+#include "send.h"
+
+#include <sys/un.h>
+
+#define METRICS_TIMEOUT	10
+
+struct metrics_conn
+{
+	rb_fde_t *F;
+	char *buf;
+	size_t len, size, off;
+};
+
+static rb_fde_t *metrics_F;
+static char *metrics_path;
+
+static void metrics_accept(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t len, void *data);
+static void metrics_read(rb_fde_t *F, void *data);
+static void metrics_write(rb_fde_t *F, void *data);
+
+static void __attribute__((format(printf, 2, 3)))
+metrics_printf(struct metrics_conn *conn, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	for(;;)
+	{
+		va_start(args, fmt);
+		n = vsnprintf(conn->buf + conn->len, conn->size - conn->len, fmt, args);
+		va_end(args);
+
+		if(n < 0)
+			return;
+		if((size_t)n < conn->size - conn->len)
+			break;
+
+		conn->size = conn->size * 2 + n;
+		conn->buf = rb_realloc(conn->buf, conn->size);
+	}
+	conn->len += n;
+}
+
+/* one histogram in seconds (scale 1e9) or bytes (scale 1), with an optional label */
+static void
+metrics_hist(struct metrics_conn *conn, const char *name, const char *label,
+		const char *value, const struct rb_hist *h, double scale)
+{
+	char labels[BUFSIZE];
+	uint64_t cumulative = 0;
+
+	if(label != NULL)
+		snprintf(labels, sizeof labels, "%s=\"%s\",", label, value);
+	else
+		labels[0] = '\0';
+
+	for(int i = 0; i < RB_HIST_BUCKETS - 1; i++)
+	{
+		cumulative += h->bucket[i];
+		metrics_printf(conn, "%s_bucket{%sle=\"%g\"} %llu\n", name, labels,
+				rb_hist_bound(i) / scale, (unsigned long long)cumulative);
+	}
+	metrics_printf(conn, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels,
+			(unsigned long long)h->count);
+
+	/* drop the trailing comma for the plain series */
+	if(label != NULL)
+		labels[strlen(labels) - 1] = '\0';
+
+	metrics_printf(conn, "%s_sum%s%s%s %.9g\n", name, *labels ? "{" : "", labels,
+			*labels ? "}" : "", h->sum / scale);
+	metrics_printf(conn, "%s_count%s%s%s %llu\n", name, *labels ? "{" : "", labels,
+			*labels ? "}" : "", (unsigned long long)h->count);
+}
+
+static void
+metrics_event_cb(const char *name, const struct rb_hist *h, void *data)
+{
+	metrics_hist(data, "ircd_event_seconds", "event", name, h, 1e9);
+}
+
+static void
+metrics_report(struct metrics_conn *conn)
+{
+	const struct rb_loop_stats *loop = rb_get_loop_stats();
+	rb_dictionary_iter iter;
+	struct Message *msg;
+
+	metrics_printf(conn, "# HELP ircd_loop_iterations_total Passes of the event loop.\n"
+			"# TYPE ircd_loop_iterations_total counter\n"
+			"ircd_loop_iterations_total %llu\n",
+			(unsigned long long)loop->iterations);
+	metrics_printf(conn, "# HELP ircd_loop_wait_seconds_total Time the event loop spent waiting for I/O.\n"
+			"# TYPE ircd_loop_wait_seconds_total counter\n"
+			"ircd_loop_wait_seconds_total %.9g\n",
+			loop->wait_ns / 1e9);
+
+	metrics_printf(conn, "# HELP ircd_loop_io_seconds Time in I/O callbacks per pass of the event loop.\n"
+			"# TYPE ircd_loop_io_seconds histogram\n");
+	metrics_hist(conn, "ircd_loop_io_seconds", NULL, NULL, &loop->io, 1e9);
+
+	metrics_printf(conn, "# HELP ircd_loop_lag_seconds Time from waking up to waiting for I/O again.\n"
+			"# TYPE ircd_loop_lag_seconds histogram\n");
+	metrics_hist(conn, "ircd_loop_lag_seconds", NULL, NULL, &loop->lag, 1e9);
+
+	metrics_printf(conn, "# HELP ircd_event_seconds Run time of timed events.\n"
+			"# TYPE ircd_event_seconds histogram\n");
+	rb_event_stats(metrics_event_cb, conn);
+
+	metrics_printf(conn, "# HELP ircd_command_seconds Time in command handlers.\n"
+			"# TYPE ircd_command_seconds histogram\n");
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+	{
+		if(msg->time.count != 0)
+			metrics_hist(conn, "ircd_command_seconds", "command", msg->cmd, &msg->time, 1e9);
+	}
+
+	metrics_printf(conn, "# HELP ircd_sendq_flush_bytes Bytes written per flush of a sendq.\n"
+			"# TYPE ircd_sendq_flush_bytes histogram\n");
+	metrics_hist(conn, "ircd_sendq_flush_bytes", NULL, NULL, &ServerStats.is_sqflush, 1);
+
+	metrics_printf(conn, "# HELP ircd_sendq_bytes Bytes queued to local clients and servers.\n"
+			"# TYPE ircd_sendq_bytes gauge\n"
+			"ircd_sendq_bytes %zu\n", sendq_total.len);
+
+	metrics_printf(conn, "# HELP ircd_jobs_pending Jobs waiting for or running on a worker thread.\n"
+			"# TYPE ircd_jobs_pending gauge\n"
+			"ircd_jobs_pending %lu\n", rb_job_pending());
+
+	metrics_printf(conn, "# HELP ircd_iothread_sockets Sockets read by an I/O thread.\n"
+			"# TYPE ircd_iothread_sockets gauge\n"
+			"ircd_iothread_sockets %lu\n", rb_iothread_count());
+
+	metrics_printf(conn, "# HELP ircd_local_clients Registered local clients.\n"
+			"# TYPE ircd_local_clients gauge\n"
+			"ircd_local_clients %lu\n", rb_dlink_list_length(&lclient_list));
+}
+
+static void
+metrics_free(struct metrics_conn *conn)
+{
+	rb_close(conn->F);
+	rb_free(conn->buf);
+	rb_free(conn);
+}
+
+static void
+metrics_timeout(rb_fde_t *F, void *data)
+{
+	metrics_free(data);
+}
+
+static void
+metrics_accept(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t len, void *data)
+{
+	struct metrics_conn *conn;
+
+	if(status != RB_OK)
+	{
+		rb_close(F);
+		return;
+	}
+
+	conn = rb_malloc(sizeof *conn);
+	conn->F = F;
+	rb_settimeout(F, METRICS_TIMEOUT, metrics_timeout, conn);
+	metrics_read(F, conn);
+}
+
+static void
+metrics_read(rb_fde_t *F, void *data)
+{
+	struct metrics_conn *conn = data;
+	char buf[BUFSIZE];
+	struct metrics_conn body = { 0 };
+	ssize_t n;
+
+	n = rb_read(F, buf, sizeof buf);
+	if(n < 0 && rb_ignore_errno(errno))
+	{
+		rb_setselect(F, RB_SELECT_READ, metrics_read, conn);
+		return;
+	}
+
+	body.size = 64 * 1024;
+	body.buf = rb_malloc(body.size);
+	metrics_report(&body);
+
+	conn->size = body.len + BUFSIZE;
+	conn->buf = rb_malloc(conn->size);
+	metrics_printf(conn, "HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", body.len);
+	memcpy(conn->buf + conn->len, body.buf, body.len);
+	conn->len += body.len;
+	rb_free(body.buf);
+
+	metrics_write(F, conn);
+}
+
+static void
+metrics_write(rb_fde_t *F, void *data)
+{
+	struct metrics_conn *conn = data;
+	ssize_t n;
+
+	while(conn->off < conn->len)
+	{
+		n = rb_write(F, conn->buf + conn->off, conn->len - conn->off);
+		if(n < 0 && rb_ignore_errno(errno))
+		{
+			rb_setselect(F, RB_SELECT_WRITE, metrics_write, conn);
+			return;
+		}
+		if(n <= 0)
+			break;
+		conn->off += n;
+	}
+
+	metrics_free(conn);
+}
+
+void
+metrics_open(void)
+{
+	const char *path = ConfigFileEntry.metrics_socket;
+	struct sockaddr_un addr;
+
+	if(path != NULL && metrics_path != NULL && !strcmp(path, metrics_path))
+		return;
+
+	metrics_close();
+
+	if(EmptyString(path))
+		return;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof addr.sun_path)
+	{
+		ilog(L_MAIN, "metrics_socket %s: path too long", path);
+		return;
+	}
+	rb_strlcpy(addr.sun_path, path, sizeof addr.sun_path);
+
+	metrics_F = rb_socket(AF_UNIX, SOCK_STREAM, 0, "metrics socket");
+	if(metrics_F == NULL)
+	{
+		ilog(L_MAIN, "metrics_socket %s: %s", path, strerror(errno));
+		return;
+	}
+
+	/* a stale socket from an earlier run would make bind() fail */
+	unlink(path);
+
+	if(bind(rb_get_fd(metrics_F), (struct sockaddr *)&addr, sizeof addr) < 0 ||
+	   rb_listen(metrics_F, 16, 0) < 0)
+	{
+		ilog(L_MAIN, "metrics_socket %s: %s", path, strerror(errno));
+		rb_close(metrics_F);
+		metrics_F = NULL;
+		return;
+	}
+
+	metrics_path = rb_strdup(path);
+	rb_accept_tcp(metrics_F, NULL, metrics_accept, NULL);
+}
+
+void
+metrics_close(void)
+{
+	if(metrics_F == NULL)
+		return;
+
+	rb_close(metrics_F);
+	metrics_F = NULL;
+
+	unlink(metrics_path);
+	rb_free(metrics_path);
+	metrics_path = NULL;
+}
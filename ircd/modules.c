@@ -248,10 +248,19 @@ load_all_modules_dir(const char *path, bool core, bool warn)
 			continue;
 
 		// Unable to obtain dentry info or dentry is not actually a file?
-		snprintf(modpath, sizeof modpath, "%s/%s", path, dirent->d_name);
-		if (! (stat(modpath, &statbuf) == 0 && S_ISREG(statbuf.st_mode)))
+		// readdir() usually knows, which saves a stat() per module
+#ifdef DT_REG
+		if (dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN && dirent->d_type != DT_LNK)
 			continue;
 
+		if (dirent->d_type != DT_REG)
+#endif
+		{
+			snprintf(modpath, sizeof modpath, "%s/%s", path, dirent->d_name);
+			if (! (stat(modpath, &statbuf) == 0 && S_ISREG(statbuf.st_mode)))
+				continue;
+		}
+
 		// Extend the modules array if it is not long enough
 		if (dentries_used == dentries_length)
 		{
@@ -36,13 +36,52 @@
 #include "numeric.h"
 #include "send.h"
 #include "rb_radixtree.h"
+#include "s_assert.h"
+
+/*
+ * Each (watcher, nick) pair is a monitor_entry, linked into the nick's
+ * users list and the watcher's monitor_list, and held in the nick's
+ * watchers set so either side can find it without walking a list.
+ *
+ * Sign-ons and sign-offs do not send anything directly: they record the
+ * new state on each watcher's entry, and the watcher gets one
+ * MONONLINE and one MONOFFLINE (each split as needed) per I/O pass.  A
+ * netjoin burst thus costs each watcher a couple of lines rather than
+ * one per nick, and a nick that flaps within a pass is reported once,
+ * in its final state.
+ */
+enum
+{
+	MONITOR_PENDING_NONE,
+	MONITOR_PENDING_ONLINE,
+	MONITOR_PENDING_OFFLINE
+};
+
+struct monitor_entry
+{
+	struct Client *client_p;
+	struct monitor *monptr;
+	rb_dlink_node unode;	/* monptr->users, data is client_p */
+	rb_dlink_node cnode;	/* client_p's monitor_list, data is monptr */
+	rb_dlink_node pnode;	/* client_p's monitor_pending */
+	int pending;
+};
+
+#define MONITOR_WATCHERS_MIN 4
 
 static rb_radixtree *monitor_tree;
+static rb_bh *monitor_entry_heap;
+
+/* clients with a non-empty monitor_pending */
+static rb_dlink_list monitor_pending_clients;
+
+static void monitor_flush(void *unused);
 
 void
 init_monitor(void)
 {
 	monitor_tree = rb_radixtree_create("monitor lists", irccasecanon);
+	monitor_entry_heap = rb_bh_create(sizeof(struct monitor_entry), MONITOR_HEAP_SIZE, "monitor_entry_heap");
 }
 
 struct monitor *
@@ -73,9 +112,181 @@ free_monitor(struct monitor *monptr)
 		return;
 
 	rb_radixtree_delete(monitor_tree, monptr->name);
+	rb_free(monptr->watchers);
 	rb_free(monptr);
 }
 
+/* the client's address through murmur3's fmix32, so the low bits the
+ * set is indexed by depend on all of it */
+static inline unsigned int
+watcher_hash(const struct Client *client_p)
+{
+	uint64_t p = (uintptr_t)client_p;
+	uint32_t h = (uint32_t)(p ^ (p >> 32));
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+static struct monitor_entry **
+watcher_slot(struct monitor *monptr, const struct Client *client_p)
+{
+	unsigned int i;
+
+	if(monptr->watchers == NULL)
+		return NULL;
+
+	for(i = watcher_hash(client_p) & monptr->watchers_mask;
+			monptr->watchers[i] != NULL;
+			i = (i + 1) & monptr->watchers_mask)
+	{
+		if(monptr->watchers[i]->client_p == client_p)
+			return &monptr->watchers[i];
+	}
+
+	return NULL;
+}
+
+static void
+watcher_insert(struct monitor *monptr, struct monitor_entry *entry)
+{
+	unsigned int i;
+
+	for(i = watcher_hash(entry->client_p) & monptr->watchers_mask;
+			monptr->watchers[i] != NULL;
+			i = (i + 1) & monptr->watchers_mask)
+		;
+
+	monptr->watchers[i] = entry;
+}
+
+/* make room for one more watcher, keeping the set at most 3/4 full */
+static void
+watchers_grow(struct monitor *monptr)
+{
+	struct monitor_entry **old = monptr->watchers;
+	unsigned int oldsize = old != NULL ? monptr->watchers_mask + 1 : 0;
+	unsigned int size;
+
+	if((rb_dlink_list_length(&monptr->users) + 1) * 4 <= oldsize * 3)
+		return;
+
+	size = oldsize ? oldsize * 2 : MONITOR_WATCHERS_MIN;
+	monptr->watchers = rb_malloc(size * sizeof(struct monitor_entry *));
+	monptr->watchers_mask = size - 1;
+
+	for(unsigned int i = 0; i < oldsize; i++)
+		if(old[i] != NULL)
+			watcher_insert(monptr, old[i]);
+
+	rb_free(old);
+}
+
+/* linear probing delete: pull later entries of the cluster back so no
+ * lookup stops early on the hole */
+static void
+watcher_remove(struct monitor *monptr, struct monitor_entry **slot)
+{
+	unsigned int mask = monptr->watchers_mask;
+	unsigned int i = slot - monptr->watchers;
+	unsigned int j = i;
+
+	monptr->watchers[i] = NULL;
+
+	for(;;)
+	{
+		unsigned int k;
+
+		j = (j + 1) & mask;
+		if(monptr->watchers[j] == NULL)
+			break;
+
+		k = watcher_hash(monptr->watchers[j]->client_p) & mask;
+		if((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		monptr->watchers[i] = monptr->watchers[j];
+		monptr->watchers[j] = NULL;
+		i = j;
+	}
+}
+
+static void
+monitor_unpend(struct monitor_entry *entry)
+{
+	struct LocalUser *lclient = entry->client_p->localClient;
+
+	if(entry->pending == MONITOR_PENDING_NONE)
+		return;
+
+	rb_dlinkDelete(&entry->pnode, &lclient->monitor_pending);
+	entry->pending = MONITOR_PENDING_NONE;
+
+	if(rb_dlink_list_length(&lclient->monitor_pending) == 0)
+		rb_dlinkDelete(&lclient->monitor_pending_node, &monitor_pending_clients);
+}
+
+/* add_monitor_watcher()
+ *
+ * inputs	- local client, monitor entry for a nick
+ * outputs	- false if the client already watches this nick
+ * side effects	- client is added to the nick's watchers
+ */
+bool
+add_monitor_watcher(struct Client *client_p, struct monitor *monptr)
+{
+	struct monitor_entry *entry;
+
+	if(watcher_slot(monptr, client_p) != NULL)
+		return false;
+
+	watchers_grow(monptr);
+
+	entry = rb_bh_alloc(monitor_entry_heap);
+	entry->client_p = client_p;
+	entry->monptr = monptr;
+
+	watcher_insert(monptr, entry);
+	rb_dlinkAdd(client_p, &entry->unode, &monptr->users);
+	rb_dlinkAdd(monptr, &entry->cnode, &client_p->localClient->monitor_list);
+
+	return true;
+}
+
+static void
+free_monitor_entry(struct monitor_entry *entry, struct monitor_entry **slot)
+{
+	struct monitor *monptr = entry->monptr;
+
+	monitor_unpend(entry);
+	watcher_remove(monptr, slot);
+	rb_dlinkDelete(&entry->unode, &monptr->users);
+	rb_dlinkDelete(&entry->cnode, &entry->client_p->localClient->monitor_list);
+	rb_bh_free(monitor_entry_heap, entry);
+
+	free_monitor(monptr);
+}
+
+/* del_monitor_watcher()
+ *
+ * inputs	- local client, monitor entry for a nick
+ * outputs	-
+ * side effects	- client stops watching the nick, which is freed if
+ * 		  nobody else watches it
+ */
+void
+del_monitor_watcher(struct Client *client_p, struct monitor *monptr)
+{
+	struct monitor_entry **slot = watcher_slot(monptr, client_p);
+
+	if(slot != NULL)
+		free_monitor_entry(*slot, slot);
+}
+
 bool
 is_monitoring(struct Client *client_p, const char *name)
 {
@@ -83,37 +294,116 @@ is_monitoring(struct Client *client_p, const char *name)
 	if (monptr == NULL)
 		return false;
 
-	return rb_dlinkFind(client_p, &monptr->users) != NULL;
+	return watcher_slot(monptr, client_p) != NULL;
+}
+
+static void
+monitor_pend(struct monitor *monptr, int state)
+{
+	if(monptr->watchers == NULL)
+		return;
+
+	for(unsigned int i = 0; i <= monptr->watchers_mask; i++)
+	{
+		struct monitor_entry *entry = monptr->watchers[i];
+		struct LocalUser *lclient;
+
+		if(entry == NULL)
+			continue;
+
+		lclient = entry->client_p->localClient;
+
+		/* only the final state matters, so a flap just overwrites */
+		if(entry->pending == MONITOR_PENDING_NONE)
+		{
+			if(rb_dlink_list_length(&lclient->monitor_pending) == 0)
+				rb_dlinkAdd(entry->client_p, &lclient->monitor_pending_node,
+						&monitor_pending_clients);
+			rb_dlinkAddTail(entry, &entry->pnode, &lclient->monitor_pending);
+		}
+		entry->pending = state;
+	}
+
+	rb_defer_once(monitor_flush, NULL);
+}
+
+static void
+monitor_flush_client(struct Client *client_p)
+{
+	rb_dlink_list *pending = &client_p->localClient->monitor_pending;
+	rb_dlink_node *ptr;
+
+	if(!IsAnyDead(client_p))
+	{
+		send_multiline_init(client_p, ",", form_str(RPL_MONONLINE), me.name, "*", "");
+		RB_DLINK_FOREACH(ptr, pending->head)
+		{
+			struct monitor_entry *entry = ptr->data;
+			struct Client *target_p;
+
+			if(entry->pending != MONITOR_PENDING_ONLINE)
+				continue;
+
+			/* the nick may have gone again by the time we flush */
+			target_p = find_named_person(entry->monptr->name);
+			if(target_p == NULL)
+			{
+				entry->pending = MONITOR_PENDING_OFFLINE;
+				continue;
+			}
+
+			send_multiline_item(client_p, "%s!%s@%s",
+					target_p->name, target_p->username, target_p->host);
+		}
+		send_multiline_fini(client_p, NULL);
+
+		send_multiline_init(client_p, ",", form_str(RPL_MONOFFLINE), me.name, "*", "");
+		RB_DLINK_FOREACH(ptr, pending->head)
+		{
+			struct monitor_entry *entry = ptr->data;
+
+			if(entry->pending == MONITOR_PENDING_OFFLINE)
+				send_multiline_item(client_p, "%s", entry->monptr->name);
+		}
+		send_multiline_fini(client_p, NULL);
+	}
+
+	while(pending->head != NULL)
+		monitor_unpend(pending->head->data);
+}
+
+static void
+monitor_flush(void *unused)
+{
+	while(monitor_pending_clients.head != NULL)
+		monitor_flush_client(monitor_pending_clients.head->data);
 }
 
 /* monitor_signon()
  *
  * inputs	- client who has just connected
  * outputs	-
- * side effects	- notifies any clients monitoring this nickname that it has
- * 		  connected to the network
+ * side effects	- queues a notification for any clients monitoring this
+ * 		  nickname that it has connected to the network
  */
 void
 monitor_signon(struct Client *client_p)
 {
-	char buf[USERHOST_REPLYLEN];
 	struct monitor *monptr = find_monitor(client_p->name, 0);
 
 	/* noones watching this nick */
 	if(monptr == NULL)
 		return;
 
-	snprintf(buf, sizeof(buf), "%s!%s@%s", client_p->name, client_p->username, client_p->host);
-
-	sendto_monitor(client_p, monptr, form_str(RPL_MONONLINE), me.name, "*", buf);
+	monitor_pend(monptr, MONITOR_PENDING_ONLINE);
 }
 
 /* monitor_signoff()
  *
  * inputs	- client who is exiting
  * outputs	-
- * side effects	- notifies any clients monitoring this nickname that it has
- * 		  left the network
+ * side effects	- queues a notification for any clients monitoring this
+ * 		  nickname that it has left the network
  */
 void
 monitor_signoff(struct Client *client_p)
@@ -124,26 +414,20 @@ monitor_signoff(struct Client *client_p)
 	if(monptr == NULL)
 		return;
 
-	sendto_monitor(client_p, monptr, form_str(RPL_MONOFFLINE), me.name, "*",
-			client_p->name);
+	monitor_pend(monptr, MONITOR_PENDING_OFFLINE);
 }
 
 void
 clear_monitor(struct Client *client_p)
 {
-	struct monitor *monptr;
 	rb_dlink_node *ptr, *next_ptr;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, client_p->localClient->monitor_list.head)
 	{
-		monptr = ptr->data;
-
-		rb_dlinkFindDestroy(client_p, &monptr->users);
-		rb_free_rb_dlink_node(ptr);
+		struct monitor_entry **slot = watcher_slot(ptr->data, client_p);
 
-		free_monitor(monptr);
+		s_assert(slot != NULL);
+		if(slot != NULL)
+			free_monitor_entry(*slot, slot);
 	}
-
-	client_p->localClient->monitor_list.head = client_p->localClient->monitor_list.tail = NULL;
-	client_p->localClient->monitor_list.length = 0;
 }
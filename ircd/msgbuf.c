@@ -25,6 +25,12 @@
 #include "client.h"
 #include "ircd.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const char tag_escape_table[256] = {
 	/*        x0   x1   x2   x3   x4   x5   x6   x7   x8   x9   xA   xB   xC   xD   xE   xF */
 	/* 0x */   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 'n',   0,   0, 'r',   0,   0,
@@ -79,81 +85,235 @@ msgbuf_unescape_value(char *value)
 	*out = *in;
 }
 
+/*
+ * The parser works on 64-byte aligned blocks of the line.  Loading a block
+ * builds a bitmask of the delimiters it is looking for, 16 or 32 bytes at a
+ * time where SSE2 or AVX2 are available, and the tokens are then split by
+ * popping bits off the mask.  Tag-heavy lines used to be rescanned by
+ * strchr() several times per tag.
+ *
+ * Aligned blocks never cross a page, so the vector loads may safely read
+ * bytes outside the line; bits for those, and for positions that have since
+ * been overwritten with '\0', are ignored by bounding every lookup.
+ */
+#define MSGBUF_SCAN_BLOCK 64
+
+enum msgbuf_scan_set
+{
+	MSGBUF_SCAN_SPACE,	/* ' ' */
+	MSGBUF_SCAN_TAGDELIM,	/* ' ', ';', '=' and '\\' */
+};
+
+struct msgbuf_scan
+{
+	char *line;		/* start of the line */
+	char *end;		/* the terminating '\0' */
+	char *block;		/* the loaded block */
+	enum msgbuf_scan_set set;	/* the delimiters being looked for */
+	uint64_t mask;		/* delimiters in the block not yet popped */
+};
+
+#if defined(__AVX2__) || defined(__SSE2__)
+__attribute__((no_sanitize_address))
+#endif
+static void
+msgbuf_scan_load(struct msgbuf_scan *scan, char *block)
+{
+	uint64_t mask = 0;
+
+#if defined(__AVX2__)
+	for (int i = 0; i < MSGBUF_SCAN_BLOCK; i += 32) {
+		__m256i v = _mm256_load_si256((const __m256i *)(block + i));
+		__m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+
+		if (scan->set == MSGBUF_SCAN_TAGDELIM)
+			m = _mm256_or_si256(_mm256_or_si256(m,
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'))), _mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('=')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))));
+
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << i;
+	}
+#elif defined(__SSE2__)
+	for (int i = 0; i < MSGBUF_SCAN_BLOCK; i += 16) {
+		__m128i v = _mm_load_si128((const __m128i *)(block + i));
+		__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+
+		if (scan->set == MSGBUF_SCAN_TAGDELIM)
+			m = _mm_or_si128(_mm_or_si128(m,
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(';'))), _mm_or_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('=')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+
+		mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << i;
+	}
+#else
+	/* without vectors, stay within the line */
+	const char *p = block > scan->line ? block : scan->line;
+	const char *end = block + MSGBUF_SCAN_BLOCK < scan->end ? block + MSGBUF_SCAN_BLOCK : scan->end;
+
+	for (; p < end; p++) {
+		if (*p == ' ' || (scan->set == MSGBUF_SCAN_TAGDELIM && (*p == ';' || *p == '=' || *p == '\\')))
+			mask |= (uint64_t)1 << (p - block);
+	}
+#endif
+
+	scan->block = block;
+	scan->mask = mask;
+}
+
+/* look for the given delimiters from p onwards */
+static void
+msgbuf_scan_seek(struct msgbuf_scan *scan, char *p, enum msgbuf_scan_set set)
+{
+	char *block = (char *)((uintptr_t)p & ~(uintptr_t)(MSGBUF_SCAN_BLOCK - 1));
+
+	scan->set = set;
+	msgbuf_scan_load(scan, block);
+	scan->mask &= ~(uint64_t)0 << (p - block);
+}
+
+/*
+ * find the next delimiter before limit.
+ * returns limit if there is none.
+ */
+static inline char *
+msgbuf_scan_pop(struct msgbuf_scan *scan, char *limit)
+{
+	char *p;
+
+	while (scan->mask == 0) {
+		if (scan->block + MSGBUF_SCAN_BLOCK >= limit)
+			return limit;
+		msgbuf_scan_load(scan, scan->block + MSGBUF_SCAN_BLOCK);
+	}
+
+	p = scan->block + __builtin_ctzll(scan->mask);
+	scan->mask &= scan->mask - 1;
+	return p < limit ? p : limit;
+}
+
+static void
+msgbuf_scan_init(struct msgbuf_scan *scan, char *line)
+{
+	scan->line = line;
+	scan->end = line + strlen(line);
+}
+
+static int msgbuf_scan_message(struct MsgBuf *msgbuf, struct msgbuf_scan *scan, char *line);
+
 /*
  * parse a message into a MsgBuf.
  * returns 0 on success, 1 on error.
+ * if the tags are unterminated the line is left partly split.
  */
 int
 msgbuf_parse(struct MsgBuf *msgbuf, char *line)
 {
+	struct msgbuf_scan scan;
 	char *ch = line;
 
 	msgbuf_init(msgbuf);
+	msgbuf_scan_init(&scan, line);
 
 	if (*ch == '@') {
+		char *limit = scan.end - line > TAGSLEN - 1 ? &line[TAGSLEN - 1] : scan.end;
 		char *t = ch + 1;
-
-		ch = strchr(ch, ' ');
-		if (ch == NULL)
-			return PARSE_UNTERMINATED_TAGS;
-
-		msgbuf->tagslen = ch - line + 1;
-
-		/* truncate tags if they're too long */
-		if (ch - line + 1 > TAGSLEN) {
-			ch = &line[TAGSLEN - 1];
-		}
-
-		/* NULL terminate the tags string */
-		*ch++ = '\0';
+		char *p;
+		char *eq = NULL;
+		char *escape = NULL;
+		char delim;
+
+		/*
+		 * split the tags in one pass, ending them at the first space or
+		 * truncating them if they're too long.  the tags are only valid
+		 * once the space has been found.
+		 */
+		msgbuf_scan_seek(&scan, t, MSGBUF_SCAN_TAGDELIM);
 
 		while (1) {
-			char *next = strchr(t, ';');
-			char *eq = strchr(t, '=');
+			p = msgbuf_scan_pop(&scan, limit);
+
+			if (p < limit && *p == '=') {
+				if (eq == NULL)
+					eq = p;
+			} else if (p < limit && *p == '\\') {
+				if (eq != NULL && escape == NULL)
+					escape = p;
+			} else {
+				delim = *p;
+				*p = '\0';
 
-			if (next != NULL) {
-				*next = '\0';
+				if (eq != NULL)
+					*eq++ = '\0';
 
-				if (eq > next)
-					eq = NULL;
-			}
+				if (*t != '\0') {
+					/* values are only rewritten from their first escape onwards */
+					if (escape != NULL)
+						msgbuf_unescape_value(escape);
+					msgbuf_append_tag(msgbuf, t, eq, 0);
+				}
 
-			if (eq != NULL)
-				*eq++ = '\0';
+				if (p == limit || delim == ' ')
+					break;
 
-			if (*t != '\0') {
-				msgbuf_unescape_value(eq);
-				msgbuf_append_tag(msgbuf, t, eq, 0);
+				t = p + 1;
+				eq = escape = NULL;
 			}
+		}
 
-			if (next != NULL) {
-				t = next + 1;
-			} else {
-				break;
-			}
+		ch = p;
+		if (delim != ' ' && p < scan.end) {
+			msgbuf_scan_seek(&scan, p + 1, MSGBUF_SCAN_SPACE);
+			ch = msgbuf_scan_pop(&scan, scan.end);
 		}
+
+		if (ch == scan.end) {
+			msgbuf_init(msgbuf);
+			return PARSE_UNTERMINATED_TAGS;
+		}
+
+		msgbuf->tagslen = ch - line + 1;
+		ch = p + 1;
 	}
 
-	return msgbuf_partial_parse(msgbuf, ch);
+	return msgbuf_scan_message(msgbuf, &scan, ch);
 }
 
 int
 msgbuf_partial_parse(struct MsgBuf *msgbuf, char *line)
+{
+	struct msgbuf_scan scan;
+
+	msgbuf_scan_init(&scan, line);
+	return msgbuf_scan_message(msgbuf, &scan, line);
+}
+
+/*
+ * parse the origin and parameters of a message, splitting them the same
+ * way as rb_string_to_array() would.
+ */
+static int
+msgbuf_scan_message(struct MsgBuf *msgbuf, struct msgbuf_scan *scan, char *line)
 {
 	char *ch = line;
 	const char *start = ch;
+	size_t n_para = 0;
 
 	/* truncate message if it's too long */
-	if (strlen(ch) > DATALEN) {
-		ch[DATALEN] = '\0';
+	if (scan->end - ch > DATALEN) {
+		scan->end = &ch[DATALEN];
+		*scan->end = '\0';
 	}
 
+	msgbuf_scan_seek(scan, ch, MSGBUF_SCAN_SPACE);
+
 	if (*ch == ':') {
 		ch++;
 		msgbuf->origin = ch;
 
-		char *end = strchr(ch, ' ');
-		if (end == NULL)
+		char *end = msgbuf_scan_pop(scan, scan->end);
+		if (end == scan->end)
 			return PARSE_UNTERMINATED_ORIGIN;
 
 		*end = '\0';
@@ -163,8 +323,49 @@ msgbuf_partial_parse(struct MsgBuf *msgbuf, char *line)
 	if (*ch == '\0')
 		return PARSE_NO_COMMAND;
 
-	msgbuf->endp = &ch[strlen(ch)];
-	msgbuf->n_para = rb_string_to_array(ch, (char **)msgbuf->para, MAXPARA);
+	msgbuf->endp = scan->end;
+
+	while (*ch != '\0') {
+		char *p, *next;
+
+		/* extra spaces have to be popped too */
+		if (*ch == ' ') {
+			while (*ch == ' ')
+				ch++;
+			if (*ch == '\0')
+				break;
+			msgbuf_scan_seek(scan, ch, MSGBUF_SCAN_SPACE);
+		}
+
+		if (*ch == ':') {
+			msgbuf->para[n_para++] = ch + 1;
+			break;
+		}
+
+		msgbuf->para[n_para++] = ch;
+
+		p = msgbuf_scan_pop(scan, scan->end);
+		if (p == scan->end)
+			break;
+
+		*p++ = '\0';
+
+		/* the last parameter keeps any extra spaces before it */
+		if (n_para == MAXPARA - 1) {
+			for (next = p; *next == ' '; next++)
+				;
+			if (*next != '\0') {
+				if (*p == ':')
+					p++;
+				msgbuf->para[n_para++] = p;
+			}
+			break;
+		}
+
+		ch = p;
+	}
+
+	msgbuf->n_para = n_para;
 	if (msgbuf->n_para == 0)
 		return PARSE_NO_PARAMS;
 
@@ -37,6 +37,9 @@
 #define CF_TYPE(x) ((x) & CF_MTYPE)
 
 static int yy_defer_accept = 1;
+static int yy_listen_shards = 1;
+static int yy_accept_budget = 0;
+static int yy_accept_priority = 0;
 
 struct TopConf *conf_cur_block;
 static char *conf_cur_block_name = NULL;
@@ -851,6 +854,12 @@ conf_set_class_sendq(void *data)
 	yy_class->max_sendq = *(unsigned int *) data;
 }
 
+static void
+conf_set_class_sendq_budget(void *data)
+{
+	SendqBudget(yy_class) = *(unsigned int *) data;
+}
+
 static char *listener_address[2];
 
 static int
@@ -861,6 +870,9 @@ conf_begin_listen(struct TopConf *tc, const char *name)
 		listener_address[i] = NULL;
 	}
 	yy_defer_accept = 0;
+	yy_listen_shards = 1;
+	yy_accept_budget = 0;
+	yy_accept_priority = 0;
 	return 0;
 }
 
@@ -872,6 +884,9 @@ conf_end_listen(struct TopConf *tc)
 		listener_address[i] = NULL;
 	}
 	yy_defer_accept = 0;
+	yy_listen_shards = 1;
+	yy_accept_budget = 0;
+	yy_accept_priority = 0;
 	return 0;
 }
 
@@ -881,10 +896,53 @@ conf_set_listen_defer_accept(void *data)
 	yy_defer_accept = *(unsigned int *) data;
 }
 
+static void
+conf_set_listen_shards(void *data)
+{
+	int shards = *(unsigned int *) data;
+
+	if(shards < 1 || shards > LISTENER_MAX_SHARDS)
+	{
+		conf_report_error("listen::shards must be between 1 and %d -- ignoring.",
+				LISTENER_MAX_SHARDS);
+		return;
+	}
+
+	yy_listen_shards = shards;
+}
+
+static void
+conf_set_listen_accept_budget(void *data)
+{
+	int budget = *(unsigned int *) data;
+
+	if(budget < 0)
+	{
+		conf_report_error("listen::accept_budget is negative -- ignoring.");
+		return;
+	}
+
+	yy_accept_budget = budget;
+}
+
+static void
+conf_set_listen_priority(void *data)
+{
+	yy_accept_priority = *(unsigned int *) data;
+}
+
 static void
 conf_set_listen_port_both(void *data, int ssl, int sctp)
 {
 	conf_parm_t *args = data;
+	struct ListenerOptions opts = {
+		.ssl = ssl,
+		.defer_accept = ssl || yy_defer_accept,
+		.shards = yy_listen_shards,
+		.accept_budget = yy_accept_budget,
+		.priority = yy_accept_priority,
+	};
+
 	for (; args; args = args->next)
 	{
 		if(CF_TYPE(args->type) != CF_INT)
@@ -897,8 +955,8 @@ conf_set_listen_port_both(void *data, int ssl, int sctp)
 			if (sctp) {
 				conf_report_error("listener::sctp_port has no addresses -- ignoring.");
 			} else {
-				add_tcp_listener(args->v.number, NULL, AF_INET, ssl, ssl || yy_defer_accept);
-				add_tcp_listener(args->v.number, NULL, AF_INET6, ssl, ssl || yy_defer_accept);
+				add_tcp_listener(args->v.number, NULL, AF_INET, &opts);
+				add_tcp_listener(args->v.number, NULL, AF_INET6, &opts);
 			}
                 }
 		else
@@ -911,12 +969,12 @@ conf_set_listen_port_both(void *data, int ssl, int sctp)
 
 			if (sctp) {
 #ifdef HAVE_LIBSCTP
-				add_sctp_listener(args->v.number, listener_address[0], listener_address[1], ssl);
+				add_sctp_listener(args->v.number, listener_address[0], listener_address[1], &opts);
 #else
 				conf_report_error("Warning -- ignoring listener::sctp_port -- SCTP support not available.");
 #endif
 			} else {
-				add_tcp_listener(args->v.number, listener_address[0], family, ssl, ssl || yy_defer_accept);
+				add_tcp_listener(args->v.number, listener_address[0], family, &opts);
 			}
                 }
 	}
@@ -2514,6 +2572,9 @@ static struct ConfEntry conf_log_table[] =
 	{ "fname_killlog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_killlog	},
 	{ "fname_klinelog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_klinelog	},
 	{ "fname_ioerrorlog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_ioerrorlog },
+	{ "fname_whowaslog", 	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.fname_whowaslog },
+	{ "whowaslog_max_size",	CF_TIME,    NULL, 0,          &ConfigFileEntry.whowaslog_max_size },
+	{ "whowaslog_max_age",	CF_TIME,    NULL, 0,          &ConfigFileEntry.whowaslog_max_age },
 	{ "\0",			0,	    NULL, 0,          NULL }
 };
 
@@ -2549,6 +2610,7 @@ static struct ConfEntry conf_class_table[] =
 	{ "max_number", 	CF_INT,  conf_set_class_max_number,		0, NULL },
 	{ "max_autoconn",	CF_INT,  conf_set_class_max_autoconn,		0, NULL },
 	{ "sendq", 		CF_TIME, conf_set_class_sendq,			0, NULL },
+	{ "sendq_budget",	CF_TIME, conf_set_class_sendq_budget,		0, NULL },
 	{ "\0",	0, NULL, 0, NULL }
 };
 
@@ -2630,6 +2692,7 @@ static struct ConfEntry conf_general_table[] =
 	{ "reject_after_count",	CF_INT,   NULL, 0, &ConfigFileEntry.reject_after_count	},
 	{ "reject_ban_time",	CF_TIME,  NULL, 0, &ConfigFileEntry.reject_ban_time	},
 	{ "reject_duration",	CF_TIME,  NULL, 0, &ConfigFileEntry.reject_duration	},
+	{ "throttle_aggregate_factor", CF_INT, NULL, 0, &ConfigFileEntry.throttle_aggregate_factor },
 	{ "throttle_count",	CF_INT,   NULL, 0, &ConfigFileEntry.throttle_count	},
 	{ "throttle_duration",	CF_TIME,  NULL, 0, &ConfigFileEntry.throttle_duration	},
 	{ "short_motd",		CF_YESNO, NULL, 0, &ConfigFileEntry.short_motd		},
@@ -2663,6 +2726,10 @@ static struct ConfEntry conf_general_table[] =
 	{ "illegal_name_short_client_message",	CF_QSTRING, NULL, BUFSIZE, &ConfigFileEntry.illegal_name_short_client_message	},
 	{ "tls_ciphers_oper_only",	CF_YESNO, NULL, 0, &ConfigFileEntry.tls_ciphers_oper_only	},
 	{ "oper_secure_only",	CF_YESNO, NULL, 0, &ConfigFileEntry.oper_secure_only	},
+	{ "metrics_socket",	CF_QSTRING, NULL, PATH_MAX, &ConfigFileEntry.metrics_socket	},
+	{ "worker_threads",	CF_INT,   NULL, 0, &ConfigFileEntry.worker_threads	},
+	{ "io_threads",		CF_INT,   NULL, 0, &ConfigFileEntry.io_threads	},
+	{ "sendq_budget",	CF_TIME,  NULL, 0, &ConfigFileEntry.sendq_budget	},
 	{ "\0", 		0, 	  NULL, 0, NULL }
 };
 
@@ -2681,6 +2748,7 @@ static struct ConfEntry conf_channel_table[] =
 	{ "disable_local_channels", CF_YESNO, NULL, 0, &ConfigChannel.disable_local_channels },
 	{ "autochanmodes",	CF_QSTRING, conf_set_channel_autochanmodes, 0, NULL	},
 	{ "displayed_usercount",	CF_INT, NULL, 0, &ConfigChannel.displayed_usercount	},
+	{ "lossy_membership_size",	CF_INT, NULL, 0, &ConfigChannel.lossy_membership_size	},
 	{ "\0", 		0, 	  NULL, 0, NULL }
 };
 
@@ -2709,6 +2777,9 @@ newconf_init()
 
 	add_top_conf("listen", conf_begin_listen, conf_end_listen, NULL);
 	add_conf_item("listen", "defer_accept", CF_YESNO, conf_set_listen_defer_accept);
+	add_conf_item("listen", "shards", CF_INT, conf_set_listen_shards);
+	add_conf_item("listen", "accept_budget", CF_INT, conf_set_listen_accept_budget);
+	add_conf_item("listen", "priority", CF_INT, conf_set_listen_priority);
 	add_conf_item("listen", "port", CF_INT | CF_FLIST, conf_set_listen_port);
 	add_conf_item("listen", "sslport", CF_INT | CF_FLIST, conf_set_listen_sslport);
 	add_conf_item("listen", "sctp_port", CF_INT | CF_FLIST, conf_set_listen_sctp_port);
@@ -35,15 +35,273 @@
 #include "s_newconf.h"
 
 static char readBuf[READBUF_SIZE];
+static bool readBuf_busy;
 static void client_dopacket(struct Client *client_p, char *buffer, size_t length);
 
+/*
+ * Input is parsed where it was read to.  A read normally lands in
+ * readBuf and its lines are parsed there; only what is left over (a
+ * partial line, or lines held back by flood control) is copied into the
+ * client's own recvq.  While that holds anything, reads are appended
+ * to it directly, and once it has been drained it is freed again.
+ *
+ * Everything read is scanned once, as it arrives: lines are counted for
+ * the flood check, and a line longer than LINEBUF_SIZE is cut there and
+ * the rest of it dropped, so a client that is not being parsed cannot
+ * grow its recvq past its flood limit in lines of LINEBUF_SIZE.
+ */
+
+/* first CR or LF in p[0..len), or NULL */
+static inline char *
+find_eol(char *p, size_t len)
+{
+	char *lf = memchr(p, '\n', len);
+	char *cr = memchr(p, '\r', lf != NULL ? (size_t)(lf - p) : len);
+
+	return cr != NULL ? cr : lf;
+}
+
+/* make room to read len more bytes onto the client's own recvq */
+static void
+recvq_reserve(struct recvq *rq, size_t len)
+{
+	if(rq->start > 0)
+	{
+		memmove(rq->buf, rq->buf + rq->start, rq->end - rq->start);
+		rq->end -= rq->start;
+		rq->start = 0;
+	}
+
+	if(rq->size - rq->end < len)
+	{
+		rq->size = MAX(rq->size * 2, rq->end + len);
+		rq->buf = rb_realloc(rq->buf, rq->size);
+	}
+}
+
+/* count the lines in what was just read from rq->buf + from onwards,
+ * cutting overlong ones down to LINEBUF_SIZE */
+static void
+recvq_scan(struct recvq *rq, size_t from)
+{
+	char *p = rq->buf + from;
+	char *end = rq->buf + rq->end;
+	char *out = p;
+
+	while(p < end)
+	{
+		size_t room = LINEBUF_SIZE - rq->partial;
+		size_t avail = end - p;
+		size_t len;
+		char *eol;
+
+		if(rq->overlong)
+		{
+			eol = find_eol(p, avail);
+			if(eol == NULL)
+			{
+				p = end;
+				break;
+			}
+			p = eol + 1;
+			rq->overlong = false;
+			continue;
+		}
+
+		eol = find_eol(p, MIN(avail, room + 1));
+		if(eol == NULL)
+		{
+			if(avail <= room)
+			{
+				if(out != p)
+					memmove(out, p, avail);
+				out += avail;
+				rq->partial += avail;
+				break;
+			}
+
+			/* end the line at LINEBUF_SIZE, drop the rest of it */
+			if(out != p)
+				memmove(out, p, room);
+			out += room;
+			*out++ = '\n';
+			p += room + 1;
+			rq->lines++;
+			rq->partial = 0;
+			rq->overlong = true;
+			continue;
+		}
+
+		len = eol - p + 1;
+		if(out != p)
+			memmove(out, p, len);
+		out += len;
+		if(rq->partial + (len - 1) > 0)
+			rq->lines++;
+		rq->partial = 0;
+		p = eol + 1;
+	}
+
+	rq->end = out - rq->buf;
+}
+
+static int
+recvq_read(struct Client *client_p, struct recvq *rq)
+{
+	size_t from;
+	int length;
+
+	if(rq->buf == NULL && !readBuf_busy)
+	{
+		length = rb_read(client_p->localClient->F, readBuf, READBUF_SIZE);
+		if(length > 0)
+		{
+			readBuf_busy = true;
+			rq->buf = readBuf;
+			rq->start = 0;
+			rq->end = length;
+			recvq_scan(rq, 0);
+		}
+		return length;
+	}
+
+	recvq_reserve(rq, READBUF_SIZE);
+	from = rq->end;
+	length = rb_read(client_p->localClient->F, rq->buf + rq->end, READBUF_SIZE);
+	if(length > 0)
+	{
+		rq->end += length;
+		recvq_scan(rq, from);
+	}
+	return length;
+}
+
+/*
+ * recvq_append - add input to a client's recvq as if it had been read
+ */
+void
+recvq_append(struct Client *client_p, const char *data, size_t len)
+{
+	struct recvq *rq = &client_p->localClient->recvq;
+	size_t from;
+
+	recvq_reserve(rq, len);
+	from = rq->end;
+	memcpy(rq->buf + rq->end, data, len);
+	rq->end += len;
+	recvq_scan(rq, from);
+}
+
+/* after parsing: keep what is left in the client's own buffer, and
+ * free that buffer once it is empty */
+static void
+recvq_settle(struct recvq *rq)
+{
+	size_t left = rq->end - rq->start;
+
+	if(rq->buf == readBuf)
+	{
+		char *buf = NULL;
+
+		if(left > 0)
+		{
+			buf = rb_malloc(left);
+			memcpy(buf, readBuf + rq->start, left);
+		}
+
+		rq->buf = buf;
+		rq->start = 0;
+		rq->end = rq->size = left;
+		readBuf_busy = false;
+	}
+	else if(rq->buf != NULL && left == 0)
+	{
+		rb_free(rq->buf);
+		rq->buf = NULL;
+		rq->start = rq->end = rq->size = 0;
+	}
+}
+
+/*
+ * recvq_get_line - next complete line, NUL terminated in place
+ *
+ * Lines end at CR or LF and empty lines are skipped.  recvq_scan() has
+ * already cut any line longer than LINEBUF_SIZE.
+ */
+static char *
+recvq_get_line(struct recvq *rq, size_t *len)
+{
+	for(;;)
+	{
+		char *line = rq->buf + rq->start;
+		size_t avail = rq->end - rq->start;
+		char *eol;
+
+		eol = find_eol(line, avail);
+		if(eol == NULL)
+			return NULL;
+
+		if(eol == line)
+		{
+			rq->start++;
+			continue;
+		}
+
+		*eol = '\0';
+		*len = eol - line;
+		rq->start += *len + 1;
+		rq->lines--;
+		return line;
+	}
+}
+
+/* lines waiting to be parsed, counting a partial one */
+static inline unsigned int
+recvq_count_lines(const struct recvq *rq)
+{
+	return rq->lines + (rq->partial > 0);
+}
+
+/*
+ * recvq_discard - drop a client's unparsed input
+ *
+ * The buffer itself is kept until it is safe to free, as the line being
+ * parsed may live in it.
+ */
+void
+recvq_discard(struct Client *client_p)
+{
+	struct recvq *rq = &client_p->localClient->recvq;
+
+	rq->start = rq->end;
+	rq->lines = 0;
+	rq->partial = 0;
+	rq->overlong = false;
+}
+
+void
+recvq_free(struct Client *client_p)
+{
+	struct recvq *rq = &client_p->localClient->recvq;
+
+	s_assert(rq->buf != readBuf);
+	if(rq->buf != readBuf)
+		rb_free(rq->buf);
+	rq->buf = NULL;
+	rq->start = rq->end = rq->size = 0;
+	rq->lines = 0;
+	rq->partial = 0;
+}
+
 /*
  * parse_client_queued - parse client queued messages
  */
 static void
 parse_client_queued(struct Client *client_p)
 {
-	int dolen;
+	struct recvq *rq = &client_p->localClient->recvq;
+	char *line;
+	size_t dolen;
 	int allow_read;
 
 	if(IsAnyDead(client_p))
@@ -57,14 +315,12 @@ parse_client_queued(struct Client *client_p)
 			if(client_p->localClient->sent_parsed >= allow_read)
 				break;
 
-			dolen = rb_linebuf_get(&client_p->localClient->
-					    buf_recvq, readBuf, READBUF_SIZE,
-					    LINEBUF_COMPLETE, LINEBUF_PARSED);
+			line = recvq_get_line(rq, &dolen);
 
-			if(dolen <= 0 || IsDead(client_p))
+			if(line == NULL || IsDead(client_p))
 				break;
 
-			client_dopacket(client_p, readBuf, dolen);
+			client_dopacket(client_p, line, dolen);
 			client_p->localClient->sent_parsed++;
 
 			/* He's dead cap'n */
@@ -92,11 +348,9 @@ parse_client_queued(struct Client *client_p)
 
 	if(IsAnyServer(client_p) || IsExemptFlood(client_p))
 	{
-		while (!IsAnyDead(client_p) && (dolen = rb_linebuf_get(&client_p->localClient->buf_recvq,
-					   readBuf, READBUF_SIZE, LINEBUF_COMPLETE,
-					   LINEBUF_PARSED)) > 0)
+		while (!IsAnyDead(client_p) && (line = recvq_get_line(rq, &dolen)) != NULL)
 		{
-			client_dopacket(client_p, readBuf, dolen);
+			client_dopacket(client_p, line, dolen);
 		}
 	}
 	else if(IsClient(client_p))
@@ -140,14 +394,12 @@ parse_client_queued(struct Client *client_p)
 			if (rb_current_time() < client_p->localClient->firsttime + ConfigFileEntry.post_registration_delay)
 				break;
 
-			dolen = rb_linebuf_get(&client_p->localClient->
-					    buf_recvq, readBuf, READBUF_SIZE,
-					    LINEBUF_COMPLETE, LINEBUF_PARSED);
+			line = recvq_get_line(rq, &dolen);
 
-			if(!dolen)
+			if(line == NULL)
 				break;
 
-			client_dopacket(client_p, readBuf, dolen);
+			client_dopacket(client_p, line, dolen);
 			if(IsAnyDead(client_p))
 				return;
 
@@ -209,6 +461,7 @@ flood_recalc(void *unused)
 			client_p->localClient->sent_parsed = 0;
 
 		parse_client_queued(client_p);
+		recvq_settle(&client_p->localClient->recvq);
 
 		if(rb_unlikely(IsAnyDead(client_p)))
 			continue;
@@ -228,6 +481,7 @@ flood_recalc(void *unused)
 			client_p->localClient->sent_parsed = 0;
 
 		parse_client_queued(client_p);
+		recvq_settle(&client_p->localClient->recvq);
 	}
 }
 
@@ -238,20 +492,22 @@ void
 read_packet(rb_fde_t * F, void *data)
 {
 	struct Client *client_p = data;
+	struct recvq *rq;
 	int length;
-	int binary = 0;
 
 	while(1)
 	{
 		if(IsAnyDead(client_p))
 			return;
 
+		rq = &client_p->localClient->recvq;
+
 		/*
 		 * Read some data. We *used to* do anti-flood protection here, but
 		 * I personally think it makes the code too hairy to make sane.
 		 *     -- adrian
 		 */
-		length = rb_read(client_p->localClient->F, readBuf, READBUF_SIZE);
+		length = recvq_read(client_p, rq);
 
 		if(length < 0)
 		{
@@ -289,28 +545,18 @@ read_packet(rb_fde_t * F, void *data)
 		}
 
 
-		/*
-		 * Before we even think of parsing what we just read, stick
-		 * it on the end of the receive queue and do it when its
-		 * turn comes around.
-		 */
-		if(IsHandshake(client_p) || IsUnknown(client_p))
-			binary = 1;
-
-		(void) rb_linebuf_parse(&client_p->localClient->buf_recvq, readBuf, length, binary);
-
-		if(IsAnyDead(client_p))
-			return;
-
 		/* Attempt to parse what we have */
 		parse_client_queued(client_p);
 
+		/* whatever wasn't parsed moves off readBuf before the next read */
+		recvq_settle(rq);
+
 		if(IsAnyDead(client_p))
 			return;
 
 		/* Check to make sure we're not flooding */
 		if(!IsAnyServer(client_p) && !IsOperGeneral(client_p) &&
-		   (rb_linebuf_alloclen(&client_p->localClient->buf_recvq) + client_p->localClient->pending_batch_lines > ConfigFileEntry.client_flood_max_lines))
+		   (recvq_count_lines(rq) + client_p->localClient->pending_batch_lines > (unsigned int)ConfigFileEntry.client_flood_max_lines))
 		{
 			exit_client(client_p, client_p, client_p, "Excess Flood");
 			return;
@@ -54,6 +54,8 @@ static void do_numeric(int, struct Client *, struct Client *, struct MsgBuf *);
 
 static int handle_command(struct Message *, struct MsgBuf *, struct Client *, struct Client *);
 
+static struct Message *find_command(const char *);
+
 static char buffer[1024];
 
 /* turn a string into a parc/parv pair */
@@ -149,6 +151,10 @@ parse(struct Client *client_p, char *pbuffer, char *bufend)
 	tagdata.client = client_p;
 	tagdata.message = &msgbuf;
 
+	/* with nothing hooked on message_tag every tag would be removed */
+	if (!hook_subscribed(h_message_tag))
+		ntags = 0;
+
 	for (int i = ntags - 1; i >= 0; i--)
 	{
 		/* a hook can adjust key/value/capmask according to its needs;
@@ -205,7 +211,9 @@ parse(struct Client *client_p, char *pbuffer, char *bufend)
 	}
 	else
 	{
-		mptr = rb_dictionary_retrieve(cmd_dict, msgbuf.cmd);
+		mptr = find_command(msgbuf.cmd);
+		if (mptr != NULL)
+			mptr->bytes += bufend - pbuffer;
 		numeric = -1;
 	}
 
@@ -268,6 +276,7 @@ handle_command(struct Message *mptr, struct MsgBuf *msgbuf_p, struct Client *cli
 	struct MessageEntry ehandler;
 	MessageHandler handler = 0;
 	char squitreason[80];
+	uint64_t start;
 
 	if(IsAnyDead(client_p))
 		return -1;
@@ -280,8 +289,11 @@ handle_command(struct Message *mptr, struct MsgBuf *msgbuf_p, struct Client *cli
 	ehandler = mptr->handlers[from->handler];
 
 	/* let hooks adjust which handler is ultimately called here */
-	hook_data hdata = { from, msgbuf_p, &ehandler };
-	call_hook(h_message_handler, &hdata);
+	if (hook_subscribed(h_message_handler))
+	{
+		hook_data hdata = { from, msgbuf_p, &ehandler };
+		call_hook(h_message_handler, &hdata);
+	}
 
 	handler = ehandler.handler;
 
@@ -315,7 +327,9 @@ handle_command(struct Message *mptr, struct MsgBuf *msgbuf_p, struct Client *cli
 		return (-1);
 	}
 
+	start = rb_hist_now();
 	(*handler) (msgbuf_p, client_p, from, msgbuf_p->n_para, msgbuf_p->para);
+	rb_hist_add(&mptr->time, rb_hist_now() - start);
 	return (1);
 }
 
@@ -327,7 +341,7 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 	struct MessageEntry ehandler;
 	MessageHandler handler = 0;
 
-	mptr = rb_dictionary_retrieve(cmd_dict, command);
+	mptr = find_command(command);
 
 	if(mptr == NULL || mptr->cmd == NULL)
 		return;
@@ -342,6 +356,238 @@ handle_encap(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *so
 	(*handler) (msgbuf_p, client_p, source_p, parc, parv);
 }
 
+/*
+ * Commands are looked up in a perfect hash table built from cmd_dict,
+ * which stays the list of record for modules and STATS m.  The command
+ * set only changes when modules are loaded or unloaded, so any change
+ * just marks the table stale and it is rebuilt on the next lookup.
+ *
+ * Each name is hashed once, case-insensitively.  The top bits of the hash
+ * pick a bucket, and the displacement stored for that bucket was chosen
+ * while building so that every name in it lands in a slot of its own.
+ * A lookup is therefore one hash, one probe and one compare.
+ */
+struct cmd_slot
+{
+	const char *cmd;
+	size_t len;
+	struct Message *msg;
+};
+
+struct cmd_table
+{
+	unsigned int slot_bits;
+	unsigned int bucket_bits;
+	uint32_t *disp;
+	struct cmd_slot *slots;
+};
+
+static struct cmd_table *cmd_table;
+static bool cmd_table_stale = true;
+
+#define CMD_TABLE_MAX_DISP 65536
+
+static inline uint64_t
+cmd_hash(const char *cmd, size_t *len)
+{
+	const unsigned char *p = (const unsigned char *)cmd;
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	/* fold case the way rb_strcasecmp() does */
+	for (; *p != '\0'; p++)
+		h = (h ^ (*p >= 'a' && *p <= 'z' ? *p - ('a' - 'A') : *p)) * 0x100000001b3ULL;
+
+	*len = (const char *)p - cmd;
+	return h;
+}
+
+static inline unsigned int
+cmd_bucket(const struct cmd_table *table, uint64_t h)
+{
+	return h >> (64 - table->bucket_bits);
+}
+
+static inline unsigned int
+cmd_slot(const struct cmd_table *table, uint64_t h, uint32_t disp)
+{
+	return ((h ^ disp) * 0x9e3779b97f4a7c15ULL) >> (64 - table->slot_bits);
+}
+
+static void
+cmd_table_free(struct cmd_table *table)
+{
+	if (table == NULL)
+		return;
+
+	rb_free(table->disp);
+	rb_free(table->slots);
+	rb_free(table);
+}
+
+/*
+ * work out where the n commands listed in order would go with the given
+ * displacement, into placed.  returns false if any two of them collide or
+ * a slot is already taken.
+ */
+static bool
+cmd_table_try(const struct cmd_table *table, const uint64_t *hash,
+	const unsigned int *order, unsigned int n, uint32_t disp, unsigned int *placed)
+{
+	for (unsigned int k = 0; k < n; k++)
+	{
+		unsigned int slot = cmd_slot(table, hash[order[k]], disp);
+
+		if (table->slots[slot].cmd != NULL)
+			return false;
+
+		for (unsigned int j = 0; j < k; j++)
+			if (placed[j] == slot)
+				return false;
+
+		placed[k] = slot;
+	}
+
+	return true;
+}
+
+/*
+ * try to place every command with slot_bits bits of slots.
+ * returns NULL if some bucket could not be displaced into free slots.
+ */
+static struct cmd_table *
+cmd_table_build(unsigned int slot_bits)
+{
+	unsigned int n = rb_dictionary_size(cmd_dict);
+	unsigned int nbuckets, i, b;
+	unsigned int *count, *start, *order, *placed;
+	uint64_t *hash;
+	size_t *len;
+	struct Message **msgs;
+	struct cmd_table *table;
+	rb_dictionary_iter iter;
+	struct Message *msg;
+
+	table = rb_malloc(sizeof(struct cmd_table));
+	table->slot_bits = slot_bits;
+	table->bucket_bits = slot_bits > 2 ? slot_bits - 2 : 1;
+	nbuckets = 1U << table->bucket_bits;
+	table->disp = rb_malloc(sizeof(uint32_t) * nbuckets);
+	table->slots = rb_malloc(sizeof(struct cmd_slot) << slot_bits);
+
+	hash = rb_malloc(sizeof(uint64_t) * (n + 1));
+	len = rb_malloc(sizeof(size_t) * (n + 1));
+	msgs = rb_malloc(sizeof(struct Message *) * (n + 1));
+	order = rb_malloc(sizeof(unsigned int) * (n + 1));
+	placed = rb_malloc(sizeof(unsigned int) * (n + 1));
+	count = rb_malloc(sizeof(unsigned int) * nbuckets);
+	start = rb_malloc(sizeof(unsigned int) * (nbuckets + 1));
+
+	/* group the commands by bucket */
+	i = 0;
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+	{
+		hash[i] = cmd_hash(msg->cmd, &len[i]);
+		msgs[i] = msg;
+		count[cmd_bucket(table, hash[i])]++;
+		i++;
+	}
+
+	for (b = 0; b < nbuckets; b++)
+		start[b + 1] = start[b] + count[b];
+	for (i = 0; i < n; i++)
+		order[start[cmd_bucket(table, hash[i])]++] = i;
+	for (b = nbuckets; b > 0; b--)
+		start[b] = start[b - 1];
+	start[0] = 0;
+
+	/* place the fullest buckets first, while the table is emptiest */
+	for (unsigned int size = n; size > 0 && table != NULL; size--)
+	{
+		for (b = 0; b < nbuckets && table != NULL; b++)
+		{
+			uint32_t disp;
+
+			if (count[b] != size)
+				continue;
+
+			for (disp = 0; disp < CMD_TABLE_MAX_DISP; disp++)
+				if (cmd_table_try(table, hash, &order[start[b]], size, disp, placed))
+					break;
+
+			if (disp == CMD_TABLE_MAX_DISP)
+			{
+				cmd_table_free(table);
+				table = NULL;
+				break;
+			}
+
+			table->disp[b] = disp;
+			for (unsigned int k = 0; k < size; k++)
+			{
+				i = order[start[b] + k];
+				table->slots[placed[k]].cmd = msgs[i]->cmd;
+				table->slots[placed[k]].len = len[i];
+				table->slots[placed[k]].msg = msgs[i];
+			}
+		}
+	}
+
+	rb_free(hash);
+	rb_free(len);
+	rb_free(msgs);
+	rb_free(order);
+	rb_free(placed);
+	rb_free(count);
+	rb_free(start);
+
+	return table;
+}
+
+static void
+cmd_table_rebuild(void)
+{
+	unsigned int n = rb_dictionary_size(cmd_dict);
+	unsigned int slot_bits = 4;
+	struct cmd_table *table = NULL;
+
+	/* keep the table at most half full so displacements are found quickly */
+	while ((1U << slot_bits) < n * 2)
+		slot_bits++;
+
+	for (unsigned int tries = 0; table == NULL && tries < 4; tries++)
+		table = cmd_table_build(slot_bits + tries);
+
+	/* lookups fall back to cmd_dict if no table could be built */
+	if (table == NULL)
+		ilog(L_MAIN, "Could not build a command table for %u commands", n);
+
+	cmd_table_free(cmd_table);
+	cmd_table = table;
+	cmd_table_stale = false;
+}
+
+static struct Message *
+find_command(const char *cmd)
+{
+	const struct cmd_slot *slot;
+	uint64_t h;
+	size_t len;
+
+	if (rb_unlikely(cmd_table_stale))
+		cmd_table_rebuild();
+
+	if (rb_unlikely(cmd_table == NULL))
+		return rb_dictionary_retrieve(cmd_dict, cmd);
+
+	h = cmd_hash(cmd, &len);
+	slot = &cmd_table->slots[cmd_slot(cmd_table, h, cmd_table->disp[cmd_bucket(cmd_table, h)])];
+
+	if (slot->cmd == NULL || slot->len != len || rb_strcasecmp(slot->cmd, cmd) != 0)
+		return NULL;
+
+	return slot->msg;
+}
+
 /*
  * clear_hash_parse()
  *
@@ -383,6 +629,7 @@ mod_add_cmd(struct Message *msg)
 	msg->bytes = 0;
 
 	rb_dictionary_add(cmd_dict, msg->cmd, msg);
+	cmd_table_stale = true;
 }
 
 /* mod_del_cmd
@@ -402,6 +649,8 @@ mod_del_cmd(struct Message *msg)
 		ilog(L_MAIN, "Delete command: %s not found", msg->cmd);
 		s_assert(0);
 	}
+
+	cmd_table_stale = true;
 }
 
 /* cancel_clients()
@@ -48,6 +48,41 @@
 
 static rb_dlink_list privilegeset_list = {NULL, NULL, 0};
 
+/* privilege name -> PrivilegeId; names are never forgotten so ids stay valid */
+static rb_dictionary *privilege_ids;
+static PrivilegeId privilege_count;
+
+PrivilegeId
+privilege_intern(const char *priv)
+{
+	PrivilegeId id;
+
+	s_assert(priv != NULL);
+
+	if (privilege_ids == NULL)
+		privilege_ids = rb_dictionary_create("privilege ids", (DCF)strcmp);
+
+	id = (PrivilegeId)(uintptr_t)rb_dictionary_retrieve(privilege_ids, priv);
+	if (id == 0)
+	{
+		id = ++privilege_count;
+		rb_dictionary_add(privilege_ids, rb_strdup(priv), (void *)(uintptr_t)id);
+	}
+
+	return id;
+}
+
+PrivilegeId
+privilege_find(const char *priv)
+{
+	s_assert(priv != NULL);
+
+	if (privilege_ids == NULL)
+		return 0;
+
+	return (PrivilegeId)(uintptr_t)rb_dictionary_retrieve(privilege_ids, priv);
+}
+
 static struct PrivilegeSet *
 privilegeset_get_any(const char *name)
 {
@@ -73,6 +108,31 @@ privilegeset_cmp_priv(const void *a_, const void *b_)
 	return strcmp(*a, *b);
 }
 
+static void
+privilegeset_index_bits(struct PrivilegeSet *set)
+{
+	size_t n;
+
+	rb_free(set->bits);
+	set->bits = NULL;
+	set->bits_words = 0;
+
+	for (n = 0; n < set->size; n++)
+	{
+		PrivilegeId id = privilege_intern(set->privs[n]);
+
+		if (id / 64 >= set->bits_words)
+		{
+			size_t words = id / 64 + 1;
+
+			set->bits = rb_realloc(set->bits, sizeof *set->bits * words);
+			memset(set->bits + set->bits_words, 0, sizeof *set->bits * (words - set->bits_words));
+			set->bits_words = words;
+		}
+		set->bits[id / 64] |= UINT64_C(1) << (id % 64);
+	}
+}
+
 static void
 privilegeset_index(struct PrivilegeSet *set)
 {
@@ -89,6 +149,8 @@ privilegeset_index(struct PrivilegeSet *set)
 		*p++ = s;
 	qsort(set->privs, set->size, sizeof *set->privs, privilegeset_cmp_priv);
 	set->privs[set->size] = NULL;
+
+	privilegeset_index_bits(set);
 }
 
 void
@@ -194,6 +256,7 @@ privilegeset_free(struct PrivilegeSet *set)
 	privilegeset_free(set->shadow);
 	rb_free(set->name);
 	rb_free(set->privs);
+	rb_free(set->bits);
 	rb_free(set->priv_storage);
 	rb_free(set);
 }
@@ -205,12 +268,16 @@ privilegeset_shade(struct PrivilegeSet *set)
 
 	set->shadow = privilegeset_new_orphan(set->name);
 	set->shadow->privs = set->privs;
+	set->shadow->bits = set->bits;
+	set->shadow->bits_words = set->bits_words;
 	set->shadow->size = set->size;
 	set->shadow->priv_storage = set->priv_storage;
 	set->shadow->stored_size = set->stored_size;
 	set->shadow->allocated_size = set->allocated_size;
 
 	set->privs = NULL;
+	set->bits = NULL;
+	set->bits_words = 0;
 	set->size = 0;
 	set->priv_storage = NULL;
 	set->stored_size = 0;
@@ -222,6 +289,9 @@ privilegeset_clear(struct PrivilegeSet *set)
 {
 	rb_free(set->privs);
 	set->privs = NULL;
+	rb_free(set->bits);
+	set->bits = NULL;
+	set->bits_words = 0;
 	set->size = 0;
 	set->stored_size = 0;
 }
@@ -232,8 +302,7 @@ privilegeset_in_set(const struct PrivilegeSet *set, const char *priv)
 	s_assert(set != NULL);
 	s_assert(priv != NULL);
 
-	const char **found = bsearch(&priv, set->privs, set->size, sizeof *set->privs, privilegeset_cmp_priv);
-	return found != NULL;
+	return privilegeset_has(set, privilege_find(priv));
 }
 
 const char *const *
@@ -388,6 +457,10 @@ privilegeset_diff(const struct PrivilegeSet *old, const struct PrivilegeSet *new
 	set_added->size = res_added - set_added->privs;
 	set_removed->size = res_removed - set_removed->privs;
 
+	privilegeset_index_bits(set_unchanged);
+	privilegeset_index_bits(set_added);
+	privilegeset_index_bits(set_removed);
+
 	return (struct privset_diff){
 		.unchanged = set_unchanged,
 		.added = set_added,
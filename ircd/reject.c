@@ -34,17 +34,42 @@
 #include "match.h"
 #include "hash.h"
 
+/*
+ * Reject and throttle entries are expired by a timer wheel: a slot per
+ * second, each holding the entries due in that second (or a whole
+ * number of turns later), so the periodic expiry only looks at the
+ * entries that are due rather than walking every one.
+ */
+#define EXPIRE_WHEEL_SIZE	64
+
+struct expire_entry
+{
+	rb_dlink_node wnode;
+	time_t expires;
+};
+
+struct expire_wheel
+{
+	rb_dlink_list slot[EXPIRE_WHEEL_SIZE];
+	time_t last;		/* last second run */
+};
+
 static rb_patricia_tree_t *reject_tree;
 static rb_dlink_list delay_exit;
 static rb_dlink_list reject_list;
-static rb_dlink_list throttle_list;
-static rb_patricia_tree_t *throttle_tree;
+static struct expire_wheel reject_wheel;
+static rb_patricia_tree_t *throttle_tree4;
+static rb_patricia_tree_t *throttle_tree6;
+static struct expire_wheel throttle_wheel;
+static void reject_expires(void *unused);
 static void throttle_expires(void *unused);
 
 
 typedef struct _reject_data
 {
+	struct expire_entry expire;
 	rb_dlink_node rnode;
+	rb_patricia_node_t *pnode;
 	struct ConfItem *aconf;
 	const char *reason;
 	time_t time;
@@ -55,19 +80,100 @@ typedef struct _reject_data
 typedef struct _delay_data
 {
 	rb_dlink_node node;
-	rb_fde_t *F;
+	int fd;
 	struct ConfItem *aconf;
 	const char *reason;
 	bool ssl;
 } delay_t;
 
+/*
+ * Throttling keeps a token bucket per address prefix at each of
+ * THROTTLE_LEVELS levels, the first being a single host (an IPv6 /64)
+ * and each further level throttle_aggregate_factor times as large.  A
+ * connection has to fit in every level, so clients rotating through the
+ * addresses of a /64 or a /24 share a budget.
+ *
+ * A bucket only stores the time at which it is full again, in
+ * milliseconds.  Each accepted connection pushes that on by
+ * throttle_duration / capacity, and while it is more than
+ * throttle_duration ahead connections are refused (and not charged).
+ * A full bucket is the same as no bucket and is freed.
+ */
+#define THROTTLE_LEVELS		3
+
+static const unsigned int throttle_bits4[THROTTLE_LEVELS] = { 32, 24, 16 };
+static const unsigned int throttle_bits6[THROTTLE_LEVELS] = { 64, 48, 32 };
+
 typedef struct _throttle
 {
-	rb_dlink_node node;
-	time_t last;
-	int count;
+	struct expire_entry expire;
+	rb_patricia_node_t *pnode;
+	rb_patricia_tree_t *tree;
+	int64_t full;		/* ms; when the bucket has refilled */
 } throttle_t;
 
+static void
+expire_wheel_init(struct expire_wheel *wheel)
+{
+	wheel->last = rb_current_time();
+}
+
+static void
+expire_schedule(struct expire_wheel *wheel, struct expire_entry *entry, void *data, time_t expires)
+{
+	/* an entry due in a second already run waits for the next one */
+	if(expires <= wheel->last)
+		expires = wheel->last + 1;
+
+	if(entry->expires != 0)
+	{
+		if(entry->expires % EXPIRE_WHEEL_SIZE == expires % EXPIRE_WHEEL_SIZE)
+		{
+			entry->expires = expires;
+			return;
+		}
+		rb_dlinkDelete(&entry->wnode, &wheel->slot[entry->expires % EXPIRE_WHEEL_SIZE]);
+	}
+
+	entry->expires = expires;
+	rb_dlinkAdd(data, &entry->wnode, &wheel->slot[expires % EXPIRE_WHEEL_SIZE]);
+}
+
+static void
+expire_unschedule(struct expire_wheel *wheel, struct expire_entry *entry)
+{
+	rb_dlinkDelete(&entry->wnode, &wheel->slot[entry->expires % EXPIRE_WHEEL_SIZE]);
+	entry->expires = 0;
+}
+
+/* call expire() on every entry of the wheel that is due; it must
+ * unschedule and free the entry */
+static void
+expire_wheel_run(struct expire_wheel *wheel, void (*expire)(void *))
+{
+	time_t now = rb_current_time();
+	time_t t = wheel->last;
+
+	if(now - t > EXPIRE_WHEEL_SIZE)
+		t = now - EXPIRE_WHEEL_SIZE;
+
+	while(t < now)
+	{
+		rb_dlink_node *ptr, *next;
+		rb_dlink_list *slot = &wheel->slot[++t % EXPIRE_WHEEL_SIZE];
+
+		RB_DLINK_FOREACH_SAFE(ptr, next, slot->head)
+		{
+			struct expire_entry *entry = (struct expire_entry *)ptr->data;
+
+			if(entry->expires <= now)
+				expire(ptr->data);
+		}
+	}
+
+	wheel->last = now;
+}
+
 unsigned long
 delay_exit_length(void)
 {
@@ -79,6 +185,10 @@ reject_free(reject_t *rdata)
 {
 	struct ConfItem *aconf = rdata->aconf;
 
+	rb_dlinkDelete(&rdata->rnode, &reject_list);
+	expire_unschedule(&reject_wheel, &rdata->expire);
+	rb_patricia_remove(reject_tree, rdata->pnode);
+
 	if (aconf)
 		deref_conf(aconf);
 
@@ -104,7 +214,7 @@ reject_exit(void *unused)
 
 		if (ddata->ssl)
 		{
-			rb_write(ddata->F, ssldeniederrcode, sizeof(ssldeniederrcode));
+			(void) send(ddata->fd, ssldeniederrcode, sizeof(ssldeniederrcode), MSG_NOSIGNAL);
 		}
 		else
 		{
@@ -118,15 +228,15 @@ reject_exit(void *unused)
 					me.name, "*", ddata->reason);
 
 			if (*dynamic_reason)
-				rb_write(ddata->F, dynamic_reason, strlen(dynamic_reason));
+				(void) send(ddata->fd, dynamic_reason, strlen(dynamic_reason), MSG_NOSIGNAL);
 
-			rb_write(ddata->F, errbuf, strlen(errbuf));
+			(void) send(ddata->fd, errbuf, strlen(errbuf), MSG_NOSIGNAL);
 		}
 
 		if (ddata->aconf)
 			deref_conf(ddata->aconf);
 
-		rb_close(ddata->F);
+		close(ddata->fd);
 		rb_free(ddata);
 	}
 
@@ -135,51 +245,62 @@ reject_exit(void *unused)
 }
 
 static void
-reject_expires(void *unused)
+reject_touch(reject_t *rdata)
 {
-	rb_dlink_node *ptr, *next;
-	rb_patricia_node_t *pnode;
-	reject_t *rdata;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, reject_list.head)
-	{
-		pnode = ptr->data;
-		rdata = pnode->data;
+	rdata->time = rb_current_time();
+	expire_schedule(&reject_wheel, &rdata->expire, rdata,
+			rdata->time + ConfigFileEntry.reject_duration);
+}
 
-		if(rdata->time + ConfigFileEntry.reject_duration > rb_current_time())
-			continue;
+static void
+reject_expire(void *data)
+{
+	reject_free(data);
+}
 
-		rb_dlinkDelete(ptr, &reject_list);
-		reject_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
-	}
+static void
+reject_expires(void *unused)
+{
+	expire_wheel_run(&reject_wheel, reject_expire);
 }
 
 void
 init_reject(void)
 {
 	reject_tree = rb_new_patricia(PATRICIA_BITS);
-	throttle_tree = rb_new_patricia(PATRICIA_BITS);
+	throttle_tree4 = rb_new_patricia(32);
+	throttle_tree6 = rb_new_patricia(128);
+	expire_wheel_init(&reject_wheel);
+	expire_wheel_init(&throttle_wheel);
 	rb_event_add("reject_exit", reject_exit, NULL, DELAYED_EXIT_TIME);
-	rb_event_add("reject_expires", reject_expires, NULL, 60);
-	rb_event_add("throttle_expires", throttle_expires, NULL, 10);
+	rb_event_add("reject_expires", reject_expires, NULL, 1);
+	rb_event_add("throttle_expires", throttle_expires, NULL, 1);
+}
+
+static int64_t
+throttle_now(void)
+{
+	return (int64_t)rb_current_time() * 1000;
 }
 
+/* buckets currently refusing connections */
 unsigned long
 throttle_size(void)
 {
-	unsigned long count;
-	rb_dlink_node *ptr;
-	rb_patricia_node_t *pnode;
-	throttle_t *t;
+	int64_t limit = throttle_now() + (int64_t)ConfigFileEntry.throttle_duration * 1000;
+	unsigned long count = 0;
 
-	count = 0;
-	RB_DLINK_FOREACH(ptr, throttle_list.head)
+	for(int i = 0; i < EXPIRE_WHEEL_SIZE; i++)
 	{
-		pnode = ptr->data;
-		t = pnode->data;
-		if (t->count > ConfigFileEntry.throttle_count)
-			count++;
+		rb_dlink_node *ptr;
+
+		RB_DLINK_FOREACH(ptr, throttle_wheel.slot[i].head)
+		{
+			throttle_t *t = ptr->data;
+
+			if(t->full > limit)
+				count++;
+		}
 	}
 
 	return count;
@@ -205,22 +326,23 @@ add_reject(struct Client *client_p, const char *mask1, const char *mask2, struct
 	if((pnode = rb_match_ip(reject_tree, (struct sockaddr *)&client_p->localClient->ip)) != NULL)
 	{
 		rdata = pnode->data;
-		rdata->time = rb_current_time();
 		rdata->count++;
 	}
 	else
 	{
+		/* an IPv6 host is its /64, so rotating through it gains nothing */
 		int bitlen = 32;
 		if(GET_SS_FAMILY(&client_p->localClient->ip) == AF_INET6)
-			bitlen = 128;
+			bitlen = 64;
 		pnode = make_and_lookup_ip(reject_tree, (struct sockaddr *)&client_p->localClient->ip, bitlen);
 		pnode->data = rdata = rb_malloc(sizeof(reject_t));
+		rdata->pnode = pnode;
 		rb_dlinkAddTail(pnode, &rdata->rnode, &reject_list);
-		rdata->time = rb_current_time();
 		rdata->count = 1;
 		rdata->aconf = NULL;
 		rdata->reason = NULL;
 	}
+	reject_touch(rdata);
 	rdata->mask_hashv = hashv;
 
 	if (aconf != NULL && aconf != rdata->aconf && (aconf->status & CONF_KILL) && aconf->passwd)
@@ -240,7 +362,7 @@ add_reject(struct Client *client_p, const char *mask1, const char *mask2, struct
 }
 
 int
-check_reject(rb_fde_t *F, struct sockaddr *addr, bool ssl)
+check_reject(int fd, struct sockaddr *addr, bool ssl)
 {
 	rb_patricia_node_t *pnode;
 	reject_t *rdata;
@@ -255,22 +377,19 @@ check_reject(rb_fde_t *F, struct sockaddr *addr, bool ssl)
 		return 0;
 
 	rdata = pnode->data;
-	rdata->time = rb_current_time();
+	reject_touch(rdata);
 
 	if (rdata->count <= (unsigned long)ConfigFileEntry.reject_after_count)
 		return 0;
 
 	if (rdata->aconf != NULL && rdata->aconf->status & CONF_ILLEGAL)
 	{
-		rb_dlinkDelete(&rdata->rnode, &reject_list);
 		reject_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
 		return 0;
 	}
 
 	ddata = rb_malloc(sizeof(delay_t));
 	ServerStats.is_rej++;
-	rb_setselect(F, RB_SELECT_WRITE | RB_SELECT_READ, NULL, NULL);
 	if (rdata->aconf)
 	{
 		ddata->aconf = rdata->aconf;
@@ -287,7 +406,7 @@ check_reject(rb_fde_t *F, struct sockaddr *addr, bool ssl)
 		ddata->aconf = NULL;
 		ddata->reason = NULL;
 	}
-	ddata->F = F;
+	ddata->fd = fd;
 	ddata->ssl = ssl;
 	rb_dlinkAdd(ddata, &ddata->node, &delay_exit);
 	return 1;
@@ -329,9 +448,7 @@ flush_reject(void)
 	{
 		pnode = ptr->data;
 		rdata = pnode->data;
-		rb_dlinkDelete(ptr, &reject_list);
 		reject_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
 	}
 }
 
@@ -347,9 +464,7 @@ remove_reject_ip(const char *ip)
 	if((pnode = rb_match_string(reject_tree, ip)) != NULL)
 	{
 		reject_t *rdata = pnode->data;
-		rb_dlinkDelete(&rdata->rnode, &reject_list);
 		reject_free(rdata);
-		rb_patricia_remove(reject_tree, pnode);
 		return 1;
 	}
 	return 0;
@@ -375,103 +490,147 @@ remove_reject_mask(const char *mask1, const char *mask2)
 		rdata = pnode->data;
 		if (rdata->mask_hashv == hashv)
 		{
-			rb_dlinkDelete(ptr, &reject_list);
 			reject_free(rdata);
-			rb_patricia_remove(reject_tree, pnode);
 			n++;
 		}
 	}
 	return n;
 }
 
+static unsigned int
+throttle_levels(void)
+{
+	return ConfigFileEntry.throttle_aggregate_factor > 1 ? THROTTLE_LEVELS : 1;
+}
+
+/* ms each connection costs at a level */
+static int64_t
+throttle_interval(unsigned int level)
+{
+	int64_t capacity = ConfigFileEntry.throttle_count > 0 ? ConfigFileEntry.throttle_count : 1;
+	int64_t interval;
+
+	while(level-- > 0)
+		capacity *= ConfigFileEntry.throttle_aggregate_factor;
+
+	interval = (int64_t)ConfigFileEntry.throttle_duration * 1000 / capacity;
+	return interval > 0 ? interval : 1;
+}
+
+static throttle_t *
+throttle_find(struct sockaddr *addr, unsigned int level)
+{
+	rb_patricia_node_t *pnode;
+
+	if(addr->sa_family == AF_INET6)
+		pnode = rb_match_ip_exact(throttle_tree6, addr, throttle_bits6[level]);
+	else
+		pnode = rb_match_ip_exact(throttle_tree4, addr, throttle_bits4[level]);
+
+	return pnode != NULL ? pnode->data : NULL;
+}
+
+static throttle_t *
+throttle_create(struct sockaddr *addr, unsigned int level)
+{
+	throttle_t *t = rb_malloc(sizeof(throttle_t));
+
+	if(addr->sa_family == AF_INET6)
+	{
+		t->tree = throttle_tree6;
+		t->pnode = make_and_lookup_ip(throttle_tree6, addr, throttle_bits6[level]);
+	}
+	else
+	{
+		t->tree = throttle_tree4;
+		t->pnode = make_and_lookup_ip(throttle_tree4, addr, throttle_bits4[level]);
+	}
+	t->pnode->data = t;
+	t->full = throttle_now();
+
+	return t;
+}
+
+static void
+throttle_free(void *data)
+{
+	throttle_t *t = data;
+
+	expire_unschedule(&throttle_wheel, &t->expire);
+	rb_patricia_remove(t->tree, t->pnode);
+	rb_free(t);
+}
+
 int
 throttle_add(struct sockaddr *addr)
 {
-	throttle_t *t;
-	rb_patricia_node_t *pnode;
+	throttle_t *t[THROTTLE_LEVELS];
+	unsigned int levels = throttle_levels();
+	int64_t now = throttle_now();
+	int64_t limit = now + (int64_t)ConfigFileEntry.throttle_duration * 1000;
+
+	if(ConfigFileEntry.throttle_duration <= 0)
+		return 0;
 
-	if((pnode = rb_match_ip(throttle_tree, addr)) != NULL)
+	for(unsigned int i = 0; i < levels; i++)
 	{
-		t = pnode->data;
+		t[i] = throttle_find(addr, i);
 
-		if(t->count > ConfigFileEntry.throttle_count)
+		/* Stop penalizing them after they've been throttled */
+		if(t[i] != NULL && t[i]->full > limit)
 		{
 			ServerStats.is_thr++;
 			return 1;
 		}
-		/* Stop penalizing them after they've been throttled */
-		t->last = rb_current_time();
-		t->count++;
+	}
 
-	} else {
-		int bitlen = 32;
-		if(GET_SS_FAMILY(addr) == AF_INET6)
-			bitlen = 128;
-		t = rb_malloc(sizeof(throttle_t));
-		t->last = rb_current_time();
-		t->count = 1;
-		pnode = make_and_lookup_ip(throttle_tree, addr, bitlen);
-		pnode->data = t;
-		rb_dlinkAdd(pnode, &t->node, &throttle_list);
+	for(unsigned int i = 0; i < levels; i++)
+	{
+		if(t[i] == NULL)
+			t[i] = throttle_create(addr, i);
+
+		if(t[i]->full < now)
+			t[i]->full = now;
+		t[i]->full += throttle_interval(i);
+
+		expire_schedule(&throttle_wheel, &t[i]->expire, t[i], (t[i]->full + 999) / 1000);
 	}
+
 	return 0;
 }
 
 int
 is_throttle_ip(struct sockaddr *addr)
 {
-	throttle_t *t;
-	rb_patricia_node_t *pnode;
-	int duration;
+	unsigned int levels = throttle_levels();
+	int64_t limit = throttle_now() + (int64_t)ConfigFileEntry.throttle_duration * 1000;
+	int64_t longest = 0;
 
-	if((pnode = rb_match_ip(throttle_tree, addr)) != NULL)
+	for(unsigned int i = 0; i < levels; i++)
 	{
-		t = pnode->data;
-		if(t->count > ConfigFileEntry.throttle_count)
-		{
-			duration = t->last + ConfigFileEntry.throttle_duration - rb_current_time();
-			return duration > 0 ? duration : 1;
-		}
+		throttle_t *t = throttle_find(addr, i);
+
+		if(t != NULL && t->full - limit > longest)
+			longest = t->full - limit;
 	}
-	return 0;
+
+	return (int)((longest + 999) / 1000);
 }
 
 void
 flush_throttle(void)
 {
-	rb_dlink_node *ptr, *next;
-	rb_patricia_node_t *pnode;
-	throttle_t *t;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, throttle_list.head)
+	for(int i = 0; i < EXPIRE_WHEEL_SIZE; i++)
 	{
-		pnode = ptr->data;
-		t = pnode->data;
+		rb_dlink_node *ptr, *next;
 
-		rb_dlinkDelete(ptr, &throttle_list);
-		rb_free(t);
-		rb_patricia_remove(throttle_tree, pnode);
+		RB_DLINK_FOREACH_SAFE(ptr, next, throttle_wheel.slot[i].head)
+			throttle_free(ptr->data);
 	}
 }
 
 static void
 throttle_expires(void *unused)
 {
-	rb_dlink_node *ptr, *next;
-	rb_patricia_node_t *pnode;
-	throttle_t *t;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next, throttle_list.head)
-	{
-		pnode = ptr->data;
-		t = pnode->data;
-
-		if(t->last + ConfigFileEntry.throttle_duration > rb_current_time())
-			continue;
-
-		rb_dlinkDelete(ptr, &throttle_list);
-		rb_free(t);
-		rb_patricia_remove(throttle_tree, pnode);
-	}
+	expire_wheel_run(&throttle_wheel, throttle_free);
 }
-
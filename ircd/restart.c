@@ -30,6 +30,7 @@
 #include "s_conf.h"
 #include "client.h"
 #include "ircd_signal.h"
+#include "whowas.h"
 
 /* external var */
 extern char * const *myargv;
@@ -52,12 +53,14 @@ void
 server_reboot(void)
 {
 	int i;
-	char path[PATH_MAX+1];
 
 	sendto_realops_snomask(SNO_GENERAL, L_NETWIDE, "Restarting server...");
 
 	ilog(L_MAIN, "Restarting server...");
 
+	/* the whowas log is what lets history survive this */
+	whowas_log_close();
+
 	/*
 	 * XXX we used to call flush_connections() here. But since this routine
 	 * doesn't exist anymore, we won't be flushing. This is ok, since
@@ -72,6 +75,14 @@ server_reboot(void)
 		close(i);
 
 	unlink(pidFileName);
+	server_exec();
+}
+
+void
+server_exec(void)
+{
+	char path[PATH_MAX+1];
+
 	execv(ircd_paths[IRCD_PATH_IRCD_EXEC], (void *)myargv);
 
 	/* use this if execv of SPATH fails */
@@ -53,6 +53,8 @@
 #include "s_assert.h"
 #include "authproc.h"
 #include "supported.h"
+#include "whowas.h"
+#include "metrics.h"
 
 struct config_server_hide ConfigServerHide;
 
@@ -523,6 +525,9 @@ detach_conf(struct Client *client_p)
 		{
 			remove_ip_limit(client_p, aconf);
 
+			/* the class may be freed below */
+			rb_linebuf_set_account(&client_p->localClient->buf_sendq, &sendq_total);
+
 			if(ConfCurrUsers(aconf) > 0)
 				--ConfCurrUsers(aconf);
 
@@ -586,6 +591,7 @@ attach_conf(struct Client *client_p, struct ConfItem *aconf)
 		detach_conf(client_p);
 
 	client_p->localClient->att_conf = aconf;
+	rb_linebuf_set_account(&client_p->localClient->buf_sendq, &SendqUsage(ClassPtr(aconf)));
 
 	aconf->clients++;
 	ConfCurrUsers(aconf)++;
@@ -626,6 +632,10 @@ service_rehash(void *data_)
 		rb_strlcpy(me.info, "unknown", sizeof(me.info));
 
 	open_logfiles();
+	whowas_log_open();
+	metrics_open();
+	rb_job_init(ConfigFileEntry.worker_threads);
+	rb_iothread_init(ConfigFileEntry.io_threads);
 
 	RB_DLINK_FOREACH(n, local_oper_list.head)
 	{
@@ -728,12 +738,19 @@ set_default_conf(void)
 	ConfigFileEntry.fname_killlog = NULL;
 	ConfigFileEntry.fname_klinelog = NULL;
 	ConfigFileEntry.fname_ioerrorlog = NULL;
+	ConfigFileEntry.fname_whowaslog = NULL;
+	ConfigFileEntry.whowaslog_max_size = 64 * 1024 * 1024;
+	ConfigFileEntry.whowaslog_max_age = 0;
 	ConfigFileEntry.hide_error_messages = 1;
 	ConfigFileEntry.max_targets = MAX_TARGETS_DEFAULT;
 	ConfigFileEntry.max_ratelimit_tokens = 30;
 	ConfigFileEntry.away_interval = 30;
 	ConfigFileEntry.tls_ciphers_oper_only = false;
 	ConfigFileEntry.oper_secure_only = false;
+	ConfigFileEntry.metrics_socket = NULL;
+	ConfigFileEntry.worker_threads = 2;
+	ConfigFileEntry.io_threads = 0;
+	ConfigFileEntry.sendq_budget = 0;
 
 	ConfigFileEntry.oper_umodes = DEFAULT_OPER_UMODES;
 	ConfigFileEntry.oper_only_umodes = UMODE_SERVNOTICE;
@@ -752,6 +769,7 @@ set_default_conf(void)
 	ConfigChannel.no_create_on_split = true;
 	ConfigChannel.disable_local_channels = false;
 	ConfigChannel.displayed_usercount = 3;
+	ConfigChannel.lossy_membership_size = 1000;
 
 	ConfigChannel.autochanmodes = MODE_TOPICLIMIT | MODE_NOPRIVMSGS;
 
@@ -769,6 +787,7 @@ set_default_conf(void)
 	ConfigFileEntry.reject_duration = 120;
 	ConfigFileEntry.throttle_count = 4;
 	ConfigFileEntry.throttle_duration = 60;
+	ConfigFileEntry.throttle_aggregate_factor = 8;
 
 	ConfigFileEntry.client_flood_max_lines = CLIENT_FLOOD_DEFAULT;
 	ConfigFileEntry.client_flood_burst_rate = 5;
@@ -852,6 +871,8 @@ validate_conf(void)
 	if (ConfigFileEntry.sasl_service == NULL)
 		ConfigFileEntry.sasl_service = rb_strdup("SaslServ");
 
+	sendq_total.limit = MAX(ConfigFileEntry.sendq_budget, 0);
+
 	/* RFC 1459 says 1 message per 2 seconds on average and bursts of
 	 * 5 messages are acceptable, so allow at least that.
 	 */
@@ -864,6 +885,10 @@ validate_conf(void)
 		ConfigFileEntry.client_flood_message_time =
 			ConfigFileEntry.client_flood_message_num * 2;
 
+	/* each segment of the whowas log must hold a useful number of records */
+	if(ConfigFileEntry.whowaslog_max_size < 1024 * 1024)
+		ConfigFileEntry.whowaslog_max_size = 1024 * 1024;
+
 	if((ConfigFileEntry.client_flood_max_lines < CLIENT_FLOOD_MIN) ||
 	   (ConfigFileEntry.client_flood_max_lines > CLIENT_FLOOD_MAX))
 		ConfigFileEntry.client_flood_max_lines = CLIENT_FLOOD_MAX;
@@ -1482,6 +1507,8 @@ clear_out_old_conf(void)
 	ConfigFileEntry.sasl_service = NULL;
 	rb_free(ConfigFileEntry.drain_reason);
 	ConfigFileEntry.drain_reason = NULL;
+	rb_free(ConfigFileEntry.metrics_socket);
+	ConfigFileEntry.metrics_socket = NULL;
 	rb_free(ConfigFileEntry.sasl_only_client_message);
 	ConfigFileEntry.sasl_only_client_message = NULL;
 	rb_free(ConfigFileEntry.sctp_forbidden_client_message);
@@ -1524,6 +1551,8 @@ clear_out_old_conf(void)
 	ConfigFileEntry.fname_klinelog = NULL;
 	rb_free(ConfigFileEntry.fname_ioerrorlog);
 	ConfigFileEntry.fname_ioerrorlog = NULL;
+	rb_free(ConfigFileEntry.fname_whowaslog);
+	ConfigFileEntry.fname_whowaslog = NULL;
 
 	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, service_list.head)
 	{
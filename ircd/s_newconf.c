@@ -438,6 +438,9 @@ attach_server_conf(struct Client *client_p, struct server_conf *server_p)
 	CurrUsers(server_p->class)++;
 
 	client_p->localClient->att_sconf = server_p;
+	rb_linebuf_set_account(&client_p->localClient->buf_sendq, &SendqUsage(server_p->class));
+	/* links are never shed, so they are told apart in the accounts */
+	rb_linebuf_set_pinned(&client_p->localClient->buf_sendq, 1);
 	server_p->servers++;
 }
 
@@ -450,6 +453,8 @@ detach_server_conf(struct Client *client_p)
 		return;
 
 	client_p->localClient->att_sconf = NULL;
+	rb_linebuf_set_account(&client_p->localClient->buf_sendq, &sendq_total);
+	rb_linebuf_set_pinned(&client_p->localClient->buf_sendq, 0);
 	server_p->servers--;
 	CurrUsers(server_p->class)--;
 
@@ -107,6 +107,7 @@ uint64_t CLICAP_MESSAGE_TAGS;
 uint64_t CLICAP_BATCH;
 uint64_t CLICAP_NO_IMPLICIT_NAMES;
 uint64_t CLICAP_LABELED_RESPONSE;
+uint64_t CLICAP_LOSSY_MEMBERSHIP;
 
 /*
  * initialize our builtin capability table. --nenolod
@@ -167,6 +168,7 @@ init_builtin_capabs(void)
 	CLICAP_BATCH = capability_put(cli_capindex, "batch", &high_priority);
 	CLICAP_NO_IMPLICIT_NAMES = capability_put(cli_capindex, "no-implicit-names", NULL);
 	CLICAP_LABELED_RESPONSE = capability_put(cli_capindex, "labeled-response", NULL);
+	CLICAP_LOSSY_MEMBERSHIP = capability_put(cli_capindex, "fef.net/lossy-membership", NULL);
 }
 
 static CNCB serv_connect_callback;
@@ -656,8 +658,11 @@ burst_TS6(struct Client *client_p)
 						target_p->user->opername);
 		}
 
-		hclientinfo.target = target_p;
-		call_hook(h_burst_client, &hclientinfo);
+		if (hook_subscribed(h_burst_client))
+		{
+			hclientinfo.target = target_p;
+			call_hook(h_burst_client, &hclientinfo);
+		}
 	}
 
 	RB_DLINK_FOREACH(ptr, global_channel_list.head)
@@ -730,8 +735,11 @@ burst_TS6(struct Client *client_p)
 				   me.id, (long) chptr->channelts, chptr->chname,
 				   EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
 
-		hchaninfo.chptr = chptr;
-		call_hook(h_burst_channel, &hchaninfo);
+		if (hook_subscribed(h_burst_channel))
+		{
+			hchaninfo.chptr = chptr;
+			call_hook(h_burst_channel, &hchaninfo);
+		}
 	}
 
 	hclientinfo.target = NULL;
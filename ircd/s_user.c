@@ -1249,6 +1249,10 @@ user_mode(struct Client *client_p, struct Client *source_p, int parc, const char
 	hdata.oldsnomask = setsnomask;
 	call_hook(h_umode_changed, &hdata);
 
+	snomask_update_subscriptions(source_p);
+	if((setflags ^ source_p->umodes) & UMODE_DEAF)
+		update_member_tables_user(source_p);
+
 	if(!(setflags & UMODE_INVISIBLE) && IsInvisible(source_p))
 		++Count.invisi;
 	if((setflags & UMODE_INVISIBLE) && !IsInvisible(source_p))
@@ -1452,6 +1456,10 @@ oper_up(struct Client *source_p, struct oper_conf *oper_p)
 	hdata.oldsnomask = oldsnomask;
 	call_hook(h_umode_changed, &hdata);
 
+	snomask_update_subscriptions(source_p);
+	if((old ^ source_p->umodes) & UMODE_DEAF)
+		update_member_tables_user(source_p);
+
 	source_p->handler = IsOperGeneral(source_p) ? OPER_HANDLER : CLIENT_HANDLER;
 
 	sendto_realops_snomask(SNO_GENERAL, L_ALL,
@@ -1638,6 +1646,9 @@ change_nick_user_host(struct Client *target_p,	const char *nick, const char *use
 	rb_strlcpy(target_p->name, nick, NICKLEN);
 	add_to_client_hash(target_p->name, target_p);
 
+	/* invalidate_bancache_user() above ran before the new names were in */
+	clear_client_matchset(target_p);
+
 	if(changed)
 	{
 		monitor_signon(target_p);
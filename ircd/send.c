@@ -35,10 +35,12 @@
 #include "s_serv.h"
 #include "s_conf.h"
 #include "s_newconf.h"
+#include "s_stats.h"
 #include "logger.h"
 #include "hook.h"
 #include "monitor.h"
 #include "msgbuf.h"
+#include "snomask.h"
 
 #define CLIENT_CAP_MASK(x)	((x)->from->localClient->client_caps | (IsServerCapable((x)->from, CAP_STAG) ? serv_clicapmask : 0))
 
@@ -46,6 +48,21 @@ static void send_queued_write(rb_fde_t *F, void *data);
 
 unsigned long current_serial = 0L;
 
+/* while nonzero, local sendqs are filled but not written; see send_cork() */
+static unsigned int send_cork_depth;
+
+/* while set, lines sent may be shed from everyone's sendq but this
+ * client's; see send_lossy_begin() */
+static struct Client *send_lossy_source;
+
+/* every local sendq, through its class where it has one */
+buf_account_t sendq_total;
+
+static void shed_sendq(buf_account_t *account, const char *name);
+
+/* set while shed_sendq() runs, so its notice cannot shed again */
+static bool sendq_shedding;
+
 struct Client *remote_rehash_oper_p;
 
 /* send_linebuf()
@@ -91,9 +108,23 @@ send_linebuf(struct Client *to, buf_head_t *linebuf)
 		/* just attach the linebuf to the sendq instead of
 		 * generating a new one
 		 */
+		if(send_lossy_source != NULL)
+			rb_linebuf_set_lossy(linebuf, send_lossy_source);
 		rb_linebuf_attach(&to->localClient->buf_sendq, linebuf);
 	}
 
+	/* servers are not shed, so leave it to the next client line */
+	for(buf_account_t *account = to->localClient->buf_sendq.account;
+			account != NULL && !IsServer(to) && !sendq_shedding; account = account->parent)
+	{
+		if(account->limit != 0 && account->len - account->pinned > account->limit)
+			shed_sendq(account, account == &sendq_total ? "the server" : get_client_class(to));
+	}
+
+	/* shedding may have dropped this client too */
+	if(IsIOError(to))
+		return -1;
+
 	/*
 	 ** Update statistics. The following is slightly incorrect
 	 ** because it counts messages even if queued, but bytes
@@ -101,11 +132,143 @@ send_linebuf(struct Client *to, buf_head_t *linebuf)
 	 */
 	to->localClient->sendM += 1;
 	me.localClient->sendM += 1;
-	if(rb_linebuf_len(&to->localClient->buf_sendq) > 0)
+	if(send_cork_depth == 0 ||
+			rb_linebuf_len(&to->localClient->buf_sendq) > get_sendq(to) / 2)
 		send_queued(to);
 	return 0;
 }
 
+/* sendq_charged()
+ *
+ * inputs	- local client, sendq account
+ * outputs	- whether the client's sendq counts towards the account
+ */
+static bool
+sendq_charged(struct Client *client_p, buf_account_t *account)
+{
+	for(buf_account_t *a = client_p->localClient->buf_sendq.account; a != NULL; a = a->parent)
+	{
+		if(a == account)
+			return true;
+	}
+
+	return false;
+}
+
+struct sendq_victim
+{
+	struct Client *client_p;
+	size_t len;
+};
+
+static int
+sendq_victim_cmp(const void *a, const void *b)
+{
+	const struct sendq_victim *va = a, *vb = b;
+
+	return (va->len < vb->len) - (va->len > vb->len);
+}
+
+/* shed_sendq()
+ *
+ * inputs	- sendq account over its limit, what to call it
+ * outputs	-
+ * side effects - brings what clients hold of the account down to 7/8
+ *		  of its limit, so this does not run again for every line.
+ *		  First the lossy lines (JOIN and PART in big channels) go
+ *		  from the sendqs of clients that asked for them to be
+ *		  dropped; then the clients with the biggest sendqs are
+ *		  dropped.  Servers are never touched here, and what they
+ *		  hold (the pinned part of the account) is not made up for
+ *		  by clients; they only have their own sendq limit.
+ */
+static void
+shed_sendq(buf_account_t *account, const char *name)
+{
+	static time_t last_notice;
+	size_t goal = account->limit - account->limit / 8 + account->pinned;
+	size_t before = account->len;
+	size_t shed;
+	unsigned int dropped = 0;
+	rb_dlink_list *lists[] = { &lclient_list, &unknown_list };
+	struct sendq_victim *victims;
+	size_t count = 0;
+	rb_dlink_node *ptr;
+
+	/* over only because of the links */
+	if(account->len - account->pinned <= account->limit)
+		return;
+
+	sendq_shedding = true;
+
+	RB_DLINK_FOREACH(ptr, lclient_list.head)
+	{
+		struct Client *target_p = ptr->data;
+
+		if(account->len <= goal)
+			break;
+
+		if(IsIOError(target_p) || !IsClientCapable(target_p, CLICAP_LOSSY_MEMBERSHIP) ||
+				!sendq_charged(target_p, account))
+			continue;
+
+		rb_linebuf_shed(&target_p->localClient->buf_sendq, target_p,
+				(int)MIN(account->len - goal, INT_MAX));
+	}
+
+	shed = before - account->len;
+
+	if(account->len > goal)
+	{
+		victims = rb_malloc(sizeof(*victims) *
+				(rb_dlink_list_length(&lclient_list) + rb_dlink_list_length(&unknown_list)));
+
+		for(size_t i = 0; i < ARRAY_SIZE(lists); i++)
+		{
+			RB_DLINK_FOREACH(ptr, lists[i]->head)
+			{
+				struct Client *target_p = ptr->data;
+				size_t len = rb_linebuf_len(&target_p->localClient->buf_sendq);
+
+				if(len == 0 || IsIOError(target_p) || IsAnyServer(target_p) ||
+						!sendq_charged(target_p, account))
+					continue;
+
+				victims[count].client_p = target_p;
+				victims[count].len = len;
+				count++;
+			}
+		}
+
+		qsort(victims, count, sizeof(*victims), sendq_victim_cmp);
+
+		for(size_t i = 0; i < count && account->len > goal; i++)
+		{
+			struct Client *target_p = victims[i].client_p;
+
+			/* nothing more is written to it, so free its sendq now
+			 * rather than when it is exited */
+			dead_link(target_p, 1);
+			rb_linebuf_donebuf(&target_p->localClient->buf_sendq);
+			dropped++;
+		}
+
+		rb_free(victims);
+	}
+
+	if(last_notice + 10 <= rb_current_time())
+	{
+		last_notice = rb_current_time();
+		sendto_realops_snomask(SNO_GENERAL, L_ALL,
+				     "SendQ budget for %s exceeded: shed %zu bytes of channel membership lines, dropped %u clients",
+				     name, shed, dropped);
+	}
+	ilog(L_MAIN, "SendQ budget for %s exceeded: shed %zu bytes of channel membership lines, dropped %u clients",
+	     name, shed, dropped);
+
+	sendq_shedding = false;
+}
+
 /* send_msgbuf()
  *
  * inputs - client to send to, msgbuf
@@ -152,11 +315,14 @@ send_queued(struct Client *to)
 
 	if(rb_linebuf_len(&to->localClient->buf_sendq))
 	{
+		int flushed = 0;
+
 		while ((retlen =
 			rb_linebuf_flush(F, &to->localClient->buf_sendq)) > 0)
 		{
 			/* We have some data written .. update counters */
 			ClearFlush(to);
+			flushed += retlen;
 
 			to->localClient->sendB += retlen;
 			me.localClient->sendB += retlen;
@@ -172,6 +338,9 @@ send_queued(struct Client *to)
 			}
 		}
 
+		if(flushed > 0)
+			rb_hist_add(&ServerStats.is_sqflush, flushed);
+
 		if(retlen == 0 || (retlen < 0 && !rb_ignore_errno(errno)))
 		{
 			dead_link(to, 0);
@@ -200,6 +369,78 @@ send_pop_queue(struct Client *to)
 		send_queued(to);
 }
 
+/* send_cork()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - until the matching send_uncork(), messages to local
+ *		  clients are queued without being written, so a burst of
+ *		  them (such as the QUITs of a netsplit) goes out in a few
+ *		  writes per client rather than one per line.  A client is
+ *		  still flushed early once its sendq is half full.
+ */
+void
+send_cork(void)
+{
+	send_cork_depth++;
+}
+
+static void
+send_uncork_list(rb_dlink_list *list)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head)
+	{
+		struct Client *target_p = ptr->data;
+
+		if(!IsIOError(target_p) && rb_linebuf_len(&target_p->localClient->buf_sendq) > 0)
+			send_queued(target_p);
+	}
+}
+
+/* send_lossy_begin()
+ *
+ * inputs	- client whose JOIN or PART is about to be sent, channel
+ * outputs	-
+ * side effects - if the channel is big enough, until send_lossy_end()
+ *		  the lines sent may be shed from the sendqs of clients
+ *		  with the lossy-membership capability when sendq memory
+ *		  runs short.  The client's own copy is always kept.
+ */
+void
+send_lossy_begin(struct Client *source_p, struct Channel *chptr)
+{
+	if(ConfigChannel.lossy_membership_size > 0 &&
+			rb_dlink_list_length(&chptr->members) >= (unsigned long)ConfigChannel.lossy_membership_size)
+		send_lossy_source = source_p;
+}
+
+void
+send_lossy_end(void)
+{
+	send_lossy_source = NULL;
+}
+
+/* send_uncork()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - ends a send_cork(); if it was the outermost one, every
+ *		  local client and server with anything queued is flushed
+ */
+void
+send_uncork(void)
+{
+	s_assert(send_cork_depth > 0);
+	if(send_cork_depth == 0 || --send_cork_depth > 0)
+		return;
+
+	send_uncork_list(&lclient_list);
+	send_uncork_list(&serv_list);
+	send_uncork_list(&unknown_list);
+}
+
 /* send_queued_write()
  *
  * inputs	- fd to have queue sent, client we're sending to
@@ -282,13 +523,16 @@ build_msgbuf(struct MsgBuf *msgbuf, struct Client *from,
 			msgbuf_append_tag(msgbuf, tags[i].key, tags[i].value, tags[i].capmask);
 	}
 
-	hdata.source = from;
-	hdata.msgbuf = msgbuf;
-	hdata.target = target;
-	hdata.chptr = chptr;
-	hdata.source_sees_message = source_sees_message;
+	if (hook_subscribed(h_outbound_msgbuf))
+	{
+		hdata.source = from;
+		hdata.msgbuf = msgbuf;
+		hdata.target = target;
+		hdata.chptr = chptr;
+		hdata.source_sees_message = source_sees_message;
 
-	call_hook(h_outbound_msgbuf, &hdata);
+		call_hook(h_outbound_msgbuf, &hdata);
+	}
 
 	/* avoid duplicating params when unparsing */
 	msgbuf->cmd = NULL;
@@ -578,6 +822,76 @@ sendto_server_tags(struct Client *one, struct Channel *chptr, uint64_t caps,
 	va_end(args);
 }
 
+/* member_table_next()
+ *
+ * inputs	- member table, position to start from, channel flags
+ *			  needed, member table flags that exclude a member
+ * outputs	- position of the next member with one of the flags needed
+ *			  (any member if type is 0) and none of the excluding
+ *			  ones, or mt->count if there is none
+ * side effects -
+ */
+static inline unsigned int
+member_table_next(const struct member_table *mt, unsigned int i, int type, uint8_t skip)
+{
+	const uint8_t *flags = mt->flags;
+	const uint64_t want = (uint64_t)(type & 0xff) * UINT64_C(0x0101010101010101);
+
+	for (; i < mt->count; i++)
+	{
+		/* test eight members at once when only a few hold the flags */
+		if (type != 0 && (i & 7) == 0 && i + 8 <= mt->count)
+		{
+			uint64_t word;
+
+			memcpy(&word, &flags[i], sizeof word);
+			if ((word & want) == 0)
+			{
+				i += 7;
+				continue;
+			}
+		}
+
+		if ((flags[i] & skip) == 0 && (type == 0 || (flags[i] & type) != 0))
+			return i;
+	}
+
+	return mt->count;
+}
+
+/* chlink_wants()
+ *
+ * inputs	- channel
+ *			- server link entry of the channel
+ *			- channel flags needed
+ *			- client not to send to
+ * outputs	- true if a member behind the link should see the message
+ * side effects -
+ */
+static bool
+chlink_wants(struct Channel *chptr, struct chlink *link, int type, struct Client *one)
+{
+	struct membership *msptr;
+	unsigned int hearing = 0;
+
+	for (int flags = 0; flags < 4; flags++)
+	{
+		if (type == 0 || (flags & type) != 0)
+			hearing += link->hearing[flags];
+	}
+
+	if (hearing != 1)
+		return hearing != 0;
+
+	/* the only member left may be the one not to send to */
+	if (one == NULL || one->from != link->server_p ||
+			(msptr = find_channel_membership(chptr, one)) == NULL)
+		return true;
+
+	return (msptr->linkflags & MEMBER_DEAF) != 0 ||
+		(type != 0 && (msptr->linkflags & type) == 0);
+}
+
 /* sendto_channel_flags_internal()
  *
  * inputs	- server not to send to
@@ -601,18 +915,19 @@ sendto_channel_flags_internal(struct Client *one, int type, struct Client *sourc
 	char local_source[USERHOST_REPLYLEN];
 	struct Client *target_p;
 	struct membership *msptr;
+	const struct member_table *mt = &chptr->localtable;
 	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
 	struct MsgBuf msgbuf;
 	struct MsgBuf_cache msgbuf_cache;
 
-	current_serial++;
-
 	snprintf(local_source, sizeof(local_source), IsPerson(source_p) ? "%s!%s@%s" : "%s",
 		source_p->name, source_p->username, source_p->host);
 
 	rb_fsnprint(buf, sizeof(buf), strings);
 
+	/* look the privilege up once rather than per recipient */
+	PrivilegeId priv_id = priv != NULL ? privilege_find(priv) : 0;
+
 	bool receives_message = false;
 	if (MyClient(source_p))
 	{
@@ -624,7 +939,7 @@ sendto_channel_flags_internal(struct Client *one, int type, struct Client *sourc
 				&& !IsDeaf(source_p)
 				&& IsClientCapable(source_p, cli_cap)
 				&& NotClientCapable(source_p, cli_negcap)
-				&& (priv == NULL || HasPrivilege(source_p, priv));
+				&& (priv == NULL || HasPrivilegeId(source_p, priv_id));
 		}
 	}
 
@@ -632,44 +947,40 @@ sendto_channel_flags_internal(struct Client *one, int type, struct Client *sourc
 
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, local_source, use_id(source_p));
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->members.head)
+	for (unsigned int i = member_table_next(mt, 0, type, MEMBER_DEAF); i < mt->count;
+			i = member_table_next(mt, i + 1, type, MEMBER_DEAF))
 	{
-		msptr = ptr->data;
-		target_p = msptr->client_p;
+		target_p = mt->client[i];
 
-		if (!MyClient(source_p) && (IsIOError(target_p->from) || target_p->from == one))
+		if (IsIOError(target_p) || target_p == one)
 			continue;
 
-		if (MyClient(source_p) && (IsIOError(target_p) || target_p == one))
-			continue;
+		if (IsClientCapable(target_p, cli_cap) && NotClientCapable(target_p, cli_negcap) && (priv == NULL || HasPrivilegeId(target_p, priv_id)))
+			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAP_MASK(target_p), false));
+	}
+
+	RB_DLINK_FOREACH(ptr, chptr->links.head)
+	{
+		struct chlink *link = ptr->data;
 
-		if (type && (msptr->flags & type) == 0)
+		target_p = link->server_p;
+
+		if (!MyClient(source_p) && (IsIOError(target_p) || target_p == one))
 			continue;
 
-		if (IsDeaf(target_p))
+		/* if we've got a specific type, target must support
+		 * CHW.. --fl
+		 */
+		if (type && NotServerCapable(target_p, CAP_CHW))
 			continue;
 
-		if (!MyClient(target_p))
-		{
-			/* if we've got a specific type, target must support
-			 * CHW.. --fl
-			 */
-			if(type && NotServerCapable(target_p->from, CAP_CHW))
-				continue;
+		if (!IsServerCapable(target_p, serv_cap) || !NotServerCapable(target_p, serv_negcap))
+			continue;
 
-			if (!IsServerCapable(target_p->from, serv_cap) || !NotServerCapable(target_p->from, serv_negcap))
-				continue;
+		if (!chlink_wants(chptr, link, type, one))
+			continue;
 
-			if (target_p->from->serial != current_serial)
-			{
-				send_linebuf(target_p->from, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAP_MASK(target_p), true));
-				target_p->from->serial = current_serial;
-			}
-		}
-		else if (IsClientCapable(target_p, cli_cap) && NotClientCapable(target_p, cli_negcap) && (priv == NULL || HasPrivilege(target_p, priv)))
-		{
-			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAP_MASK(target_p), false));
-		}
+		send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAP_MASK(target_p), true));
 	}
 
 	/* source client may not be on the channel, send echo separately */
@@ -736,8 +1047,8 @@ sendto_channel_opmod_internal(struct Client *one, struct Client *source_p, struc
 	char chbuf[CHANNELLEN + 2];
 	struct Client *target_p;
 	struct membership *msptr;
+	const struct member_table *mt = &chptr->localtable;
 	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
 	struct MsgBuf msgbuf_statusmsg;
 	struct MsgBuf msgbuf_eopmod;
 	struct MsgBuf msgbuf_old;
@@ -782,43 +1093,39 @@ sendto_channel_opmod_internal(struct Client *one, struct Client *source_p, struc
 	msgbuf_partial_parse(&msgbuf_old, buf);
 	msgbuf_cache_init(&msgbuf_cache_old, &msgbuf_old, NULL, NULL);
 
-	current_serial++;
-
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->members.head)
+	for (unsigned int i = member_table_next(mt, 0, CHFL_CHANOP, MEMBER_DEAF); i < mt->count;
+			i = member_table_next(mt, i + 1, CHFL_CHANOP, MEMBER_DEAF))
 	{
-		msptr = ptr->data;
-		target_p = msptr->client_p;
+		target_p = mt->client[i];
 
-		if (!MyClient(source_p) && (IsIOError(target_p->from) || target_p->from == one))
+		if ((!MyClient(source_p) && IsIOError(target_p)) || target_p == one)
 			continue;
 
-		if (MyClient(source_p) && target_p == one)
-			continue;
+		if (IsClientCapable(target_p, cli_cap) && NotClientCapable(target_p, cli_negcap))
+			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache_statusmsg, CLIENT_CAP_MASK(target_p), false));
+	}
+
+	RB_DLINK_FOREACH(ptr, chptr->links.head)
+	{
+		struct chlink *link = ptr->data;
+
+		target_p = link->server_p;
 
-		if ((msptr->flags & CHFL_CHANOP) == 0)
+		if (!MyClient(source_p) && (IsIOError(target_p) || target_p == one))
 			continue;
 
-		if (IsDeaf(target_p))
+		if (!IsServerCapable(target_p, serv_cap) || !NotServerCapable(target_p, serv_negcap))
 			continue;
 
-		if (!MyClient(target_p))
-		{
-			if (!IsServerCapable(target_p->from, serv_cap) || !NotServerCapable(target_p->from, serv_negcap))
-				continue;
+		if (!chlink_wants(chptr, link, CHFL_CHANOP, one))
+			continue;
 
-			if(target_p->from->serial != current_serial)
-			{
-				if (IsServerCapable(target_p->from, CAP_EOPMOD))
-					send_linebuf(target_p->from, msgbuf_cache_get(&msgbuf_cache_eopmod, CLIENT_CAP_MASK(target_p), true));
-				else if (chptr->mode.mode & MODE_MODERATED)
-					send_linebuf(target_p->from, msgbuf_cache_get(&msgbuf_cache_statusmsg, CLIENT_CAP_MASK(target_p), true));
-				else
-					send_linebuf(target_p->from, msgbuf_cache_get(&msgbuf_cache_old, CLIENT_CAP_MASK(target_p), true));
-				target_p->from->serial = current_serial;
-			}
-		} else if (IsClientCapable(target_p, cli_cap) && NotClientCapable(target_p, cli_negcap)) {
-			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache_statusmsg, CLIENT_CAP_MASK(target_p), false));
-		}
+		if (IsServerCapable(target_p, CAP_EOPMOD))
+			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache_eopmod, CLIENT_CAP_MASK(target_p), true));
+		else if (chptr->mode.mode & MODE_MODERATED)
+			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache_statusmsg, CLIENT_CAP_MASK(target_p), true));
+		else
+			send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache_old, CLIENT_CAP_MASK(target_p), true));
 	}
 
 	/* source client may not be on the channel, send echo separately */
@@ -873,9 +1180,8 @@ sendto_channel_local_internal(struct Client *one, int type, struct Client *sourc
 {
 	char buf[DATALEN + 1];
 	struct membership *msptr;
+	const struct member_table *mt = &chptr->localtable;
 	struct Client *target_p;
-	rb_dlink_node *ptr;
-	rb_dlink_node *next_ptr;
 	struct MsgBuf msgbuf;
 	struct MsgBuf_cache msgbuf_cache;
 	rb_strf_t strings = { .format = pattern, .format_args = args, .next = NULL };
@@ -886,6 +1192,8 @@ sendto_channel_local_internal(struct Client *one, int type, struct Client *sourc
 	if (source_p == NULL)
 		source_p = &me;
 
+	PrivilegeId priv_id = priv != NULL ? privilege_find(priv) : 0;
+
 	bool receives_message = false;
 	if (MyClient(source_p) && (msptr = find_channel_membership(chptr, source_p)) != NULL)
 	{
@@ -893,7 +1201,7 @@ sendto_channel_local_internal(struct Client *one, int type, struct Client *sourc
 			&& (!type || (msptr->flags & type) != 0)
 			&& IsClientCapable(source_p, caps)
 			&& NotClientCapable(source_p, negcaps)
-			&& (priv == NULL || HasPrivilege(source_p, priv));
+			&& (priv == NULL || HasPrivilegeId(source_p, priv_id));
 	}
 
 	build_msgbuf(&msgbuf, source_p, NULL, chptr, receives_message, buf, n_tags, tags);
@@ -901,10 +1209,10 @@ sendto_channel_local_internal(struct Client *one, int type, struct Client *sourc
 	/* source is already provided as part of pattern; don't overwrite it with anything else */
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, NULL, NULL);
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->locmembers.head)
+	for (unsigned int i = member_table_next(mt, 0, type, 0); i < mt->count;
+			i = member_table_next(mt, i + 1, type, 0))
 	{
-		msptr = ptr->data;
-		target_p = msptr->client_p;
+		target_p = mt->client[i];
 
 		if (target_p == one)
 			continue;
@@ -912,13 +1220,10 @@ sendto_channel_local_internal(struct Client *one, int type, struct Client *sourc
 		if (IsIOError(target_p))
 			continue;
 
-		if (type && (msptr->flags & type) == 0)
-			continue;
-
 		if (!IsClientCapable(target_p, caps) || !NotClientCapable(target_p, negcaps))
 			continue;
 
-		if (priv != NULL && !HasPrivilege(target_p, priv))
+		if (priv != NULL && !HasPrivilegeId(target_p, priv_id))
 			continue;
 
 		send_linebuf(target_p, msgbuf_cache_get(&msgbuf_cache, CLIENT_CAP_MASK(target_p), false));
@@ -1630,6 +1935,22 @@ sendto_anywhere_tags(struct Client *target_p, struct Client *source_p, const cha
 	va_end(args);
 }
 
+/* snomask_recipients()
+ *
+ * inputs	- snomask bits of a notice
+ * output	- list of local opers to consider for it
+ * side effects -
+ */
+static rb_dlink_list *
+snomask_recipients(unsigned int flags)
+{
+	/* a single bit has its own subscriber list */
+	if (flags != 0 && (flags & (flags - 1)) == 0)
+		return &snomask_bits[ffs(flags) - 1].subscribers;
+
+	return &local_oper_list;
+}
+
 /* sendto_realops_snomask()
  *
  * inputs	- snomask needed, level (opers/admin), va_args
@@ -1650,6 +1971,14 @@ sendto_realops_snomask(int flags, int level, const char *pattern, ...)
 	char buf[DATALEN + 1];
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
+	/* nobody here wants it and it goes nowhere else, don't even format it */
+	if (!SnomaskSubscribed(flags) && !(level & L_NETWIDE) && remote_rehash_oper_p == NULL)
+	{
+		snomask_count(flags, false);
+		return;
+	}
+	snomask_count(flags, SnomaskSubscribed(flags));
+
 	/* rather a lot of copying around, oh well -- jilles */
 	va_start(args, pattern);
 	size_t used = snprintf(buf, sizeof(buf), ":%s NOTICE * :*** Notice -- ", me.name);
@@ -1678,7 +2007,7 @@ sendto_realops_snomask(int flags, int level, const char *pattern, ...)
 	}
 	level &= ~L_NETWIDE;
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, local_oper_list.head)
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, snomask_recipients(flags)->head)
 	{
 		client_p = ptr->data;
 
@@ -1715,6 +2044,10 @@ sendto_realops_snomask_from(int flags, int level, struct Client *source_p,
 	char buf[DATALEN + 1];
 	rb_strf_t strings = { .format = pattern, .format_args = &args, .next = NULL };
 
+	snomask_count(flags, SnomaskSubscribed(flags));
+	if (!SnomaskSubscribed(flags))
+		return;
+
 	va_start(args, pattern);
 	int used = snprintf(buf, sizeof(buf), ":%s NOTICE * :*** Notice -- ", source_p->name);
 	rb_fsnprint(buf + used, sizeof(buf) - used, &strings);
@@ -1731,7 +2064,7 @@ sendto_realops_snomask_from(int flags, int level, struct Client *source_p,
 	build_msgbuf(&msgbuf, source_p, NULL, NULL, receives_message, buf, 0, NULL);
 	msgbuf_cache_init(&msgbuf_cache, &msgbuf, NULL, NULL);
 
-	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, local_oper_list.head)
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, snomask_recipients(flags)->head)
 	{
 		client_p = ptr->data;
 
@@ -109,6 +109,9 @@ int snomask_modes[256] = {
 
 static char snobuf[BUFSIZE];
 
+struct snomask_bit snomask_bits[SNO_BITS];
+unsigned int snomask_subscribed;	/* bits with at least one subscriber */
+
 /*
  * construct_snobuf
  *
@@ -195,3 +198,84 @@ find_snomask_slot(void)
 	return my_umode;
 }
 
+
+static void
+snomask_subscribe(struct Client *client_p, unsigned int want)
+{
+	unsigned int changed = want ^ client_p->localClient->sno_subscribed;
+	int i;
+
+	for (i = 0; changed != 0; i++, changed >>= 1)
+	{
+		struct snomask_bit *bit = &snomask_bits[i];
+
+		if (!(changed & 1))
+			continue;
+
+		if (want & (1U << i))
+			rb_dlinkAddAlloc(client_p, &bit->subscribers);
+		else
+			rb_dlinkFindDestroy(client_p, &bit->subscribers);
+
+		if (rb_dlink_list_length(&bit->subscribers) != 0)
+			snomask_subscribed |= 1U << i;
+		else
+			snomask_subscribed &= ~(1U << i);
+	}
+
+	client_p->localClient->sno_subscribed = want;
+}
+
+/*
+ * snomask_update_subscriptions
+ *
+ * inputs       - client whose snomask or oper status may have changed
+ * outputs      - NONE
+ * side effects - the client is added to or removed from the subscriber
+ *                lists so they match its snomask; only local opers
+ *                receive server notices, so nobody else subscribes
+ */
+void
+snomask_update_subscriptions(struct Client *client_p)
+{
+	if (MyConnect(client_p))
+		snomask_subscribe(client_p, IsOper(client_p) ? client_p->snomask : 0);
+}
+
+/*
+ * snomask_unsubscribe
+ *
+ * inputs       - exiting local client
+ * outputs      - NONE
+ * side effects - the client is removed from all subscriber lists
+ */
+void
+snomask_unsubscribe(struct Client *client_p)
+{
+	if (MyConnect(client_p))
+		snomask_subscribe(client_p, 0);
+}
+
+/*
+ * snomask_count
+ *
+ * inputs       - snomask bits of a notice, whether anyone was sent it
+ * outputs      - NONE
+ * side effects - per-snomask notice counters are updated
+ */
+void
+snomask_count(unsigned int flags, bool sent)
+{
+	int i;
+
+	for (i = 0; flags != 0; i++, flags >>= 1)
+	{
+		if (!(flags & 1))
+			continue;
+
+		if (sent)
+			snomask_bits[i].sent++;
+		else
+			snomask_bits[i].skipped++;
+	}
+}
@@ -842,6 +842,89 @@ ssld_foreach_info(void (*func)(void *data, pid_t pid, int cli_count, enum ssld_s
 	}
 }
 
+/* ssld_foreach_upgrade()
+ *
+ * Calls func for each ssld helper still in use, with the descriptors
+ * that have to survive a server upgrade for ssld_adopt() to take the
+ * helper back.
+ */
+void
+ssld_foreach_upgrade(void (*func)(void *data, pid_t pid, int ctlfd, int pipefd, bool shutdown, const char *version), void *data)
+{
+	rb_dlink_node *ptr;
+	ssl_ctl_t *ctl;
+	RB_DLINK_FOREACH(ptr, ssl_daemons.head)
+	{
+		ctl = ptr->data;
+		if(ctl->dead)
+			continue;
+		func(data, ctl->pid, rb_get_fd(ctl->F), rb_get_fd(ctl->P), ctl->shutdown, ctl->version);
+	}
+}
+
+/* ssld_adopt()
+ *
+ * Takes back an ssld helper started before a server upgrade, whose
+ * control socket and pipe were kept across exec.
+ */
+ssl_ctl_t *
+ssld_adopt(pid_t pid, int ctlfd, int pipefd, bool shutdown, const char *version)
+{
+	rb_fde_t *F, *P;
+	ssl_ctl_t *ctl;
+
+	F = rb_open(ctlfd, RB_FD_SOCKET, "SSL/TLS handle passing socket");
+	P = rb_open(pipefd, RB_FD_PIPE, "SSL/TLS pipe");
+	if(F == NULL || P == NULL)
+	{
+		rb_close(F);
+		rb_close(P);
+		return NULL;
+	}
+	rb_set_nb(F);
+	rb_set_nb(P);
+
+	ctl = allocate_ssl_daemon(F, P, pid);
+	rb_strlcpy(ctl->version, version, sizeof(ctl->version));
+	if(shutdown)
+	{
+		ctl->shutdown = 1;
+		ssld_count--;
+	}
+	/* adopted early in startup; nothing is read before the event loop runs */
+	rb_setselect(ctl->F, RB_SELECT_READ, ssl_read_ctl, ctl);
+	rb_setselect(ctl->P, RB_SELECT_READ, ssl_do_pipe, ctl);
+	return ctl;
+}
+
+/* ssld_attach_pid()
+ *
+ * Finds an adopted ssld helper by pid for a client carried over an
+ * upgrade, and counts the client against it.
+ */
+ssl_ctl_t *
+ssld_attach_pid(pid_t pid)
+{
+	rb_dlink_node *ptr;
+	ssl_ctl_t *ctl;
+	RB_DLINK_FOREACH(ptr, ssl_daemons.head)
+	{
+		ctl = ptr->data;
+		if(ctl->pid == pid && !ctl->dead)
+		{
+			ctl->cli_count++;
+			return ctl;
+		}
+	}
+	return NULL;
+}
+
+pid_t
+ssld_get_pid(ssl_ctl_t *ctl)
+{
+	return ctl->pid;
+}
+
 void
 init_ssld(void)
 {
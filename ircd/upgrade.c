@@ -0,0 +1,876 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  upgrade.c: Re-executing the server without dropping local clients.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * An upgrade writes the state of every registered local client and of
+ * the channels they are on to a file, keeps the client sockets and the
+ * ssld control sockets open across execv(), and lets the new binary
+ * rebuild the same clients on the same sockets.  Clients see nothing but
+ * a netsplit: server links are dropped before the exec and come back
+ * through the usual autoconnect and burst.
+ *
+ * The state file is line based:
+ *
+ *   FEFUPGRADE <version>
+ *   ME <sid> <last uid> <max local> <max global> <total clients>
+ *   SSLD <pid> <ctl fd> <pipe fd> <shutdown> :<version>
+ *   CLIENT <uid> <nick> <user> <host> <orighost> <sockhost> <ip> <ts> <fd>
+ *          <ssld pid> <umodes> <flags> <localflags> <firsttime> :<realname>
+ *     CONNID, SNOMASK, ACCOUNT, CERTFP, CIPHER, MANGLED, AWAY, OPER, CAPS,
+ *     MONITOR, SENDQ, RECVQ, OVERLONG lines for the client above
+ *   ACCEPT <uid> <uid>
+ *   CHANNEL <name> <ts> <modes> <limit> <join num> <join time> <forward> :<key>
+ *     TOPIC, MLOCK, BAN, MEMBER lines for the channel above
+ *   END
+ *
+ * The last field of a line takes the rest of it, and is written after a
+ * ':' whenever it may contain spaces or start with one.
+ */
+
+#include "stdinc.h"
+#include "upgrade.h"
+#include "channel.h"
+#include "chmode.h"
+#include "client.h"
+#include "hash.h"
+#include "hostmask.h"
+#include "ircd.h"
+#include "logger.h"
+#include "monitor.h"
+#include "msg.h"
+#include "packet.h"
+#include "privilege.h"
+#include "restart.h"
+#include "s_conf.h"
+#include "s_newconf.h"
+#include "s_serv.h"
+#include "s_user.h"
+#include "send.h"
+#include "snomask.h"
+#include "sslproc.h"
+#include "whowas.h"
+
+#define UPGRADE_VERSION		1
+#define UPGRADE_RECVQ_CHUNK	4096
+#define UPGRADE_LINELEN		(UPGRADE_RECVQ_CHUNK * 2 + 64)
+#define UPGRADE_MAXPARA		15
+
+/* client flags that describe the user rather than the connection's state */
+#define UPGRADE_FLAGS	(FLAGS_FLOODDONE | FLAGS_SERVICE | FLAGS_TGCHANGE | \
+			 FLAGS_DYNSPOOF | FLAGS_EXTENDCHANS | FLAGS_EXEMPTRESV | \
+			 FLAGS_EXEMPTKLINE | FLAGS_EXEMPTFLOOD | FLAGS_IP_SPOOFING | \
+			 FLAGS_EXEMPTSPAMBOT | FLAGS_EXEMPTSHIDE | FLAGS_EXEMPTJUPE | \
+			 FLAGS_IDENTIFIED)
+#define UPGRADE_LFLAGS	(LFLAGS_SSL | LFLAGS_SCTP | LFLAGS_SECURE)
+
+#define UPGRADE_QUIT	"Server upgrading, please reconnect"
+
+struct upgrade_save
+{
+	FILE *f;
+	char *keep;		/* descriptors to carry across exec */
+};
+
+static rb_dlink_list upgrade_lines;	/* the state file, read by upgrade_init() */
+
+/* split the fields after a line's keyword; the max'th takes the rest */
+static int
+upgrade_split(char *line, char *parv[], int max)
+{
+	int parc = 0;
+
+	while(line != NULL && parc < max - 1)
+	{
+		parv[parc++] = line;
+		if((line = strchr(line, ' ')) != NULL)
+			*line++ = '\0';
+	}
+
+	if(line != NULL)
+	{
+		if(*line == ':')
+			line++;
+		parv[parc++] = line;
+	}
+
+	return parc;
+}
+
+static const char *
+umode_letters(unsigned int umodes)
+{
+	static char buf[128];
+	char *p = buf;
+
+	*p++ = '+';
+	for(int i = 0; i < 128; i++)
+		if(user_modes[i] && (umodes & user_modes[i]))
+			*p++ = (char) i;
+	*p = '\0';
+
+	return buf;
+}
+
+static void
+keep_fd(struct upgrade_save *save, int fd)
+{
+	if(fd >= 0 && fd < maxconnections)
+		save->keep[fd] = 1;
+}
+
+static void
+save_ssld(void *data, pid_t pid, int ctlfd, int pipefd, bool shutdown, const char *version)
+{
+	struct upgrade_save *save = data;
+
+	fprintf(save->f, "SSLD %ld %d %d %d :%s\n", (long) pid, ctlfd, pipefd, shutdown ? 1 : 0, version);
+	keep_fd(save, ctlfd);
+	keep_fd(save, pipefd);
+}
+
+static void
+save_recvq(FILE *f, const char *buf, size_t size)
+{
+	for(size_t i = 0; i < size; i += UPGRADE_RECVQ_CHUNK)
+	{
+		size_t len = size - i;
+
+		if(len > UPGRADE_RECVQ_CHUNK)
+			len = UPGRADE_RECVQ_CHUNK;
+
+		fputs("RECVQ ", f);
+		for(size_t j = 0; j < len; j++)
+			fprintf(f, "%02x", (unsigned char) buf[i + j]);
+		fputc('\n', f);
+	}
+}
+
+static void
+save_client(struct upgrade_save *save, struct Client *client_p)
+{
+	struct LocalUser *lc = client_p->localClient;
+	struct recvq *rq = &lc->recvq;
+	FILE *f = save->f;
+	char ipaddr[HOSTIPLEN + 1];
+	rb_dlink_node *ptr;
+	int ofs;
+
+	rb_inet_ntop_sock((struct sockaddr *)&lc->ip, ipaddr, sizeof(ipaddr));
+
+	fprintf(f, "CLIENT %s %s %s %s %s %s %s %ld %d %ld %s %llx %lx %ld :%s\n",
+		client_p->id, client_p->name, client_p->username, client_p->host,
+		client_p->orighost, client_p->sockhost, ipaddr, (long) client_p->tsinfo,
+		rb_get_fd(lc->F), lc->ssl_ctl != NULL ? (long) ssld_get_pid(lc->ssl_ctl) : 0L,
+		umode_letters(client_p->umodes),
+		(unsigned long long) (client_p->flags & UPGRADE_FLAGS),
+		(unsigned long) (lc->localflags & UPGRADE_LFLAGS),
+		(long) lc->firsttime, client_p->info);
+	keep_fd(save, rb_get_fd(lc->F));
+
+	RB_DLINK_FOREACH(ptr, lc->connids.head)
+		fprintf(f, "CONNID %u\n", RB_POINTER_TO_UINT(ptr->data));
+
+	if(client_p->snomask)
+		fprintf(f, "SNOMASK %s\n", construct_snobuf(client_p->snomask));
+	if(*client_p->user->suser)
+		fprintf(f, "ACCOUNT %s\n", client_p->user->suser);
+	if(client_p->certfp != NULL)
+		fprintf(f, "CERTFP %s\n", client_p->certfp);
+	if(lc->cipher_string != NULL)
+		fprintf(f, "CIPHER :%s\n", lc->cipher_string);
+	if(lc->mangledhost != NULL)
+		fprintf(f, "MANGLED :%s\n", lc->mangledhost);
+	if(client_p->user->away != NULL)
+		fprintf(f, "AWAY :%s\n", client_p->user->away);
+	if(client_p->user->opername != NULL && client_p->user->privset != NULL)
+		fprintf(f, "OPER %s %s\n", client_p->user->opername, client_p->user->privset->name);
+	if(lc->client_caps)
+		fprintf(f, "CAPS :%s\n", capability_index_list(cli_capindex, lc->client_caps));
+
+	RB_DLINK_FOREACH(ptr, lc->monitor_list.head)
+		fprintf(f, "MONITOR %s\n", ((struct monitor *)ptr->data)->name);
+
+	/* whatever could not be written yet, resuming mid-line */
+	ofs = lc->buf_sendq.writeofs;
+	RB_DLINK_FOREACH(ptr, lc->buf_sendq.list.head)
+	{
+		buf_line_t *line = ptr->data;
+		int len = line->len - ofs;
+
+		while(len > 0 && (line->buf[ofs + len - 1] == '\r' || line->buf[ofs + len - 1] == '\n'))
+			len--;
+		if(len > 0)
+			fprintf(f, "SENDQ :%.*s\n", len, line->buf + ofs);
+		ofs = 0;
+	}
+
+	if(rq->buf != NULL)
+		save_recvq(f, rq->buf + rq->start, rq->end - rq->start);
+
+	/* this is where the recvq has been scanned up to, so it goes
+	 * before anything not yet scanned */
+	if(rq->overlong)
+		fputs("OVERLONG\n", f);
+
+	/* and whatever an I/O thread has read past that */
+	if(rb_iothread_detach(lc->F))
+	{
+		char buf[UPGRADE_RECVQ_CHUNK];
+		ssize_t len;
+
+		while((len = rb_read(lc->F, buf, sizeof buf)) > 0)
+			save_recvq(f, buf, len);
+	}
+}
+
+static void
+save_bans(FILE *f, char letter, rb_dlink_list *list)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		struct Ban *banptr = ptr->data;
+
+		fprintf(f, "BAN %c %ld %s %s :%s\n", letter, (long) banptr->when, banptr->who,
+			banptr->forward != NULL ? banptr->forward : "*", banptr->banstr);
+	}
+}
+
+static void
+save_channel(FILE *f, struct Channel *chptr)
+{
+	char modes[256], *p = modes;
+	rb_dlink_node *ptr;
+	bool saved = false;
+
+	RB_DLINK_FOREACH(ptr, chptr->locmembers.head)
+	{
+		struct membership *msptr = ptr->data;
+
+		if(!IsAnyDead(msptr->client_p))
+			saved = true;
+	}
+	if(!saved)
+		return;
+
+	*p++ = '+';
+	for(int i = 0; i < 256; i++)
+		if(chmode_flags[i] && (chptr->mode.mode & chmode_flags[i]))
+			*p++ = (char) i;
+	*p = '\0';
+
+	fprintf(f, "CHANNEL %s %ld %s %d %u %u %s :%s\n", chptr->chname, (long) chptr->channelts,
+		modes, chptr->mode.limit, chptr->mode.join_num, chptr->mode.join_time,
+		*chptr->mode.forward ? chptr->mode.forward : "*", chptr->mode.key);
+
+	if(chptr->topic != NULL)
+		fprintf(f, "TOPIC %ld %s :%s\n", (long) chptr->topic_time,
+			*chptr->topic_info ? chptr->topic_info : "*", chptr->topic);
+	if(chptr->mode_lock != NULL)
+		fprintf(f, "MLOCK :%s\n", chptr->mode_lock);
+
+	save_bans(f, 'b', &chptr->banlist);
+	save_bans(f, 'e', &chptr->exceptlist);
+	save_bans(f, 'I', &chptr->invexlist);
+	save_bans(f, 'q', &chptr->quietlist);
+
+	RB_DLINK_FOREACH(ptr, chptr->locmembers.head)
+	{
+		struct membership *msptr = ptr->data;
+
+		if(!IsAnyDead(msptr->client_p))
+			fprintf(f, "MEMBER %s %u\n", msptr->client_p->id,
+				msptr->flags & (CHFL_CHANOP | CHFL_VOICE));
+	}
+}
+
+/* server_upgrade()
+ *
+ * input	- client asking for the upgrade
+ * output	- only returns if the state file could not be created
+ * side effects - server links and unregistered connections are closed,
+ *		  the state of local clients is saved and the server is
+ *		  re-executed keeping their sockets
+ */
+void
+server_upgrade(struct Client *source_p)
+{
+	struct upgrade_save save;
+	char path[PATH_MAX + 1];
+	rb_dlink_node *ptr, *next_ptr;
+	struct Client *target_p;
+
+	snprintf(path, sizeof(path), "%s.upgrade", pidFileName);
+	if((save.f = fopen(path, "w")) == NULL)
+	{
+		sendto_one_notice(source_p, ":Unable to write %s: %s", path, strerror(errno));
+		return;
+	}
+	save.keep = rb_malloc(maxconnections);
+
+	/* source_p may be behind one of the links closed below */
+	ilog(L_MAIN, "Server upgrading by %s", get_client_name(source_p, HIDE_IP));
+	sendto_realops_snomask(SNO_GENERAL, L_NETWIDE, "Server upgrading by %s",
+			       get_client_name(source_p, HIDE_IP));
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, serv_list.head)
+	{
+		target_p = ptr->data;
+		exit_client(target_p, target_p, &me, "Server upgrading");
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head)
+	{
+		target_p = ptr->data;
+		exit_client(target_p, target_p, &me, UPGRADE_QUIT);
+	}
+
+	fprintf(save.f, "FEFUPGRADE %d\n", UPGRADE_VERSION);
+	fprintf(save.f, "ME %s %s %d %d %lu\n", me.id, get_current_uid(),
+		Count.max_loc, Count.max_tot, Count.totalrestartcount);
+
+	ssld_foreach_upgrade(save_ssld, &save);
+
+	RB_DLINK_FOREACH(ptr, lclient_list.head)
+	{
+		target_p = ptr->data;
+
+		send_queued(target_p);
+		if(!IsAnyDead(target_p))
+			save_client(&save, target_p);
+	}
+
+	RB_DLINK_FOREACH(ptr, lclient_list.head)
+	{
+		rb_dlink_node *aptr;
+
+		target_p = ptr->data;
+		if(IsAnyDead(target_p))
+			continue;
+
+		RB_DLINK_FOREACH(aptr, target_p->localClient->allow_list.head)
+		{
+			struct Client *accept_p = aptr->data;
+
+			if(MyClient(accept_p) && !IsAnyDead(accept_p))
+				fprintf(save.f, "ACCEPT %s %s\n", target_p->id, accept_p->id);
+		}
+	}
+
+	RB_DLINK_FOREACH(ptr, global_channel_list.head)
+		save_channel(save.f, ptr->data);
+
+	fputs("END\n", save.f);
+
+	if(ferror(save.f) | fclose(save.f))
+	{
+		ilog(L_MAIN, "Unable to write %s, restarting instead", path);
+		unlink(path);
+		server_reboot();
+	}
+
+	whowas_log_close();
+
+	for(int fd = 3; fd < maxconnections; fd++)
+	{
+		if(save.keep[fd])
+			fcntl(fd, F_SETFD, 0);
+		else
+			close(fd);
+	}
+
+	unlink(pidFileName);
+	rb_setenv(UPGRADE_ENV, path, 1);
+	server_exec();
+}
+
+static void
+upgrade_free(void)
+{
+	rb_dlink_node *ptr;
+
+	while((ptr = upgrade_lines.head) != NULL)
+	{
+		rb_free(ptr->data);
+		rb_dlinkDestroy(ptr, &upgrade_lines);
+	}
+}
+
+/* a state file that is not ours must not close stdio */
+static void
+close_fd(int fd)
+{
+	if(fd > 2)
+		close(fd);
+}
+
+/* close the client sockets and ssld descriptors a state file names,
+ * for when it will not be restored */
+static void
+upgrade_close_fds(void)
+{
+	char line[UPGRADE_LINELEN];
+	char *parv[UPGRADE_MAXPARA];
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, upgrade_lines.head)
+	{
+		rb_strlcpy(line, ptr->data, sizeof(line));
+
+		if(!strncmp(line, "SSLD ", 5) && upgrade_split(line + 5, parv, 5) == 5)
+		{
+			close_fd(atoi(parv[1]));
+			close_fd(atoi(parv[2]));
+		}
+		else if(!strncmp(line, "CLIENT ", 7) && upgrade_split(line + 7, parv, 10) == 10)
+			close_fd(atoi(parv[8]));
+	}
+}
+
+bool
+upgrade_resuming(void)
+{
+	return getenv(UPGRADE_ENV) != NULL;
+}
+
+/* upgrade_init()
+ *
+ * input	-
+ * output	-
+ * side effects - the state file left by server_upgrade() is read, the
+ *		  descriptors it names are closed on exec again and the ssld
+ *		  helpers are taken back, so no new ones are started for
+ *		  them and no helper inherits a client socket
+ */
+void
+upgrade_init(void)
+{
+	const char *path = getenv(UPGRADE_ENV);
+	char line[UPGRADE_LINELEN];
+	char *parv[UPGRADE_MAXPARA];
+	rb_dlink_node *ptr;
+	FILE *f;
+	char *p;
+
+	if(path == NULL)
+		return;
+
+	if((f = fopen(path, "r")) == NULL)
+	{
+		ilog(L_MAIN, "Unable to read upgrade state %s: %s", path, strerror(errno));
+		unsetenv(UPGRADE_ENV);
+		return;
+	}
+
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		if((p = strchr(line, '\n')) != NULL)
+			*p = '\0';
+		rb_dlinkAddTailAlloc(rb_strdup(line), &upgrade_lines);
+	}
+	fclose(f);
+	unlink(path);
+	unsetenv(UPGRADE_ENV);
+
+	snprintf(line, sizeof(line), "FEFUPGRADE %d", UPGRADE_VERSION);
+	if(upgrade_lines.head == NULL || strcmp(upgrade_lines.head->data, line))
+	{
+		ilog(L_MAIN, "Upgrade state %s is not usable, dropping it", path);
+		upgrade_close_fds();
+		upgrade_free();
+		return;
+	}
+
+	RB_DLINK_FOREACH(ptr, upgrade_lines.head)
+	{
+		rb_strlcpy(line, ptr->data, sizeof(line));
+
+		if(!strncmp(line, "SSLD ", 5) && upgrade_split(line + 5, parv, 5) == 5)
+		{
+			if(ssld_adopt(atol(parv[0]), atoi(parv[1]), atoi(parv[2]), atoi(parv[3]), parv[4]) == NULL)
+			{
+				close(atoi(parv[1]));
+				close(atoi(parv[2]));
+			}
+		}
+		else if(!strncmp(line, "CLIENT ", 7) && upgrade_split(line + 7, parv, UPGRADE_MAXPARA) == UPGRADE_MAXPARA)
+			fcntl(atoi(parv[8]), F_SETFD, FD_CLOEXEC);
+	}
+}
+
+static int
+hexval(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return 0;
+}
+
+static struct Client *
+restore_client(char *rest)
+{
+	char *parv[UPGRADE_MAXPARA];
+	struct Client *client_p;
+	rb_fde_t *F;
+	pid_t sslpid;
+	int fd;
+
+	if(upgrade_split(rest, parv, UPGRADE_MAXPARA) != UPGRADE_MAXPARA)
+		return NULL;
+
+	fd = atoi(parv[8]);
+	if(find_id(parv[0]) != NULL || find_named_client(parv[1]) != NULL ||
+			(F = rb_open(fd, RB_FD_SOCKET, "Incoming Connection")) == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	rb_set_nb(F);
+
+	client_p = make_client(NULL);
+	client_p->localClient->F = F;
+	make_user(client_p);
+
+	rb_strlcpy(client_p->id, parv[0], sizeof(client_p->id));
+	rb_strlcpy(client_p->name, parv[1], sizeof(client_p->name));
+	rb_strlcpy(client_p->username, parv[2], sizeof(client_p->username));
+	rb_strlcpy(client_p->host, parv[3], sizeof(client_p->host));
+	rb_strlcpy(client_p->orighost, parv[4], sizeof(client_p->orighost));
+	rb_strlcpy(client_p->sockhost, parv[5], sizeof(client_p->sockhost));
+	rb_inet_pton_sock(parv[6], (struct sockaddr_storage *)&client_p->localClient->ip);
+	client_p->tsinfo = atol(parv[7]);
+	sslpid = atol(parv[9]);
+	for(const char *m = parv[10]; *m != '\0'; m++)
+		client_p->umodes |= user_modes[(unsigned char) *m];
+	client_p->flags |= strtoull(parv[11], NULL, 16) & UPGRADE_FLAGS;
+	client_p->localClient->localflags |= strtoul(parv[12], NULL, 16) & UPGRADE_LFLAGS;
+	client_p->localClient->firsttime = atol(parv[13]);
+	rb_strlcpy(client_p->info, parv[14], sizeof(client_p->info));
+
+	/* a client whose helper is gone is dropped by upgrade_restore() */
+	if(sslpid != 0)
+		client_p->localClient->ssl_ctl = ssld_attach_pid(sslpid);
+
+	add_to_client_hash(client_p->name, client_p);
+	add_to_id_hash(client_p->id, client_p);
+	add_to_hostname_hash(client_p->orighost, client_p);
+
+	rb_dlinkMoveNode(&client_p->localClient->tnode, &unknown_list, &lclient_list);
+	SetClient(client_p);
+
+	client_p->servptr = &me;
+	rb_dlinkAdd(client_p, &client_p->lnode, &me.serv->users);
+	rb_dlinkAddTail(client_p, &client_p->node, &global_client_list);
+	Count.total++;
+
+	free_pre_client(client_p);
+	return client_p;
+}
+
+static void
+restore_client_line(struct Client *client_p, const char *cmd, char *rest)
+{
+	struct LocalUser *lc = client_p->localClient;
+	char *parv[2];
+	int parc;
+
+	parc = upgrade_split(rest, parv, strcmp(cmd, "OPER") ? 1 : 2);
+
+	if(!strcmp(cmd, "CONNID") && parc == 1)
+	{
+		uint32_t id = strtoul(parv[0], NULL, 10);
+
+		if(id != 0 && find_cli_connid_hash(id) == NULL)
+		{
+			add_to_cli_connid_hash(client_p, id);
+			rb_dlinkAddAlloc(RB_UINT_TO_POINTER(id), &lc->connids);
+		}
+	}
+	else if(!strcmp(cmd, "SNOMASK") && parc == 1)
+		client_p->snomask = parse_snobuf_to_mask(0, parv[0]);
+	else if(!strcmp(cmd, "ACCOUNT") && parc == 1)
+		rb_strlcpy(client_p->user->suser, parv[0], sizeof(client_p->user->suser));
+	else if(!strcmp(cmd, "CERTFP") && parc == 1)
+		client_p->certfp = rb_strdup(parv[0]);
+	else if(!strcmp(cmd, "CIPHER") && parc == 1)
+		lc->cipher_string = rb_strdup(parv[0]);
+	else if(!strcmp(cmd, "MANGLED") && parc == 1)
+	{
+		lc->mangledhost = rb_malloc(HOSTLEN + 1);
+		rb_strlcpy(lc->mangledhost, parv[0], HOSTLEN + 1);
+	}
+	else if(!strcmp(cmd, "AWAY") && parc == 1)
+	{
+		allocate_away(client_p);
+		rb_strlcpy(client_p->user->away, parv[0], AWAYLEN);
+	}
+	else if(!strcmp(cmd, "OPER") && parc == 2)
+	{
+		struct PrivilegeSet *privset = privilegeset_get(parv[1]);
+
+		if(privset == NULL || !IsOper(client_p))
+			return;
+
+		client_p->user->opername = rb_strdup(parv[0]);
+		client_p->user->privset = privilegeset_ref(privset);
+		rb_dlinkAddAlloc(client_p, &local_oper_list);
+		rb_dlinkAddAlloc(client_p, &oper_list);
+		Count.oper++;
+	}
+	else if(!strcmp(cmd, "CAPS") && parc == 1)
+	{
+		char *cap, *p;
+
+		for(cap = rb_strtok_r(parv[0], " ", &p); cap != NULL; cap = rb_strtok_r(NULL, " ", &p))
+			lc->client_caps |= capability_get(cli_capindex, cap, NULL);
+	}
+	else if(!strcmp(cmd, "MONITOR") && parc == 1)
+		add_monitor_watcher(client_p, find_monitor(parv[0], 1));
+	else if(!strcmp(cmd, "SENDQ") && parc == 1)
+	{
+		rb_strf_t strings = { .format = parv[0], .format_args = NULL, .next = NULL };
+
+		rb_linebuf_put(&lc->buf_sendq, &strings);
+	}
+	else if(!strcmp(cmd, "RECVQ") && parc == 1)
+	{
+		size_t len = strlen(parv[0]) / 2;
+
+		/* decoded in place, over the hex */
+		for(size_t i = 0; i < len; i++)
+			parv[0][i] = hexval(parv[0][2 * i]) << 4 | hexval(parv[0][2 * i + 1]);
+		recvq_append(client_p, parv[0], len);
+	}
+	else if(!strcmp(cmd, "OVERLONG"))
+		lc->recvq.overlong = true;
+}
+
+static struct Channel *
+restore_channel(char *rest)
+{
+	char *parv[8];
+	struct Channel *chptr;
+	bool isnew;
+
+	if(upgrade_split(rest, parv, 8) != 8)
+		return NULL;
+
+	chptr = get_or_create_channel(&me, parv[0], &isnew);
+	if(chptr == NULL || !isnew)
+		return NULL;
+
+	chptr->channelts = atol(parv[1]);
+	for(const char *m = parv[2]; *m != '\0'; m++)
+		chptr->mode.mode |= chmode_flags[(unsigned char) *m];
+	chptr->mode.limit = atoi(parv[3]);
+	chptr->mode.join_num = strtoul(parv[4], NULL, 10);
+	chptr->mode.join_time = strtoul(parv[5], NULL, 10);
+	if(strcmp(parv[6], "*"))
+		rb_strlcpy(chptr->mode.forward, parv[6], sizeof(chptr->mode.forward));
+	rb_strlcpy(chptr->mode.key, parv[7], sizeof(chptr->mode.key));
+
+	return chptr;
+}
+
+static void
+restore_channel_line(struct Channel *chptr, const char *cmd, char *rest)
+{
+	char *parv[5];
+	int parc;
+
+	if(!strcmp(cmd, "TOPIC") && (parc = upgrade_split(rest, parv, 3)) == 3)
+		set_channel_topic(chptr, parv[2], parv[1], atol(parv[0]));
+	else if(!strcmp(cmd, "MLOCK") && (parc = upgrade_split(rest, parv, 1)) == 1)
+		chptr->mode_lock = rb_strdup(parv[0]);
+	else if(!strcmp(cmd, "BAN") && (parc = upgrade_split(rest, parv, 5)) == 5)
+	{
+		rb_dlink_list *list;
+		struct Ban *banptr;
+
+		switch(*parv[0])
+		{
+		case 'b':
+			list = &chptr->banlist;
+			break;
+		case 'e':
+			list = &chptr->exceptlist;
+			break;
+		case 'I':
+			list = &chptr->invexlist;
+			break;
+		case 'q':
+			list = &chptr->quietlist;
+			break;
+		default:
+			return;
+		}
+
+		banptr = allocate_ban(parv[4], parv[2], strcmp(parv[3], "*") ? parv[3] : NULL);
+		banptr->when = atol(parv[1]);
+		rb_dlinkAddTail(banptr, &banptr->node, list);
+		banset_add(chptr, list, banptr);
+	}
+	else if(!strcmp(cmd, "MEMBER") && (parc = upgrade_split(rest, parv, 2)) == 2)
+	{
+		struct Client *target_p = find_id(parv[0]);
+
+		if(target_p != NULL && MyClient(target_p) && !IsMember(target_p, chptr))
+			add_user_to_channel(chptr, target_p, atoi(parv[1]) & (CHFL_CHANOP | CHFL_VOICE));
+	}
+}
+
+/* check a restored client against the current config, as registering would */
+static void
+restore_finish(struct Client *client_p)
+{
+	struct ConfItem *aconf;
+	const char *notilde = client_p->username;
+
+	if(IsOper(client_p) && client_p->user->privset == NULL)
+		client_p->umodes &= ~(ConfigFileEntry.oper_only_umodes | UMODE_OPER | UMODE_ADMIN);
+	if(IsInvisible(client_p))
+		Count.invisi++;
+
+	snomask_update_subscriptions(client_p);
+	client_p->handler = IsOperGeneral(client_p) ? OPER_HANDLER : CLIENT_HANDLER;
+
+	if(find_tgchange(client_p->sockhost))
+		client_p->localClient->targets_free = TGCHANGE_INITIAL_LOW;
+	else
+		client_p->localClient->targets_free = TGCHANGE_INITIAL;
+
+	if(IsSSL(client_p) && client_p->localClient->ssl_ctl == NULL)
+	{
+		exit_client(client_p, client_p, &me, UPGRADE_QUIT);
+		return;
+	}
+
+	if(*notilde == '~')
+		notilde++;
+	aconf = find_address_conf(client_p->orighost, client_p->sockhost,
+				  client_p->username, notilde,
+				  (struct sockaddr *)&client_p->localClient->ip,
+				  GET_SS_FAMILY(&client_p->localClient->ip), NULL);
+	if(aconf == NULL || !(aconf->status & CONF_CLIENT) || attach_conf(client_p, aconf) != 0)
+	{
+		exit_client(client_p, client_p, &me, UPGRADE_QUIT);
+		return;
+	}
+
+	rb_iothread_attach(client_p->localClient->F);
+	rb_setselect(client_p->localClient->F, RB_SELECT_READ, read_packet, client_p);
+	send_queued(client_p);
+}
+
+/* upgrade_restore()
+ *
+ * input	-
+ * output	-
+ * side effects - the clients and channels saved by server_upgrade() are
+ *		  recreated; clients the current config no longer lets in
+ *		  are disconnected
+ */
+void
+upgrade_restore(void)
+{
+	struct Client *client_p = NULL;
+	struct Channel *chptr = NULL;
+	rb_dlink_node *ptr, *next_ptr;
+	bool usable = true;
+	int restored = 0;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, upgrade_lines.head)
+	{
+		char *line = ptr->data;
+		char *rest = strchr(line, ' ');
+		char *parv[UPGRADE_MAXPARA];
+
+		if(rest != NULL)
+			*rest++ = '\0';
+
+		if(!usable)
+		{
+			/* nothing is rebuilt, but the sockets still have to go */
+			if(!strcmp(line, "CLIENT") && upgrade_split(rest, parv, 10) == 10)
+				close(atoi(parv[8]));
+		}
+		else if(!strcmp(line, "ME") && upgrade_split(rest, parv, 5) == 5)
+		{
+			if(strcmp(parv[0], me.id))
+			{
+				ilog(L_MAIN, "Server ID changed from %s, dropping upgraded clients", parv[0]);
+				usable = false;
+				continue;
+			}
+			set_current_uid(parv[1]);
+			Count.max_loc = atoi(parv[2]);
+			Count.max_tot = atoi(parv[3]);
+			Count.totalrestartcount = strtoul(parv[4], NULL, 10);
+		}
+		else if(!strcmp(line, "CLIENT"))
+		{
+			chptr = NULL;
+			if((client_p = restore_client(rest)) != NULL)
+				restored++;
+		}
+		else if(!strcmp(line, "ACCEPT") && upgrade_split(rest, parv, 2) == 2)
+		{
+			struct Client *source_p = find_id(parv[0]);
+			struct Client *target_p = find_id(parv[1]);
+
+			client_p = NULL;
+			if(source_p != NULL && target_p != NULL && MyClient(source_p) && MyClient(target_p))
+			{
+				rb_dlinkAddAlloc(target_p, &source_p->localClient->allow_list);
+				rb_dlinkAddAlloc(source_p, &target_p->on_allow_list);
+			}
+		}
+		else if(!strcmp(line, "CHANNEL"))
+		{
+			client_p = NULL;
+			chptr = restore_channel(rest);
+		}
+		else if(client_p != NULL)
+			restore_client_line(client_p, line, rest);
+		else if(chptr != NULL)
+			restore_channel_line(chptr, line, rest);
+	}
+
+	upgrade_free();
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, global_channel_list.head)
+	{
+		chptr = ptr->data;
+		if(rb_dlink_list_length(&chptr->members) == 0)
+			destroy_channel(chptr);
+	}
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head)
+		restore_finish(ptr->data);
+
+	if(restored)
+	{
+		ilog(L_MAIN, "Upgrade restored %d clients", restored);
+		sendto_realops_snomask(SNO_GENERAL, L_NETWIDE, "Upgrade restored %d clients", restored);
+	}
+}
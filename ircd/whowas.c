@@ -39,26 +39,79 @@
 #include "logger.h"
 #include "scache.h"
 #include "rb_radixtree.h"
+#include "rb_dictionary.h"
 
 struct whowas_top
 {
-	char *name;
 	rb_dlink_list wwlist;
 };
 
+/* refcounted interned string, keyed in whowas_strings by str */
+struct whowas_string
+{
+	unsigned int refcount;
+	char str[];
+};
+
 static rb_radixtree *whowas_tree = NULL;
-static rb_dlink_list whowas_list = {NULL, NULL, 0};
+static rb_dictionary *whowas_strings = NULL;
+static rb_bh *whowas_top_heap = NULL;
+
+/* the history itself: a ring of whowas_list_length slots, oldest at
+ * whowas_ring_next once the ring has wrapped */
+static struct Whowas *whowas_ring = NULL;
+static unsigned int whowas_ring_next = 0;
+static unsigned int whowas_count = 0;
 static unsigned int whowas_list_length = NICKNAMEHISTORYLENGTH;
-static void whowas_trim(void *unused);
+
+static size_t whowas_strings_memory = 0;
+
+static const char *
+whowas_intern(const char *str)
+{
+	struct whowas_string *ws;
+	size_t len;
+
+	ws = rb_dictionary_retrieve(whowas_strings, str);
+	if(ws != NULL)
+	{
+		ws->refcount++;
+		return ws->str;
+	}
+
+	len = strlen(str) + 1;
+	ws = rb_malloc(sizeof(struct whowas_string) + len);
+	ws->refcount = 1;
+	memcpy(ws->str, str, len);
+	rb_dictionary_add(whowas_strings, ws->str, ws);
+
+	whowas_strings_memory += sizeof(struct whowas_string) + len;
+	return ws->str;
+}
+
+static void
+whowas_unintern(const char *str)
+{
+	struct whowas_string *ws;
+
+	ws = (struct whowas_string *)(void *)(str - offsetof(struct whowas_string, str));
+	s_assert(ws->refcount > 0);
+
+	if(--ws->refcount > 0)
+		return;
+
+	rb_dictionary_delete(whowas_strings, ws->str);
+	whowas_strings_memory -= sizeof(struct whowas_string) + strlen(ws->str) + 1;
+	rb_free(ws);
+}
 
 static void
-whowas_free_wtop(struct whowas_top *wtop)
+whowas_free_wtop(struct whowas_top *wtop, const char *name)
 {
 	if(rb_dlink_list_length(&wtop->wwlist) == 0)
 	{
-		rb_radixtree_delete(whowas_tree, wtop->name);
-		rb_free(wtop->name);
-		rb_free(wtop);
+		rb_radixtree_delete(whowas_tree, name);
+		rb_bh_free(whowas_top_heap, wtop);
 	}
 }
 
@@ -71,13 +124,31 @@ whowas_get_top(const char *name)
 	if (wtop != NULL)
 		return wtop;
 
-	wtop = rb_malloc(sizeof(struct whowas_top));
-	wtop->name = rb_strdup(name);
-	rb_radixtree_add(whowas_tree, wtop->name, wtop);
+	wtop = rb_bh_alloc(whowas_top_heap);
+	rb_radixtree_add(whowas_tree, name, wtop);
 
 	return wtop;
 }
 
+/* release a ring slot, leaving it zeroed for reuse */
+static void
+whowas_release(struct Whowas *who)
+{
+	if(who->online != NULL)
+		rb_dlinkDelete(&who->cnode, &who->online->whowas_clist);
+	rb_dlinkDelete(&who->wnode, &who->wtop->wwlist);
+	whowas_free_wtop(who->wtop, who->name);
+
+	whowas_unintern(who->username);
+	whowas_unintern(who->hostname);
+	whowas_unintern(who->sockhost);
+	whowas_unintern(who->realname);
+	whowas_unintern(who->suser);
+
+	memset(who, 0, sizeof(struct Whowas));
+	whowas_count--;
+}
+
 rb_dlink_list *
 whowas_get_list(const char *name)
 {
@@ -98,27 +169,32 @@ whowas_add_history(struct Client *client_p, int online)
 	if(client_p == NULL)
 		return;
 
-	/* trim some of the entries if we're getting well over our history length */
-	if(rb_dlink_list_length(&whowas_list) > whowas_list_length + 100)
-		whowas_trim(NULL);
+	/* the ring is full when the next slot is in use: trimming is just
+	 * dropping the oldest entry and advancing */
+	who = &whowas_ring[whowas_ring_next];
+	if(who->wtop != NULL)
+		whowas_release(who);
+
+	whowas_ring_next = (whowas_ring_next + 1) % whowas_list_length;
+	whowas_count++;
 
 	wtop = whowas_get_top(client_p->name);
-	who = rb_malloc(sizeof(struct Whowas));
 	who->wtop = wtop;
 	who->logoff = rb_current_time();
 
 	rb_strlcpy(who->name, client_p->name, sizeof(who->name));
-	rb_strlcpy(who->username, client_p->username, sizeof(who->username));
-	rb_strlcpy(who->hostname, client_p->host, sizeof(who->hostname));
-	rb_strlcpy(who->realname, client_p->info, sizeof(who->realname));
-	rb_strlcpy(who->sockhost, client_p->sockhost, sizeof(who->sockhost));
-	rb_strlcpy(who->suser, client_p->user->suser, sizeof(who->suser));
+	who->username = whowas_intern(client_p->username);
+	who->hostname = whowas_intern(client_p->host);
+	who->realname = whowas_intern(client_p->info);
+	who->sockhost = whowas_intern(client_p->sockhost);
+	who->suser = whowas_intern(client_p->user->suser);
 
 	who->flags = (IsIPSpoof(client_p) ? WHOWAS_IP_SPOOFING : 0) |
 		(IsDynSpoof(client_p) ? WHOWAS_DYNSPOOF : 0);
 
 	/* this is safe do to with the servername cache */
 	who->servername = scache_get_name(client_p->servptr->serv->nameinfo);
+	who->serial = whowas_log_add(who);
 
 	if(online)
 	{
@@ -129,7 +205,6 @@ whowas_add_history(struct Client *client_p, int online)
 		who->online = NULL;
 
 	rb_dlinkAdd(who, &who->wnode, &wtop->wwlist);
-	rb_dlinkAdd(who, &who->whowas_node, &whowas_list);
 }
 
 
@@ -170,46 +245,26 @@ whowas_get_history(const char *nick, time_t timelimit)
 	return NULL;
 }
 
-static void
-whowas_trim(void *unused)
-{
-	long over;
-
-	if(rb_dlink_list_length(&whowas_list) < whowas_list_length)
-		return;
-	over = rb_dlink_list_length(&whowas_list) - whowas_list_length;
-
-	/* remove whowas entries over the configured length */
-	for(long i = 0; i < over; i++)
-	{
-		if(whowas_list.tail != NULL && whowas_list.tail->data != NULL)
-		{
-			struct Whowas *twho = whowas_list.tail->data;
-			if(twho->online != NULL)
-				rb_dlinkDelete(&twho->cnode, &twho->online->whowas_clist);
-			rb_dlinkDelete(&twho->wnode, &twho->wtop->wwlist);
-			rb_dlinkDelete(&twho->whowas_node, &whowas_list);
-			whowas_free_wtop(twho->wtop);
-			rb_free(twho);
-		}
-	}
-}
-
 void
 whowas_init(void)
 {
 	whowas_tree = rb_radixtree_create("whowas", irccasecanon);
+	whowas_strings = rb_dictionary_create("whowas strings", (DCF)strcmp);
+	whowas_top_heap = rb_bh_create(sizeof(struct whowas_top), 1024, "whowas_top_heap");
+
 	if(whowas_list_length == 0)
 	{
 		whowas_list_length = NICKNAMEHISTORYLENGTH;
 	}
-	rb_event_add("whowas_trim", whowas_trim, NULL, 10);
+	whowas_ring = rb_malloc(sizeof(struct Whowas) * whowas_list_length);
 }
 
 void
 whowas_memory_usage(size_t * count, size_t * memused)
 {
-	*count = rb_dlink_list_length(&whowas_list);
-	*memused += *count * sizeof(struct Whowas);
+	*count = whowas_count;
+	*memused += sizeof(struct Whowas) * whowas_list_length;
 	*memused += sizeof(struct whowas_top) * rb_radixtree_size(whowas_tree);
+	*memused += whowas_strings_memory;
+	*memused += sizeof(rb_dictionary_element) * rb_dictionary_size(whowas_strings);
 }
@@ -0,0 +1,777 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  whowas_log.c: Persistent on-disk whowas history.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * The in-memory whowas ring is lost on restart, so every entry added to
+ * it is also appended to a log file of fixed-size records.  The log is
+ * kept as two segments, the live one and a ".old" one; when the live
+ * segment reaches half of whowaslog_max_size it replaces the old one.
+ * Both segments are mapped read-only and indexed by canonical nick, so
+ * WHOWAS can fall back to them once the ring has forgotten a nick.
+ *
+ * Records are collected in a buffer and written out in one sequential
+ * write() per flush, from an event or when the buffer fills.  Every
+ * file operation (the writes, rotating, deleting an expired segment)
+ * runs on the rb_job pool, one at a time, so a slow disk holds back
+ * only the log.  The index is updated when a write is done.
+ *
+ * Index entries number records across the whole log rather than per
+ * segment, so rotating and expiring leave the index alone: entries for
+ * a retired segment simply fall outside both segments' ranges.  Nicks
+ * are kept in order of their newest record, and those whose newest
+ * record has been retired are pruned from the front of that list.
+ * Only opening the log scans the segments.
+ */
+
+#include "stdinc.h"
+#include "whowas.h"
+#include "client.h"
+#include "match.h"
+#include "ircd.h"
+#include "s_assert.h"
+#include "s_conf.h"
+#include "logger.h"
+#include "rb_radixtree.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define WHOWAS_LOG_MAGIC	"FEFWWLG1"
+#define WHOWAS_LOG_PENDING	64	/* records buffered before a forced flush */
+#define WHOWAS_LOG_PENDING_MAX	4096	/* records buffered while the disk is busy */
+#define WHOWAS_LOG_FLUSH_TIME	1	/* seconds between periodic flushes */
+
+struct whowas_log_record
+{
+	uint64_t serial;
+	int64_t logoff;
+	unsigned char flags;
+	char name[NICKLEN + 1];
+	char username[USERLEN + 1];
+	char hostname[HOSTLEN + 1];
+	char sockhost[HOSTIPLEN + 1];
+	char realname[REALLEN + 1];
+	char suser[NICKLEN + 1];
+	char servername[HOSTLEN + 1];
+};
+
+/* the header occupies the first record slot, so records stay aligned */
+struct whowas_log_header
+{
+	char magic[8];
+	uint32_t recsize;
+};
+
+#define RECSIZE		sizeof(struct whowas_log_record)
+
+enum
+{
+	SEG_OLD,
+	SEG_CUR,
+	LAST_SEG
+};
+
+struct whowas_log_segment
+{
+	int fd;
+	const char *map;
+	size_t maplen;
+	uint32_t base;		/* log-wide number of its first record */
+	uint32_t count;		/* records on disk, header excluded */
+};
+
+/* index entry: log-wide record number, counted modulo 2^32 */
+struct whowas_log_nick
+{
+	rb_dlink_node node;	/* in whowas_log_nicks */
+	char name[NICKLEN + 1];
+	uint32_t count;
+	uint32_t size;
+	uint32_t *recs;		/* oldest first */
+};
+
+/* a write of records to the live segment */
+struct whowas_log_write
+{
+	int fd;
+	uint32_t count;		/* records in the segment before these */
+	unsigned int n;
+	ssize_t ret;
+	int err;
+	int truncate_err;
+	struct whowas_log_record recs[];
+};
+
+/* moving the live segment to .old and starting a new one */
+struct whowas_log_rotate
+{
+	char *path;
+	char *oldpath;
+	int rename_err;
+	int fd;
+	off_t size;
+	char err[BUFSIZE];
+};
+
+static char *whowas_log_path;
+static struct whowas_log_segment segments[LAST_SEG] = { { -1, NULL, 0, 0, 0 }, { -1, NULL, 0, 0, 0 } };
+static rb_radixtree *whowas_log_index;
+static rb_dlink_list whowas_log_nicks;	/* by newest record, oldest first */
+static size_t whowas_log_index_memory;
+
+static struct whowas_log_record *pending;
+static unsigned int pending_count;
+static unsigned int pending_size;
+static unsigned int pending_dropped;
+
+static bool whowas_log_busy;		/* a file job is running */
+
+static uint64_t next_serial = 1;
+static struct ev_entry *whowas_log_ev;
+
+static void whowas_log_flush(void *unused);
+
+static size_t
+segment_maplen(void)
+{
+	/* map each segment once at its maximum size; pages past EOF are
+	 * never touched since we only read records we know are there */
+	return ConfigFileEntry.whowaslog_max_size / 2 + 2 * RECSIZE;
+}
+
+static const struct whowas_log_record *
+segment_record(struct whowas_log_segment *seg, uint32_t num)
+{
+	return (const struct whowas_log_record *)(void *)(seg->map + (size_t)(num + 1) * RECSIZE);
+}
+
+static bool
+record_valid(const struct whowas_log_record *rec)
+{
+	return rec->serial != 0 &&
+		rec->name[sizeof(rec->name) - 1] == '\0' &&
+		rec->username[sizeof(rec->username) - 1] == '\0' &&
+		rec->hostname[sizeof(rec->hostname) - 1] == '\0' &&
+		rec->sockhost[sizeof(rec->sockhost) - 1] == '\0' &&
+		rec->realname[sizeof(rec->realname) - 1] == '\0' &&
+		rec->suser[sizeof(rec->suser) - 1] == '\0' &&
+		rec->servername[sizeof(rec->servername) - 1] == '\0' &&
+		rec->name[0] != '\0';
+}
+
+static bool
+record_expired(const struct whowas_log_record *rec)
+{
+	return ConfigFileEntry.whowaslog_max_age > 0 &&
+		rec->logoff + ConfigFileEntry.whowaslog_max_age < rb_current_time();
+}
+
+/* the record a log-wide number refers to, if it is still on disk */
+static const struct whowas_log_record *
+index_record(uint32_t rec)
+{
+	for(int s = SEG_OLD; s < LAST_SEG; s++)
+	{
+		struct whowas_log_segment *seg = &segments[s];
+
+		if(seg->map != NULL && rec - seg->base < seg->count)
+			return segment_record(seg, rec - seg->base);
+	}
+
+	return NULL;
+}
+
+static void
+index_free(struct whowas_log_nick *wn)
+{
+	rb_radixtree_delete(whowas_log_index, wn->name);
+	rb_dlinkDelete(&wn->node, &whowas_log_nicks);
+	whowas_log_index_memory -= sizeof(struct whowas_log_nick) + wn->size * sizeof(uint32_t);
+	rb_free(wn->recs);
+	rb_free(wn);
+}
+
+/* drop the nicks whose records have all been retired */
+static void
+index_sweep(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, whowas_log_nicks.head)
+	{
+		struct whowas_log_nick *wn = ptr->data;
+
+		if(index_record(wn->recs[wn->count - 1]) != NULL)
+			break;
+		index_free(wn);
+	}
+}
+
+static void
+index_add(const char *name, uint32_t rec)
+{
+	struct whowas_log_nick *wn;
+	uint32_t stale = 0;
+
+	wn = rb_radixtree_retrieve(whowas_log_index, name);
+	if(wn == NULL)
+	{
+		wn = rb_malloc(sizeof(struct whowas_log_nick));
+		rb_strlcpy(wn->name, name, sizeof(wn->name));
+		rb_radixtree_add(whowas_log_index, wn->name, wn);
+		rb_dlinkAddTail(wn, &wn->node, &whowas_log_nicks);
+		whowas_log_index_memory += sizeof(struct whowas_log_nick);
+	}
+	else
+		rb_dlinkMoveTail(&wn->node, &whowas_log_nicks);
+
+	/* retired records are the oldest, so they are at the front */
+	while(stale < wn->count && index_record(wn->recs[stale]) == NULL)
+		stale++;
+	if(stale > 0)
+	{
+		wn->count -= stale;
+		memmove(wn->recs, wn->recs + stale, wn->count * sizeof(uint32_t));
+	}
+
+	if(wn->count == wn->size)
+	{
+		uint32_t grow = wn->size ? wn->size : 2;
+
+		wn->size += grow;
+		wn->recs = rb_realloc(wn->recs, wn->size * sizeof(uint32_t));
+		whowas_log_index_memory += grow * sizeof(uint32_t);
+	}
+
+	wn->recs[wn->count++] = rec;
+}
+
+static void
+index_destroy(void)
+{
+	rb_dlink_node *ptr, *next_ptr;
+
+	if(whowas_log_index != NULL)
+		rb_radixtree_destroy(whowas_log_index, NULL, NULL);
+	whowas_log_index = NULL;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, whowas_log_nicks.head)
+	{
+		struct whowas_log_nick *wn = ptr->data;
+
+		rb_dlinkDelete(&wn->node, &whowas_log_nicks);
+		rb_free(wn->recs);
+		rb_free(wn);
+	}
+	whowas_log_index_memory = 0;
+}
+
+/* index both segments; only done when the log is opened */
+static void
+index_build(void)
+{
+	index_destroy();
+	whowas_log_index = rb_radixtree_create("whowas log", irccasecanon);
+
+	for(int s = SEG_OLD; s < LAST_SEG; s++)
+	{
+		struct whowas_log_segment *seg = &segments[s];
+
+		for(uint32_t i = 0; i < seg->count; i++)
+		{
+			const struct whowas_log_record *rec = segment_record(seg, i);
+
+			if(!record_valid(rec) || record_expired(rec))
+				continue;
+
+			if(rec->serial >= next_serial)
+				next_serial = rec->serial + 1;
+
+			index_add(rec->name, seg->base + i);
+		}
+	}
+}
+
+static void
+segment_close(struct whowas_log_segment *seg)
+{
+	if(seg->map != NULL)
+		munmap((void *)seg->map, seg->maplen);
+	if(seg->fd >= 0)
+		close(seg->fd);
+
+	seg->fd = -1;
+	seg->map = NULL;
+	seg->maplen = 0;
+	seg->count = 0;
+}
+
+/* open a segment file, writing the header of a new one; this also runs
+ * on the job pool, so errors go to err rather than the log */
+static int
+segment_file(const char *path, bool create, off_t *size, char *err, size_t errlen)
+{
+	struct whowas_log_header hdr;
+	struct stat st;
+	int fd;
+
+	*err = '\0';
+
+	fd = open(path, O_RDWR | O_APPEND | (create ? O_CREAT : 0), 0600);
+	if(fd < 0)
+	{
+		if(errno != ENOENT || create)
+			snprintf(err, errlen, "unable to open %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	if(fstat(fd, &st) < 0)
+	{
+		snprintf(err, errlen, "unable to stat %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if(st.st_size == 0)
+	{
+		char buf[RECSIZE];
+
+		memset(buf, 0, sizeof(buf));
+		memcpy(hdr.magic, WHOWAS_LOG_MAGIC, sizeof(hdr.magic));
+		hdr.recsize = RECSIZE;
+		memcpy(buf, &hdr, sizeof(hdr));
+
+		if(write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+		{
+			snprintf(err, errlen, "unable to write header to %s: %s", path, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		st.st_size = RECSIZE;
+	}
+	else
+	{
+		if(read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+				memcmp(hdr.magic, WHOWAS_LOG_MAGIC, sizeof(hdr.magic)) ||
+				hdr.recsize != RECSIZE)
+		{
+			snprintf(err, errlen, "%s is not a whowas log for this build, ignoring it", path);
+			close(fd);
+			return -1;
+		}
+
+		/* drop a torn record left by a crash mid-write */
+		if(st.st_size % RECSIZE)
+		{
+			st.st_size -= st.st_size % RECSIZE;
+			if(ftruncate(fd, st.st_size) < 0)
+				snprintf(err, errlen, "unable to truncate %s: %s", path, strerror(errno));
+		}
+	}
+
+	*size = st.st_size;
+	return fd;
+}
+
+static bool
+segment_map(struct whowas_log_segment *seg, int fd, off_t size, const char *path)
+{
+	seg->maplen = segment_maplen();
+	if((size_t)size > seg->maplen)
+		seg->maplen = size;
+
+	seg->map = mmap(NULL, seg->maplen, PROT_READ, MAP_SHARED, fd, 0);
+	if(seg->map == MAP_FAILED)
+	{
+		ilog(L_MAIN, "whowas log: unable to map %s: %s", path, strerror(errno));
+		seg->map = NULL;
+		seg->maplen = 0;
+		close(fd);
+		return false;
+	}
+
+	seg->fd = fd;
+	seg->count = size / RECSIZE - 1;
+	return true;
+}
+
+static bool
+segment_open(struct whowas_log_segment *seg, const char *path, bool create)
+{
+	char err[BUFSIZE];
+	off_t size;
+	int fd;
+
+	fd = segment_file(path, create, &size, err, sizeof(err));
+	if(*err != '\0')
+		ilog(L_MAIN, "whowas log: %s", err);
+	if(fd < 0)
+		return false;
+
+	return segment_map(seg, fd, size, path);
+}
+
+static void
+old_path(char *buf, size_t len)
+{
+	snprintf(buf, len, "%s.old", whowas_log_path);
+}
+
+static void
+rotate_work(void *data)
+{
+	struct whowas_log_rotate *job = data;
+
+	job->rename_err = rename(job->path, job->oldpath) < 0 ? errno : 0;
+	job->fd = segment_file(job->path, true, &job->size, job->err, sizeof(job->err));
+}
+
+static void
+rotate_done(void *data)
+{
+	struct whowas_log_rotate *job = data;
+	struct whowas_log_segment *old = &segments[SEG_OLD];
+	struct whowas_log_segment *cur = &segments[SEG_CUR];
+
+	whowas_log_busy = false;
+
+	if(job->rename_err != 0)
+		ilog(L_MAIN, "whowas log: unable to rename %s: %s", job->path, strerror(job->rename_err));
+	if(*job->err != '\0')
+		ilog(L_MAIN, "whowas log: %s", job->err);
+
+	/* the live segment's file is now the .old one, and stays mapped */
+	segment_close(old);
+	*old = *cur;
+	cur->fd = -1;
+	cur->map = NULL;
+	cur->maplen = 0;
+	cur->base = old->base + old->count;
+	cur->count = 0;
+
+	/* with no live segment, nothing more is logged.  if the rename
+	 * failed the file opened is the one just retired */
+	if(job->fd >= 0 && job->rename_err != 0)
+		close(job->fd);
+	else if(job->fd >= 0)
+		segment_map(cur, job->fd, job->size, job->path);
+
+	index_sweep();
+
+	rb_free(job->path);
+	rb_free(job->oldpath);
+	rb_free(job);
+
+	whowas_log_flush(NULL);
+}
+
+/* retire the old segment, and make the live one old */
+static void
+whowas_log_rotate(void)
+{
+	struct whowas_log_rotate *job = rb_malloc(sizeof(struct whowas_log_rotate));
+	char oldpath[PATH_MAX];
+
+	old_path(oldpath, sizeof(oldpath));
+	job->path = rb_strdup(whowas_log_path);
+	job->oldpath = rb_strdup(oldpath);
+
+	whowas_log_busy = true;
+	rb_job_post(rotate_work, rotate_done, job);
+}
+
+static void
+unlink_work(void *data)
+{
+	unlink(data);
+}
+
+static void
+unlink_done(void *data)
+{
+	whowas_log_busy = false;
+	rb_free(data);
+}
+
+/* drop the old segment once everything in it is past whowaslog_max_age */
+static void
+whowas_log_expire(void)
+{
+	struct whowas_log_segment *seg = &segments[SEG_OLD];
+	char oldpath[PATH_MAX];
+
+	if(seg->map == NULL || seg->count == 0 || ConfigFileEntry.whowaslog_max_age <= 0)
+		return;
+
+	if(!record_expired(segment_record(seg, seg->count - 1)))
+		return;
+
+	old_path(oldpath, sizeof(oldpath));
+	segment_close(seg);
+	index_sweep();
+
+	whowas_log_busy = true;
+	rb_job_post(unlink_work, unlink_done, rb_strdup(oldpath));
+}
+
+static void
+write_work(void *data)
+{
+	struct whowas_log_write *job = data;
+	size_t len = job->n * RECSIZE;
+
+	job->ret = write(job->fd, job->recs, len);
+	job->err = errno;
+
+	/* keep the file record-aligned */
+	job->truncate_err = 0;
+	if(job->ret > 0 && job->ret != (ssize_t)len &&
+			ftruncate(job->fd, (size_t)(job->count + 1) * RECSIZE) < 0)
+		job->truncate_err = errno;
+}
+
+static void
+write_done(void *data)
+{
+	struct whowas_log_write *job = data;
+	struct whowas_log_segment *seg = &segments[SEG_CUR];
+
+	whowas_log_busy = false;
+
+	if(job->ret != (ssize_t)(job->n * RECSIZE))
+	{
+		ilog(L_MAIN, "whowas log: write to %s failed: %s", whowas_log_path,
+			job->ret < 0 ? strerror(job->err) : "short write");
+		if(job->truncate_err != 0)
+			ilog(L_MAIN, "whowas log: unable to truncate %s: %s", whowas_log_path,
+				strerror(job->truncate_err));
+	}
+	else
+	{
+		for(unsigned int i = 0; i < job->n; i++)
+			index_add(job->recs[i].name, seg->base + job->count + i);
+		seg->count += job->n;
+	}
+
+	rb_free(job);
+
+	if(pending_dropped > 0)
+	{
+		ilog(L_MAIN, "whowas log: %u records not logged while writes were behind", pending_dropped);
+		pending_dropped = 0;
+	}
+
+	if(pending_count >= WHOWAS_LOG_PENDING)
+		whowas_log_flush(NULL);
+}
+
+static void
+whowas_log_flush(void *unused)
+{
+	struct whowas_log_segment *seg = &segments[SEG_CUR];
+	struct whowas_log_write *job;
+	size_t room;
+	unsigned int n;
+
+	if(whowas_log_busy)
+		return;
+
+	whowas_log_expire();
+	if(whowas_log_busy)
+		return;
+
+	if(pending_count == 0 || seg->fd < 0)
+	{
+		pending_count = 0;
+		return;
+	}
+
+	room = seg->maplen / RECSIZE - 1 - seg->count;
+	if(pending_count > room && seg->count > 0)
+	{
+		whowas_log_rotate();
+		return;
+	}
+
+	n = MIN(pending_count, room);
+	if(n == 0)
+	{
+		pending_count = 0;
+		return;
+	}
+
+	job = rb_malloc(sizeof(struct whowas_log_write) + n * RECSIZE);
+	job->fd = seg->fd;
+	job->count = seg->count;
+	job->n = n;
+	memcpy(job->recs, pending, n * RECSIZE);
+
+	pending_count -= n;
+	memmove(pending, pending + n, pending_count * RECSIZE);
+
+	whowas_log_busy = true;
+	rb_job_post(write_work, write_done, job);
+}
+
+uint64_t
+whowas_log_add(struct Whowas *who)
+{
+	struct whowas_log_record *rec;
+
+	if(segments[SEG_CUR].fd < 0)
+		return next_serial++;
+
+	if(pending_count == pending_size)
+	{
+		/* the disk is this far behind; leave the rest to the ring */
+		if(pending_size == WHOWAS_LOG_PENDING_MAX)
+		{
+			pending_dropped++;
+			return next_serial++;
+		}
+
+		pending_size = pending_size ? pending_size * 2 : WHOWAS_LOG_PENDING;
+		pending = rb_realloc(pending, pending_size * RECSIZE);
+	}
+
+	rec = &pending[pending_count++];
+	memset(rec, 0, sizeof(*rec));
+
+	rec->serial = next_serial;
+	rec->logoff = who->logoff;
+	rec->flags = who->flags;
+	rb_strlcpy(rec->name, who->name, sizeof(rec->name));
+	rb_strlcpy(rec->username, who->username, sizeof(rec->username));
+	rb_strlcpy(rec->hostname, who->hostname, sizeof(rec->hostname));
+	rb_strlcpy(rec->sockhost, who->sockhost, sizeof(rec->sockhost));
+	rb_strlcpy(rec->realname, who->realname, sizeof(rec->realname));
+	rb_strlcpy(rec->suser, who->suser, sizeof(rec->suser));
+	rb_strlcpy(rec->servername, who->servername, sizeof(rec->servername));
+
+	if(pending_count >= WHOWAS_LOG_PENDING)
+		whowas_log_flush(NULL);
+
+	return next_serial++;
+}
+
+void
+whowas_log_search(const char *nick, uint64_t before,
+		int (*cb)(struct Whowas *, void *), void *data)
+{
+	struct whowas_log_nick *wn;
+	struct Whowas who;
+
+	if(whowas_log_index == NULL)
+		return;
+
+	wn = rb_radixtree_retrieve(whowas_log_index, nick);
+	if(wn == NULL)
+		return;
+
+	/* newest first, like the in-memory list */
+	for(uint32_t i = wn->count; i > 0; i--)
+	{
+		const struct whowas_log_record *r = index_record(wn->recs[i - 1]);
+
+		if(r == NULL || r->serial >= before || record_expired(r))
+			continue;
+
+		memset(&who, 0, sizeof(who));
+		rb_strlcpy(who.name, r->name, sizeof(who.name));
+		who.username = r->username;
+		who.hostname = r->hostname;
+		who.sockhost = r->sockhost;
+		who.realname = r->realname;
+		who.suser = r->suser;
+		who.servername = r->servername;
+		who.flags = r->flags;
+		who.logoff = r->logoff;
+		who.serial = r->serial;
+
+		if(cb(&who, data))
+			return;
+	}
+}
+
+void
+whowas_log_open(void)
+{
+	char oldpath[PATH_MAX];
+	const char *path = ConfigFileEntry.fname_whowaslog;
+
+	if(whowas_log_path != NULL && path != NULL && !strcmp(whowas_log_path, path) &&
+			segments[SEG_CUR].maplen >= segment_maplen())
+		return;
+
+	whowas_log_close();
+
+	if(EmptyString(path))
+		return;
+
+	whowas_log_path = rb_strdup(path);
+	old_path(oldpath, sizeof(oldpath));
+
+	segments[SEG_OLD].base = 0;
+	segment_open(&segments[SEG_OLD], oldpath, false);
+	segments[SEG_CUR].base = segments[SEG_OLD].count;
+	if(!segment_open(&segments[SEG_CUR], whowas_log_path, true))
+	{
+		whowas_log_close();
+		return;
+	}
+
+	index_build();
+	whowas_log_ev = rb_event_add("whowas_log_flush", whowas_log_flush, NULL, WHOWAS_LOG_FLUSH_TIME);
+}
+
+void
+whowas_log_close(void)
+{
+	/* write out what is pending; jobs only finish when drained */
+	rb_job_drain();
+	while(whowas_log_busy || (pending_count > 0 && segments[SEG_CUR].fd >= 0))
+	{
+		whowas_log_flush(NULL);
+		rb_job_drain();
+	}
+	pending_count = 0;
+
+	if(whowas_log_ev != NULL)
+	{
+		rb_event_delete(whowas_log_ev);
+		whowas_log_ev = NULL;
+	}
+
+	segment_close(&segments[SEG_OLD]);
+	segment_close(&segments[SEG_CUR]);
+	index_destroy();
+
+	rb_free(whowas_log_path);
+	whowas_log_path = NULL;
+}
+
+void
+whowas_log_memory_usage(size_t *count, size_t *memused)
+{
+	*count = segments[SEG_OLD].count + segments[SEG_CUR].count;
+	*memused = whowas_log_index_memory;
+	if(whowas_log_index != NULL)
+		*memused += rb_radixtree_size(whowas_log_index) * sizeof(void *);
+}
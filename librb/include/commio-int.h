@@ -75,8 +75,17 @@ struct acceptdata
 	ACCB *callback;
 	ACPRE *precb;
 	void *data;
+	unsigned long deferred;
+	unsigned int budget;
+	int priority;
+	rb_dlink_node node;
+	rb_dlink_list *queued;	/* the accept queue it is on, if any */
 };
 
+/* most connections accepted from one listener per pass of the event
+ * loop, unless rb_set_accept_budget() says otherwise */
+#define RB_ACCEPT_BATCH 64
+
 /* Only have open flags for now, could be more later */
 #define FLAG_OPEN	0x1
 #define IsFDOpen(F)	(F->flags & FLAG_OPEN)
@@ -106,6 +115,7 @@ struct _fde
 	void *ssl;
 	unsigned int handshake_count;
 	unsigned long ssl_errno;
+	struct rb_iothread_conn *io;
 };
 
 typedef void (*comm_event_cb_t) (void *);
@@ -122,6 +132,12 @@ typedef struct timer_data
 
 extern rb_dlink_list *rb_fd_table;
 
+/* iothread.c: reads and read interest for a socket an I/O thread has;
+ * the last two return 0 when F is to be handled as usual after all */
+void rb_iothread_close(rb_fde_t *F);
+int rb_iothread_setselect(rb_fde_t *F, PF *handler, void *client_data);
+int rb_iothread_read(rb_fde_t *F, void *buf, int count, ssize_t *ret);
+
 static inline rb_fde_t *
 rb_find_fd(int fd)
 {
@@ -155,6 +171,9 @@ void rb_io_unsched_event(struct ev_entry *ev);
 int rb_io_supports_event(void);
 void rb_io_init_event(void);
 
+/* each backend calls this as soon as its wait for I/O returns */
+void rb_select_woke(void);
+
 /* epoll versions */
 void rb_setselect_epoll(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
 int rb_init_netio_epoll(void);
@@ -45,8 +45,9 @@ typedef void CNCB(rb_fde_t *, int, void *);
 typedef void DUMPCB(int, const char *desc, void *);
 /* callback for accept callbacks */
 typedef void ACCB(rb_fde_t *, int status, struct sockaddr *addr, rb_socklen_t len, void *);
-/* callback for pre-accept callback */
-typedef int ACPRE(rb_fde_t *, struct sockaddr *addr, rb_socklen_t len, void *);
+/* callback for pre-accept callback, given the bare descriptor before an
+ * rb_fde_t is set up for it; returning 0 hands the descriptor over to it */
+typedef int ACPRE(int fd, struct sockaddr *addr, rb_socklen_t len, void *);
 
 enum
 {
@@ -137,6 +138,10 @@ int rb_bind(rb_fde_t *F, struct sockaddr *addr);
 int rb_sctp_bindx(rb_fde_t *F, struct sockaddr_storage *addrs, size_t len);
 
 void rb_accept_tcp(rb_fde_t *, ACPRE * precb, ACCB * callback, void *data);
+unsigned long rb_get_accept_deferred(rb_fde_t *);
+void rb_set_accept_budget(rb_fde_t *, unsigned int budget, int priority);
+int rb_get_accept_backlog(rb_fde_t *, unsigned int *queued, unsigned int *limit);
+int rb_set_reuseport(rb_fde_t *);
 ssize_t rb_write(rb_fde_t *, const void *buf, int count);
 ssize_t rb_writev(rb_fde_t *, struct rb_iovec *vector, int count);
 
@@ -158,6 +163,17 @@ int rb_ignore_errno(int);
 void rb_setselect(rb_fde_t *, unsigned int type, PF * handler, void *client_data);
 void rb_init_netio(void);
 int rb_select(unsigned long);
+/* event loop counters, in nanoseconds */
+struct rb_loop_stats
+{
+	uint64_t iterations;
+	uint64_t wait_ns;	/* blocked waiting for I/O */
+	struct rb_hist io;	/* I/O callbacks, per pass */
+	struct rb_hist lag;	/* from waking up to waiting again, per pass */
+};
+
+const struct rb_loop_stats *rb_get_loop_stats(void);
+
 void rb_defer(void (*)(void *), void *);
 void rb_defer_once(void (*)(void *), void *);
 int rb_fd_ssl(rb_fde_t *F);
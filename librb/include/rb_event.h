@@ -41,6 +41,7 @@ void rb_event_init(void);
 void rb_event_delete(struct ev_entry *);
 void rb_set_back_events(time_t);
 void rb_dump_events(void (*func) (char *, void *), void *ptr);
+void rb_event_stats(void (*cb)(const char *name, const struct rb_hist *, void *), void *privdata);
 void rb_run_one_event(struct ev_entry *);
 void rb_run_one_event_for_tests(const char *name);
 time_t rb_event_next(void);
@@ -0,0 +1,83 @@
+/*
+ * ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ * rb_hashmap.h: Open-addressing string hash map.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice is present in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __rb_hashmap_H__
+#define __rb_hashmap_H__
+
+#include <stdbool.h>
+
+struct rb_hashmap;		/* defined in src/hashmap.c */
+
+typedef struct rb_hashmap rb_hashmap;
+
+/*
+ * rb_hashmap_create() creates a new hash map keyed on strings.  If fold is
+ * not NULL, it is a 256 byte table every key byte is passed through before
+ * hashing and comparing, so keys that fold to the same string are equal.
+ * Keys are copied.
+ */
+extern rb_hashmap *rb_hashmap_create(const char *name, const unsigned char *fold);
+
+/*
+ * rb_hashmap_destroy() destroys all entries in a map, and also optionally calls
+ * a defined callback function to destroy any data attached to it.
+ */
+extern void rb_hashmap_destroy(rb_hashmap *map,
+	void (*destroy_cb)(const char *key, void *data, void *privdata),
+	void *privdata);
+
+/*
+ * rb_hashmap_hash() returns the hash of a key, for use with the _hashed
+ * variants below when the same key is looked up and then added.
+ */
+extern uint32_t rb_hashmap_hash(const rb_hashmap *map, const char *key);
+
+/*
+ * rb_hashmap_add() adds a key->value entry to the map.  It returns false and
+ * leaves the map unchanged if the key is already present.
+ */
+extern bool rb_hashmap_add(rb_hashmap *map, const char *key, void *data);
+extern bool rb_hashmap_add_hashed(rb_hashmap *map, const char *key, uint32_t hash, void *data);
+
+/*
+ * rb_hashmap_retrieve() returns the data of a key, or NULL.
+ */
+extern void *rb_hashmap_retrieve(const rb_hashmap *map, const char *key);
+extern void *rb_hashmap_retrieve_hashed(const rb_hashmap *map, const char *key, uint32_t hash);
+
+/*
+ * rb_hashmap_delete() deletes a key->value entry from the map, returning the
+ * data it had, or NULL if it was not present.
+ */
+extern void *rb_hashmap_delete(rb_hashmap *map, const char *key);
+
+/*
+ * rb_hashmap_size() returns the number of entries in a map.
+ */
+extern unsigned int rb_hashmap_size(const rb_hashmap *map);
+
+/*
+ * rb_hashmap_stats() outputs hash map stats using a callback.
+ */
+extern void rb_hashmap_stats(rb_hashmap *map, void (*cb)(const char *line, void *privdata), void *privdata);
+extern void rb_hashmap_stats_walk(void (*cb)(const char *line, void *privdata), void *privdata);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  rb_hist.h: Cheap log-scale histograms for timings and sizes.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef RB_LIB_H
+# error "Do not use rb_hist.h directly"
+#endif
+
+#ifndef __RB_HIST_H__
+#define __RB_HIST_H__
+
+/*
+ * Bucket i counts values up to 4^i, and the last bucket everything
+ * above.  In nanoseconds that spans 1ns to about 4 seconds, in bytes
+ * 1 byte to 4 gigabytes, so one layout does for both and a zeroed
+ * struct is ready to use.
+ */
+#define RB_HIST_BUCKETS 18
+
+struct rb_hist
+{
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[RB_HIST_BUCKETS];
+};
+
+/* upper bound of bucket i; the last bucket has none */
+static inline uint64_t
+rb_hist_bound(int i)
+{
+	return (uint64_t)1 << (2 * i);
+}
+
+static inline void
+rb_hist_add(struct rb_hist *h, uint64_t v)
+{
+	int i = 0;
+
+	if(v > 1)
+	{
+		i = (64 - __builtin_clzll(v - 1) + 1) / 2;
+		if(i >= RB_HIST_BUCKETS)
+			i = RB_HIST_BUCKETS - 1;
+	}
+
+	h->count++;
+	h->sum += v;
+	if(v > h->max)
+		h->max = v;
+	h->bucket[i]++;
+}
+
+/* upper bound of the bucket holding the q'th quantile, or max beyond the last bound */
+static inline uint64_t
+rb_hist_quantile(const struct rb_hist *h, double q)
+{
+	uint64_t want = (uint64_t)(q * h->count), seen = 0;
+
+	for(int i = 0; i < RB_HIST_BUCKETS - 1; i++)
+	{
+		seen += h->bucket[i];
+		if(seen > want)
+			return rb_hist_bound(i) < h->max ? rb_hist_bound(i) : h->max;
+	}
+	return h->max;
+}
+
+/* monotonic clock in nanoseconds, for timing */
+static inline uint64_t
+rb_hist_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* __RB_HIST_H__ */
@@ -0,0 +1,54 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  rb_iothread.h: Socket reads on their own threads.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef RB_LIB_H
+# error "Do not use rb_iothread.h directly"
+#endif
+
+#ifndef __RB_IOTHREAD_H__
+#define __RB_IOTHREAD_H__
+
+/*
+ * An attached socket is read by an I/O thread with its own epoll set,
+ * into a small buffer that rb_read() then copies from on the event
+ * loop.  Nothing else changes for the caller: RB_SELECT_READ handlers
+ * are still called on the event loop, when the buffer has data or the
+ * socket has hit EOF or an error, and writes are untouched.
+ *
+ * Only available with epoll; elsewhere rb_iothread_init() starts
+ * nothing and rb_iothread_attach() always fails.
+ */
+
+/* start threads until there are count of them; returns how many there are */
+int rb_iothread_init(int count);
+
+/* hand F's reads to the least busy thread; returns 0 if F stays on the
+ * event loop (no threads, or not a plain stream socket) */
+int rb_iothread_attach(rb_fde_t *F);
+
+/* take F's reads back; whatever the thread had already read is still
+ * returned by rb_read() first.  Returns 0 if F was not attached.
+ * rb_close() does this itself. */
+int rb_iothread_detach(rb_fde_t *F);
+
+/* sockets currently attached */
+unsigned long rb_iothread_count(void);
+
+#endif /* __RB_IOTHREAD_H__ */
@@ -0,0 +1,52 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  rb_job.h: A small thread pool for CPU-heavy, self-contained work.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#ifndef RB_LIB_H
+# error "Do not use rb_job.h directly"
+#endif
+
+#ifndef __RB_JOB_H__
+#define __RB_JOB_H__
+
+/*
+ * A job is a pair of callbacks sharing one data pointer.  work runs on
+ * a pool thread and must only touch what data points to: no librb
+ * calls other than the ones documented as safe (rb_crypt_r), no
+ * clients, no sending.  done then runs on the event loop, in the order
+ * the jobs finished, and is where the result is used and data freed.
+ *
+ * Until rb_job_init() has started any threads, rb_job_post() runs both
+ * callbacks before it returns.
+ */
+typedef void rb_job_cb(void *);
+
+/* start threads until there are count of them; returns how many there are */
+int rb_job_init(int count);
+
+void rb_job_post(rb_job_cb *work, rb_job_cb *done, void *data);
+
+/* wait for every posted job and run its done callback, e.g. before
+ * unloading the module the callbacks live in */
+void rb_job_drain(void);
+
+/* jobs posted whose done callback has not run yet */
+unsigned long rb_job_pending(void);
+
+#endif /* __RB_JOB_H__ */
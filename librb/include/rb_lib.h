@@ -158,6 +158,7 @@ int rb_gettimeofday(struct timeval *, void *);
 
 void rb_sleep(unsigned int seconds, unsigned int useconds);
 char *rb_crypt(const char *, const char *);
+char *rb_crypt_r(const char *, const char *, char *, size_t);
 
 unsigned char *rb_base64_encode(const unsigned char *str, int length);
 unsigned char *rb_base64_decode(const unsigned char *str, int length, int *ret);
@@ -167,12 +168,15 @@ int rb_setenv(const char *, const char *, int);
 
 
 #include <rb_tools.h>
+#include <rb_hist.h>
 #include <rb_memory.h>
 #include <rb_commio.h>
 #include <rb_balloc.h>
 #include <rb_linebuf.h>
 #include <rb_event.h>
 #include <rb_helper.h>
+#include <rb_job.h>
+#include <rb_iothread.h>
 #include <rb_rawbuf.h>
 #include <rb_patricia.h>
 
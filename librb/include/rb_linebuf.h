@@ -51,8 +51,22 @@ typedef struct _buf_line
 	uint8_t raw;		/* Whether this linebuf may hold 8-bit data */
 	int len;		/* How much data we've got */
 	int refcount;		/* how many linked lists are we in? */
+	const void *lossy;	/* if set, may be shed from any queue but this owner's */
 } buf_line_t;
 
+/*
+ * What a group of buf_head_ts have queued between them.  A buf_head_t
+ * charged to an account also charges every parent of it, so the
+ * accounts form a tree whose root sees everything below it.
+ */
+typedef struct _buf_account
+{
+	struct _buf_account *parent;
+	size_t len;		/* bytes queued, kept up to date as they change */
+	size_t pinned;		/* of len, queued on pinned buf_head_ts */
+	size_t limit;		/* for the owner to enforce, 0 for none */
+} buf_account_t;
+
 typedef struct _buf_head
 {
 	rb_dlink_list list;	/* the actual dlink list */
@@ -60,6 +74,8 @@ typedef struct _buf_head
 	int alloclen;		/* Actual allocated data length */
 	int writeofs;		/* offset in the first line for the write */
 	int numlines;		/* number of lines */
+	buf_account_t *account;	/* charged for len, if set */
+	uint8_t pinned;		/* charged as pinned, for the owner to leave alone */
 } buf_head_t;
 
 /* they should be functions, but .. */
@@ -74,6 +90,10 @@ int rb_linebuf_parse(buf_head_t *, char *, int, int);
 int rb_linebuf_get(buf_head_t *, char *, int, int, int);
 void rb_linebuf_put(buf_head_t *, const rb_strf_t *);
 void rb_linebuf_attach(buf_head_t *, buf_head_t *);
+void rb_linebuf_set_account(buf_head_t *, buf_account_t *);
+void rb_linebuf_set_pinned(buf_head_t *, int pinned);
+void rb_linebuf_set_lossy(buf_head_t *, const void *owner);
+int rb_linebuf_shed(buf_head_t *, const void *owner, int want);
 void rb_count_rb_linebuf_memory(size_t *, size_t *);
 int rb_linebuf_flush(rb_fde_t *F, buf_head_t *);
 
@@ -63,6 +63,7 @@ rb_patricia_tree_t;
 
 
 rb_patricia_node_t *rb_match_ip(rb_patricia_tree_t *tree, struct sockaddr *ip);
+rb_patricia_node_t *rb_match_ip_exact(rb_patricia_tree_t *tree, struct sockaddr *ip, unsigned int bitlen);
 rb_patricia_node_t *rb_match_string(rb_patricia_tree_t *tree, const char *string);
 rb_patricia_node_t *rb_match_exact_string(rb_patricia_tree_t *tree, const char *string);
 rb_patricia_node_t *rb_patricia_search_exact(rb_patricia_tree_t *patricia, rb_prefix_t *prefix);
@@ -59,6 +59,10 @@ struct defer
 };
 static rb_dlink_list defer_list;
 
+static struct rb_loop_stats loop_stats;
+static uint64_t loop_entered;	/* when rb_select() last started waiting */
+static uint64_t loop_woke;	/* when that wait returned, 0 while waiting */
+
 static struct ev_entry *rb_timeout_ev;
 
 
@@ -75,7 +79,10 @@ int rb_maxconnections = 0;
 
 static PF rb_connect_timeout;
 static PF rb_connect_outcome;
+static PF rb_accept_tryaccept;
 static void mangle_mapped_sockaddr(struct sockaddr *in);
+static void rb_accept_queue(rb_fde_t *F);
+static int (*setup_fd_handler) (rb_fde_t *);
 
 static inline rb_fde_t *
 add_fd(int fd)
@@ -357,6 +364,24 @@ rb_setsockopt_reuseaddr(rb_fde_t *F)
 	return 0;
 }
 
+/* let several sockets bind the same address, the kernel spreading new
+ * connections over them; must come before rb_bind() */
+int
+rb_set_reuseport(rb_fde_t *F)
+{
+#ifdef SO_REUSEPORT
+	int opt_one = 1;
+
+	if(F == NULL)
+		return -1;
+
+	return setsockopt(F->fd, SOL_SOCKET, SO_REUSEPORT, &opt_one, sizeof(opt_one));
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 #ifdef HAVE_LIBSCTP
 static int
 rb_setsockopt_sctp(rb_fde_t *F)
@@ -506,24 +531,91 @@ rb_sctp_bindx(rb_fde_t *F, struct sockaddr_storage *addrs, size_t len)
 #endif
 }
 
-static void rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused))) {
+/*
+ * accept one connection, already non-blocking and close-on-exec.
+ * returns -1 with errno set when the backlog is empty or on error.
+ */
+static int
+rb_accept_fd(int fd, struct sockaddr *addr, rb_socklen_t *addrlen)
+{
+	int new_fd;
+#ifdef HAVE_ACCEPT4
+	new_fd = accept4(fd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+	int res;
+
+	new_fd = accept(fd, addr, addrlen);
+	if(new_fd < 0)
+		return -1;
+
+	res = fcntl(new_fd, F_GETFL, 0);
+	if(res == -1 || fcntl(new_fd, F_SETFL, res | O_NONBLOCK) == -1 ||
+	   fcntl(new_fd, F_SETFD, FD_CLOEXEC) == -1)
+	{
+		rb_lib_log("rb_accept: Couldn't set FD %d non blocking!", new_fd);
+		close(new_fd);
+		/* reported like an interrupted accept, so the caller moves on */
+		errno = EINTR;
+		return -1;
+	}
+#endif
+	return new_fd;
+}
+
+/*
+ * Listeners are not drained from their select handler but queued, and
+ * once per pass of the event loop the queue is drained in priority
+ * order, each listener up to its budget.  A flood on one port then
+ * costs the others at most that port's budget per pass, and never
+ * delays a port with a higher priority.
+ */
+static rb_dlink_list accept_queue;	/* waiting for the next pass */
+static rb_dlink_list accept_draining;	/* the rest of this pass */
+static int accept_scheduled;
+
+static void
+rb_accept_batch(rb_fde_t *F)
+{
 	struct rb_sockaddr_storage st;
 	rb_fde_t *new_F;
 	rb_socklen_t addrlen;
 	int new_fd;
 
-	while(1)
+	for(unsigned int count = 0;; count++)
 	{
+		if(count == F->accept->budget)
+		{
+			/* leave the rest of the backlog for the next pass.
+			 * no read handler is set meanwhile, and the event
+			 * backends may be edge triggered, so come back on our own.
+			 */
+			F->accept->deferred++;
+			rb_accept_queue(F);
+			return;
+		}
+
 		memset(&st, 0, sizeof(st));
 		addrlen = sizeof(st);
 
-		new_fd = accept(F->fd, (struct sockaddr *)&st, &addrlen);
+		new_fd = rb_accept_fd(F->fd, (struct sockaddr *)&st, &addrlen);
 		if(new_fd < 0)
 		{
+			if(errno == EINTR)
+				continue;
 			rb_setselect(F, RB_SELECT_ACCEPT, rb_accept_tryaccept, NULL);
 			return;
 		}
 
+		mangle_mapped_sockaddr((struct sockaddr *)&st);
+
+		/* the pre-callback sees the bare descriptor, so connections
+		 * it drops never cost an rb_fde_t */
+		if(F->accept->precb != NULL)
+		{
+			if(!F->accept->precb(new_fd, (struct sockaddr *)&st, addrlen, F->accept->data))	/* pre-callback decided to drop it */
+				continue;
+		}
+
 		new_F = rb_open(new_fd, RB_FD_SOCKET | (F->type & RB_FD_INHERIT_TYPES), "Incoming Connection");
 
 		if(new_F == NULL)
@@ -535,19 +627,13 @@ static void rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused)))
 			continue;
 		}
 
-		if(rb_unlikely(!rb_set_nb(new_F)))
+		if(rb_unlikely(setup_fd_handler(new_F)))
 		{
-			rb_lib_log("rb_accept: Couldn't set FD %d non blocking!", new_F->fd);
+			rb_lib_log("rb_accept: Couldn't set up FD %d!", new_F->fd);
 			rb_close(new_F);
+			continue;
 		}
 
-		mangle_mapped_sockaddr((struct sockaddr *)&st);
-
-		if(F->accept->precb != NULL)
-		{
-			if(!F->accept->precb(new_F, (struct sockaddr *)&st, addrlen, F->accept->data))	/* pre-callback decided to drop it */
-				continue;
-		}
 #ifdef HAVE_SSL
 		if(F->type & RB_FD_SSL)
 		{
@@ -559,8 +645,92 @@ static void rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused)))
 			F->accept->callback(new_F, RB_OK, (struct sockaddr *)&st, addrlen,
 					    F->accept->data);
 		}
+
+		/* the callback may have closed the listener */
+		if(!IsFDOpen(F))
+			return;
 	}
+}
 
+static void
+rb_accept_pass(void *unused)
+{
+	rb_dlink_node *ptr;
+
+	accept_scheduled = 0;
+
+	/* anything queued from here on waits for the next pass.  each
+	 * listener moves on its own, so queued always names its list;
+	 * they go to the head from the tail, which keeps their order */
+	while((ptr = accept_queue.tail) != NULL)
+	{
+		rb_fde_t *F = ptr->data;
+
+		rb_dlinkMoveNode(ptr, &accept_queue, &accept_draining);
+		F->accept->queued = &accept_draining;
+	}
+
+	/* rb_close() takes a listener off this list if a callback closes it */
+	while((ptr = accept_draining.head) != NULL)
+	{
+		rb_fde_t *F = ptr->data;
+
+		rb_dlinkDelete(ptr, &accept_draining);
+		F->accept->queued = NULL;
+		rb_accept_batch(F);
+	}
+}
+
+static void
+rb_accept_unqueue(rb_fde_t *F)
+{
+	if(F->accept->queued != NULL)
+	{
+		rb_dlinkDelete(&F->accept->node, F->accept->queued);
+		F->accept->queued = NULL;
+	}
+}
+
+/* highest priority first, and in arrival order within one */
+static void
+rb_accept_insert(rb_fde_t *F, rb_dlink_list *list)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, list->head)
+	{
+		rb_fde_t *other = ptr->data;
+
+		if(other->accept->priority < F->accept->priority)
+			break;
+	}
+
+	if(ptr != NULL)
+		rb_dlinkAddBefore(ptr, F, &F->accept->node, list);
+	else
+		rb_dlinkAddTail(F, &F->accept->node, list);
+	F->accept->queued = list;
+}
+
+static void
+rb_accept_queue(rb_fde_t *F)
+{
+	if(F->accept->queued != NULL)
+		return;
+
+	rb_accept_insert(F, &accept_queue);
+
+	if(!accept_scheduled)
+	{
+		accept_scheduled = 1;
+		rb_defer(rb_accept_pass, NULL);
+	}
+}
+
+static void
+rb_accept_tryaccept(rb_fde_t *F, void *data __attribute__((unused)))
+{
+	rb_accept_queue(F);
 }
 
 /* try to accept a TCP connection */
@@ -575,7 +745,64 @@ rb_accept_tcp(rb_fde_t *F, ACPRE * precb, ACCB * callback, void *data)
 	F->accept->callback = callback;
 	F->accept->data = data;
 	F->accept->precb = precb;
-	rb_accept_tryaccept(F, NULL);
+	F->accept->deferred = 0;
+	F->accept->budget = RB_ACCEPT_BATCH;
+	F->accept->priority = 0;
+	rb_accept_queue(F);
+}
+
+/* at most budget accepts per pass of the event loop (0 for the default),
+ * and listeners with a higher priority are drained first */
+void
+rb_set_accept_budget(rb_fde_t *F, unsigned int budget, int priority)
+{
+	if(F == NULL || F->accept == NULL)
+		return;
+
+	F->accept->budget = budget != 0 ? budget : RB_ACCEPT_BATCH;
+	if(F->accept->priority == priority)
+		return;
+
+	F->accept->priority = priority;
+
+	/* waiting in this pass or the next, it moves within that one */
+	if(F->accept->queued != NULL)
+	{
+		rb_dlink_list *list = F->accept->queued;
+
+		rb_accept_unqueue(F);
+		rb_accept_insert(F, list);
+	}
+}
+
+/* connections waiting in the kernel's accept queue, and its size */
+int
+rb_get_accept_backlog(rb_fde_t *F, unsigned int *queued, unsigned int *limit)
+{
+#if defined(TCP_INFO) && defined(__linux__)
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+
+	if(F == NULL || (F->type & RB_FD_SCTP) ||
+	   getsockopt(F->fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+		return -1;
+
+	/* for a listening socket these are the accept queue's length and limit */
+	*queued = info.tcpi_unacked;
+	*limit = info.tcpi_sacked;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* how many times the accept loop stopped at RB_ACCEPT_BATCH */
+unsigned long
+rb_get_accept_deferred(rb_fde_t *F)
+{
+	if(F == NULL || F->accept == NULL)
+		return 0;
+	return F->accept->deferred;
 }
 
 /*
@@ -1096,7 +1323,10 @@ rb_close(rb_fde_t *F)
 	}
 
 	rb_setselect(F, RB_SELECT_WRITE | RB_SELECT_READ, NULL, NULL);
+	rb_iothread_close(F);
 	rb_settimeout(F, 0, NULL, NULL);
+	if(F->accept != NULL)
+		rb_accept_unqueue(F);
 	rb_free(F->accept);
 	rb_free(F->connect);
 	rb_free(F->desc);
@@ -1202,6 +1432,9 @@ rb_read(rb_fde_t *F, void *buf, int count)
 	if(F == NULL)
 		return 0;
 
+	if(F->io != NULL && rb_iothread_read(F, buf, count, &ret))
+		return ret;
+
 	/* This needs to be *before* RB_FD_SOCKET otherwise you'll process
 	 * an SSL socket as a regular socket
 	 */
@@ -1776,7 +2009,6 @@ rb_inet_pton(int af, const char *src, void *dst)
 
 static void (*setselect_handler) (rb_fde_t *, unsigned int, PF *, void *);
 static int (*select_handler) (long);
-static int (*setup_fd_handler) (rb_fde_t *);
 static int (*io_sched_event) (struct ev_entry *, int);
 static void (*io_unsched_event) (struct ev_entry *);
 static int (*io_supports_event) (void);
@@ -1993,6 +2225,14 @@ rb_init_netio(void)
 void
 rb_setselect(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
 {
+	/* an I/O thread watches for reads itself */
+	if(F->io != NULL && (type & RB_SELECT_READ) && rb_iothread_setselect(F, handler, client_data))
+	{
+		type &= ~RB_SELECT_READ;
+		if(type == 0)
+			return;
+	}
+
 	setselect_handler(F, type, handler, client_data);
 }
 
@@ -2019,10 +2259,46 @@ rb_defer_once(void (*fn)(void *), void *data)
 	rb_defer(fn, data);
 }
 
+/* called by the backends when their wait for I/O returns */
+void
+rb_select_woke(void)
+{
+	if(loop_woke != 0)
+		return;
+
+	loop_woke = rb_hist_now();
+	loop_stats.wait_ns += loop_woke - loop_entered;
+}
+
+const struct rb_loop_stats *
+rb_get_loop_stats(void)
+{
+	return &loop_stats;
+}
+
 int
 rb_select(unsigned long timeout)
 {
-	int ret = select_handler(timeout);
+	int ret;
+	uint64_t now;
+
+	/* deferred work must not wait behind a blocking poll */
+	if(rb_dlink_list_length(&defer_list) > 0)
+		timeout = 0;
+
+	now = rb_hist_now();
+	if(loop_woke != 0)
+		rb_hist_add(&loop_stats.lag, now - loop_woke);
+	loop_entered = now;
+	loop_woke = 0;
+
+	ret = select_handler(timeout);
+
+	/* in case the backend returned without saying it woke */
+	rb_select_woke();
+	rb_hist_add(&loop_stats.io, rb_hist_now() - loop_woke);
+	loop_stats.iterations++;
+
 	rb_dlink_node *ptr, *next;
 	RB_DLINK_FOREACH_SAFE(ptr, next, defer_list.head)
 	{
@@ -30,14 +30,44 @@
 #include <librb_config.h>
 #include <rb_lib.h>
 
+#include <pthread.h>
+
 static char *rb_md5_crypt(const char *pw, const char *salt);
 static char *rb_des_crypt(const char *pw, const char *salt);
 static char *rb_sha256_crypt(const char *key, const char *salt);
 static char *rb_sha512_crypt(const char *key, const char *salt);
+static char *rb_sha256_crypt_r(const char *key, const char *salt, char *buffer, int buflen);
+static char *rb_sha512_crypt_r(const char *key, const char *salt, char *buffer, int buflen);
+
+/* the MD5 and DES code keeps its state in statics */
+static pthread_mutex_t rb_legacy_crypt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *
+rb_legacy_crypt(const char *key, const char *salt, char *buf, size_t len)
+{
+	char *ret;
+
+	pthread_mutex_lock(&rb_legacy_crypt_lock);
+	if(salt[0] == '$')
+		ret = rb_md5_crypt(key, salt);
+	else
+		ret = rb_des_crypt(key, salt);
+
+	if(ret != NULL)
+	{
+		rb_strlcpy(buf, ret, len);
+		ret = buf;
+	}
+	pthread_mutex_unlock(&rb_legacy_crypt_lock);
+
+	return ret;
+}
 
 char *
 rb_crypt(const char *key, const char *salt)
 {
+	static char legacy[128];
+
 	/* First, check if we are supposed to be using a replacement
 	 * hash instead of DES...  */
 	if(salt[0] == '$' && (salt[2] == '$' || salt[3] == '$'))
@@ -45,7 +75,7 @@ rb_crypt(const char *key, const char *salt)
 		switch(salt[1])
 		{
 		case '1':
-			return rb_md5_crypt(key, salt);
+			return rb_legacy_crypt(key, salt, legacy, sizeof legacy);
 		case '5':
 			return rb_sha256_crypt(key, salt);
 		case '6':
@@ -55,7 +85,29 @@ rb_crypt(const char *key, const char *salt)
 		}
 	}
 	else
-		return rb_des_crypt(key, salt);
+		return rb_legacy_crypt(key, salt, legacy, sizeof legacy);
+}
+
+/* rb_crypt() into the caller's buffer, which is safe in a job thread */
+char *
+rb_crypt_r(const char *key, const char *salt, char *buf, size_t len)
+{
+	if(salt[0] == '$' && (salt[2] == '$' || salt[3] == '$'))
+	{
+		switch(salt[1])
+		{
+		case '1':
+			return rb_legacy_crypt(key, salt, buf, len);
+		case '5':
+			return rb_sha256_crypt_r(key, salt, buf, len);
+		case '6':
+			return rb_sha512_crypt_r(key, salt, buf, len);
+		default:
+			return NULL;
+		}
+	}
+	else
+		return rb_legacy_crypt(key, salt, buf, len);
 }
 
 #define b64_from_24bit(B2, B1, B0, N)					\
@@ -218,6 +218,7 @@ rb_select_devpoll(long delay)
 			return RB_ERROR;
 		}
 
+		rb_select_woke();
 		rb_set_time();
 		if(num == 0)
 			continue;
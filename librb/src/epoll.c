@@ -174,6 +174,7 @@ rb_select_epoll(long delay)
 
 	/* save errno as rb_set_time() will likely clobber it */
 	o_errno = errno;
+	rb_select_woke();
 	rb_set_time();
 	errno = o_errno;
 
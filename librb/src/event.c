@@ -156,12 +156,22 @@ rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish)
 		rb_event_frequency(delta_ish), delta_ish);
 }
 
+/* run an event, timing it */
+static void
+rb_event_call(struct ev_entry *ev)
+{
+	uint64_t start;
+
+	rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
+	start = rb_hist_now();
+	ev->func(ev->arg);
+	rb_hist_add(&ev->time, rb_hist_now() - start);
+}
 
 void
 rb_run_one_event(struct ev_entry *ev)
 {
-	rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-	ev->func(ev->arg);
+	rb_event_call(ev);
 	if(!ev->frequency)
 	{
 		rb_event_delete(ev);
@@ -218,8 +228,7 @@ rb_event_run(void)
 		}
 		if(ev->when <= rb_current_time())
 		{
-			rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-			ev->func(ev->arg);
+			rb_event_call(ev);
 
 			/* event is scheduled more than once */
 			if(ev->frequency)
@@ -282,18 +291,41 @@ rb_dump_events(void (*func) (char *, void *), void *ptr)
 	snprintf(buf, sizeof buf, "Last event to run: %s", last_event_ran);
 	func(buf, ptr);
 
-	rb_strlcpy(buf, "Operation                    Next Execution", sizeof buf);
+	rb_strlcpy(buf, "Operation                    Next Execution               Runs     Avg usec Max usec", sizeof buf);
 	func(buf, ptr);
 
 	RB_DLINK_FOREACH(dptr, event_list.head)
 	{
 		ev = dptr->data;
-		snprintf(buf, sizeof buf, "%-28s %-4lld seconds (frequency=%d)", ev->name,
-			    (long long)(ev->when - rb_current_time()), (int)ev->frequency);
+		snprintf(buf, sizeof buf, "%-28s %-4lld seconds (frequency=%-4d) %-8llu %-8llu %llu", ev->name,
+			    (long long)(ev->when - rb_current_time()), (int)ev->frequency,
+			    (unsigned long long)ev->time.count,
+			    (unsigned long long)(ev->time.count ? ev->time.sum / ev->time.count / 1000 : 0),
+			    (unsigned long long)(ev->time.max / 1000));
 		func(buf, ptr);
 	}
 }
 
+/*
+ * void rb_event_stats(cb, privdata)
+ * Input: Callback, and data to pass it.
+ * Output: None.
+ * Side-effects: Calls cb with the name and run times of each event.
+ */
+void
+rb_event_stats(void (*cb)(const char *name, const struct rb_hist *, void *), void *privdata)
+{
+	rb_dlink_node *ptr;
+	struct ev_entry *ev;
+
+	RB_DLINK_FOREACH(ptr, event_list.head)
+	{
+		ev = ptr->data;
+		if(!ev->dead)
+			cb(ev->name, &ev->time, privdata);
+	}
+}
+
 /*
  * void rb_set_back_events(time_t by)
  * Input: Time to set back events by.
@@ -0,0 +1,506 @@
+/*
+ * ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ * hashmap.c: Open-addressing string hash map.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice is present in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The table is laid out in the manner of a "Swiss table": besides the
+ * array of slots there is one control byte per slot, holding either
+ * EMPTY, DELETED, or the top 7 bits of the slot's hash.  Lookups test a
+ * group of 8 control bytes at once with plain 64-bit arithmetic, and only
+ * touch the slots whose control byte matches, so a miss usually costs a
+ * single cache line.  Slots keep the full hash, which is compared before
+ * the key and reused when the table is resized.
+ *
+ * Resizing is incremental: a new table is allocated and each later add or
+ * delete moves a few slots from the old one, so no single call has to
+ * rehash the whole map.  Lookups check the new table and then the old.
+ */
+
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <rb_hashmap.h>
+
+#define HM_GROUP	8
+#define HM_EMPTY	0x80
+#define HM_DELETED	0xfe
+#define HM_MIN_SIZE	16
+#define HM_MIGRATE	32	/* old slots moved per add or delete */
+
+#define HM_LSB		UINT64_C(0x0101010101010101)
+#define HM_MSB		UINT64_C(0x8080808080808080)
+
+struct hm_slot
+{
+	uint32_t hash;
+	char *key;
+	void *data;
+};
+
+struct hm_table
+{
+	uint8_t *ctrl;
+	struct hm_slot *slots;
+	uint32_t mask;		/* slots - 1 */
+	uint32_t used;
+	uint32_t tombs;
+};
+
+struct rb_hashmap
+{
+	struct hm_table cur;
+	struct hm_table old;	/* being emptied into cur, if ctrl != NULL */
+	uint32_t migrate_pos;
+	unsigned int count;
+	const unsigned char *fold;
+	char *id;
+	rb_dlink_node node;
+};
+
+static rb_dlink_list hashmap_list = {NULL, NULL, 0};
+
+/* control bytes of a group, first slot in the lowest byte */
+static inline uint64_t
+hm_load(const uint8_t *ctrl)
+{
+	uint64_t w;
+
+	memcpy(&w, ctrl, sizeof w);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+/* lowest byte of a group with its top bit set in mask */
+static inline unsigned int
+hm_first(uint64_t mask)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(mask) >> 3;
+#else
+	unsigned int i = 0;
+
+	while ((mask & 0x80) == 0)
+	{
+		mask >>= 8;
+		i++;
+	}
+	return i;
+#endif
+}
+
+/* bytes equal to h2; may rarely flag a neighbour too, which the hash
+ * compare then rejects */
+static inline uint64_t
+hm_match(uint64_t group, uint8_t h2)
+{
+	uint64_t x = group ^ (HM_LSB * h2);
+
+	return (x - HM_LSB) & ~x & HM_MSB;
+}
+
+static inline uint64_t
+hm_match_empty(uint64_t group)
+{
+	return group & ~(group << 6) & HM_MSB;
+}
+
+static inline uint64_t
+hm_match_free(uint64_t group)
+{
+	return group & HM_MSB;
+}
+
+static inline uint8_t
+hm_h2(uint32_t hash)
+{
+	return hash >> 25;
+}
+
+static inline bool
+hm_keyeq(const rb_hashmap *map, const char *a, const char *b)
+{
+	const unsigned char *fold = map->fold;
+
+	if (fold == NULL)
+		return strcmp(a, b) == 0;
+
+	for (; fold[(unsigned char)*a] == fold[(unsigned char)*b]; a++, b++)
+	{
+		if (*a == '\0')
+			return true;
+	}
+
+	return false;
+}
+
+static void
+hm_table_alloc(struct hm_table *t, uint32_t size)
+{
+	t->ctrl = rb_malloc(size);
+	memset(t->ctrl, HM_EMPTY, size);
+	t->slots = rb_malloc(size * sizeof(struct hm_slot));
+	t->mask = size - 1;
+	t->used = 0;
+	t->tombs = 0;
+}
+
+static void
+hm_table_free(struct hm_table *t)
+{
+	rb_free(t->ctrl);
+	rb_free(t->slots);
+	memset(t, 0, sizeof *t);
+}
+
+static int64_t
+hm_table_find(const rb_hashmap *map, const struct hm_table *t, const char *key, uint32_t hash)
+{
+	uint32_t gmask, g;
+	uint8_t h2 = hm_h2(hash);
+
+	if (t->ctrl == NULL)
+		return -1;
+
+	gmask = (t->mask + 1) / HM_GROUP - 1;
+	g = hash & gmask;
+
+	for (uint32_t i = 0; i <= gmask; )
+	{
+		uint32_t base = g * HM_GROUP;
+		uint64_t group = hm_load(&t->ctrl[base]);
+
+		for (uint64_t m = hm_match(group, h2); m != 0; m &= m - 1)
+		{
+			uint32_t j = base + hm_first(m);
+
+			if (t->slots[j].hash == hash && hm_keyeq(map, t->slots[j].key, key))
+				return j;
+		}
+
+		if (hm_match_empty(group) != 0)
+			return -1;
+
+		i++;
+		g = (g + i) & gmask;
+	}
+
+	return -1;
+}
+
+/* claim a free slot for hash; the caller fills it in */
+static uint32_t
+hm_table_insert(struct hm_table *t, uint32_t hash)
+{
+	uint32_t gmask = (t->mask + 1) / HM_GROUP - 1;
+	uint32_t g = hash & gmask;
+
+	for (uint32_t i = 0; ; )
+	{
+		uint32_t base = g * HM_GROUP;
+		uint64_t m = hm_match_free(hm_load(&t->ctrl[base]));
+
+		if (m != 0)
+		{
+			uint32_t j = base + hm_first(m);
+
+			if (t->ctrl[j] == HM_DELETED)
+				t->tombs--;
+			t->ctrl[j] = hm_h2(hash);
+			t->used++;
+			return j;
+		}
+
+		i++;
+		g = (g + i) & gmask;
+	}
+}
+
+static void
+hm_migrate(rb_hashmap *map, uint32_t n)
+{
+	struct hm_table *old = &map->old;
+
+	while (old->ctrl != NULL && n-- > 0)
+	{
+		uint32_t j;
+
+		if (old->used == 0 || map->migrate_pos > old->mask)
+		{
+			hm_table_free(old);
+			return;
+		}
+
+		j = map->migrate_pos++;
+		if (old->ctrl[j] & HM_EMPTY)
+			continue;
+
+		map->cur.slots[hm_table_insert(&map->cur, old->slots[j].hash)] = old->slots[j];
+
+		/* keep the probe chains of the old table intact */
+		old->ctrl[j] = HM_DELETED;
+		old->used--;
+		old->tombs++;
+	}
+}
+
+static void
+hm_grow(rb_hashmap *map)
+{
+	uint32_t size = map->cur.mask + 1;
+
+	if (map->cur.used + map->cur.tombs + 1 <= size - size / 8)
+		return;
+
+	/* only one resize at a time */
+	hm_migrate(map, UINT32_MAX);
+
+	/* mostly tombstones: rebuild at the same size */
+	if (map->cur.used >= size / 2)
+		size *= 2;
+
+	map->old = map->cur;
+	map->migrate_pos = 0;
+	hm_table_alloc(&map->cur, size);
+}
+
+rb_hashmap *
+rb_hashmap_create(const char *name, const unsigned char *fold)
+{
+	rb_hashmap *map = rb_malloc(sizeof(rb_hashmap));
+
+	map->fold = fold;
+	map->id = rb_strdup(name);
+	hm_table_alloc(&map->cur, HM_MIN_SIZE);
+
+	rb_dlinkAdd(map, &map->node, &hashmap_list);
+
+	return map;
+}
+
+static void
+hm_table_destroy(struct hm_table *t,
+	void (*destroy_cb)(const char *key, void *data, void *privdata),
+	void *privdata)
+{
+	if (t->ctrl == NULL)
+		return;
+
+	for (uint32_t j = 0; j <= t->mask; j++)
+	{
+		if (t->ctrl[j] & HM_EMPTY)
+			continue;
+
+		if (destroy_cb != NULL)
+			destroy_cb(t->slots[j].key, t->slots[j].data, privdata);
+		rb_free(t->slots[j].key);
+	}
+
+	hm_table_free(t);
+}
+
+void
+rb_hashmap_destroy(rb_hashmap *map,
+	void (*destroy_cb)(const char *key, void *data, void *privdata),
+	void *privdata)
+{
+	lrb_assert(map != NULL);
+
+	hm_table_destroy(&map->cur, destroy_cb, privdata);
+	hm_table_destroy(&map->old, destroy_cb, privdata);
+
+	rb_dlinkDelete(&map->node, &hashmap_list);
+	rb_free(map->id);
+	rb_free(map);
+}
+
+uint32_t
+rb_hashmap_hash(const rb_hashmap *map, const char *key)
+{
+	const unsigned char *fold = map->fold;
+	uint32_t h = 0x811c9dc5;
+
+	/* FNV-1a over the folded key */
+	for (const unsigned char *p = (const unsigned char *)key; *p != '\0'; p++)
+	{
+		h ^= fold != NULL ? fold[*p] : *p;
+		h *= 0x01000193;
+	}
+
+	/* spread it, as both the top and the bottom bits are used */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+bool
+rb_hashmap_add_hashed(rb_hashmap *map, const char *key, uint32_t hash, void *data)
+{
+	struct hm_slot *slot;
+
+	lrb_assert(map != NULL);
+	lrb_assert(key != NULL);
+
+	if (rb_hashmap_retrieve_hashed(map, key, hash) != NULL)
+		return false;
+
+	hm_grow(map);
+	hm_migrate(map, HM_MIGRATE);
+
+	slot = &map->cur.slots[hm_table_insert(&map->cur, hash)];
+	slot->hash = hash;
+	slot->key = rb_strdup(key);
+	slot->data = data;
+	map->count++;
+
+	return true;
+}
+
+bool
+rb_hashmap_add(rb_hashmap *map, const char *key, void *data)
+{
+	return rb_hashmap_add_hashed(map, key, rb_hashmap_hash(map, key), data);
+}
+
+void *
+rb_hashmap_retrieve_hashed(const rb_hashmap *map, const char *key, uint32_t hash)
+{
+	int64_t j;
+
+	lrb_assert(map != NULL);
+
+	if ((j = hm_table_find(map, &map->cur, key, hash)) >= 0)
+		return map->cur.slots[j].data;
+
+	if ((j = hm_table_find(map, &map->old, key, hash)) >= 0)
+		return map->old.slots[j].data;
+
+	return NULL;
+}
+
+void *
+rb_hashmap_retrieve(const rb_hashmap *map, const char *key)
+{
+	return rb_hashmap_retrieve_hashed(map, key, rb_hashmap_hash(map, key));
+}
+
+void *
+rb_hashmap_delete(rb_hashmap *map, const char *key)
+{
+	uint32_t hash = rb_hashmap_hash(map, key);
+	struct hm_table *t = &map->cur;
+	void *data;
+	int64_t j;
+
+	lrb_assert(map != NULL);
+
+	if ((j = hm_table_find(map, t, key, hash)) < 0)
+	{
+		t = &map->old;
+		if ((j = hm_table_find(map, t, key, hash)) < 0)
+			return NULL;
+	}
+
+	data = t->slots[j].data;
+	rb_free(t->slots[j].key);
+	t->ctrl[j] = HM_DELETED;
+	t->used--;
+	t->tombs++;
+	map->count--;
+
+	hm_migrate(map, HM_MIGRATE);
+
+	return data;
+}
+
+unsigned int
+rb_hashmap_size(const rb_hashmap *map)
+{
+	lrb_assert(map != NULL);
+
+	return map->count;
+}
+
+/* sum and maximum of the number of groups probed to reach each entry */
+static void
+hm_table_depth(const struct hm_table *t, int *sum, int *maxdepth)
+{
+	uint32_t gmask;
+
+	if (t->ctrl == NULL)
+		return;
+
+	gmask = (t->mask + 1) / HM_GROUP - 1;
+
+	for (uint32_t j = 0; j <= t->mask; j++)
+	{
+		uint32_t g, i;
+
+		if (t->ctrl[j] & HM_EMPTY)
+			continue;
+
+		for (g = t->slots[j].hash & gmask, i = 0; g != j / HM_GROUP; )
+		{
+			i++;
+			g = (g + i) & gmask;
+		}
+
+		*sum += i + 1;
+		if ((int)i + 1 > *maxdepth)
+			*maxdepth = i + 1;
+	}
+}
+
+void
+rb_hashmap_stats(rb_hashmap *map, void (*cb)(const char *line, void *privdata), void *privdata)
+{
+	char str[256];
+	int sum = 0, maxdepth = 0;
+
+	lrb_assert(map != NULL);
+
+	if (map->count > 0)
+	{
+		hm_table_depth(&map->cur, &sum, &maxdepth);
+		hm_table_depth(&map->old, &sum, &maxdepth);
+		snprintf(str, sizeof str, "%-30s %-15s %-10u %-10d %-10u %-10d", map->id, "HASH", map->count, sum, sum / map->count, maxdepth);
+	}
+	else
+	{
+		snprintf(str, sizeof str, "%-30s %-15s %-10s %-10s %-10s %-10s", map->id, "HASH", "0", "0", "0", "0");
+	}
+
+	cb(str, privdata);
+}
+
+void
+rb_hashmap_stats_walk(void (*cb)(const char *line, void *privdata), void *privdata)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, hashmap_list.head)
+	{
+		rb_hashmap_stats(ptr->data, cb, privdata);
+	}
+}
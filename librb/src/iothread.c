@@ -0,0 +1,716 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  iothread.c: Socket reads on their own threads.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Each thread has an epoll set of the sockets attached to it, armed
+ * EPOLLONESHOT so a socket is only ever read by one thread at a time.
+ * What it reads goes into the socket's ring, which has one producer
+ * (the thread) and one consumer (rb_read() on the event loop), so
+ * neither side takes a lock.  A socket that gains data goes on the
+ * thread's ready queue, also single producer and single consumer, and
+ * the event loop is woken through an eventfd, once per batch.
+ *
+ * A full ring stops the thread reading that socket (it is left
+ * disarmed and marked stalled) until rb_read() makes room and re-arms
+ * it, so a client the event loop is not reading is held back by the
+ * kernel's buffers as before.
+ *
+ * Detaching a socket takes it out of the epoll set and marks it dead
+ * under its lock, which the thread holds while it reads, so the fd can
+ * be closed straight after.  The memory is only freed by the thread,
+ * two batches later, when no epoll_wait() result can still point at
+ * it.
+ */
+
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <commio-int.h>
+
+#if defined(HAVE_EPOLL_CTL) && defined(HAVE_SYS_EPOLL_H)
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+/* bytes a thread reads ahead of the event loop, per socket */
+#define IO_RING_SIZE	4096
+#define IO_RING_MASK	(IO_RING_SIZE - 1)
+
+/* events taken from epoll at once */
+#define IO_EVENTS	256
+
+/* the longest a thread sleeps; detached sockets are freed when it wakes */
+#define IO_IDLE_MS	1000
+
+/* the ring, the ready queue and the flags below are shared with a
+ * thread without a lock; everything is sequentially consistent, as
+ * both sides store one thing and then load what the other stored */
+#define io_load(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define io_store(p, v)		__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define io_exchange(p, v)	__atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+
+struct io_thread;
+
+struct rb_iothread_conn
+{
+	char ring[IO_RING_SIZE];
+	size_t head;			/* written by the thread */
+	size_t tail;			/* written by the event loop */
+
+	int error;			/* -1 for EOF, or why the thread's read failed */
+	int stalled;			/* the ring filled up and the socket is disarmed */
+	int queued;			/* on the thread's ready queue */
+
+	int fd;
+	struct io_thread *thread;
+	pthread_mutex_t lock;		/* held by the thread while it reads */
+	bool dead;			/* detached; set under lock */
+
+	/* event loop only */
+	rb_fde_t *F;
+	PF *read_handler;
+	void *read_data;
+	bool ready;
+	struct rb_iothread_conn *next;
+};
+
+struct io_thread
+{
+	int ep;
+	unsigned long conns;		/* event loop only */
+
+	/* sockets with something for the event loop */
+	struct rb_iothread_conn **queue;
+	size_t queue_mask;
+	size_t queue_head;		/* written by the thread */
+	size_t queue_tail;		/* written by the event loop */
+
+	/* detached sockets, and the ones detached before the last batch */
+	pthread_mutex_t grave_lock;
+	struct rb_iothread_conn *grave;
+	struct rb_iothread_conn *grave_old;
+};
+
+static struct io_thread **io_threads;
+static int io_nthreads;
+static unsigned long io_attached;
+
+/* the event loop waits on io_rfd, the threads write to io_wfd */
+static rb_fde_t *io_rfd;
+static int io_wfd = -1;
+static int io_wake_pending;
+
+/* sockets whose read handler is due, in the order they became ready */
+static struct rb_iothread_conn *ready_head, *ready_tail;
+static bool ready_scheduled;
+
+static void io_run(void *unused);
+
+static void
+io_arm(struct rb_iothread_conn *conn)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = conn;
+
+	/* fails harmlessly if the socket was detached meanwhile */
+	epoll_ctl(conn->thread->ep, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/* read until the socket or the ring runs dry; true if there is news
+ * for the event loop */
+static bool
+io_fill(struct rb_iothread_conn *conn)
+{
+	size_t head = conn->head;
+	bool news = false;
+
+	for(;;)
+	{
+		size_t space = IO_RING_SIZE - (head - io_load(&conn->tail));
+		size_t off, len;
+		ssize_t n;
+
+		if(space == 0)
+		{
+			io_store(&conn->stalled, 1);
+
+			/* rb_read() may have made room before it could see
+			 * the flag; whichever side clears it re-arms */
+			if(head - io_load(&conn->tail) < IO_RING_SIZE &&
+			   io_exchange(&conn->stalled, 0) == 1)
+				continue;
+			return news;
+		}
+
+		off = head & IO_RING_MASK;
+		len = IO_RING_SIZE - off;
+		if(len > space)
+			len = space;
+
+		n = recv(conn->fd, conn->ring + off, len, 0);
+		if(n > 0)
+		{
+			head += n;
+			io_store(&conn->head, head);
+			news = true;
+
+			if((size_t)n == len)
+				continue;
+		}
+		else if(n == 0)
+		{
+			io_store(&conn->error, -1);
+			return true;
+		}
+		else if(errno == EINTR)
+			continue;
+		else if(!rb_ignore_errno(errno))
+		{
+			io_store(&conn->error, errno);
+			return true;
+		}
+
+		io_arm(conn);
+		return news;
+	}
+}
+
+static void
+io_wakeup(void)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t one = 1;
+#else
+	char one = 1;
+#endif
+	ssize_t ret;
+
+	do
+		ret = write(io_wfd, &one, sizeof one);
+	while(ret < 0 && errno == EINTR);
+}
+
+/* free what was detached before the batch that just ended started */
+static void
+io_bury(struct io_thread *t)
+{
+	struct rb_iothread_conn *conn, *next;
+
+	pthread_mutex_lock(&t->grave_lock);
+	conn = t->grave_old;
+	t->grave_old = t->grave;
+	t->grave = NULL;
+	pthread_mutex_unlock(&t->grave_lock);
+
+	for(; conn != NULL; conn = next)
+	{
+		next = conn->next;
+		pthread_mutex_destroy(&conn->lock);
+		rb_free(conn);
+	}
+}
+
+static void *
+io_thread_main(void *arg)
+{
+	struct io_thread *t = arg;
+	struct epoll_event events[IO_EVENTS];
+
+	for(;;)
+	{
+		int n = epoll_wait(t->ep, events, IO_EVENTS, IO_IDLE_MS);
+		bool pushed = false;
+
+		for(int i = 0; i < n; i++)
+		{
+			struct rb_iothread_conn *conn = events[i].data.ptr;
+
+			pthread_mutex_lock(&conn->lock);
+			if(!conn->dead && io_fill(conn) && io_exchange(&conn->queued, 1) == 0)
+			{
+				/* a socket is queued at most once, so this never
+				 * overtakes queue_tail */
+				t->queue[t->queue_head & t->queue_mask] = conn;
+				io_store(&t->queue_head, t->queue_head + 1);
+				pushed = true;
+			}
+			pthread_mutex_unlock(&conn->lock);
+		}
+
+		if(pushed && io_exchange(&io_wake_pending, 1) == 0)
+			io_wakeup();
+
+		io_bury(t);
+	}
+
+	return NULL;
+}
+
+static void
+io_schedule(struct rb_iothread_conn *conn)
+{
+	if(conn->ready)
+		return;
+
+	conn->ready = true;
+	conn->next = NULL;
+	if(ready_tail != NULL)
+		ready_tail->next = conn;
+	else
+		ready_head = conn;
+	ready_tail = conn;
+
+	if(!ready_scheduled)
+	{
+		ready_scheduled = true;
+		rb_defer(io_run, NULL);
+	}
+}
+
+/* hand a socket nobody refers to any more to its thread to free */
+static void
+io_release(struct rb_iothread_conn *conn)
+{
+	struct io_thread *t = conn->thread;
+
+	if(conn->F != NULL || conn->ready || io_load(&conn->queued))
+		return;
+
+	pthread_mutex_lock(&t->grave_lock);
+	conn->next = t->grave;
+	t->grave = conn;
+	pthread_mutex_unlock(&t->grave_lock);
+}
+
+static void
+io_drop(rb_fde_t *F)
+{
+	struct rb_iothread_conn *conn = F->io;
+
+	F->io = NULL;
+	conn->F = NULL;
+	conn->read_handler = NULL;
+	io_release(conn);
+}
+
+/* move what the threads have queued onto the ready list */
+static void
+io_collect(void)
+{
+	for(int i = 0; i < io_nthreads; i++)
+	{
+		struct io_thread *t = io_threads[i];
+		size_t head = io_load(&t->queue_head);
+
+		for(; t->queue_tail != head; t->queue_tail++)
+		{
+			struct rb_iothread_conn *conn = t->queue[t->queue_tail & t->queue_mask];
+
+			/* cleared before the ring is read, so anything read
+			 * after this queues the socket again */
+			io_store(&conn->queued, 0);
+
+			if(conn->F == NULL)
+				io_release(conn);
+			else
+				io_schedule(conn);
+		}
+	}
+}
+
+static void
+io_run(void *unused)
+{
+	struct rb_iothread_conn *conn, *next;
+
+	ready_scheduled = false;
+	io_collect();
+
+	/* a handler that leaves data behind is called again next pass,
+	 * not in a loop here */
+	conn = ready_head;
+	ready_head = ready_tail = NULL;
+
+	for(; conn != NULL; conn = next)
+	{
+		PF *hdl = conn->read_handler;
+		void *data = conn->read_data;
+
+		next = conn->next;
+		conn->ready = false;
+
+		if(conn->F == NULL)
+		{
+			io_release(conn);
+			continue;
+		}
+
+		if(hdl == NULL)
+			continue;
+
+		conn->read_handler = NULL;
+		conn->read_data = NULL;
+		hdl(conn->F, data);
+	}
+}
+
+static void
+io_ready(rb_fde_t *F, void *unused)
+{
+	char buf[64];
+
+	io_store(&io_wake_pending, 0);
+	while(read(rb_get_fd(F), buf, sizeof buf) > 0)
+		;
+
+	io_run(NULL);
+	rb_setselect(F, RB_SELECT_READ, io_ready, NULL);
+}
+
+static bool
+io_open_wakeup(void)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if(fd < 0)
+		return false;
+
+	io_rfd = rb_open(fd, RB_FD_PIPE, "I/O thread wakeup");
+	io_wfd = fd;
+#else
+	rb_fde_t *wfd;
+
+	if(rb_pipe(&io_rfd, &wfd, "I/O thread wakeup") < 0)
+		return false;
+
+	io_wfd = rb_get_fd(wfd);
+	fcntl(rb_get_fd(io_rfd), F_SETFD, FD_CLOEXEC);
+	fcntl(io_wfd, F_SETFD, FD_CLOEXEC);
+#endif
+
+	rb_setselect(io_rfd, RB_SELECT_READ, io_ready, NULL);
+	return true;
+}
+
+static struct io_thread *
+io_thread_new(void)
+{
+	struct io_thread *t;
+	size_t size = 1;
+
+	/* every socket a thread has can be on its queue at once, and so
+	 * can the closed ones the event loop has not collected yet */
+	while(size < 2 * (size_t)rb_getmaxconnect())
+		size <<= 1;
+
+	t = rb_malloc(sizeof *t);
+	t->ep = epoll_create1(EPOLL_CLOEXEC);
+	if(t->ep < 0)
+	{
+		rb_free(t);
+		return NULL;
+	}
+
+	t->queue = rb_malloc(size * sizeof *t->queue);
+	t->queue_mask = size - 1;
+	pthread_mutex_init(&t->grave_lock, NULL);
+	return t;
+}
+
+int
+rb_iothread_init(int count)
+{
+	sigset_t all, old;
+
+	if(count <= io_nthreads)
+		return io_nthreads;
+
+	if(io_rfd == NULL && !io_open_wakeup())
+	{
+		rb_lib_log("rb_iothread_init: couldn't open the wakeup fd: %s", strerror(errno));
+		return io_nthreads;
+	}
+
+	io_threads = rb_realloc(io_threads, count * sizeof *io_threads);
+
+	/* signals are for the event loop; the threads inherit this mask */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while(io_nthreads < count)
+	{
+		struct io_thread *t = io_thread_new();
+		pthread_t thread;
+		int ret;
+
+		if(t == NULL)
+		{
+			rb_lib_log("rb_iothread_init: couldn't create an epoll set: %s", strerror(errno));
+			break;
+		}
+
+		ret = pthread_create(&thread, NULL, io_thread_main, t);
+		if(ret != 0)
+		{
+			rb_lib_log("rb_iothread_init: couldn't start a thread: %s", strerror(ret));
+			close(t->ep);
+			rb_free(t->queue);
+			rb_free(t);
+			break;
+		}
+
+		pthread_detach(thread);
+		io_threads[io_nthreads++] = t;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return io_nthreads;
+}
+
+int
+rb_iothread_attach(rb_fde_t *F)
+{
+	struct rb_iothread_conn *conn;
+	struct io_thread *t;
+	struct epoll_event ev;
+	PF *hdl;
+	void *data;
+
+	if(io_nthreads == 0 || F == NULL || F->io != NULL)
+		return 0;
+
+	/* SCTP keeps message boundaries and in-process TLS reads through
+	 * its own library, so only plain stream sockets are moved */
+	if((F->type & (RB_FD_SOCKET | RB_FD_SSL | RB_FD_SCTP | RB_FD_LISTEN)) != RB_FD_SOCKET)
+		return 0;
+
+	t = io_threads[0];
+	for(int i = 1; i < io_nthreads; i++)
+		if(io_threads[i]->conns < t->conns)
+			t = io_threads[i];
+
+	conn = rb_malloc(sizeof *conn);
+	conn->fd = F->fd;
+	conn->thread = t;
+	conn->F = F;
+	pthread_mutex_init(&conn->lock, NULL);
+
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = conn;
+	if(epoll_ctl(t->ep, EPOLL_CTL_ADD, F->fd, &ev) != 0)
+	{
+		rb_lib_log("rb_iothread_attach: epoll_ctl failed: %s", strerror(errno));
+		pthread_mutex_destroy(&conn->lock);
+		rb_free(conn);
+		return 0;
+	}
+
+	/* a read handler already set moves over with the socket */
+	hdl = F->read_handler;
+	data = F->read_data;
+	if(hdl != NULL)
+		rb_setselect(F, RB_SELECT_READ, NULL, NULL);
+
+	F->io = conn;
+	conn->read_handler = hdl;
+	conn->read_data = data;
+
+	t->conns++;
+	io_attached++;
+	return 1;
+}
+
+int
+rb_iothread_detach(rb_fde_t *F)
+{
+	struct rb_iothread_conn *conn = F->io;
+
+	if(conn == NULL || conn->dead)
+		return 0;
+
+	epoll_ctl(conn->thread->ep, EPOLL_CTL_DEL, conn->fd, NULL);
+
+	/* waits out a read in progress; after this the thread leaves the
+	 * socket alone */
+	pthread_mutex_lock(&conn->lock);
+	conn->dead = true;
+	pthread_mutex_unlock(&conn->lock);
+
+	conn->thread->conns--;
+	io_attached--;
+
+	if(io_load(&conn->head) == conn->tail)
+		io_drop(F);
+	else if(conn->read_handler != NULL)
+		io_schedule(conn);
+	return 1;
+}
+
+unsigned long
+rb_iothread_count(void)
+{
+	return io_attached;
+}
+
+void
+rb_iothread_close(rb_fde_t *F)
+{
+	if(F->io == NULL)
+		return;
+
+	rb_iothread_detach(F);
+	if(F->io != NULL)
+		io_drop(F);
+}
+
+int
+rb_iothread_setselect(rb_fde_t *F, PF *handler, void *client_data)
+{
+	struct rb_iothread_conn *conn = F->io;
+
+	/* detached and drained: back to the event loop's own polling */
+	if(conn->dead && io_load(&conn->head) == conn->tail)
+	{
+		io_drop(F);
+		return 0;
+	}
+
+	conn->read_handler = handler;
+	conn->read_data = client_data;
+
+	if(handler != NULL &&
+	   (io_load(&conn->head) != conn->tail || (!conn->dead && io_load(&conn->error) != 0)))
+		io_schedule(conn);
+
+	return 1;
+}
+
+int
+rb_iothread_read(rb_fde_t *F, void *buf, int count, ssize_t *ret)
+{
+	struct rb_iothread_conn *conn = F->io;
+	size_t tail = conn->tail;
+	size_t head = io_load(&conn->head);
+	size_t len, off, first;
+
+	if(head == tail)
+	{
+		int error;
+
+		if(conn->dead)
+		{
+			io_drop(F);
+			return 0;
+		}
+
+		error = io_load(&conn->error);
+		if(error == 0)
+		{
+			errno = EAGAIN;
+			*ret = -1;
+			return 1;
+		}
+
+		/* the error is stored after the last of the data */
+		head = io_load(&conn->head);
+		if(head == tail)
+		{
+			if(error < 0)
+				*ret = 0;
+			else
+			{
+				errno = error;
+				*ret = -1;
+			}
+			return 1;
+		}
+	}
+
+	len = head - tail;
+	if(len > (size_t)count)
+		len = count;
+
+	off = tail & IO_RING_MASK;
+	first = IO_RING_SIZE - off;
+	if(first > len)
+		first = len;
+
+	memcpy(buf, conn->ring + off, first);
+	memcpy((char *)buf + first, conn->ring, len - first);
+	io_store(&conn->tail, tail + len);
+
+	if(!conn->dead && io_load(&conn->stalled) && io_exchange(&conn->stalled, 0) == 1)
+		io_arm(conn);
+
+	*ret = len;
+	return 1;
+}
+
+#else /* no epoll */
+
+int
+rb_iothread_init(int count)
+{
+	return 0;
+}
+
+int
+rb_iothread_attach(rb_fde_t *F)
+{
+	return 0;
+}
+
+int
+rb_iothread_detach(rb_fde_t *F)
+{
+	return 0;
+}
+
+unsigned long
+rb_iothread_count(void)
+{
+	return 0;
+}
+
+void
+rb_iothread_close(rb_fde_t *F)
+{
+}
+
+int
+rb_iothread_setselect(rb_fde_t *F, PF *handler, void *client_data)
+{
+	return 0;
+}
+
+int
+rb_iothread_read(rb_fde_t *F, void *buf, int count, ssize_t *ret)
+{
+	return 0;
+}
+
+#endif
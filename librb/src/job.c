@@ -0,0 +1,261 @@
+/*
+ *  ircd-FEF: an advanced, scalable Internet Relay Chat daemon.
+ *  job.c: A small thread pool for CPU-heavy, self-contained work.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Posted jobs go on one queue that every pool thread takes from.  A
+ * finished job moves to the done queue, and the thread that makes the
+ * done queue non-empty wakes the event loop through an eventfd (or a
+ * pipe where there is none), so a burst of jobs costs one wakeup.  Only
+ * the event loop thread posts jobs and runs done callbacks.
+ */
+
+#include <librb_config.h>
+#include <rb_lib.h>
+#include <commio-int.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+struct rb_job
+{
+	rb_job_cb *work;
+	rb_job_cb *done;
+	void *data;
+	struct rb_job *next;
+};
+
+struct rb_job_queue
+{
+	struct rb_job *head;
+	struct rb_job *tail;
+};
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_idle_cond = PTHREAD_COND_INITIALIZER;
+
+/* both queues and job_running are under job_lock */
+static struct rb_job_queue job_work;
+static struct rb_job_queue job_done;
+static unsigned long job_running;
+
+static int job_threads;
+static unsigned long job_pending;
+
+/* the event loop waits on job_rfd, pool threads write to job_wfd */
+static rb_fde_t *job_rfd;
+static int job_wfd = -1;
+
+static void
+rb_job_push(struct rb_job_queue *q, struct rb_job *job)
+{
+	job->next = NULL;
+	if(q->tail != NULL)
+		q->tail->next = job;
+	else
+		q->head = job;
+	q->tail = job;
+}
+
+static void
+rb_job_wakeup(void)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t one = 1;
+#else
+	char one = 1;
+#endif
+	ssize_t ret;
+
+	/* a full pipe or a saturated counter already means "wake up" */
+	do
+		ret = write(job_wfd, &one, sizeof one);
+	while(ret < 0 && errno == EINTR);
+}
+
+static void *
+rb_job_thread(void *unused)
+{
+	struct rb_job *job;
+	bool wake;
+
+	pthread_mutex_lock(&job_lock);
+	for(;;)
+	{
+		while(job_work.head == NULL)
+			pthread_cond_wait(&job_work_cond, &job_lock);
+
+		job = job_work.head;
+		job_work.head = job->next;
+		if(job_work.head == NULL)
+			job_work.tail = NULL;
+		pthread_mutex_unlock(&job_lock);
+
+		job->work(job->data);
+
+		pthread_mutex_lock(&job_lock);
+		wake = job_done.head == NULL;
+		rb_job_push(&job_done, job);
+		if(--job_running == 0)
+			pthread_cond_broadcast(&job_idle_cond);
+
+		if(wake)
+			rb_job_wakeup();
+	}
+
+	return NULL;
+}
+
+static void
+rb_job_run_done(void)
+{
+	struct rb_job *job, *next;
+
+	pthread_mutex_lock(&job_lock);
+	job = job_done.head;
+	job_done.head = job_done.tail = NULL;
+	pthread_mutex_unlock(&job_lock);
+
+	for(; job != NULL; job = next)
+	{
+		next = job->next;
+		job_pending--;
+		job->done(job->data);
+		rb_free(job);
+	}
+}
+
+static void
+rb_job_ready(rb_fde_t *F, void *unused)
+{
+	char buf[64];
+
+	while(read(rb_get_fd(F), buf, sizeof buf) > 0)
+		;
+
+	rb_job_run_done();
+	rb_setselect(F, RB_SELECT_READ, rb_job_ready, NULL);
+}
+
+static bool
+rb_job_open_wakeup(void)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if(fd < 0)
+		return false;
+
+	job_rfd = rb_open(fd, RB_FD_PIPE, "job pool wakeup");
+	job_wfd = fd;
+#else
+	rb_fde_t *wfd;
+
+	if(rb_pipe(&job_rfd, &wfd, "job pool wakeup") < 0)
+		return false;
+
+	job_wfd = rb_get_fd(wfd);
+	fcntl(rb_get_fd(job_rfd), F_SETFD, FD_CLOEXEC);
+	fcntl(job_wfd, F_SETFD, FD_CLOEXEC);
+#endif
+
+	rb_setselect(job_rfd, RB_SELECT_READ, rb_job_ready, NULL);
+	return true;
+}
+
+int
+rb_job_init(int count)
+{
+	sigset_t all, old;
+	pthread_t thread;
+
+	if(count > job_threads && job_rfd == NULL && !rb_job_open_wakeup())
+	{
+		rb_lib_log("rb_job_init: couldn't open the wakeup fd: %s", strerror(errno));
+		return job_threads;
+	}
+
+	/* signals are for the event loop; the threads inherit this mask */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while(job_threads < count)
+	{
+		int ret = pthread_create(&thread, NULL, rb_job_thread, NULL);
+
+		if(ret != 0)
+		{
+			rb_lib_log("rb_job_init: couldn't start a thread: %s", strerror(ret));
+			break;
+		}
+
+		pthread_detach(thread);
+		job_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return job_threads;
+}
+
+void
+rb_job_post(rb_job_cb *work, rb_job_cb *done, void *data)
+{
+	struct rb_job *job;
+
+	if(job_threads == 0)
+	{
+		work(data);
+		done(data);
+		return;
+	}
+
+	job = rb_malloc(sizeof *job);
+	job->work = work;
+	job->done = done;
+	job->data = data;
+	job_pending++;
+
+	pthread_mutex_lock(&job_lock);
+	rb_job_push(&job_work, job);
+	job_running++;
+	pthread_cond_signal(&job_work_cond);
+	pthread_mutex_unlock(&job_lock);
+}
+
+void
+rb_job_drain(void)
+{
+	pthread_mutex_lock(&job_lock);
+	while(job_running != 0)
+		pthread_cond_wait(&job_idle_cond, &job_lock);
+	pthread_mutex_unlock(&job_lock);
+
+	rb_job_run_done();
+}
+
+unsigned long
+rb_job_pending(void)
+{
+	return job_pending;
+}
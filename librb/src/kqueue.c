@@ -238,6 +238,7 @@ rb_select_kqueue(long delay)
 		/* NOTREACHED */
 	}
 
+	rb_select_woke();
 	rb_set_time();
 
 	if(num == 0)
@@ -58,6 +58,19 @@ rb_linebuf_free(buf_line_t * p)
 	rb_bh_free(rb_linebuf_heap, p);
 }
 
+/* every change to a buf_head_t's len goes through here */
+static inline void
+rb_linebuf_charge(buf_head_t *bufhead, int len)
+{
+	bufhead->len += len;
+	for(buf_account_t *account = bufhead->account; account != NULL; account = account->parent)
+	{
+		account->len += len;
+		if(bufhead->pinned)
+			account->pinned += len;
+	}
+}
+
 /*
  * rb_linebuf_new_line
  *
@@ -99,7 +112,7 @@ rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *
 
 	/* Update the allocated size */
 	bufhead->alloclen--;
-	bufhead->len -= bufline->len;
+	rb_linebuf_charge(bufhead, -bufline->len);
 	lrb_assert(bufhead->len >= 0);
 	bufhead->numlines--;
 
@@ -227,7 +240,7 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 		}
 		bufline->terminated = 1;
 		bufline->len = LINEBUF_SIZE;
-		bufhead->len += LINEBUF_SIZE;
+		rb_linebuf_charge(bufhead, LINEBUF_SIZE);
 		return clen;
 	}
 
@@ -239,7 +252,7 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 	if(*bufch != '\r' && *bufch != '\n')
 	{
 		/* No linefeed, bail for the next time */
-		bufhead->len += cpylen;
+		rb_linebuf_charge(bufhead, cpylen);
 		bufline->len += cpylen;
 		bufline->terminated = 0;
 		return clen;
@@ -254,7 +267,7 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 	}
 
 	bufline->terminated = 1;
-	bufhead->len += cpylen;
+	rb_linebuf_charge(bufhead, cpylen);
 	bufline->len += cpylen;
 	return clen;
 }
@@ -294,7 +307,7 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 		bufline->buf[LINEBUF_SIZE] = '\0';
 		bufline->terminated = 1;
 		bufline->len = LINEBUF_SIZE;
-		bufhead->len += LINEBUF_SIZE;
+		rb_linebuf_charge(bufhead, LINEBUF_SIZE);
 		return clen;
 	}
 
@@ -306,14 +319,14 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
 	if(*bufch != '\r' && *bufch != '\n')
 	{
 		/* No linefeed, bail for the next time */
-		bufhead->len += cpylen;
+		rb_linebuf_charge(bufhead, cpylen);
 		bufline->len += cpylen;
 		bufline->terminated = 0;
 		return clen;
 	}
 
 	bufline->terminated = 1;
-	bufhead->len += cpylen;
+	rb_linebuf_charge(bufhead, cpylen);
 	bufline->len += cpylen;
 	return clen;
 }
@@ -477,13 +490,103 @@ rb_linebuf_attach(buf_head_t * bufhead, buf_head_t * new)
 
 		/* Update the allocated size */
 		bufhead->alloclen++;
-		bufhead->len += line->len;
+		rb_linebuf_charge(bufhead, line->len);
 		bufhead->numlines++;
 
 		line->refcount++;
 	}
 }
 
+/*
+ * rb_linebuf_set_account
+ *
+ * charge what is queued, and everything queued later, to another
+ * account (or none), taking it off the old one.
+ */
+void
+rb_linebuf_set_account(buf_head_t *bufhead, buf_account_t *account)
+{
+	int len = bufhead->len;
+
+	if(bufhead->account == account)
+		return;
+
+	rb_linebuf_charge(bufhead, -len);
+	bufhead->account = account;
+	rb_linebuf_charge(bufhead, len);
+}
+
+/*
+ * rb_linebuf_set_pinned
+ *
+ * charge what is queued, and everything queued later, as pinned or not,
+ * so the owner of the accounts can tell what it may not shed.
+ */
+void
+rb_linebuf_set_pinned(buf_head_t *bufhead, int pinned)
+{
+	int len = bufhead->len;
+
+	if(bufhead->pinned == !!pinned)
+		return;
+
+	rb_linebuf_charge(bufhead, -len);
+	bufhead->pinned = !!pinned;
+	rb_linebuf_charge(bufhead, len);
+}
+
+/*
+ * rb_linebuf_set_lossy
+ *
+ * mark the lines in a buf_head_t as ones rb_linebuf_shed() may drop
+ * from any queue they get attached to, except owner's.
+ */
+void
+rb_linebuf_set_lossy(buf_head_t *bufhead, const void *owner)
+{
+	rb_dlink_node *ptr;
+
+	RB_DLINK_FOREACH(ptr, bufhead->list.head)
+	{
+		buf_line_t *line = ptr->data;
+
+		line->lossy = owner;
+	}
+}
+
+/*
+ * rb_linebuf_shed
+ *
+ * drop lossy lines not marked for owner, oldest first, until at least
+ * want bytes are gone.  A partly written first line is kept.
+ * Returns the number of bytes dropped.
+ */
+int
+rb_linebuf_shed(buf_head_t *bufhead, const void *owner, int want)
+{
+	rb_dlink_node *ptr, *next_ptr;
+	int shed = 0;
+
+	RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bufhead->list.head)
+	{
+		buf_line_t *line = ptr->data;
+
+		if(shed >= want)
+			break;
+
+		if(line->lossy == NULL || line->lossy == owner || !line->terminated)
+			continue;
+
+		if(ptr == bufhead->list.head && bufhead->writeofs != 0)
+			continue;
+
+		shed += line->len;
+		rb_linebuf_done_line(bufhead, line, ptr);
+	}
+
+	return shed;
+}
+
 /*
  * rb_linebuf_put
  *
@@ -520,7 +623,7 @@ rb_linebuf_put(buf_head_t *bufhead, const rb_strf_t *strings)
 	bufline->terminated = 1;
 
 	bufline->len = len;
-	bufhead->len += len;
+	rb_linebuf_charge(bufhead, len);
 }
 
 /*
@@ -983,6 +983,31 @@ rb_match_ip(rb_patricia_tree_t *tree, struct sockaddr *ip)
 	return NULL;
 }
 
+/* exact match of the first bitlen bits of ip, without allocating */
+rb_patricia_node_t *
+rb_match_ip_exact(rb_patricia_tree_t *tree, struct sockaddr *ip, unsigned int bitlen)
+{
+	rb_prefix_t prefix;
+	void *ipptr;
+	int family;
+
+	if(ip->sa_family == AF_INET6)
+	{
+		family = AF_INET6;
+		ipptr = &((struct sockaddr_in6 *)ip)->sin6_addr;
+	}
+	else
+	{
+		family = AF_INET;
+		ipptr = &((struct sockaddr_in *)ip)->sin_addr;
+	}
+
+	if(New_Prefix2(family, ipptr, bitlen, &prefix) == NULL)
+		return NULL;
+
+	return rb_patricia_search_exact(tree, &prefix);
+}
+
 rb_patricia_node_t *
 rb_match_string(rb_patricia_tree_t *tree, const char *string)
 {
@@ -176,6 +176,7 @@ rb_select_poll(long delay)
 	int revents;
 
 	num = poll(pollfd_list.pollfds, pollfd_list.maxindex + 1, delay);
+	rb_select_woke();
 	rb_set_time();
 	if(num < 0)
 	{
@@ -137,6 +137,7 @@ rb_select_ports(long delay)
 
 
 	i = port_getn(pe, pelst, pemax, &nget, p);
+	rb_select_woke();
 	rb_set_time();
 
 	if(i == -1)
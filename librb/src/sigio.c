@@ -253,6 +253,7 @@ rb_select_sigio(long delay)
 			else
 				sig = sigtimedwait(&our_sigset, &si, &timeout);
 
+			rb_select_woke();
 			if(sig > 0)
 			{
 
@@ -321,6 +322,7 @@ rb_select_sigio(long delay)
 
 
 	num = poll(pollfd_list.pollfds, pollfd_list.maxindex + 1, delay);
+	rb_select_woke();
 	rb_set_time();
 	if(num < 0)
 	{
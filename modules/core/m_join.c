@@ -1209,6 +1209,7 @@ remove_our_modes(struct Channel *chptr, struct Client *source_p)
 		if(is_chanop(msptr))
 		{
 			msptr->flags &= ~CHFL_CHANOP;
+			update_member_table(msptr);
 			lpara[count++] = msptr->client_p->name;
 			*mbuf++ = 'o';
 
@@ -1234,6 +1235,7 @@ remove_our_modes(struct Channel *chptr, struct Client *source_p)
 				}
 
 				msptr->flags &= ~CHFL_VOICE;
+				update_member_table(msptr);
 				lpara[count++] = msptr->client_p->name;
 				*mbuf++ = 'v';
 			}
@@ -1241,6 +1243,7 @@ remove_our_modes(struct Channel *chptr, struct Client *source_p)
 		else if(is_voiced(msptr))
 		{
 			msptr->flags &= ~CHFL_VOICE;
+			update_member_table(msptr);
 			lpara[count++] = msptr->client_p->name;
 			*mbuf++ = 'v';
 		}
@@ -1299,6 +1302,8 @@ remove_ban_list(struct Channel *chptr, struct Client *source_p,
 
 	pbuf = lparabuf;
 
+	banset_clear(chptr, list);
+
 	cur_len = mlen = sprintf(lmodebuf, ":%s MODE %s -", source_p->name, chptr->chname);
 	mbuf = lmodebuf + mlen;
 
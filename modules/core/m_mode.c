@@ -237,6 +237,7 @@ possibly_remove_lower_forward(struct Client *fakesource_p, int mems,
 					actualBan->forward ? "$" : "",
 					actualBan->forward ? actualBan->forward : "");
 			rb_dlinkDelete(&actualBan->node, banlist);
+			banset_del(chptr, banlist, actualBan);
 			free_ban(actualBan);
 			return;
 		}
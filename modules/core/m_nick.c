@@ -695,6 +695,7 @@ change_local_nick(struct Client *client_p, struct Client *source_p,
 	del_from_client_hash(source_p->name, source_p);
 	rb_strlcpy(source_p->name, nick, sizeof(source_p->name));
 	add_to_client_hash(nick, source_p);
+	clear_client_matchset(source_p);
 
 	if(!samenick)
 		monitor_signon(source_p);
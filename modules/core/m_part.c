@@ -131,19 +131,23 @@ part_one_client(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client
 	{
 		sendto_server_tags(client_p, chptr, CAP_TS6, NOCAPS, msgbuf_p->n_tags, msgbuf_p->tags,
 			":%s PART %s :%s", use_id(source_p), chptr->chname, reason);
+		send_lossy_begin(source_p, chptr);
 		sendto_channel_local_tags(source_p, ALL_MEMBERS, NULL, chptr, msgbuf_p->n_tags, msgbuf_p->tags,
 			":%s!%s@%s PART %s :%s",
 		     source_p->name, source_p->username,
 		     source_p->host, chptr->chname, reason);
+		send_lossy_end();
 	}
 	else
 	{
 		sendto_server_tags(client_p, chptr, CAP_TS6, NOCAPS, msgbuf_p->n_tags, msgbuf_p->tags,
 			":%s PART %s", use_id(source_p), chptr->chname);
+		send_lossy_begin(source_p, chptr);
 		sendto_channel_local_tags(source_p, ALL_MEMBERS, NULL, chptr, msgbuf_p->n_tags, msgbuf_p->tags,
 			":%s!%s@%s PART %s",
 			 source_p->name, source_p->username,
 			 source_p->host, chptr->chname);
+		send_lossy_end();
 	}
 	remove_user_from_channel(msptr);
 }
@@ -33,6 +33,7 @@
 #endif
 
 #include "client.h"
+#include "hash.h"
 #include "ircd.h"
 #include "modules.h"
 #include "numeric.h"
@@ -72,6 +73,7 @@ static const char challenge_desc[] =
 	"Provides the challenge-response facility used for becoming an IRC operator";
 
 static void m_challenge(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
+static void challenge_unload(void);
 
 /* We have openssl support, so include /CHALLENGE */
 struct Message challenge_msgtab = {
@@ -81,14 +83,41 @@ struct Message challenge_msgtab = {
 
 mapi_clist_av1 challenge_clist[] = { &challenge_msgtab, NULL };
 
-DECLARE_MODULE_AV2(challenge, NULL, NULL, challenge_clist, NULL, NULL, NULL, NULL, challenge_desc);
+DECLARE_MODULE_AV2(challenge, NULL, challenge_unload, challenge_clist, NULL, NULL, NULL, NULL, challenge_desc);
 
 #if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
-static bool generate_challenge(char **r_challenge, unsigned char **r_response, EVP_PKEY *key);
+typedef EVP_PKEY challenge_key;
+#  define challenge_key_ref(k)	EVP_PKEY_up_ref(k)
+#  define challenge_key_free(k)	EVP_PKEY_free(k)
 #else
-static bool generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key);
+typedef RSA challenge_key;
+#  define challenge_key_ref(k)	RSA_up_ref(k)
+#  define challenge_key_free(k)	RSA_free(k)
 #endif
 
+static bool generate_challenge(char **r_challenge, unsigned char **r_response, challenge_key *key,
+		const unsigned char *secret, char *error, size_t errlen);
+
+/*
+ * The RSA encryption runs on a worker thread.  The job holds its own
+ * reference to the key, and the client is looked up again when it is
+ * done, since it may have gone away in the meantime.
+ */
+struct challenge_job
+{
+	char id[IDLEN];
+	char *opername;
+	challenge_key *key;
+	unsigned char secret[CHALLENGE_SECRET_LENGTH];
+	char *challenge;
+	unsigned char *response;
+	bool ok;
+	char error[256];
+};
+
+static void challenge_job_work(void *);
+static void challenge_job_done(void *);
+
 static void
 cleanup_challenge(struct Client *target_p)
 {
@@ -110,10 +139,8 @@ static void
 m_challenge(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
 	struct oper_conf *oper_p;
-	char *challenge = NULL; /* to placate gcc */
-	char chal_line[CHALLENGE_WIDTH];
+	struct challenge_job *job;
 	unsigned char *b_response;
-	size_t cnt;
 	int len = 0;
 
 	begin_local_response_batch();
@@ -138,6 +165,10 @@ m_challenge(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		return;
 	}
 
+	/* a challenge is already being generated */
+	if(source_p->localClient->localflags & LFLAGS_OPERCHECK)
+		return;
+
 	if(*parv[1] == '+')
 	{
 		/* Ignore it if we aren't expecting this... -A1kmm */
@@ -275,40 +306,96 @@ m_challenge(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 		}
 	}
 
-	if(generate_challenge(&challenge, &(source_p->localClient->challenge), oper_p->rsa_pubkey))
+	job = rb_malloc(sizeof *job);
+	if(!rb_get_random(job->secret, sizeof job->secret))
+	{
+		rb_free(job);
+		sendto_one_notice(source_p, ":Failed to generate challenge.");
+		return;
+	}
+
+	rb_strlcpy(job->id, source_p->id, sizeof job->id);
+	job->opername = rb_strdup(oper_p->name);
+	job->key = oper_p->rsa_pubkey;
+	challenge_key_ref(job->key);
+
+	source_p->localClient->localflags |= LFLAGS_OPERCHECK;
+	rb_job_post(challenge_job_work, challenge_job_done, job);
+}
+
+static void
+challenge_job_work(void *data)
+{
+	struct challenge_job *job = data;
+
+	job->ok = generate_challenge(&job->challenge, &job->response, job->key,
+			job->secret, job->error, sizeof job->error);
+}
+
+static void
+challenge_job_done(void *data)
+{
+	struct challenge_job *job = data;
+	struct Client *source_p = find_id(job->id);
+	char chal_line[CHALLENGE_WIDTH];
+	size_t cnt;
+
+	if(!job->ok && job->error[0] != '\0')
+		ilog(L_MAIN, "OpenSSL Error (CHALLENGE): %s", job->error);
+
+	if(source_p != NULL && MyClient(source_p) && !IsAnyDead(source_p))
 	{
-		char *chal = challenge;
-		source_p->localClient->chal_time = rb_current_time();
-		for(;;)
+		source_p->localClient->localflags &= ~LFLAGS_OPERCHECK;
+
+		if(IsOper(source_p))
+			;
+		else if(job->ok)
 		{
-			cnt = rb_strlcpy(chal_line, chal, CHALLENGE_WIDTH);
-			sendto_one(source_p, form_str(RPL_RSACHALLENGE2), me.name, source_p->name, chal_line);
-			if(cnt >= CHALLENGE_WIDTH)
-				chal += CHALLENGE_WIDTH - 1;
-			else
-				break;
+			char *chal = job->challenge;
 
+			cleanup_challenge(source_p);
+			source_p->localClient->challenge = job->response;
+			job->response = NULL;
+			source_p->localClient->chal_time = rb_current_time();
+			for(;;)
+			{
+				cnt = rb_strlcpy(chal_line, chal, CHALLENGE_WIDTH);
+				sendto_one(source_p, form_str(RPL_RSACHALLENGE2), me.name, source_p->name, chal_line);
+				if(cnt >= CHALLENGE_WIDTH)
+					chal += CHALLENGE_WIDTH - 1;
+				else
+					break;
+
+			}
+			sendto_one(source_p, form_str(RPL_ENDOFRSACHALLENGE2),
+				   me.name, source_p->name);
+			source_p->user->opername = rb_strdup(job->opername);
 		}
-		sendto_one(source_p, form_str(RPL_ENDOFRSACHALLENGE2),
-			   me.name, source_p->name);
-		rb_free(challenge);
-		source_p->user->opername = rb_strdup(oper_p->name);
+		else
+			sendto_one_notice(source_p, ":Failed to generate challenge.");
 	}
-	else
-		sendto_one_notice(source_p, ":Failed to generate challenge.");
+
+	challenge_key_free(job->key);
+	rb_free(job->challenge);
+	rb_free(job->response);
+	rb_free(job->opername);
+	rb_free(job);
 }
 
+static void
+challenge_unload(void)
+{
+	/* the done callbacks live here */
+	rb_job_drain();
+}
+
+/* runs on a worker thread: no logging, and the random secret comes in */
 static bool
-#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
-generate_challenge(char **r_challenge, unsigned char **r_response, EVP_PKEY *key)
-#else
-generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
-#endif
+generate_challenge(char **r_challenge, unsigned char **r_response, challenge_key *key,
+		const unsigned char *secret, char *error, size_t errlen)
 {
-	unsigned char secret[CHALLENGE_SECRET_LENGTH];
 	unsigned char *tmp = NULL;
 	unsigned long e = 0;
-	unsigned long cnt = 0;
 	bool retval = false;
 	size_t length;
 	EVP_MD_CTX *mctx = NULL;
@@ -316,9 +403,6 @@ generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
 	EVP_PKEY_CTX *pctx = NULL;
 #endif
 
-	if(!rb_get_random(secret, sizeof secret))
-		return false;
-
 	if((*r_response = rb_malloc(SHA_DIGEST_LENGTH)) == NULL)
 		return false;
 
@@ -328,7 +412,7 @@ generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
 	if(EVP_DigestInit(mctx, EVP_sha1()) < 1)
 		goto fail;
 
-	if(EVP_DigestUpdate(mctx, secret, sizeof secret) < 1)
+	if(EVP_DigestUpdate(mctx, secret, CHALLENGE_SECRET_LENGTH) < 1)
 		goto fail;
 
 	if(EVP_DigestFinal(mctx, *r_response, NULL) < 1)
@@ -350,7 +434,7 @@ generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
 	if(EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_OAEP_PADDING) < 1)
 		goto fail;
 
-	if(EVP_PKEY_encrypt(pctx, tmp, &length, secret, sizeof secret) < 1)
+	if(EVP_PKEY_encrypt(pctx, tmp, &length, secret, CHALLENGE_SECRET_LENGTH) < 1)
 		goto fail;
 #else
 	if((length = (size_t) RSA_size(key)) < 1)
@@ -359,7 +443,7 @@ generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
 	if((tmp = rb_malloc(length)) == NULL)
 		goto fail;
 
-	if(RSA_public_encrypt(sizeof secret, secret, tmp, key, RSA_PKCS1_OAEP_PADDING) < 1)
+	if(RSA_public_encrypt(CHALLENGE_SECRET_LENGTH, secret, tmp, key, RSA_PKCS1_OAEP_PADDING) < 1)
 		goto fail;
 #endif
 
@@ -370,11 +454,10 @@ generate_challenge(char **r_challenge, unsigned char **r_response, RSA *key)
 	goto done;
 
 fail:
-	while ((cnt < 100) && (e = ERR_get_error()))
-	{
-		ilog(L_MAIN, "OpenSSL Error (CHALLENGE): %s", ERR_error_string(e, 0));
-		cnt++;
-	}
+	/* the error queue is per thread; keep the first for the log */
+	if((e = ERR_get_error()) != 0)
+		ERR_error_string_n(e, error, errlen);
+	ERR_clear_error();
 
 	rb_free(*r_response);
 	*r_response = NULL;
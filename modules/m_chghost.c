@@ -136,6 +136,8 @@ do_chghost(struct Client *source_p, struct Client *target_p,
 		if (MyClient(target_p))
 			sendto_one_numeric(target_p, RPL_HOSTHIDDEN, "%s :hostname reset by %s", target_p->host, source_p->name);
 	}
+	/* the spoof flag decides which hosts bans are matched against */
+	clear_client_matchset(target_p);
 	if (MyClient(source_p))
 		sendto_one_notice(source_p, ":Changed hostname for %s to %s", target_p->name, target_p->host);
 	if (!IsServer(source_p) && !IsService(source_p))
@@ -411,6 +411,11 @@ static struct InfoStruct info_table[] = {
 		"STATS Y is only shown to operators",
 		INFO_INTBOOL_YN(&ConfigFileEntry.stats_y_oper_only),
 	},
+	{
+		"throttle_aggregate_factor",
+		"Connection throttle growth per address prefix level",
+		INFO_DECIMAL(&ConfigFileEntry.throttle_aggregate_factor),
+	},
 	{
 		"throttle_count",
 		"Connection throttle threshold",
@@ -491,6 +496,11 @@ static struct InfoStruct info_table[] = {
 		"Total +b/e/I/q modes allowed in a +L channel",
 		INFO_DECIMAL(&ConfigChannel.max_bans_large),
 	},
+	{
+		"lossy_membership_size",
+		"Channel size from which JOIN and PART may be shed under sendq pressure",
+		INFO_DECIMAL(&ConfigChannel.lossy_membership_size),
+	},
 	{
 		"max_chans_per_user",
 		"Maximum number of channels a user can join",
@@ -541,6 +551,21 @@ static struct InfoStruct info_table[] = {
 		"Require TLS to become an oper",
 		INFO_INTBOOL_YN(&ConfigFileEntry.oper_secure_only),
 	},
+	{
+		"worker_threads",
+		"Threads for password checks and other CPU-heavy work",
+		INFO_DECIMAL(&ConfigFileEntry.worker_threads),
+	},
+	{
+		"io_threads",
+		"Threads reading from client sockets",
+		INFO_DECIMAL(&ConfigFileEntry.io_threads),
+	},
+	{
+		"sendq_budget",
+		"Most memory all sendqs together may use before some are shed",
+		INFO_DECIMAL(&ConfigFileEntry.sendq_budget),
+	},
 
 	{ NULL, NULL, 0, { NULL } },
 };
@@ -103,11 +103,8 @@ add_monitor(struct Client *client_p, const char *nicks)
 		monptr = find_monitor(name, 1);
 
 		/* already monitoring this nick */
-		if(rb_dlinkFind(client_p, &monptr->users))
+		if(!add_monitor_watcher(client_p, monptr))
 			continue;
-
-		rb_dlinkAddAlloc(client_p, &monptr->users);
-		rb_dlinkAddAlloc(monptr, &client_p->localClient->monitor_list);
 	}
 
 	send_multiline_init(client_p, ",", form_str(RPL_MONONLINE),
@@ -200,10 +197,7 @@ del_monitor(struct Client *client_p, const char *nicks)
 		if((monptr = find_monitor(name, 0)) == NULL)
 			continue;
 
-		rb_dlinkFindDestroy(client_p, &monptr->users);
-		rb_dlinkFindDestroy(monptr, &client_p->localClient->monitor_list);
-
-		free_monitor(monptr);
+		del_monitor_watcher(client_p, monptr);
 	}
 }
 
@@ -24,6 +24,7 @@
 
 #include "stdinc.h"
 #include "client.h"
+#include "hash.h"
 #include "match.h"
 #include "ircd.h"
 #include "numeric.h"
@@ -47,6 +48,9 @@ static void mc_oper(struct MsgBuf *, struct Client *, struct Client *, int, cons
 static void me_oper(struct MsgBuf *, struct Client *, struct Client *, int, const char **);
 
 static bool match_oper_password(const char *password, struct oper_conf *oper_p);
+static void oper_check_password(struct Client *source_p, struct oper_conf *oper_p, const char *name, const char *password);
+static void oper_password_result(struct Client *source_p, struct oper_conf *oper_p, const char *name, bool ok);
+static void oper_unload(void);
 
 struct Message oper_msgtab = {
 	"OPER", 0, 0, 0, 0,
@@ -55,7 +59,7 @@ struct Message oper_msgtab = {
 
 mapi_clist_av1 oper_clist[] = { &oper_msgtab, NULL };
 
-DECLARE_MODULE_AV2(oper, NULL, NULL, oper_clist, NULL, NULL, NULL, NULL, oper_desc);
+DECLARE_MODULE_AV2(oper, NULL, oper_unload, oper_clist, NULL, NULL, NULL, NULL, oper_desc);
 
 /*
  * m_oper
@@ -91,6 +95,10 @@ m_oper(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 		return;
 	}
 
+	/* one password check at a time */
+	if(source_p->localClient->localflags & LFLAGS_OPERCHECK)
+		return;
+
 	/* end the grace period */
 	if(!IsFloodDone(source_p))
 		flood_endgrace(source_p);
@@ -150,7 +158,19 @@ m_oper(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 		}
 	}
 
-	if(match_oper_password(password, oper_p))
+	if(IsOperConfEncrypted(oper_p) && !EmptyString(oper_p->passwd) && !EmptyString(password))
+	{
+		oper_check_password(source_p, oper_p, name, password);
+		return;
+	}
+
+	oper_password_result(source_p, oper_p, name, match_oper_password(password, oper_p));
+}
+
+static void
+oper_password_result(struct Client *source_p, struct oper_conf *oper_p, const char *name, bool ok)
+{
+	if(ok)
 	{
 		begin_local_response_batch();
 		oper_up(source_p, oper_p);
@@ -178,6 +198,81 @@ m_oper(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p
 	}
 }
 
+/*
+ * Hashing the password is the slow part of OPER, so it happens on a
+ * worker thread.  The job works on copies; the client and the oper
+ * block are looked up again once it is done, since either may have
+ * gone away in the meantime.
+ */
+struct oper_job
+{
+	char id[IDLEN];
+	char *name;
+	char *password;
+	char *passwd;
+	bool ok;
+};
+
+static void
+oper_job_work(void *data)
+{
+	struct oper_job *job = data;
+	char buf[BUFSIZE];
+	const char *encr;
+
+	encr = rb_crypt_r(job->password, job->passwd, buf, sizeof buf);
+	job->ok = encr != NULL && strcmp(encr, job->passwd) == 0;
+}
+
+static void
+oper_job_done(void *data)
+{
+	struct oper_job *job = data;
+	struct Client *source_p = find_id(job->id);
+	struct oper_conf *oper_p;
+
+	if(source_p != NULL && MyClient(source_p) && !IsAnyDead(source_p))
+	{
+		source_p->localClient->localflags &= ~LFLAGS_OPERCHECK;
+
+		oper_p = find_oper_conf(source_p->username, source_p->orighost,
+					source_p->sockhost, job->name);
+
+		/* a rehash may have removed the block or changed the password
+		 * we checked against */
+		if(!IsOper(source_p))
+			oper_password_result(source_p, oper_p, job->name,
+					job->ok && oper_p != NULL && oper_p->passwd != NULL &&
+					strcmp(oper_p->passwd, job->passwd) == 0);
+	}
+
+	rb_free(job->name);
+	rb_free(job->password);
+	rb_free(job->passwd);
+	rb_free(job);
+}
+
+static void
+oper_check_password(struct Client *source_p, struct oper_conf *oper_p, const char *name, const char *password)
+{
+	struct oper_job *job = rb_malloc(sizeof *job);
+
+	rb_strlcpy(job->id, source_p->id, sizeof job->id);
+	job->name = rb_strdup(name);
+	job->password = rb_strdup(password);
+	job->passwd = rb_strdup(oper_p->passwd);
+
+	source_p->localClient->localflags |= LFLAGS_OPERCHECK;
+	rb_job_post(oper_job_work, oper_job_done, job);
+}
+
+static void
+oper_unload(void)
+{
+	/* the done callbacks live here */
+	rb_job_drain();
+}
+
 /*
  * mc_oper - server-to-server OPER propagation
  *     parv[1] = opername
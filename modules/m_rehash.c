@@ -130,8 +130,7 @@ rehash_omotd(struct Client *source_p)
 	if (!MyConnect(source_p))
 		remote_rehash_oper_p = source_p;
 
-	free_cachefile(oper_motd);
-	oper_motd = cache_file(ircd_paths[IRCD_PATH_IRCD_OMOTD], "opers.motd", 0);
+	cache_oper_motd();
 }
 
 static void
@@ -27,6 +27,7 @@
 #include "send.h"
 #include "msg.h"
 #include "modules.h"
+#include "packet.h"
 #include "sslproc.h"
 #include "s_assert.h"
 #include "s_serv.h"
@@ -94,7 +95,7 @@ mr_starttls(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *sou
 	s_assert(client_p->localClient != NULL);
 
 	/* clear out any remaining plaintext lines */
-	rb_linebuf_donebuf(&client_p->localClient->buf_recvq);
+	recvq_discard(client_p);
 
 	sendto_one_numeric(client_p, RPL_STARTTLS, form_str(RPL_STARTTLS));
 	send_queued(client_p);
@@ -44,10 +44,12 @@
 #include "hash.h"
 #include "reject.h"
 #include "whowas.h"
+#include "rb_hashmap.h"
 #include "rb_radixtree.h"
 #include "response.h"
 #include "sslproc.h"
 #include "s_assert.h"
+#include "snomask.h"
 
 static const char stats_desc[] =
 	"Provides the STATS command to inspect various server/network information";
@@ -101,6 +103,8 @@ static void stats_tdeny(struct Client *);
 static void stats_deny(struct Client *);
 static void stats_exempt(struct Client *);
 static void stats_events(struct Client *);
+static void stats_hooks(struct Client *);
+static void stats_timings(struct Client *);
 static void stats_prop_klines(struct Client *);
 static void stats_auth(struct Client *);
 static void stats_tklines(struct Client *);
@@ -155,6 +159,8 @@ static struct stats_cmd stats_cmd_table[256] = {
 	['f'] = HANDLER_NORM(stats_comm,	true,	NULL),
 	['F'] = HANDLER_NORM(stats_comm,	true,	NULL),
 	['g'] = HANDLER_NORM(stats_prop_klines,	false,	"oper:general"),
+	['h'] = HANDLER_NORM(stats_hooks,	true,	NULL),
+	['H'] = HANDLER_NORM(stats_timings,	true,	NULL),
 	['i'] = HANDLER_NORM(stats_auth,	false,	NULL),
 	['I'] = HANDLER_NORM(stats_auth,	false,	NULL),
 	['k'] = HANDLER_NORM(stats_tklines,	false,	NULL),
@@ -317,6 +323,7 @@ stats_hash(struct Client *source_p)
 
 	rb_dictionary_stats_walk(stats_hash_cb, source_p);
 	rb_radixtree_stats_walk(stats_hash_cb, source_p);
+	rb_hashmap_stats_walk(stats_hash_cb, source_p);
 }
 
 static void
@@ -498,6 +505,76 @@ stats_events (struct Client *source_p)
 	rb_dump_events(stats_events_cb, source_p);
 }
 
+static void
+stats_hooks(struct Client *source_p)
+{
+	sendto_one_numeric(source_p, RPL_STATSDEBUG, "h :%-30s %-5s %-12s %-12s %-10s",
+		"NAME", "FNS", "CALLS", "TOTAL USEC", "AVG NSEC");
+
+	for (int i = 0; i < max_hooks; i++)
+	{
+		if (hooks[i].name == NULL || (hooks[i].nfns == 0 && hooks[i].calls == 0))
+			continue;
+
+		sendto_one_numeric(source_p, RPL_STATSDEBUG, "h :%-30s %-5d %-12llu %-12llu %-10llu",
+			hooks[i].name, hooks[i].nfns, hooks[i].calls, hooks[i].nsec / 1000,
+			hooks[i].calls ? hooks[i].nsec / hooks[i].calls : 0);
+	}
+}
+
+static void
+stats_timings_line(struct Client *source_p, const char *kind, const char *name,
+		const struct rb_hist *h)
+{
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+		"H :%-6s %-20s %-10llu %-12.1f %-9.1f %-9.1f %-9.1f %.1f",
+		kind, name, (unsigned long long)h->count, h->sum / 1000.0,
+		h->count ? (double)h->sum / h->count / 1000.0 : 0.0,
+		rb_hist_quantile(h, 0.5) / 1000.0, rb_hist_quantile(h, 0.99) / 1000.0,
+		h->max / 1000.0);
+}
+
+static void
+stats_timings_event_cb(const char *name, const struct rb_hist *h, void *data)
+{
+	if(h->count != 0)
+		stats_timings_line(data, "event", name, h);
+}
+
+static void
+stats_timings(struct Client *source_p)
+{
+	const struct rb_loop_stats *loop = rb_get_loop_stats();
+	const struct rb_hist *sq = &ServerStats.is_sqflush;
+	rb_dictionary_iter iter;
+	struct Message *msg;
+
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+		"H :event loop: %llu passes, %.1f seconds waiting for I/O",
+		(unsigned long long)loop->iterations, loop->wait_ns / 1e9);
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+		"H :sendq flushes: %llu, bytes avg %llu p50 %llu p99 %llu max %llu",
+		(unsigned long long)sq->count,
+		(unsigned long long)(sq->count ? sq->sum / sq->count : 0),
+		(unsigned long long)rb_hist_quantile(sq, 0.5),
+		(unsigned long long)rb_hist_quantile(sq, 0.99),
+		(unsigned long long)sq->max);
+
+	/* quantiles are bucket bounds, so within a factor of 4 */
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+		"H :%-6s %-20s %-10s %-12s %-9s %-9s %-9s %s",
+		"KIND", "NAME", "COUNT", "TOTAL USEC", "AVG USEC", "P50 USEC", "P99 USEC", "MAX USEC");
+	stats_timings_line(source_p, "loop", "io", &loop->io);
+	stats_timings_line(source_p, "loop", "lag", &loop->lag);
+	rb_event_stats(stats_timings_event_cb, source_p);
+
+	RB_DICTIONARY_FOREACH(msg, &iter, cmd_dict)
+	{
+		if(msg->time.count != 0)
+			stats_timings_line(source_p, "cmd", msg->cmd, &msg->time);
+	}
+}
+
 static void
 stats_prop_klines(struct Client *source_p)
 {
@@ -1042,6 +1119,22 @@ stats_tstats (struct Client *source_p)
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "T :sasl successes %u fails %u",
 			   sp.is_ssuc, sp.is_sbad);
+	for (int i = 0; i < 128; i++)
+	{
+		const struct snomask_bit *bit;
+
+		if (snomask_modes[i] == 0)
+			continue;
+
+		bit = &snomask_bits[ffs(snomask_modes[i]) - 1];
+		if (bit->sent == 0 && bit->skipped == 0)
+			continue;
+
+		sendto_one_numeric(source_p, RPL_STATSDEBUG,
+				   "T :snomask %c notices %llu unwanted %llu subscribers %lu",
+				   i, bit->sent, bit->skipped,
+				   rb_dlink_list_length(&bit->subscribers));
+	}
 	sendto_one_numeric(source_p, RPL_STATSDEBUG, "T :Client Server");
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "T :connected %u %u", sp.is_cl, sp.is_sv);
@@ -1212,6 +1305,8 @@ stats_memory (struct Client *source_p)
 	size_t away_memory = 0;	/* memory used by aways */
 	size_t ww = 0;		/* whowas array count */
 	size_t wwm = 0;		/* whowas array memory used */
+	size_t wwl = 0;		/* whowas log records */
+	size_t wwlm = 0;	/* whowas log index memory used */
 	size_t conf_memory = 0;	/* memory used by conf lines */
 	size_t mem_servers_cached;	/* memory used by scache */
 
@@ -1230,6 +1325,7 @@ stats_memory (struct Client *source_p)
 	size_t total_memory = 0;
 
 	whowas_memory_usage(&ww, &wwm);
+	whowas_log_memory_usage(&wwl, &wwlm);
 
 	RB_DLINK_FOREACH(ptr, global_client_list.head)
 	{
@@ -1349,7 +1445,11 @@ stats_memory (struct Client *source_p)
 			   "z :Whowas array %zu(%zu)",
 			   ww, wwm);
 
-	totww = wwm;
+	sendto_one_numeric(source_p, RPL_STATSDEBUG,
+			   "z :Whowas log %zu(%zu)",
+			   wwl, wwlm);
+
+	totww = wwm + wwlm;
 
 	sendto_one_numeric(source_p, RPL_STATSDEBUG,
 			   "z :Hash: client %u(%lu) chan %u(%lu)",
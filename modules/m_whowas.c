@@ -54,6 +54,54 @@ mapi_clist_av1 whowas_clist[] = { &whowas_msgtab, NULL };
 
 DECLARE_MODULE_AV2(whowas, NULL, NULL, whowas_clist, NULL, NULL, NULL, NULL, whowas_desc);
 
+struct whowas_reply
+{
+	struct Client *client_p;
+	struct Client *source_p;
+	long sendq_limit;
+	int cur;
+	int max;
+};
+
+/* send one entry; returns nonzero once the reply should stop */
+static int
+whowas_reply_entry(struct Whowas *temp, void *data)
+{
+	struct whowas_reply *reply = data;
+	struct Client *source_p = reply->source_p;
+	char tbuf[26];
+
+	if(reply->cur > 0 && rb_linebuf_len(&reply->client_p->localClient->buf_sendq) > reply->sendq_limit)
+	{
+		sendto_one(source_p, form_str(ERR_TOOMANYMATCHES),
+			   me.name, source_p->name, "WHOWAS");
+		return 1;
+	}
+
+	sendto_one(source_p, form_str(RPL_WHOWASUSER),
+		   me.name, source_p->name, temp->name,
+		   temp->username, temp->hostname, temp->realname);
+	if (!EmptyString(temp->sockhost) &&
+			strcmp(temp->sockhost, "0") &&
+			show_ip_whowas(temp, source_p))
+		sendto_one_numeric(source_p, RPL_WHOISACTUALLY,
+				   form_str(RPL_WHOISACTUALLY),
+				   temp->name, temp->sockhost);
+
+	if (!EmptyString(temp->suser))
+		sendto_one_numeric(source_p, RPL_WHOISLOGGEDIN,
+				   "%s %s :was logged in as",
+				   temp->name, temp->suser);
+
+	sendto_one_numeric(source_p, RPL_WHOISSERVER,
+			   form_str(RPL_WHOISSERVER),
+			   temp->name, temp->servername,
+			   rb_ctime(temp->logoff, tbuf, sizeof(tbuf)));
+
+	reply->cur++;
+	return reply->max > 0 && reply->cur >= reply->max;
+}
+
 /*
 ** m_whowas
 **      parv[1] = nickname queried
@@ -62,13 +110,12 @@ static void
 m_whowas(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
 	rb_dlink_list *whowas_list;
-	rb_dlink_node *ptr;
-	int cur = 0;
+	rb_dlink_node *ptr = NULL;
+	struct whowas_reply reply;
+	uint64_t oldest = UINT64_MAX;
 	int max = -1;
 	char *p;
 	const char *nick;
-	char tbuf[26];
-	long sendq_limit;
 
 	static time_t last_used = 0L;
 
@@ -107,52 +154,36 @@ m_whowas(struct MsgBuf *msgbuf_p, struct Client *client_p, struct Client *source
 
 	nick = parv[1];
 
-	sendq_limit = get_sendq(client_p) * 9 / 10;
+	reply.client_p = client_p;
+	reply.source_p = source_p;
+	reply.sendq_limit = get_sendq(client_p) * 9 / 10;
+	reply.cur = 0;
+	reply.max = max;
+
 	whowas_list = whowas_get_list(nick);
 
 	begin_local_response_batch();
 
-	if(whowas_list == NULL)
-	{
-		sendto_one_numeric(source_p, ERR_WASNOSUCHNICK, form_str(ERR_WASNOSUCHNICK), nick);
-		sendto_one_numeric(source_p, RPL_ENDOFWHOWAS, form_str(RPL_ENDOFWHOWAS), parv[1]);
-		return;
-	}
-
-	RB_DLINK_FOREACH(ptr, whowas_list->head)
+	/* the in-memory history holds the newest entries for a nick; the
+	 * log is only consulted for what is older than all of them */
+	if(whowas_list != NULL)
 	{
-		struct Whowas *temp = ptr->data;
-		if(cur > 0 && rb_linebuf_len(&client_p->localClient->buf_sendq) > sendq_limit)
+		RB_DLINK_FOREACH(ptr, whowas_list->head)
 		{
-			sendto_one(source_p, form_str(ERR_TOOMANYMATCHES),
-				   me.name, source_p->name, "WHOWAS");
-			break;
-		}
+			struct Whowas *temp = ptr->data;
 
-		sendto_one(source_p, form_str(RPL_WHOWASUSER),
-			   me.name, source_p->name, temp->name,
-			   temp->username, temp->hostname, temp->realname);
-		if (!EmptyString(temp->sockhost) &&
-				strcmp(temp->sockhost, "0") &&
-				show_ip_whowas(temp, source_p))
-			sendto_one_numeric(source_p, RPL_WHOISACTUALLY,
-					   form_str(RPL_WHOISACTUALLY),
-					   temp->name, temp->sockhost);
-
-		if (!EmptyString(temp->suser))
-			sendto_one_numeric(source_p, RPL_WHOISLOGGEDIN,
-					   "%s %s :was logged in as",
-					   temp->name, temp->suser);
-
-		sendto_one_numeric(source_p, RPL_WHOISSERVER,
-				   form_str(RPL_WHOISSERVER),
-				   temp->name, temp->servername,
-				   rb_ctime(temp->logoff, tbuf, sizeof(tbuf)));
-
-		cur++;
-		if(max > 0 && cur >= max)
-			break;
+			if(temp->serial < oldest)
+				oldest = temp->serial;
+			if(whowas_reply_entry(temp, &reply))
+				break;
+		}
 	}
 
+	if(whowas_list == NULL || ptr == NULL)
+		whowas_log_search(nick, oldest, whowas_reply_entry, &reply);
+
+	if(reply.cur == 0)
+		sendto_one_numeric(source_p, ERR_WASNOSUCHNICK, form_str(ERR_WASNOSUCHNICK), nick);
+
 	sendto_one_numeric(source_p, RPL_ENDOFWHOWAS, form_str(RPL_ENDOFWHOWAS), parv[1]);
 }
@@ -0,0 +1,98 @@
+/*
+ *  channel_bench.c: Measure channel message fan-out to local members
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make channel_bench" and run
+ *  it with an optional number of members and messages.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "channel.h"
+#include "send.h"
+
+static struct Client **members;
+static long nmembers;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+empty_sendqs(void)
+{
+	for (long i = 0; i < nmembers; i++)
+		rb_linebuf_donebuf(&members[i]->localClient->buf_sendq);
+}
+
+static void
+bench(const char *name, struct Channel *chptr, int type, long messages)
+{
+	double elapsed = 0, start;
+
+	for (long n = 0; n < messages; n++) {
+		start = now();
+		sendto_channel_flags(NULL, type, members[0], chptr, "PRIVMSG %s%s :hello there, how is everyone doing today?",
+			type == CHFL_CHANOP ? "@" : "", chptr->chname);
+		elapsed += now() - start;
+
+		empty_sendqs();
+	}
+
+	printf("%-16s %12.0f msgs/sec %10.1f us/msg\n", name,
+		messages / elapsed, elapsed * 1e6 / messages);
+}
+
+int main(int argc, char *argv[])
+{
+	char nick[NICKLEN];
+	struct Channel *chptr;
+	long messages;
+
+	nmembers = argc > 1 ? atol(argv[1]) : 10000;
+	messages = argc > 2 ? atol(argv[2]) : 1000;
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	chptr = make_channel();
+	members = rb_malloc(nmembers * sizeof(*members));
+
+	for (long i = 0; i < nmembers; i++) {
+		snprintf(nick, sizeof(nick), "bench%ld", i);
+		members[i] = make_local_person_nick(nick);
+		/* one member in a hundred is opped */
+		add_user_to_channel(chptr, members[i], i % 100 == 0 ? CHFL_CHANOP : CHFL_PEON);
+	}
+
+	bench("all members", chptr, ALL_MEMBERS, messages);
+	bench("chanops", chptr, ONLY_CHANOPS, messages * 10);
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
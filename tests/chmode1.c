@@ -20,6 +20,7 @@
 #include <stdinc.h>
 #include <channel.h>
 #include <hook.h>
+#include <s_user.h>
 
 #include "client_util.h"
 #include "ircd_util.h"
@@ -101,6 +102,94 @@ test_chmode_limits(void)
 	remove_hook("get_channel_access", chmode_access_hook);
 }
 
+static void
+test_chmode_bans(void)
+{
+	struct Client *target = make_local_person_full("banned", "user", "host.example.test", "192.0.2.10", "Banned");
+	const char *forward;
+	char mask[64];
+
+	is_int(0, is_banned(channel, target, NULL, NULL, NULL), MSG);
+
+	/* many unrelated bans, so the host index grows */
+	for (int i = 0; i < 100; i++)
+	{
+		snprintf(mask, sizeof mask, "*!*@host%d.example.test", i);
+		ok(add_id(&me, channel, mask, NULL, &channel->banlist, CHFL_BAN) != NULL, MSG);
+		snprintf(mask, sizeof mask, "*!*@198.51.%d.0/24", i);
+		ok(add_id(&me, channel, mask, NULL, &channel->banlist, CHFL_BAN) != NULL, MSG);
+	}
+	is_int(0, is_banned(channel, target, NULL, NULL, NULL), MSG);
+
+	static const struct {
+		const char *mask;
+		int result;
+	} masks[] = {
+		{ "*!*@host.example.test", CHFL_BAN },
+		{ "*!*@HOST.Example.TEST", CHFL_BAN },
+		{ "banned!user@host.example.test", CHFL_BAN },
+		{ "other!*@host.example.test", 0 },
+		{ "*!*@192.0.2.10", CHFL_BAN },
+		{ "*!*@192.0.2.0/24", CHFL_BAN },
+		{ "b*!*@192.0.2.0/24", CHFL_BAN },
+		{ "x*!*@192.0.2.0/24", 0 },
+		{ "*!*@192.0.3.0/24", 0 },
+		{ "*!*@192.0.2.0/0", 0 },
+		{ "*!*@2001:db8::/32", 0 },
+		{ "*!*@*.example.test", CHFL_BAN },
+		{ "*!user@*", CHFL_BAN },
+		{ "*example*", CHFL_BAN },
+		{ "$x:nothing", 0 },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(masks); i++)
+	{
+		ok(add_id(&me, channel, masks[i].mask, NULL, &channel->banlist, CHFL_BAN) != NULL, MSG);
+		is_int(masks[i].result, is_banned(channel, target, NULL, NULL, NULL), "%s: %s", masks[i].mask, "banned");
+		is_int(0, is_quieted(channel, target, NULL, NULL), "%s: %s", masks[i].mask, "not quieted");
+		ok(del_id(channel, masks[i].mask, &channel->banlist, CHFL_BAN) != NULL, MSG);
+		is_int(0, is_banned(channel, target, NULL, NULL, NULL), "%s: %s", masks[i].mask, "removed");
+	}
+
+	/* exceptions, and the forward of the first matching ban */
+	add_id(&me, channel, "*!*@host.example.test", "#first", &channel->banlist, CHFL_BAN);
+	add_id(&me, channel, "*!*@nowhere.test", "#none", &channel->banlist, CHFL_BAN);
+	add_id(&me, channel, "*!*@192.0.2.0/24", "#last", &channel->banlist, CHFL_BAN);
+	forward = NULL;
+	is_int(CHFL_BAN, is_banned(channel, target, NULL, NULL, &forward), MSG);
+	is_string("#last", forward, MSG);
+
+	add_id(&me, channel, "*!user@192.0.2.10", NULL, &channel->exceptlist, CHFL_EXCEPTION);
+	is_int(CHFL_EXCEPTION, is_banned(channel, target, NULL, NULL, NULL), MSG);
+	del_id(channel, "*!user@192.0.2.10", &channel->exceptlist, CHFL_EXCEPTION);
+
+	del_id(channel, "*!*@192.0.2.0/24", &channel->banlist, CHFL_BAN);
+	forward = NULL;
+	is_int(CHFL_BAN, is_banned(channel, target, NULL, NULL, &forward), MSG);
+	is_string("#first", forward, MSG);
+
+	add_id(&me, channel, "*!*@192.0.2.0/25", NULL, &channel->quietlist, CHFL_QUIET);
+	is_int(CHFL_BAN, is_quieted(channel, target, NULL, NULL), MSG);
+	del_id(channel, "*!*@192.0.2.0/25", &channel->quietlist, CHFL_QUIET);
+	del_id(channel, "*!*@host.example.test", &channel->banlist, CHFL_BAN);
+	del_id(channel, "*!*@nowhere.test", &channel->banlist, CHFL_BAN);
+
+	/* the cached ban strings follow nick and host changes */
+	add_id(&me, channel, "renamed!*@*", NULL, &channel->banlist, CHFL_BAN);
+	add_id(&me, channel, "*!*@moved.example.test", NULL, &channel->quietlist, CHFL_QUIET);
+	is_int(0, is_banned(channel, target, NULL, NULL, NULL), MSG);
+	is_int(0, is_quieted(channel, target, NULL, NULL), MSG);
+	change_nick_user_host(target, "Renamed", target->username, target->host, 0, "test");
+	is_int(CHFL_BAN, is_banned(channel, target, NULL, NULL, NULL), MSG);
+	change_nick_user_host(target, target->name, target->username, "Moved.example.test", 0, "test");
+	is_int(CHFL_BAN, is_quieted(channel, target, NULL, NULL), MSG);
+	change_nick_user_host(target, "banned", target->username, "host.example.test", 0, "test");
+	is_int(0, is_banned(channel, target, NULL, NULL, NULL), MSG);
+	is_int(0, is_quieted(channel, target, NULL, NULL), MSG);
+
+	remove_local_person(target);
+}
+
 static void
 chmode_init(void)
 {
@@ -120,6 +209,7 @@ main(int argc, char *argv[])
 
 	test_chmode_parse();
 	test_chmode_limits();
+	test_chmode_bans();
 
 	client_util_free();
 	ircd_util_free();
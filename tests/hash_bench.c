@@ -0,0 +1,133 @@
+/*
+ *  hash_bench.c: Compare nick lookups in rb_radixtree and rb_hashmap
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make hash_bench" and run
+ *  it with an optional number of nicks and lookups.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "match.h"
+#include "client.h"
+#include "rb_hashmap.h"
+#include "rb_radixtree.h"
+
+struct Client me;
+
+static char (*nicks)[NICKLEN];
+static long nnicks;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* nick-like names, with the odd character that case-folds */
+static void
+make_nicks(void)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\^{}|_-0123456789";
+
+	nicks = rb_malloc(nnicks * sizeof *nicks);
+	srand(1);
+
+	for (long i = 0; i < nnicks; i++)
+	{
+		int len = snprintf(nicks[i], sizeof nicks[i], "%c%ld", 'a' + rand() % 26, i);
+
+		while (len < 9 && rand() % 3 != 0)
+			nicks[i][len++] = chars[rand() % (sizeof chars - 1)];
+		nicks[i][len] = '\0';
+	}
+}
+
+static void
+report(const char *name, const char *op, long count, double elapsed)
+{
+	printf("%-10s %-8s %12.0f ops/sec %8.1f ns/op\n", name, op,
+		count / elapsed, elapsed * 1e9 / count);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_radixtree *tree;
+	rb_hashmap *map;
+	long lookups;
+	double start;
+
+	nnicks = argc > 1 ? atol(argv[1]) : 500000;
+	lookups = argc > 2 ? atol(argv[2]) : 5000000;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	make_nicks();
+
+	tree = rb_radixtree_create("bench", irccasecanon);
+	map = rb_hashmap_create("bench", irctoupper_tab);
+
+	start = now();
+	for (long i = 0; i < nnicks; i++)
+		rb_radixtree_add(tree, nicks[i], nicks[i]);
+	report("radixtree", "add", nnicks, now() - start);
+
+	start = now();
+	for (long i = 0; i < nnicks; i++)
+		rb_hashmap_add(map, nicks[i], nicks[i]);
+	report("hashmap", "add", nnicks, now() - start);
+
+	/* lookups in random order; dropping the first character makes
+	 * about half of them misses */
+	srand(2);
+	start = now();
+	for (long n = 0; n < lookups; n++)
+	{
+		long i = rand() % nnicks;
+
+		rb_radixtree_retrieve(tree, nicks[i] + (n & 1));
+	}
+	report("radixtree", "lookup", lookups, now() - start);
+
+	srand(2);
+	start = now();
+	for (long n = 0; n < lookups; n++)
+	{
+		long i = rand() % nnicks;
+
+		rb_hashmap_retrieve(map, nicks[i] + (n & 1));
+	}
+	report("hashmap", "lookup", lookups, now() - start);
+
+	start = now();
+	for (long i = 0; i < nnicks; i++)
+		rb_radixtree_delete(tree, nicks[i]);
+	report("radixtree", "delete", nnicks, now() - start);
+
+	start = now();
+	for (long i = 0; i < nnicks; i++)
+		rb_hashmap_delete(map, nicks[i]);
+	report("hashmap", "delete", nnicks, now() - start);
+
+	return 0;
+}
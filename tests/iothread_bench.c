@@ -0,0 +1,159 @@
+/*
+ *  iothread_bench.c: Measure socket reads with and without I/O threads
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make iothread_bench" and run
+ *  it with an optional number of seconds per run, sockets and writer
+ *  threads.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+struct Client me;
+
+#define LINE ":nick!user@host.example.com PRIVMSG #channel :hello there, how is everyone doing today?\r\n"
+
+/* what each write() puts on a socket, as a busy client pipelines */
+#define WRITE_LINES	8
+
+static int nsockets;
+static int nwriters;
+static int *write_fds;
+static volatile int stop;
+static unsigned long long bytes_read;
+
+static double
+now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* each writer keeps its share of the sockets full */
+static void *
+writer(void *arg)
+{
+	static char chunk[sizeof(LINE) * WRITE_LINES];
+	int id = (int)(intptr_t)arg;
+	int len = 0;
+
+	for (int i = 0; i < WRITE_LINES; i++)
+		len += sprintf(chunk + len, "%s", LINE);
+
+	while (!stop)
+		for (int i = id; i < nsockets; i += nwriters)
+			if (write(write_fds[i], chunk, len) < 0 && errno != EAGAIN)
+				return NULL;
+
+	return NULL;
+}
+
+/* what read_packet does, less the parsing */
+static void
+reader(rb_fde_t *F, void *data)
+{
+	char buf[READBUF_SIZE];
+	ssize_t len;
+
+	while ((len = rb_read(F, buf, sizeof buf)) > 0)
+		bytes_read += len;
+
+	if (len < 0 && rb_ignore_errno(errno))
+		rb_setselect(F, RB_SELECT_READ, reader, NULL);
+}
+
+static void
+run(int threads, double seconds)
+{
+	pthread_t tids[nwriters];
+	double start, cpu;
+
+	rb_lib_init(NULL, NULL, NULL, 0, nsockets * 2 + 64, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_iothread_init(threads);
+
+	write_fds = rb_malloc(nsockets * sizeof *write_fds);
+	for (int i = 0; i < nsockets; i++)
+	{
+		rb_fde_t *F[2];
+
+		if (rb_socketpair(AF_UNIX, SOCK_STREAM, 0, &F[0], &F[1], "bench") < 0)
+		{
+			perror("socketpair");
+			exit(1);
+		}
+		rb_set_nb(F[0]);
+		rb_set_nb(F[1]);
+		write_fds[i] = rb_get_fd(F[1]);
+		rb_iothread_attach(F[0]);
+		rb_setselect(F[0], RB_SELECT_READ, reader, NULL);
+	}
+
+	for (int i = 0; i < nwriters; i++)
+		pthread_create(&tids[i], NULL, writer, (void *)(intptr_t)i);
+
+	start = now(CLOCK_MONOTONIC);
+	cpu = now(CLOCK_THREAD_CPUTIME_ID);
+	while (now(CLOCK_MONOTONIC) - start < seconds)
+		rb_select(100);
+	cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	start = now(CLOCK_MONOTONIC) - start;
+	stop = 1;
+
+	printf("%2d io threads %10.1f MB/s %8.1f main thread ns/KB %5.0f%% main thread busy\n",
+		threads, bytes_read / start / 1e6, cpu * 1e9 / (bytes_read / 1024.0),
+		cpu * 100 / start);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int threads[] = { 0, 1, 2, 4, 8 };
+	double seconds = argc > 1 ? atof(argv[1]) : 2;
+
+	nsockets = argc > 2 ? atoi(argv[2]) : 1000;
+	nwriters = argc > 3 ? atoi(argv[3]) : 4;
+
+	/* threads cannot be stopped, so every run is its own process */
+	for (size_t i = 0; i < ARRAY_SIZE(threads); i++)
+	{
+		pid_t pid = fork();
+
+		if (pid < 0)
+		{
+			perror("fork");
+			return 1;
+		}
+		if (pid == 0)
+		{
+			run(threads[i], seconds);
+			_exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ *  linebuf_bench.c: Measure the rb_linebuf read and write paths
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make linebuf_bench" and run
+ *  it with an optional number of lines.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+
+struct Client me;
+
+#define TEXT ":nick!user@host.example.com PRIVMSG #channel :hello there, how is everyone doing today?"
+#define LINE TEXT "\r\n"
+
+/* how many lines arrive in one read(), and how many targets share a line */
+#define READ_LINES	32
+#define FANOUT		100
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name, long count, double elapsed)
+{
+	printf("%-16s %12.0f lines/sec %8.1f ns/line\n", name,
+		count / elapsed, elapsed * 1e9 / count);
+}
+
+/* split reads into lines and take them out again, as read_packet does */
+static void
+bench_parse_get(long lines)
+{
+	static char chunk[sizeof(LINE) * READ_LINES];
+	char line[BUFSIZE];
+	buf_head_t buf;
+	int len = 0;
+	double start;
+
+	for (int i = 0; i < READ_LINES; i++)
+		len += sprintf(chunk + len, "%s", LINE);
+
+	rb_linebuf_newbuf(&buf);
+
+	start = now();
+	for (long n = 0; n < lines; n += READ_LINES)
+	{
+		/* the last argument is binary, which only the helpers use */
+		rb_linebuf_parse(&buf, chunk, len, 0);
+		while (rb_linebuf_get(&buf, line, sizeof line, LINEBUF_COMPLETE, LINEBUF_PARSED) > 0)
+			;
+	}
+	report("parse+get", lines, now() - start);
+
+	rb_linebuf_donebuf(&buf);
+}
+
+/* format a line once and attach it to many sendqs, as sendto_channel_flags
+ * does, then write them all out */
+static void
+bench_put_attach_flush(long lines, rb_fde_t *F)
+{
+	static buf_head_t sendq[FANOUT];
+	buf_head_t buf;
+	rb_strf_t strings = { .format = TEXT, .format_args = NULL, .next = NULL };
+	double start, put = 0, attach = 0, flush = 0;
+
+	for (int i = 0; i < FANOUT; i++)
+		rb_linebuf_newbuf(&sendq[i]);
+
+	for (long n = 0; n < lines; n += FANOUT)
+	{
+		start = now();
+		rb_linebuf_newbuf(&buf);
+		rb_linebuf_put(&buf, &strings);
+		put += now() - start;
+
+		start = now();
+		for (int i = 0; i < FANOUT; i++)
+			rb_linebuf_attach(&sendq[i], &buf);
+		rb_linebuf_donebuf(&buf);
+		attach += now() - start;
+
+		start = now();
+		for (int i = 0; i < FANOUT; i++)
+			while (rb_linebuf_len(&sendq[i]) > 0 && rb_linebuf_flush(F, &sendq[i]) > 0)
+				;
+		flush += now() - start;
+	}
+
+	report("put", lines / FANOUT, put);
+	report("attach", lines, attach);
+	report("flush", lines, flush);
+
+	for (int i = 0; i < FANOUT; i++)
+		rb_linebuf_donebuf(&sendq[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	long lines = argc > 1 ? atol(argv[1]) : 10000000;
+	rb_fde_t *F;
+	int fd;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	/* flush writes to /dev/null so only the librb side is measured */
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0)
+	{
+		perror("/dev/null");
+		return 1;
+	}
+	F = rb_open(fd, RB_FD_FILE, "/dev/null");
+
+	bench_parse_get(lines);
+	bench_put_attach_flush(lines, F);
+
+	rb_close(F);
+	return 0;
+}
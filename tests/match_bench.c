@@ -0,0 +1,177 @@
+/*
+ *  match_bench.c: Measure match() and find_conf_by_address()
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make match_bench" and run
+ *  it with an optional number of iterations and K-lines.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "match.h"
+#include "client.h"
+#include "hostmask.h"
+#include "s_conf.h"
+
+struct Client me;
+
+/* ban masks as they are found on busy channels */
+static const char *masks[] = {
+	"*!*@*.example.net",
+	"*!*@192.0.2.*",
+	"spammer*!*@*",
+	"*!~*@*",
+	"*!*bot*@*.dynamic.example.org",
+	"*!*@gateway/web/irccloud.com/x-*",
+	"?????*!*@*",
+	"*!*@2001:db8:*",
+	"*[Bb][Oo][Tt]*!*@*",
+	"nick!user@host.example.com",
+};
+
+static const char *names[] = {
+	"SomeNick!~someuser@host-203-0-113-7.dsl.Example.NET",
+	"another!ident@192.0.2.44",
+	"w!u@gateway/web/irccloud.com/x-abcdefghijklmnop",
+	"LongerNickName_|away!~LongUserName@2001:db8:1234:5678:9abc:def0:1234:5678",
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *name, long count, double elapsed)
+{
+	printf("%-24s %12.0f ops/sec %8.1f ns/op\n", name,
+		count / elapsed, elapsed * 1e9 / count);
+}
+
+static void
+bench_match(long iterations)
+{
+	char folded[ARRAY_SIZE(names)][NICKLEN + USERLEN + HOSTLEN + 6];
+	volatile int hits = 0;
+	double start;
+
+	for (size_t j = 0; j < ARRAY_SIZE(names); j++)
+	{
+		size_t k;
+
+		for (k = 0; names[j][k] != '\0'; k++)
+			folded[j][k] = irctolower(names[j][k]);
+		folded[j][k] = '\0';
+	}
+
+	/* one op is one mask against one name, as a ban check does */
+	start = now();
+	for (long n = 0; n < iterations; n++)
+		for (size_t i = 0; i < ARRAY_SIZE(masks); i++)
+			for (size_t j = 0; j < ARRAY_SIZE(names); j++)
+				hits += match(masks[i], names[j]);
+	report("match", iterations * ARRAY_SIZE(masks) * ARRAY_SIZE(names), now() - start);
+
+	start = now();
+	for (long n = 0; n < iterations; n++)
+		for (size_t i = 0; i < ARRAY_SIZE(masks); i++)
+			for (size_t j = 0; j < ARRAY_SIZE(names); j++)
+				hits += match_folded(masks[i], folded[j]);
+	report("match_folded", iterations * ARRAY_SIZE(masks) * ARRAY_SIZE(names), now() - start);
+}
+
+/* K-lines shaped like a real ban list: hosts, wildcard hosts, single
+ * addresses and CIDR ranges, in roughly that mix */
+static void
+add_klines(long count)
+{
+	static struct ConfItem aconf;
+	char mask[HOSTLEN + 1];
+
+	for (long i = 0; i < count; i++)
+	{
+		switch (i % 4)
+		{
+		case 0:
+			snprintf(mask, sizeof mask, "host%ld.isp%ld.example.com", i, i % 97);
+			break;
+		case 1:
+			snprintf(mask, sizeof mask, "*.customers%ld.example.org", i);
+			break;
+		case 2:
+			snprintf(mask, sizeof mask, "198.%ld.%ld.%ld", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+			break;
+		case 3:
+			snprintf(mask, sizeof mask, "10.%ld.%ld.0/24", (i >> 8) & 255, i & 255);
+			break;
+		}
+		add_conf_by_address(rb_strdup(mask), CONF_KILL, (i % 3) ? "*" : "baduser", NULL, &aconf);
+	}
+}
+
+static void
+bench_find_conf(long iterations, long klines)
+{
+	struct rb_sockaddr_storage addr;
+	volatile struct ConfItem *found = NULL;
+	double start;
+
+	add_klines(klines);
+	rb_inet_pton_sock("203.0.113.7", &addr);
+
+	/* a client that is not banned walks every candidate, which is the
+	 * common case at connect time */
+	start = now();
+	for (long n = 0; n < iterations; n++)
+		found = find_conf_by_address("host-203-0-113-7.dsl.example.net", "203.0.113.7",
+				"host-203-0-113-7.dsl.example.net", (struct sockaddr *)&addr,
+				CONF_KILL, AF_INET, "someuser", NULL);
+	report("find_conf_by_address miss", iterations, now() - start);
+
+	rb_inet_pton_sock("10.1.2.3", &addr);
+	start = now();
+	for (long n = 0; n < iterations; n++)
+		found = find_conf_by_address("host.customers5.example.org", "10.1.2.3",
+				"host.customers5.example.org", (struct sockaddr *)&addr,
+				CONF_KILL, AF_INET, "someuser", NULL);
+	report("find_conf_by_address hit", iterations, now() - start);
+
+	if (found == NULL)
+		printf("(no K-line matched; is the list long enough?)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	long klines = argc > 2 ? atol(argv[2]) : 10000;
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	init_host_hash();
+
+	bench_match(iterations);
+	bench_find_conf(iterations * 10, klines);
+
+	return 0;
+}
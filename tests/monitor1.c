@@ -0,0 +1,126 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "monitor.h"
+#include "s_conf.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static void watchers1(void)
+{
+	struct Client *user = make_local_person();
+	struct Client *user2 = make_local_person_nick("watcher2");
+	char name[NICKLEN];
+
+	/* enough nicks to make the watcher sets grow a few times */
+	for (int i = 0; i < 50; i++)
+	{
+		snprintf(name, sizeof(name), "nick%d", i);
+		ok(add_monitor_watcher(user, find_monitor(name, 1)), MSG);
+	}
+	ok(!add_monitor_watcher(user, find_monitor("nick3", 1)), "Already watching; " MSG);
+	ok(add_monitor_watcher(user2, find_monitor("nick3", 1)), MSG);
+	is_int(50, rb_dlink_list_length(&user->localClient->monitor_list), MSG);
+	is_int(2, rb_dlink_list_length(&find_monitor("nick3", 0)->users), MSG);
+
+	ok(is_monitoring(user, "NICK7"), "Case insensitive; " MSG);
+	ok(!is_monitoring(user, "nick50"), MSG);
+	ok(!is_monitoring(user2, "nick7"), MSG);
+
+	del_monitor_watcher(user, find_monitor("nick7", 0));
+	ok(!is_monitoring(user, "nick7"), MSG);
+	ok(find_monitor("nick7", 0) == NULL, "Unwatched nick freed; " MSG);
+
+	for (int i = 0; i < 50; i++)
+	{
+		snprintf(name, sizeof(name), "nick%d", i);
+		ok(i == 7 || is_monitoring(user, name), MSG);
+	}
+
+	clear_monitor(user);
+	is_int(0, rb_dlink_list_length(&user->localClient->monitor_list), MSG);
+	ok(find_monitor("nick0", 0) == NULL, MSG);
+	ok(is_monitoring(user2, "nick3"), "Other watchers kept; " MSG);
+
+	clear_monitor(user2);
+	ok(find_monitor("nick3", 0) == NULL, MSG);
+
+	remove_local_person(user);
+	remove_local_person(user2);
+}
+
+static void signon_batch1(void)
+{
+	struct Client *user = make_local_person();
+	struct Client *targets[4];
+	char name[NICKLEN];
+
+	for (int i = 0; i < 4; i++)
+	{
+		snprintf(name, sizeof(name), "nick%d", i);
+		add_monitor_watcher(user, find_monitor(name, 1));
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		snprintf(name, sizeof(name), "nick%d", i);
+		targets[i] = make_local_person_nick(name);
+		monitor_signon(targets[i]);
+	}
+	monitor_signoff(targets[2]);
+
+	/* nothing is sent until the end of the I/O pass */
+	is_client_sendq_empty(user, MSG);
+	rb_select(0);
+
+	is_client_sendq_one(":me.test 730 * :nick0!username@example.test,nick1!username@example.test,nick3!username@example.test" CRLF,
+		user, "Coalesced online; " MSG);
+	is_client_sendq(":me.test 731 * :nick2" CRLF, user, "Final state wins; " MSG);
+
+	/* clearing with notifications pending must not send them later */
+	monitor_signoff(targets[0]);
+	clear_monitor(user);
+	rb_select(0);
+	is_client_sendq_empty(user, MSG);
+
+	for (int i = 0; i < 4; i++)
+		remove_local_person(targets[i]);
+	remove_local_person(user);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	watchers1();
+	signon_batch1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
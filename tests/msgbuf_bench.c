@@ -0,0 +1,76 @@
+/*
+ *  msgbuf_bench.c: Measure msgbuf_parse throughput
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  Not run by "make check"; build it with "make msgbuf_bench" and run
+ *  it with an optional number of iterations per line.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "msgbuf.h"
+#include "client.h"
+
+struct Client me;
+
+static const struct {
+	const char *name;
+	const char *line;
+} lines[] = {
+	{ "client privmsg", "PRIVMSG #channel :hello there, how is everyone doing today?" },
+	{ "server privmsg", ":00AAAAAAB PRIVMSG #channel :hello there, how is everyone doing today?" },
+	{ "many params", ":irc.example.net 005 nick CHANTYPES=# EXCEPTS INVEX CHANMODES=eIbq,k,flj,CFLMPQScgimnprstuz CHANLIMIT=#:250 PREFIX=(ov)@+ MAXLIST=bqeI:100 MODES=4 NETWORK=Example :are supported by this server" },
+	{ "client tags", "@+draft/reply=1234567890;+typing=active;label=abcdef PRIVMSG #channel :hello there" },
+	{ "server tags", "@time=2024-01-01T00:00:00.000Z;account=someaccount;msgid=AbCdEfGhIjKlMnOp;+draft/reply=1234567890;+example.com/escaped=a\\sb\\:c\\\\d;batch=xyz;solanum.chat/oper :00AAAAAAB PRIVMSG #channel :hello there, how is everyone doing today?" },
+	{ "valueless tags", "@a;b;c;d;e;f;g;h;i;j;k;l;m;n;o;p;q;r;s;t;u;v;w;x;y;z PING :x" },
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	static char buf[EXT_BUFSIZE + 1];
+	long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+	struct MsgBuf msgbuf;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lines); i++) {
+		size_t len = strlen(lines[i].line) + 1;
+		double start = now(), elapsed;
+
+		for (long n = 0; n < iterations; n++) {
+			memcpy(buf, lines[i].line, len);
+			msgbuf_parse(&msgbuf, buf);
+		}
+
+		elapsed = now() - start;
+		printf("%-16s %12.0f lines/sec %8.1f ns/line\n", lines[i].name,
+			iterations / elapsed, elapsed * 1e9 / iterations);
+	}
+
+	return 0;
+}
@@ -0,0 +1,471 @@
+/*
+ *  msgbuf_parse2.c: Compare msgbuf_parse with the strchr-based parser it replaced
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "msgbuf.h"
+#include "client.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+struct Client me;
+
+static char line[EXT_BUFSIZE * 2];
+static char buf_new[sizeof(line)];
+static char buf_ref[sizeof(line)];
+static unsigned int failures;
+
+/* the parser as it was before it scanned the line in blocks */
+static const char ref_unescape_table[256] = {
+	[':'] = ';', ['\\'] = '\\', ['n'] = '\n', ['r'] = '\r', ['s'] = ' ',
+};
+
+static void
+ref_unescape_value(char *value)
+{
+	char *in = value;
+	char *out = value;
+
+	if (value == NULL)
+		return;
+
+	while (*in != '\0') {
+		if (*in == '\\') {
+			const char unescape = ref_unescape_table[(unsigned char)*++in];
+
+			if (*in == '\0')
+				break;
+
+			if (unescape) {
+				*out++ = unescape;
+				in++;
+			} else {
+				*out++ = *in++;
+			}
+		} else {
+			*out++ = *in++;
+		}
+	}
+
+	*out = *in;
+}
+
+static int
+ref_partial_parse(struct MsgBuf *msgbuf, char *line)
+{
+	char *ch = line;
+	const char *start = ch;
+
+	if (strlen(ch) > DATALEN) {
+		ch[DATALEN] = '\0';
+	}
+
+	if (*ch == ':') {
+		ch++;
+		msgbuf->origin = ch;
+
+		char *end = strchr(ch, ' ');
+		if (end == NULL)
+			return PARSE_UNTERMINATED_ORIGIN;
+
+		*end = '\0';
+		ch = end + 1;
+	}
+
+	if (*ch == '\0')
+		return PARSE_NO_COMMAND;
+
+	msgbuf->endp = &ch[strlen(ch)];
+	msgbuf->n_para = rb_string_to_array(ch, (char **)msgbuf->para, MAXPARA);
+	if (msgbuf->n_para == 0)
+		return PARSE_NO_PARAMS;
+
+	const char *potential_colon = msgbuf->para[msgbuf->n_para - 1] - 1;
+	if (potential_colon >= start && *potential_colon == ':')
+		msgbuf->preserve_trailing = true;
+	msgbuf->cmd = msgbuf->para[0];
+	return PARSE_SUCCESS;
+}
+
+static int
+ref_parse(struct MsgBuf *msgbuf, char *line)
+{
+	char *ch = line;
+
+	msgbuf_init(msgbuf);
+
+	if (*ch == '@') {
+		char *t = ch + 1;
+
+		ch = strchr(ch, ' ');
+		if (ch == NULL)
+			return PARSE_UNTERMINATED_TAGS;
+
+		msgbuf->tagslen = ch - line + 1;
+
+		if (ch - line + 1 > TAGSLEN) {
+			ch = &line[TAGSLEN - 1];
+		}
+
+		*ch++ = '\0';
+
+		while (1) {
+			char *next = strchr(t, ';');
+			char *eq = strchr(t, '=');
+
+			if (next != NULL) {
+				*next = '\0';
+
+				if (eq > next)
+					eq = NULL;
+			}
+
+			if (eq != NULL)
+				*eq++ = '\0';
+
+			if (*t != '\0') {
+				ref_unescape_value(eq);
+				msgbuf_append_tag(msgbuf, t, eq, 0);
+			}
+
+			if (next != NULL) {
+				t = next + 1;
+			} else {
+				break;
+			}
+		}
+	}
+
+	return ref_partial_parse(msgbuf, ch);
+}
+
+static ptrdiff_t
+offset(const char *base, const char *p)
+{
+	return p == NULL ? -1 : p - base;
+}
+
+/*
+ * parse a copy of the line with each parser and compare everything,
+ * including what was left in the buffers.
+ */
+static bool
+compare(const char *what, size_t len, bool partial)
+{
+	struct MsgBuf new, ref;
+	int res_new, res_ref;
+	bool same = true;
+
+	memcpy(buf_new, line, len + 1);
+	memcpy(buf_ref, line, len + 1);
+
+	if (partial) {
+		msgbuf_init(&new);
+		msgbuf_init(&ref);
+		res_new = msgbuf_partial_parse(&new, buf_new);
+		res_ref = ref_partial_parse(&ref, buf_ref);
+	} else {
+		res_new = msgbuf_parse(&new, buf_new);
+		res_ref = ref_parse(&ref, buf_ref);
+	}
+
+	same = same && res_new == res_ref;
+	/* unterminated tags are split before the end is found */
+	if (res_ref != PARSE_UNTERMINATED_TAGS)
+		same = same && memcmp(buf_new, buf_ref, len + 1) == 0;
+	same = same && new.n_tags == ref.n_tags && new.tagslen == ref.tagslen;
+	for (size_t i = 0; same && i < new.n_tags; i++) {
+		same = same && offset(buf_new, new.tags[i].key) == offset(buf_ref, ref.tags[i].key);
+		same = same && offset(buf_new, new.tags[i].value) == offset(buf_ref, ref.tags[i].value);
+	}
+	same = same && offset(buf_new, new.origin) == offset(buf_ref, ref.origin);
+	same = same && offset(buf_new, new.cmd) == offset(buf_ref, ref.cmd);
+	same = same && offset(buf_new, new.endp) == offset(buf_ref, ref.endp);
+	same = same && new.n_para == ref.n_para;
+	for (size_t i = 0; same && i < new.n_para; i++)
+		same = same && offset(buf_new, new.para[i]) == offset(buf_ref, ref.para[i]);
+	same = same && new.preserve_trailing == ref.preserve_trailing;
+
+	if (!same && failures++ < 10)
+		diag("%s: %s parse of \"%.200s\" (%zu bytes) differs", what,
+			partial ? "partial" : "full", line, len);
+
+	return same;
+}
+
+static bool
+compare_both(const char *what)
+{
+	size_t len = strlen(line);
+	bool full = compare(what, len, false);
+	bool partial = compare(what, len, true);
+
+	return full && partial;
+}
+
+static void
+fill(char *p, size_t n, char c)
+{
+	for (size_t i = 0; i < n; i++)
+		p[i] = c + i % 26;
+}
+
+static void
+corpus(void)
+{
+	static const char *lines[] = {
+		"@tag=value PRIVMSG #test :test",
+		"@tag0=value0;tag1=value1;tag2=value2 PRIVMSG #test :test",
+		"@tag0=val=ue0;tag1=val=ue1 PRIVMSG #test :test",
+		"@tag= PRIVMSG #test :test",
+		"@tag PRIVMSG #test :test",
+		"@=value PRIVMSG #test :test",
+		"@= PRIVMSG #test :test",
+		"@=value;tag2=value2 PRIVMSG #test :test",
+		"@=;tag2=value2 PRIVMSG #test :test",
+		"@ta g=value PRIVMSG #test :test",
+		"@tag=va lue PRIVMSG #test :test",
+		"@tag =value PRIVMSG #test :test",
+		"@tag= value PRIVMSG #test :test",
+		"@;;;a;;b=;=c PRIVMSG #test :test",
+		"@tag=\\:\\s\\\\\\r\\n PRIVMSG #test :test",
+		"@tag=a\\ PRIVMSG #test :test",
+		"@tag=a\\;b=\\x\\ PRIVMSG #test :test",
+		"@k\\ey=v\\alue PRIVMSG #test :test",
+		"@tag=\xff\\\xfe PRIVMSG #test :test",
+		"@tag=value",
+		"@tag=value ",
+		"@tag=value  ",
+		"@tag=value :origin",
+		"@tag=value :origin ",
+		"@tag=value :origin PRIVMSG",
+		":origin PRIVMSG #test :test",
+		":origin",
+		":origin ",
+		":origin   ",
+		":origin  PRIVMSG  #test  :test  ",
+		"PRIVMSG #test :test",
+		"PRIVMSG #test ::test",
+		"PRIVMSG #test :",
+		"PRIVMSG #test :a b c",
+		"PRIVMSG",
+		"  PRIVMSG  ",
+		"PRIVMSG :",
+		":",
+		":test",
+		"",
+		" ",
+		"   ",
+		"@",
+		"@ ",
+		"@  ",
+		"@;",
+		"@=",
+		"a b c d e f g h i j k l m n o p q r s t",
+		"a b c d e f g h i j k l m n :o p q r s t",
+		"a b c d e f g h i j k l m n o :p q r s t",
+		"a b c d e f g h i j k l m n   o p q r s t",
+		"a b c d e f g h i j k l m n   :o p q r s t",
+		"a b c d e f g h i j k l m n    ",
+		"a b c d e f g h i j k l m n :",
+		":o a b c d e f g h i j k l m n o p",
+		"a b c d e f g h i j k l m :",
+		"a b c d e f g h i j k l m :n",
+	};
+	unsigned int mismatches = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lines); i++) {
+		rb_strlcpy(line, lines[i], sizeof(line));
+		mismatches += !compare_both("corpus");
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
+/* lines with many tags, and tags around TAGSLEN */
+static void
+tags(void)
+{
+	unsigned int mismatches = 0;
+
+	for (int n = 0; n <= MAXTAGS + 4; n++) {
+		char *p = line;
+
+		*p++ = '@';
+		for (int i = 0; i < n; i++)
+			p += sprintf(p, "%stag%d=value%d", i ? ";" : "", i, i);
+		strcpy(p, " PRIVMSG #test :test");
+		mismatches += !compare_both("tags");
+
+		/* the same without values, which used to be scanned to the end */
+		p = line;
+		*p++ = '@';
+		for (int i = 0; i < n; i++)
+			p += sprintf(p, "%stag%d", i ? ";" : "", i);
+		strcpy(p, " PRIVMSG #test :test");
+		mismatches += !compare_both("tags");
+	}
+
+	for (size_t len = TAGSLEN - 70; len <= TAGSLEN + 70; len++) {
+		for (int variant = 0; variant < 4; variant++) {
+			line[0] = '@';
+			fill(&line[1], len - 1, 'a');
+			if (variant & 1)
+				line[len / 2] = '=';
+			if (variant & 2)
+				for (size_t i = 7; i < len - 1; i += 61)
+					line[i] = ';';
+			strcpy(&line[len], " :origin PRIVMSG #test :test");
+			mismatches += !compare_both("tagslen");
+
+			/* the truncation point and what follows it */
+			strcpy(&line[len], " PRIVMSG #test :test");
+			if (len > TAGSLEN)
+				line[TAGSLEN] = ':';
+			mismatches += !compare_both("tagslen");
+		}
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
+/* parameters at and beyond MAXPARA, and data around DATALEN */
+static void
+para(void)
+{
+	unsigned int mismatches = 0;
+
+	for (int n = 0; n <= MAXPARA + 3; n++) {
+		for (int spaces = 1; spaces <= 3; spaces++) {
+			for (int colon = 0; colon <= n; colon++) {
+				char *p = line;
+
+				for (int i = 0; i < n; i++) {
+					for (int s = 0; i && s < spaces; s++)
+						*p++ = ' ';
+					if (i == colon)
+						*p++ = ':';
+					p += sprintf(p, "p%d", i);
+				}
+				*p = '\0';
+				mismatches += !compare_both("para");
+
+				strcpy(p, "   ");
+				mismatches += !compare_both("para");
+			}
+		}
+	}
+
+	for (size_t len = DATALEN - 70; len <= DATALEN + 70; len++) {
+		for (size_t space = 1; space < len; space += 13) {
+			fill(line, len, 'A');
+			line[space] = ' ';
+			line[len] = '\0';
+			mismatches += !compare_both("datalen");
+
+			line[0] = ':';
+			mismatches += !compare_both("datalen");
+
+			memmove(&line[6], line, len + 1);
+			memcpy(line, "@a=b ", 5);
+			line[5] = ':';
+			mismatches += !compare_both("datalen");
+		}
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
+/* every line of up to six characters made of the characters that matter */
+static void
+exhaustive(void)
+{
+	static const char alphabet[] = "@: ;=\\a";
+	const size_t n = sizeof(alphabet) - 1;
+	unsigned int mismatches = 0;
+
+	for (size_t len = 0; len <= 6; len++) {
+		size_t total = 1;
+
+		for (size_t i = 0; i < len; i++)
+			total *= n;
+
+		for (size_t v = 0; v < total; v++) {
+			size_t x = v;
+
+			for (size_t i = 0; i < len; i++, x /= n)
+				line[i] = alphabet[x % n];
+			line[len] = '\0';
+
+			mismatches += !compare_both("exhaustive");
+		}
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
+/* long random lines, weighted towards delimiters so tokens cross blocks */
+static void
+random_lines(void)
+{
+	static const char alphabet[] = "@: ;=\\ab";
+	unsigned int mismatches = 0;
+
+	srandom(1);
+
+	for (int i = 0; i < 20000; i++) {
+		size_t len = random() % (i % 10 ? 600 : TAGSLEN + DATALEN + 200);
+		int sparse = random() % 64 + 1;
+
+		for (size_t j = 0; j < len; j++) {
+			if (random() % sparse == 0)
+				line[j] = alphabet[random() % (sizeof(alphabet) - 1)];
+			else
+				line[j] = 'a' + random() % 26;
+		}
+		line[len] = '\0';
+		if (len > 0 && i % 3 == 0)
+			line[0] = '@';
+
+		mismatches += !compare_both("random");
+	}
+
+	is_int(0, mismatches, MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	memset(&me, 0, sizeof(me));
+	strcpy(me.name, "me.name.");
+
+	plan_lazy();
+
+	corpus();
+	tags();
+	para();
+	exhaustive();
+	random_lines();
+
+	return 0;
+}
@@ -25,6 +25,7 @@
 #include "stdinc.h"
 #include "client.h"
 #include "privilege.h"
+#include "s_newconf.h"
 
 #define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
 
@@ -159,6 +160,52 @@ static void test_privset_diff_rehash(void)
 	cleanup();
 }
 
+static void test_privset_has_privilege(void)
+{
+	struct User user = { 0 };
+	struct Client client = { .user = &user };
+	char name[] = "late:priv";
+
+	/* a literal checked before any set names it must not stay unknown */
+	is_bool(false, HasPrivilege(&client, "late:priv"), MSG);
+	user.privset = privilegeset_set_new("test", "foo", 0);
+	is_bool(false, HasPrivilege(&client, "late:priv"), MSG);
+	is_bool(false, HasPrivilege(&client, name), MSG);
+
+	user.privset = privilegeset_set_new("test", "foo late:priv", 0);
+	is_bool(true, HasPrivilege(&client, "late:priv"), MSG);
+	is_bool(true, HasPrivilege(&client, name), MSG);
+	is_bool(true, HasPrivilege(&client, "foo"), MSG);
+	is_bool(false, HasPrivilege(&client, "bar"), MSG);
+
+	is_int(0, privilege_find("never:named"), MSG);
+	is_bool(false, HasPrivilegeId(&client, 0), MSG);
+	is_int(privilege_find("late:priv"), privilege_intern("late:priv"), MSG);
+
+	cleanup();
+}
+
+static void test_privset_many(void)
+{
+	char privs[2048] = "", buf[32];
+	struct PrivilegeSet *set;
+
+	for (int i = 0; i < 150; i += 2)
+	{
+		snprintf(buf, sizeof buf, "many:%d ", i);
+		rb_strlcat(privs, buf, sizeof privs);
+	}
+	set = privilegeset_set_new("test", privs, 0);
+
+	for (int i = 0; i < 150; i++)
+	{
+		snprintf(buf, sizeof buf, "many:%d", i);
+		is_bool(i % 2 == 0, privilegeset_in_set(set, buf), MSG);
+	}
+
+	cleanup();
+}
+
 int main(int argc, char *argv[])
 {
 	plan_lazy();
@@ -169,6 +216,8 @@ int main(int argc, char *argv[])
 	test_privset_persistence();
 	test_privset_diff();
 	test_privset_diff_rehash();
+	test_privset_has_privilege();
+	test_privset_many();
 
 	return 0;
 }
@@ -0,0 +1,146 @@
+/*
+ *  rb_accept1.c: Test the accept queue in rb_commio
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define LISTENERS 3
+
+static rb_fde_t *listeners[LISTENERS];
+static int clients[LISTENERS];
+static int accepted[LISTENERS];
+static char order[LISTENERS + 1];	/* listeners in the order they accepted */
+
+/* what the first listener's callback does to the others */
+static void (*on_accept)(void);
+
+static void
+accept_cb(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen_t len, void *data)
+{
+	int i = (rb_fde_t **)data - listeners;
+
+	accepted[i]++;
+	order[strlen(order)] = '0' + i;
+	rb_close(F);
+
+	if (i == 0 && on_accept != NULL)
+		on_accept();
+}
+
+static void
+open_listeners(void)
+{
+	struct sockaddr_in sin;
+	rb_socklen_t len;
+
+	for (int i = 0; i < LISTENERS; i++)
+	{
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		listeners[i] = rb_socket(AF_INET, SOCK_STREAM, 0, "test listener");
+		is_int(0, rb_bind(listeners[i], (struct sockaddr *)&sin), MSG);
+		is_int(0, rb_listen(listeners[i], 16, 0), MSG);
+
+		len = sizeof(sin);
+		getsockname(rb_get_fd(listeners[i]), (struct sockaddr *)&sin, &len);
+
+		/* the handshake completes before anything is accepted */
+		clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+		is_int(0, connect(clients[i], (struct sockaddr *)&sin, sizeof(sin)), MSG);
+		accepted[i] = 0;
+	}
+	memset(order, 0, sizeof(order));
+
+	/* all three are queued for the same pass, in this order */
+	for (int i = 0; i < LISTENERS; i++)
+		rb_accept_tcp(listeners[i], NULL, accept_cb, &listeners[i]);
+}
+
+static void
+close_listeners(void)
+{
+	for (int i = 0; i < LISTENERS; i++)
+	{
+		if (listeners[i] != NULL)
+			rb_close(listeners[i]);
+		close(clients[i]);
+	}
+	rb_select(0);
+}
+
+static void
+close_second(void)
+{
+	rb_close(listeners[1]);
+	listeners[1] = NULL;
+}
+
+static void
+closed1(void)
+{
+	on_accept = close_second;
+	open_listeners();
+	rb_select(0);
+
+	is_int(1, accepted[0], MSG);
+	is_int(0, accepted[1], "Closed listener not drained; " MSG);
+	is_int(1, accepted[2], "Rest of the pass still drained; " MSG);
+	is_string("02", order, MSG);
+
+	close_listeners();
+}
+
+static void
+raise_third(void)
+{
+	rb_set_accept_budget(listeners[2], 0, 10);
+}
+
+static void
+priority1(void)
+{
+	on_accept = raise_third;
+	open_listeners();
+	rb_select(0);
+
+	/* raised while waiting in this pass, so it goes next */
+	is_string("021", order, MSG);
+
+	close_listeners();
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 1024);
+
+	closed1();
+	priority1();
+
+	return 0;
+}
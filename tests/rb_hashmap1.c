@@ -0,0 +1,200 @@
+/*
+ *  rb_hashmap1.c: Test rb_hashmap
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+#include "ircd_defs.h"
+#include "client.h"
+#include "match.h"
+#include "rb_hashmap.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define MANY 20000
+
+static void basic1(void)
+{
+	rb_hashmap *map = rb_hashmap_create("basic1", NULL);
+
+	ok(rb_hashmap_add(map, "one", "data1"), MSG);
+	ok(rb_hashmap_add(map, "two", "data2"), MSG);
+	ok(!rb_hashmap_add(map, "one", "data3"), MSG);
+	is_int(2, rb_hashmap_size(map), MSG);
+
+	is_string("data1", rb_hashmap_retrieve(map, "one"), MSG);
+	is_string("data2", rb_hashmap_retrieve(map, "two"), MSG);
+	ok(rb_hashmap_retrieve(map, "ONE") == NULL, MSG);
+	ok(rb_hashmap_retrieve(map, "three") == NULL, MSG);
+	ok(rb_hashmap_retrieve(map, "") == NULL, MSG);
+
+	is_string("data1", rb_hashmap_delete(map, "one"), MSG);
+	ok(rb_hashmap_delete(map, "one") == NULL, MSG);
+	ok(rb_hashmap_retrieve(map, "one") == NULL, MSG);
+	is_string("data2", rb_hashmap_retrieve(map, "two"), MSG);
+	is_int(1, rb_hashmap_size(map), MSG);
+
+	ok(rb_hashmap_add(map, "one", "data4"), MSG);
+	is_string("data4", rb_hashmap_retrieve(map, "one"), MSG);
+
+	rb_hashmap_destroy(map, NULL, NULL);
+}
+
+static void fold1(void)
+{
+	rb_hashmap *map = rb_hashmap_create("fold1", irctoupper_tab);
+
+	ok(rb_hashmap_add(map, "Nick[away]", "data1"), MSG);
+	is_string("data1", rb_hashmap_retrieve(map, "nick{AWAY}"), MSG);
+	is_string("data1", rb_hashmap_retrieve(map, "NICK[away]"), MSG);
+	ok(rb_hashmap_retrieve(map, "Nick[away") == NULL, MSG);
+	ok(!rb_hashmap_add(map, "NICK{AWAY}", "data2"), MSG);
+
+	is_int(rb_hashmap_hash(map, "a|b^c"), rb_hashmap_hash(map, "A\\B~C"), MSG);
+	is_string("data1", rb_hashmap_retrieve_hashed(map, "nick[away]", rb_hashmap_hash(map, "NICK{AWAY}")), MSG);
+
+	is_string("data1", rb_hashmap_delete(map, "nick{away}"), MSG);
+	is_int(0, rb_hashmap_size(map), MSG);
+
+	rb_hashmap_destroy(map, NULL, NULL);
+}
+
+static int destroyed;
+
+static void
+count_cb(const char *key, void *data, void *privdata)
+{
+	destroyed++;
+}
+
+static void many1(void)
+{
+	rb_hashmap *map = rb_hashmap_create("many1", NULL);
+	static long keys[MANY];
+	char key[16];
+	int bad;
+
+	/* every other key is deleted while the table keeps growing, so
+	 * deletes and lookups land on both tables of a resize */
+	bad = 0;
+	for (int i = 0; i < MANY; i++)
+	{
+		snprintf(key, sizeof key, "key%d", i);
+		keys[i] = i;
+		if (!rb_hashmap_add(map, key, &keys[i]))
+			bad++;
+
+		if (i % 2 == 1)
+		{
+			snprintf(key, sizeof key, "key%d", i - 1);
+			if (rb_hashmap_delete(map, key) != &keys[i - 1])
+				bad++;
+			if (rb_hashmap_retrieve(map, key) != NULL)
+				bad++;
+		}
+	}
+	is_int(0, bad, MSG);
+	is_int(MANY / 2, rb_hashmap_size(map), MSG);
+
+	bad = 0;
+	for (int i = 0; i < MANY; i++)
+	{
+		void *data;
+
+		snprintf(key, sizeof key, "key%d", i);
+		data = rb_hashmap_retrieve(map, key);
+		if (data != (i % 2 == 1 ? &keys[i] : NULL))
+			bad++;
+	}
+	is_int(0, bad, MSG);
+
+	/* refill the deleted half, reusing tombstones */
+	bad = 0;
+	for (int i = 0; i < MANY; i += 2)
+	{
+		snprintf(key, sizeof key, "key%d", i);
+		if (!rb_hashmap_add(map, key, &keys[i]))
+			bad++;
+	}
+	for (int i = 0; i < MANY; i++)
+	{
+		snprintf(key, sizeof key, "key%d", i);
+		if (rb_hashmap_retrieve(map, key) != &keys[i])
+			bad++;
+	}
+	is_int(0, bad, MSG);
+	is_int(MANY, rb_hashmap_size(map), MSG);
+
+	destroyed = 0;
+	rb_hashmap_destroy(map, count_cb, NULL);
+	is_int(MANY, destroyed, MSG);
+}
+
+static void churn1(void)
+{
+	rb_hashmap *map = rb_hashmap_create("churn1", NULL);
+	char key[16];
+	int bad = 0;
+
+	/* constant turnover fills the table with tombstones, which resizes
+	 * at the same size must clear out */
+	for (int i = 0; i < MANY * 10; i++)
+	{
+		snprintf(key, sizeof key, "k%d", i);
+		if (!rb_hashmap_add(map, key, map))
+			bad++;
+
+		if (i >= 100)
+		{
+			snprintf(key, sizeof key, "k%d", i - 100);
+			if (rb_hashmap_delete(map, key) != map)
+				bad++;
+		}
+	}
+	is_int(0, bad, MSG);
+	is_int(100, rb_hashmap_size(map), MSG);
+
+	for (int i = MANY * 10 - 100; i < MANY * 10; i++)
+	{
+		snprintf(key, sizeof key, "k%d", i);
+		if (rb_hashmap_retrieve(map, key) != map)
+			bad++;
+	}
+	is_int(0, bad, MSG);
+
+	rb_hashmap_destroy(map, NULL, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, DNODE_HEAP_SIZE, FD_HEAP_SIZE);
+	rb_linebuf_init(LINEBUF_HEAP_SIZE);
+
+	plan_lazy();
+
+	basic1();
+	fold1();
+	many1();
+	churn1();
+
+	return 0;
+}
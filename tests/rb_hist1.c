@@ -0,0 +1,98 @@
+/*
+ *  rb_hist1.c: Test rb_hist
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+static int
+bucket_of(uint64_t v)
+{
+	struct rb_hist h = { 0 };
+
+	rb_hist_add(&h, v);
+	for (int i = 0; i < RB_HIST_BUCKETS; i++)
+		if (h.bucket[i])
+			return i;
+	return -1;
+}
+
+static void buckets1(void)
+{
+	is_int(0, bucket_of(0), MSG);
+	is_int(0, bucket_of(1), MSG);
+	is_int(1, bucket_of(2), MSG);
+	is_int(1, bucket_of(4), MSG);
+	is_int(2, bucket_of(5), MSG);
+	is_int(2, bucket_of(16), MSG);
+	is_int(3, bucket_of(17), MSG);
+	is_int(5, bucket_of(1000), MSG);
+	is_int(5, bucket_of(1024), MSG);
+	is_int(6, bucket_of(1025), MSG);
+	is_int(RB_HIST_BUCKETS - 2, bucket_of(rb_hist_bound(RB_HIST_BUCKETS - 2)), MSG);
+	is_int(RB_HIST_BUCKETS - 1, bucket_of(rb_hist_bound(RB_HIST_BUCKETS - 2) + 1), MSG);
+	is_int(RB_HIST_BUCKETS - 1, bucket_of(UINT64_MAX), MSG);
+
+	/* every value is within its bucket's bounds */
+	int bad = 0;
+	for (uint64_t v = 2; v < 100000; v++)
+	{
+		int i = bucket_of(v);
+		if (v > rb_hist_bound(i) || v <= rb_hist_bound(i - 1))
+			bad++;
+	}
+	is_int(0, bad, MSG);
+}
+
+static void quantile1(void)
+{
+	struct rb_hist h = { 0 };
+
+	is_int(0, rb_hist_quantile(&h, 0.5), MSG);
+
+	for (int i = 0; i < 90; i++)
+		rb_hist_add(&h, 10);
+	for (int i = 0; i < 10; i++)
+		rb_hist_add(&h, 3000);
+
+	is_int(100, h.count, MSG);
+	is_int(90 * 10 + 10 * 3000, h.sum, MSG);
+	is_int(3000, h.max, MSG);
+
+	is_int(16, rb_hist_quantile(&h, 0.5), MSG);
+	is_int(16, rb_hist_quantile(&h, 0.89), MSG);
+	/* the bound of the last bucket used is above max, so max it is */
+	is_int(3000, rb_hist_quantile(&h, 0.99), MSG);
+	is_int(3000, rb_hist_quantile(&h, 1.0), MSG);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	buckets1();
+	quantile1();
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ *  rb_linebuf1.c: Test sendq accounting and shedding in rb_linebuf
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "stdinc.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+/* "0123456789\r\n" */
+#define LINE_LEN 12
+
+static void
+put_line(buf_head_t *bufhead)
+{
+	rb_strf_t strings = { .format = "0123456789", .format_args = NULL, .next = NULL };
+
+	rb_linebuf_put(bufhead, &strings);
+}
+
+static void account1(void)
+{
+	buf_account_t total = { 0 };
+	buf_account_t class = { .parent = &total };
+	buf_head_t a, b, shared;
+
+	rb_linebuf_newbuf(&a);
+	rb_linebuf_newbuf(&b);
+	rb_linebuf_newbuf(&shared);
+
+	/* what was queued before moves with the buffer */
+	put_line(&a);
+	rb_linebuf_set_account(&a, &class);
+	is_int(LINE_LEN, class.len, MSG);
+	is_int(LINE_LEN, total.len, MSG);
+
+	rb_linebuf_set_account(&b, &total);
+	put_line(&shared);
+	rb_linebuf_attach(&a, &shared);
+	rb_linebuf_attach(&b, &shared);
+	is_int(2 * LINE_LEN, class.len, MSG);
+	is_int(3 * LINE_LEN, total.len, MSG);
+
+	rb_linebuf_set_account(&a, &total);
+	is_int(0, class.len, MSG);
+	is_int(3 * LINE_LEN, total.len, MSG);
+
+	rb_linebuf_donebuf(&a);
+	rb_linebuf_donebuf(&b);
+	rb_linebuf_donebuf(&shared);
+	is_int(0, total.len, MSG);
+}
+
+static void pinned1(void)
+{
+	buf_account_t total = { 0 };
+	buf_account_t class = { .parent = &total };
+	buf_head_t link, client;
+
+	rb_linebuf_newbuf(&link);
+	rb_linebuf_newbuf(&client);
+	rb_linebuf_set_account(&link, &class);
+	rb_linebuf_set_account(&client, &total);
+
+	/* what was queued before is pinned along with what comes later */
+	put_line(&link);
+	rb_linebuf_set_pinned(&link, 1);
+	put_line(&link);
+	put_line(&client);
+	is_int(2 * LINE_LEN, class.pinned, MSG);
+	is_int(2 * LINE_LEN, total.pinned, MSG);
+	is_int(3 * LINE_LEN, total.len, MSG);
+
+	/* moving it moves the pinned part with it */
+	rb_linebuf_set_account(&link, &total);
+	is_int(0, class.pinned, MSG);
+	is_int(2 * LINE_LEN, total.pinned, MSG);
+
+	rb_linebuf_set_pinned(&link, 0);
+	is_int(0, total.pinned, MSG);
+	is_int(3 * LINE_LEN, total.len, MSG);
+
+	rb_linebuf_set_pinned(&link, 1);
+	rb_linebuf_donebuf(&link);
+	rb_linebuf_donebuf(&client);
+	is_int(0, total.pinned, MSG);
+	is_int(0, total.len, MSG);
+}
+
+static void shed1(void)
+{
+	buf_account_t total = { 0 };
+	buf_head_t q, lossy;
+	int owner, other;
+
+	rb_linebuf_newbuf(&q);
+	rb_linebuf_newbuf(&lossy);
+	rb_linebuf_set_account(&q, &total);
+
+	put_line(&lossy);
+	rb_linebuf_set_lossy(&lossy, &other);
+
+	put_line(&q);
+	rb_linebuf_attach(&q, &lossy);
+	put_line(&q);
+	rb_linebuf_attach(&q, &lossy);
+	is_int(4, rb_linebuf_numlines(&q), MSG);
+
+	/* the owner keeps its own lossy lines */
+	is_int(0, rb_linebuf_shed(&q, &other, 1000), MSG);
+	is_int(4, rb_linebuf_numlines(&q), MSG);
+
+	/* the oldest goes first, and no more than asked for */
+	is_int(LINE_LEN, rb_linebuf_shed(&q, &owner, 1), MSG);
+	is_int(3, rb_linebuf_numlines(&q), MSG);
+	is_int(3 * LINE_LEN, total.len, MSG);
+
+	is_int(LINE_LEN, rb_linebuf_shed(&q, &owner, 1000), MSG);
+	is_int(2, rb_linebuf_numlines(&q), MSG);
+	is_int(0, rb_linebuf_shed(&q, &owner, 1000), MSG);
+	is_int(2 * LINE_LEN, rb_linebuf_len(&q), MSG);
+	is_int(2 * LINE_LEN, total.len, MSG);
+
+	/* a partly written line is never shed */
+	rb_linebuf_donebuf(&q);
+	rb_linebuf_attach(&q, &lossy);
+	q.writeofs = 1;
+	is_int(0, rb_linebuf_shed(&q, &owner, 1000), MSG);
+	q.writeofs = 0;
+	is_int(LINE_LEN, rb_linebuf_shed(&q, &owner, 1000), MSG);
+	is_int(0, total.len, MSG);
+
+	rb_linebuf_donebuf(&lossy);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	rb_lib_init(NULL, NULL, NULL, 0, 1024, 1024, 1024);
+	rb_linebuf_init(64);
+
+	account1();
+	pinned1();
+	shed1();
+
+	return 0;
+}
@@ -1026,6 +1026,37 @@ static void sendto_channel_flags__remote__chanop(void)
 	standard_free();
 }
 
+static void sendto_channel_flags__remote__changes(void)
+{
+	standard_init();
+	standard_server_caps(CAP_CHW, 0);
+
+	// Only the deaf member behind the link is left with +o
+	find_channel_membership(channel, remote_chan_o)->flags &= ~CHFL_CHANOP;
+	update_member_table(find_channel_membership(channel, remote_chan_o));
+	find_channel_membership(channel, remote_chan_ov)->flags &= ~CHFL_CHANOP;
+	update_member_table(find_channel_membership(channel, remote_chan_ov));
+
+	sendto_channel_flags(server3, CHFL_CHANOP, remote3, channel, "TEST #placeholder :Hello %s!", "World");
+	is_client_sendq_empty(server, "No +o users to receive message; " MSG);
+	is_client_sendq_empty(server2, "No +o users to receive message; " MSG);
+
+	// It stops being deaf
+	remote_chan_d->umodes &= ~UMODE_DEAF;
+	update_member_tables_user(remote_chan_d);
+
+	sendto_channel_flags(server3, CHFL_CHANOP, remote3, channel, "TEST #placeholder :Hello %s!", "World");
+	is_client_sendq(":" TEST_REMOTE3_NICK " TEST #placeholder :Hello World!" CRLF, server, "Has +o; " MSG);
+	is_client_sendq_empty(server2, "No +o users to receive message; " MSG);
+
+	// The only member behind the link who hears it is the one excluded
+	sendto_channel_flags(remote2_chan_p, ALL_MEMBERS, remote3, channel, "TEST #placeholder :Hello %s!", "World");
+	is_client_sendq(":" TEST_REMOTE3_NICK " TEST #placeholder :Hello World!" CRLF, server, "On channel; " MSG);
+	is_client_sendq_empty(server2, "Only the excluded user to receive message; " MSG);
+
+	standard_free();
+}
+
 static void sendto_channel_flags__local__chanop_voice(void)
 {
 	standard_init();
@@ -3366,10 +3397,8 @@ static void sendto_monitor1(void)
 	standard_init();
 
 	monptr = find_monitor(TEST_NICK, 1);
-	rb_dlinkAddAlloc(local_chan_o, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_o->localClient->monitor_list);
-	rb_dlinkAddAlloc(local_chan_v, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_v->localClient->monitor_list);
+	add_monitor_watcher(local_chan_o, monptr);
+	add_monitor_watcher(local_chan_v, monptr);
 
 	sendto_monitor(user, monptr, "Hello %s!", "World");
 	is_client_sendq_empty(user, "Not monitoring; " MSG);
@@ -3397,10 +3426,8 @@ static void sendto_monitor1__tags(void)
 	SetClientCap(local_chan_v, CAP_ACCOUNT_TAG);
 
 	monptr = find_monitor(TEST_NICK, 1);
-	rb_dlinkAddAlloc(local_chan_o, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_o->localClient->monitor_list);
-	rb_dlinkAddAlloc(local_chan_v, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_v->localClient->monitor_list);
+	add_monitor_watcher(local_chan_o, monptr);
+	add_monitor_watcher(local_chan_v, monptr);
 
 	sendto_monitor(user, monptr, "Hello %s!", "World");
 	is_client_sendq_empty(user, "Not monitoring; " MSG);
@@ -3412,8 +3439,7 @@ static void sendto_monitor1__tags(void)
 	is_client_sendq_empty(server, MSG);
 	is_client_sendq_empty(server2, MSG);
 
-	rb_dlinkAddAlloc(local_chan_ov, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_ov->localClient->monitor_list);
+	add_monitor_watcher(local_chan_ov, monptr);
 	clear_monitor(local_chan_o);
 	clear_monitor(local_chan_v);
 
@@ -3439,10 +3465,8 @@ static void sendto_monitor_with_capability1(void)
 	SetClientCap(local_chan_o, CAP_MULTI_PREFIX);
 
 	monptr = find_monitor(TEST_NICK, 1);
-	rb_dlinkAddAlloc(local_chan_o, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_o->localClient->monitor_list);
-	rb_dlinkAddAlloc(local_chan_v, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_v->localClient->monitor_list);
+	add_monitor_watcher(local_chan_o, monptr);
+	add_monitor_watcher(local_chan_v, monptr);
 
 	sendto_monitor_with_capability(user, monptr, CAP_MULTI_PREFIX, NOCAPS, "Hello %s!", "World");
 	is_client_sendq_empty(user, "Not monitoring; " MSG);
@@ -3488,10 +3512,8 @@ static void sendto_monitor_with_capability1__tags(void)
 	SetClientCap(local_chan_v, CAP_ACCOUNT_TAG);
 
 	monptr = find_monitor(TEST_NICK, 1);
-	rb_dlinkAddAlloc(local_chan_o, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_o->localClient->monitor_list);
-	rb_dlinkAddAlloc(local_chan_v, &monptr->users);
-	rb_dlinkAddAlloc(monptr, &local_chan_v->localClient->monitor_list);
+	add_monitor_watcher(local_chan_o, monptr);
+	add_monitor_watcher(local_chan_v, monptr);
 
 	sendto_monitor_with_capability(user, monptr, CAP_MULTI_PREFIX, NOCAPS, "Hello %s!", "World");
 	is_client_sendq_empty(user, "Not monitoring; " MSG);
@@ -4359,6 +4381,10 @@ static void sendto_realops_snomask1(void)
 	oper2->snomask = SNO_GENERAL | SNO_REJ;
 	oper3->snomask = SNO_BOTS | SNO_SKILL;
 	oper4->snomask = SNO_GENERAL | SNO_REJ;
+	snomask_update_subscriptions(oper1);
+	snomask_update_subscriptions(oper2);
+	snomask_update_subscriptions(oper3);
+	snomask_update_subscriptions(oper4);
 
 	oper3->user->privset = privilegeset_get("admin");
 	oper4->user->privset = privilegeset_get("admin");
@@ -4454,6 +4480,10 @@ static void sendto_realops_snomask1__tags(void)
 	oper2->snomask = SNO_GENERAL | SNO_REJ;
 	oper3->snomask = SNO_BOTS | SNO_SKILL;
 	oper4->snomask = SNO_GENERAL | SNO_REJ;
+	snomask_update_subscriptions(oper1);
+	snomask_update_subscriptions(oper2);
+	snomask_update_subscriptions(oper3);
+	snomask_update_subscriptions(oper4);
 
 	oper3->user->privset = privilegeset_get("admin");
 	oper4->user->privset = privilegeset_get("admin");
@@ -4521,6 +4551,46 @@ static void sendto_realops_snomask1__tags(void)
 	standard_free();
 }
 
+static void sendto_realops_snomask_unwanted1(void)
+{
+	struct Client *oper1 = make_local_person_nick("oper1");
+	struct Client *user1 = make_local_person_nick("user1");
+	unsigned long long sent, skipped;
+
+	make_local_person_oper(oper1);
+	oper1->snomask = SNO_BOTS;
+	user1->snomask = SNO_SPY;
+	snomask_update_subscriptions(oper1);
+	snomask_update_subscriptions(user1);
+
+	remote_rehash_oper_p = NULL;
+
+	is_bool(true, SnomaskSubscribed(SNO_BOTS), MSG);
+	is_bool(false, SnomaskSubscribed(SNO_SPY), "Not an oper; " MSG);
+
+	skipped = snomask_bits[ffs(SNO_SPY) - 1].skipped;
+	sendto_realops_snomask(SNO_SPY, L_ALL, "Hello %s!", "World");
+	is_client_sendq_empty(oper1, "Doesn't match mask; " MSG);
+	is_client_sendq_empty(user1, "Not an oper; " MSG);
+	is_int(skipped + 1, snomask_bits[ffs(SNO_SPY) - 1].skipped, MSG);
+
+	sent = snomask_bits[ffs(SNO_BOTS) - 1].sent;
+	sendto_realops_snomask(SNO_BOTS | SNO_SPY, L_ALL, "Hello %s!", "World");
+	is_client_sendq(":" TEST_ME_NAME " NOTICE * :*** Notice -- Hello World!" CRLF, oper1, "Matches mask; " MSG);
+	is_int(sent + 1, snomask_bits[ffs(SNO_BOTS) - 1].sent, MSG);
+
+	oper1->snomask = 0;
+	snomask_update_subscriptions(oper1);
+	is_bool(false, SnomaskSubscribed(SNO_BOTS), MSG);
+
+	oper1->snomask = SNO_BOTS;
+	snomask_update_subscriptions(oper1);
+	remove_local_person(oper1);
+	is_bool(false, SnomaskSubscribed(SNO_BOTS), "Exited; " MSG);
+
+	remove_local_person(user1);
+}
+
 static void sendto_realops_snomask_from1(void)
 {
 	struct Client *oper1 = make_local_person_nick("oper1");
@@ -4537,6 +4607,10 @@ static void sendto_realops_snomask_from1(void)
 	oper2->snomask = SNO_GENERAL | SNO_REJ;
 	oper3->snomask = SNO_BOTS | SNO_SKILL;
 	oper4->snomask = SNO_GENERAL | SNO_REJ;
+	snomask_update_subscriptions(oper1);
+	snomask_update_subscriptions(oper2);
+	snomask_update_subscriptions(oper3);
+	snomask_update_subscriptions(oper4);
 
 	oper3->user->privset = privilegeset_get("admin");
 	oper4->user->privset = privilegeset_get("admin");
@@ -4657,6 +4731,10 @@ static void sendto_realops_snomask_from1__tags(void)
 	oper2->snomask = SNO_GENERAL | SNO_REJ;
 	oper3->snomask = SNO_BOTS | SNO_SKILL;
 	oper4->snomask = SNO_GENERAL | SNO_REJ;
+	snomask_update_subscriptions(oper1);
+	snomask_update_subscriptions(oper2);
+	snomask_update_subscriptions(oper3);
+	snomask_update_subscriptions(oper4);
 
 	oper3->user->privset = privilegeset_get("admin");
 	oper4->user->privset = privilegeset_get("admin");
@@ -5133,6 +5211,7 @@ int main(int argc, char *argv[])
 	sendto_channel_flags__remote__voice();
 	sendto_channel_flags__local__chanop();
 	sendto_channel_flags__remote__chanop();
+	sendto_channel_flags__remote__changes();
 	sendto_channel_flags__local__chanop_voice();
 	sendto_channel_flags__remote__chanop_voice();
 
@@ -5180,6 +5259,7 @@ int main(int argc, char *argv[])
 
 	sendto_realops_snomask1();
 	sendto_realops_snomask1__tags();
+	sendto_realops_snomask_unwanted1();
 	sendto_realops_snomask_from1();
 	sendto_realops_snomask_from1__tags();
 	sendto_wallops_flags1();
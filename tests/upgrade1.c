@@ -0,0 +1,180 @@
+/*
+ *  upgrade1.c: Test reading the upgrade state file
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "tap/basic.h"
+
+#include "ircd_util.h"
+#include "client_util.h"
+
+#include "channel.h"
+#include "hash.h"
+#include "upgrade.h"
+
+#define MSG "%s:%d (%s)", __FILE__, __LINE__, __FUNCTION__
+
+#define STATE_FILE "upgrade1.state"
+
+/* write a state file and point the next upgrade_init() at it */
+static void
+write_state(const char *state)
+{
+	FILE *f = fopen(STATE_FILE, "w");
+
+	fputs(state, f);
+	fclose(f);
+	setenv(UPGRADE_ENV, STATE_FILE, 1);
+}
+
+static bool
+fd_open(int fd)
+{
+	return fcntl(fd, F_GETFD) != -1;
+}
+
+static void
+write_client(char *buf, size_t size, const char *id, const char *nick, int fd)
+{
+	snprintf(buf, size, "CLIENT %s %s user 127.0.0.1 127.0.0.1 127.0.0.1 127.0.0.1 %ld %d 0 i 0 0 %ld :Real name\n",
+		id, nick, (long) rb_current_time(), fd, (long) rb_current_time());
+}
+
+static void
+rejected1(void)
+{
+	char state[BUFSIZE], client[BUFSIZE];
+	int sv[2], pipefds[2];
+
+	is_int(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv), MSG);
+	is_int(0, pipe(pipefds), MSG);
+
+	/* a state file from another version is not read, but the
+	 * descriptors it names must still be closed */
+	write_client(client, sizeof(client), TEST_ME_ID "AAAAAA", "upgraded", sv[0]);
+	snprintf(state, sizeof(state), "FEFUPGRADE 0\nME 0AA 0AAAAAAAB 1 1 0\nSSLD 1 %d %d 0 :ssld\n%sEND\n",
+		pipefds[0], pipefds[1], client);
+	write_state(state);
+
+	upgrade_init();
+	ok(!upgrade_resuming(), MSG);
+	ok(access(STATE_FILE, F_OK) != 0, "State file removed; " MSG);
+	ok(!fd_open(sv[0]), "Client socket closed; " MSG);
+	ok(!fd_open(pipefds[0]), "ssld control closed; " MSG);
+	ok(!fd_open(pipefds[1]), "ssld pipe closed; " MSG);
+	ok(fd_open(sv[1]), MSG);
+
+	/* so is an empty one */
+	write_state("");
+	upgrade_init();
+	ok(!upgrade_resuming(), MSG);
+	upgrade_restore();
+	ok(find_named_client("upgraded") == NULL, MSG);
+
+	close(sv[1]);
+}
+
+static void
+rejected2(void)
+{
+	char state[BUFSIZE], client[BUFSIZE];
+	int sv[2];
+
+	is_int(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv), MSG);
+
+	/* saved by a server with another ID */
+	write_client(client, sizeof(client), "9ZZAAAAAA", "upgraded", sv[0]);
+	snprintf(state, sizeof(state), "FEFUPGRADE 1\nME 9ZZ 9ZZAAAAAB 1 1 0\n%sEND\n", client);
+	write_state(state);
+
+	upgrade_init();
+	is_int(FD_CLOEXEC, fcntl(sv[0], F_GETFD) & FD_CLOEXEC, "Client socket closed on exec; " MSG);
+
+	upgrade_restore();
+	ok(!fd_open(sv[0]), "Client socket closed; " MSG);
+	ok(find_named_client("upgraded") == NULL, MSG);
+
+	close(sv[1]);
+}
+
+static void
+restored1(void)
+{
+	char state[BUFSIZE], client[BUFSIZE];
+	struct Client *client_p;
+	struct Channel *chptr;
+	int sv[2];
+
+	is_int(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv), MSG);
+
+	/* a line, the rest of an overlong one, and a partial one */
+	write_client(client, sizeof(client), TEST_ME_ID "AAAAAA", "upgraded", sv[0]);
+	snprintf(state, sizeof(state),
+		"FEFUPGRADE 1\n"
+		"ME 0AA 0AAAAAAAB 1 1 0\n"
+		"%s"
+		"RECVQ 50494e47203a610d0a\n"
+		"OVERLONG\n"
+		"RECVQ 78780a50524956\n"
+		"CHANNEL #upgrade 1000 nt 0 0 0 * :\n"
+		"MEMBER " TEST_ME_ID "AAAAAA 2\n"
+		"MEMBER " TEST_ME_ID "AAAAAB 2\n"
+		"END\n", client);
+	write_state(state);
+
+	upgrade_init();
+	upgrade_restore();
+
+	client_p = find_named_client("upgraded");
+	if (ok(client_p != NULL, MSG)) {
+		ok(MyClient(client_p), MSG);
+		is_string(TEST_ME_ID "AAAAAA", client_p->id, MSG);
+		ok(IsInvisible(client_p), MSG);
+		is_int(1, client_p->localClient->recvq.lines, "Overlong tail dropped; " MSG);
+		is_int(4, client_p->localClient->recvq.partial, MSG);
+		ok(!client_p->localClient->recvq.overlong, MSG);
+
+		chptr = find_channel("#upgrade");
+		if (ok(chptr != NULL, MSG)) {
+			ok(is_chanop(find_channel_membership(chptr, client_p)), MSG);
+			is_int(1, rb_dlink_list_length(&chptr->members), "Unknown member ignored; " MSG);
+		}
+
+		remove_local_person(client_p);
+	}
+
+	close(sv[1]);
+}
+
+int main(int argc, char *argv[])
+{
+	plan_lazy();
+
+	ircd_util_init(__FILE__);
+	client_util_init();
+
+	rejected1();
+	rejected2();
+	restored1();
+
+	client_util_free();
+	ircd_util_free();
+	return 0;
+}
@@ -0,0 +1,1121 @@
+/*
+ *  ircbench.c: Drive many clients and a fake server against a local ircd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * ircbench connects -c clients at -C per second, joins each to -J of -j
+ * channels and then, for -t seconds, has them chatter at -r messages per
+ * client per second.  A share of those messages are NICK changes (-n),
+ * WHO (-w) or LIST (-l) instead.  Every PRIVMSG carries the time it was
+ * sent, so each copy that arrives gives one delivery latency.
+ *
+ * -R count:seconds drops that many clients at once every so often and
+ * reconnects them straight away.  -L name:sid:password links a fake TS6
+ * server that bursts -u users into the same channels, chatters with them
+ * like the clients do, and splits and relinks every -S seconds.
+ *
+ * With -P the ircd's resident size and CPU use are read from /proc.  The
+ * generator's own CPU use is shown too: near 100% means the numbers are
+ * limited by ircbench rather than the server.
+ *
+ * The server under test wants an auth block for the clients with
+ * exceed_limit and a class with room for them, general::throttle_count
+ * raised (or an exempt block for the source address), and for -L a
+ * connect block for the fake server with matching passwords.  With
+ * more than a few messages per channel per second, raise
+ * general::default_floodcount too, or the server drops them as floods;
+ * ircbench counts the notices it gets when that happens.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/resource.h>
+#include <netinet/tcp.h>
+#include "rb_lib.h"
+
+#define CONNECT_TIMEOUT	30
+#define READBUF_SIZE	16384
+#define MAXPARA		16
+#define LINE_SIZE	512
+
+/* how long to wait for stragglers to register before chatter starts */
+#define RAMP_GRACE	10
+
+/*
+ * Latencies are kept in a log-linear histogram: 16 buckets per power of
+ * two, so a quantile is within about 6% of the real value.  rb_hist is
+ * too coarse for comparing runs.
+ */
+#define LAT_SUB		16
+#define LAT_BUCKETS	(61 * LAT_SUB)
+
+struct lat_hist
+{
+	uint64_t count;
+	uint64_t bucket[LAT_BUCKETS];
+};
+
+struct stats
+{
+	uint64_t sent;		/* PRIVMSGs sent, by clients or the fake server */
+	uint64_t delivered;	/* PRIVMSG copies received by clients */
+	uint64_t link_delivered;	/* PRIVMSG copies received by the fake server */
+	uint64_t nicks, whos, lists;
+	uint64_t registered, lost;
+	uint64_t throttled;	/* PRIVMSGs the server dropped for channel flooding */
+	struct lat_hist latency;
+	struct lat_hist reply;	/* WHO and LIST, until the end numeric */
+	struct lat_hist connect;	/* connect() to 001 */
+};
+
+struct conn;
+typedef void conn_handler(struct conn *, const char *prefix, int parc, char **parv);
+
+struct conn
+{
+	rb_fde_t *F;
+	buf_head_t recvq;
+	buf_head_t sendq;
+	conn_handler *handle;
+	void (*lost)(struct conn *);
+};
+
+enum client_state
+{
+	CLIENT_DOWN,
+	CLIENT_CONNECTING,
+	CLIENT_REGISTERING,
+	CLIENT_UP,
+};
+
+struct client
+{
+	struct conn conn;	/* first, so a struct conn * is a struct client * */
+	int idx;
+	enum client_state state;
+	bool storm;		/* part of the reconnect storm in progress */
+	bool alt_nick;
+	int retries;
+	uint64_t connect_start;
+	uint64_t reply_start;	/* outstanding WHO or LIST */
+	int *chans;
+};
+
+struct fake_server
+{
+	struct conn conn;
+	char *name, *sid, *password;
+	bool up;
+	bool bursting;
+	uint64_t burst_start;
+	time_t relink_at;
+	time_t split_at;
+};
+
+static struct
+{
+	const char *host;
+	int port;
+	int clients;
+	int channels;
+	int joins;
+	double rate;
+	double nick_pct, who_pct, list_pct;
+	int storm_count, storm_every;
+	int duration;
+	double connect_rate;
+	const char *tls_cert;
+	const char *link;
+	int link_users;
+	int split_every;
+	pid_t pid;
+	int interval;
+	int msglen;
+} opt = {
+	.host = "127.0.0.1",
+	.port = 6667,
+	.clients = 1000,
+	.channels = 100,
+	.joins = 3,
+	.rate = 0.2,
+	.nick_pct = 1,
+	.who_pct = 0.5,
+	.list_pct = 0,
+	.duration = 30,
+	.connect_rate = 500,
+	.link_users = 1000,
+	.split_every = 0,
+	.interval = 1,
+	.msglen = 80,
+};
+
+static struct rb_sockaddr_storage server_addr;
+static struct client *clients;
+static struct fake_server fake;
+static struct stats total, interval;
+static uint64_t start_ns;
+static volatile sig_atomic_t interrupted;
+
+static int storm_pending;
+static uint64_t storm_start;
+
+static void conn_read(rb_fde_t *F, void *data);
+static void client_connect(struct client *c);
+
+/* --- latency histograms ------------------------------------------------ */
+
+static int
+lat_index(uint64_t v)
+{
+	int shift;
+
+	if(v < LAT_SUB)
+		return v;
+
+	shift = 63 - __builtin_clzll(v) - 4;
+	return (shift + 1) * LAT_SUB + (int)((v >> shift) - LAT_SUB);
+}
+
+/* largest value that falls into bucket i */
+static uint64_t
+lat_bound(int i)
+{
+	int shift;
+
+	if(i < LAT_SUB)
+		return i;
+
+	shift = i / LAT_SUB - 1;
+	return (((uint64_t)(i % LAT_SUB + LAT_SUB + 1)) << shift) - 1;
+}
+
+static void
+lat_add(struct lat_hist *h, uint64_t v)
+{
+	h->count++;
+	h->bucket[lat_index(v)]++;
+}
+
+static double
+lat_quantile_ms(const struct lat_hist *h, double q)
+{
+	uint64_t want = (uint64_t)(q * h->count), seen = 0;
+
+	if(h->count == 0)
+		return 0;
+
+	for(int i = 0; i < LAT_BUCKETS; i++)
+	{
+		seen += h->bucket[i];
+		if(seen > want)
+			return lat_bound(i) / 1e6;
+	}
+	return 0;
+}
+
+/* count in both the running total and the current report interval */
+#define STAT_ADD(field)		do { total.field++; interval.field++; } while(0)
+#define STAT_LATENCY(field, v)	do { uint64_t _v = (v); lat_add(&total.field, _v); lat_add(&interval.field, _v); } while(0)
+
+/* --- connections ------------------------------------------------------- */
+
+static void
+conn_init(struct conn *conn, rb_fde_t *F)
+{
+	int on = 1;
+
+	/* Nagle would hold back a command sent while the last is unacked,
+	 * which shows up as 40ms of latency that is not the server's */
+	setsockopt(rb_get_fd(F), IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+	conn->F = F;
+	rb_linebuf_newbuf(&conn->recvq);
+	rb_linebuf_newbuf(&conn->sendq);
+}
+
+static void
+conn_close(struct conn *conn)
+{
+	if(conn->F == NULL)
+		return;
+
+	rb_close(conn->F);
+	conn->F = NULL;
+	rb_linebuf_donebuf(&conn->recvq);
+	rb_linebuf_donebuf(&conn->sendq);
+}
+
+static void
+conn_flush(rb_fde_t *F, void *data)
+{
+	struct conn *conn = data;
+	int n;
+
+	while(rb_linebuf_len(&conn->sendq) > 0)
+	{
+		n = rb_linebuf_flush(F, &conn->sendq);
+		if(n < 0 && rb_ignore_errno(errno))
+		{
+			rb_setselect(F, RB_SELECT_WRITE, conn_flush, conn);
+			return;
+		}
+		if(n <= 0)
+		{
+			conn->lost(conn);
+			return;
+		}
+	}
+}
+
+static void __attribute__((format(printf, 2, 3)))
+conn_send(struct conn *conn, const char *fmt, ...)
+{
+	va_list args;
+	rb_strf_t strings = { .format = fmt, .format_args = &args, .next = NULL };
+
+	if(conn->F == NULL)
+		return;
+
+	va_start(args, fmt);
+	rb_linebuf_put(&conn->sendq, &strings);
+	va_end(args);
+
+	conn_flush(conn->F, conn);
+}
+
+/* split a line into prefix, command and parameters, in place */
+static int
+parse_line(char *line, const char **prefix, char **parv)
+{
+	int parc = 0;
+
+	*prefix = NULL;
+
+	if(*line == '@')
+	{
+		line = strchr(line, ' ');
+		if(line == NULL)
+			return 0;
+		while(*line == ' ')
+			line++;
+	}
+
+	if(*line == ':')
+	{
+		*prefix = line + 1;
+		line = strchr(line, ' ');
+		if(line == NULL)
+			return 0;
+		*line++ = '\0';
+	}
+
+	while(*line != '\0' && parc < MAXPARA)
+	{
+		while(*line == ' ')
+			line++;
+		if(*line == '\0')
+			break;
+
+		if(*line == ':' && parc > 0)
+		{
+			parv[parc++] = line + 1;
+			break;
+		}
+
+		parv[parc++] = line;
+		line = strchr(line, ' ');
+		if(line == NULL)
+			break;
+		*line++ = '\0';
+	}
+
+	return parc;
+}
+
+static void
+conn_read(rb_fde_t *F, void *data)
+{
+	struct conn *conn = data;
+	static char buf[READBUF_SIZE];
+	char line[READBUF_SIZE];
+	char *parv[MAXPARA];
+	const char *prefix;
+	int n, parc;
+
+	for(;;)
+	{
+		n = rb_read(F, buf, sizeof buf);
+		if(n == RB_RW_SSL_NEED_WRITE)
+		{
+			rb_setselect(F, RB_SELECT_WRITE, conn_read, conn);
+			return;
+		}
+		if(n < 0 && rb_ignore_errno(errno))
+			break;
+		if(n <= 0)
+		{
+			conn->lost(conn);
+			return;
+		}
+
+		rb_linebuf_parse(&conn->recvq, buf, n, 1);
+		while(rb_linebuf_get(&conn->recvq, line, sizeof line, LINEBUF_COMPLETE, LINEBUF_PARSED) > 0)
+		{
+			parc = parse_line(line, &prefix, parv);
+			if(parc > 0)
+				conn->handle(conn, prefix, parc, parv);
+
+			/* the handler may have dropped the connection */
+			if(conn->F != F)
+				return;
+		}
+	}
+
+	rb_setselect(F, RB_SELECT_READ, conn_read, conn);
+}
+
+/* the time a PRIVMSG was sent, from its text, or 0 if it is not ours */
+static uint64_t
+message_time(const char *text)
+{
+	if(strncmp(text, "ib ", 3))
+		return 0;
+
+	return strtoull(text + 3, NULL, 10);
+}
+
+/* "ib <ns> " and padding up to -m characters */
+static const char *
+message_text(void)
+{
+	static char text[LINE_SIZE];
+	int len;
+
+	len = snprintf(text, sizeof text, "ib %llu ", (unsigned long long)rb_hist_now());
+	while(len < opt.msglen && len < (int)sizeof text - 1)
+	{
+		text[len] = 'a' + len % 26;
+		len++;
+	}
+	text[len] = '\0';
+
+	return text;
+}
+
+/* --- clients ----------------------------------------------------------- */
+
+static void
+client_nick(struct client *c)
+{
+	conn_send(&c->conn, "NICK %c%d%s", c->alt_nick ? 'c' : 'b', c->idx,
+			c->retries ? "_" : "");
+}
+
+static void
+client_handle(struct conn *conn, const char *prefix, int parc, char **parv)
+{
+	struct client *c = (struct client *)conn;
+	uint64_t sent;
+
+	if(!strcmp(parv[0], "PRIVMSG") && parc > 2)
+	{
+		STAT_ADD(delivered);
+		if((sent = message_time(parv[2])) != 0)
+			STAT_LATENCY(latency, rb_hist_now() - sent);
+	}
+	else if(!strcmp(parv[0], "PING"))
+		conn_send(conn, "PONG :%s", parc > 1 ? parv[1] : "");
+	else if(!strcmp(parv[0], "001"))
+	{
+		char joins[LINE_SIZE];
+		int len = 0;
+
+		c->state = CLIENT_UP;
+		c->retries = 0;
+		STAT_ADD(registered);
+		STAT_LATENCY(connect, rb_hist_now() - c->connect_start);
+
+		for(int i = 0; i < opt.joins; i++)
+			len += snprintf(joins + len, sizeof joins - len, "%s#ib%d", i ? "," : "", c->chans[i]);
+		conn_send(conn, "JOIN %s", joins);
+
+		if(c->storm && --storm_pending == 0)
+			printf("storm: reconnected in %.1f ms\n", (rb_hist_now() - storm_start) / 1e6);
+		c->storm = false;
+	}
+	else if(!strcmp(parv[0], "NOTICE") && parc > 2 && strstr(parv[2], " throttled due to flooding"))
+		STAT_ADD(throttled);
+	else if(!strcmp(parv[0], "433") && c->state == CLIENT_REGISTERING)
+	{
+		/* the previous connection has not gone yet */
+		c->retries++;
+		client_nick(c);
+	}
+	else if((!strcmp(parv[0], "315") || !strcmp(parv[0], "323")) && c->reply_start != 0)
+	{
+		STAT_LATENCY(reply, rb_hist_now() - c->reply_start);
+		c->reply_start = 0;
+	}
+	else if(!strcmp(parv[0], "ERROR"))
+	{
+		if(total.lost < 10)
+			fprintf(stderr, "client %d: ERROR %s\n", c->idx, parc > 1 ? parv[1] : "");
+	}
+}
+
+static void
+client_lost(struct conn *conn)
+{
+	struct client *c = (struct client *)conn;
+
+	conn_close(conn);
+	c->state = CLIENT_DOWN;
+	STAT_ADD(lost);
+
+	if(c->storm)
+	{
+		c->storm = false;
+		storm_pending--;
+	}
+}
+
+static void
+client_connected(rb_fde_t *F, int status, void *data)
+{
+	struct client *c = data;
+
+	if(status != RB_OK)
+	{
+		if(total.lost < 10)
+			fprintf(stderr, "client %d: %s\n", c->idx, status == RB_ERROR_SSL ?
+					rb_get_ssl_strerror(F) : rb_errstr(status));
+		client_lost(&c->conn);
+		return;
+	}
+
+	c->state = CLIENT_REGISTERING;
+	client_nick(c);
+	conn_send(&c->conn, "USER ib%d * * :ircbench", c->idx);
+	if(c->conn.F != NULL)
+		conn_read(F, &c->conn);
+}
+
+static void
+client_connect(struct client *c)
+{
+	rb_fde_t *F;
+
+	F = rb_socket(GET_SS_FAMILY(&server_addr), SOCK_STREAM, 0, "ircbench client");
+	if(F == NULL)
+	{
+		STAT_ADD(lost);
+		return;
+	}
+
+	conn_init(&c->conn, F);
+	c->state = CLIENT_CONNECTING;
+	c->alt_nick = false;
+	c->reply_start = 0;
+	c->connect_start = rb_hist_now();
+
+	if(opt.tls_cert != NULL)
+		rb_connect_tcp_ssl(F, (struct sockaddr *)&server_addr, NULL, client_connected, c, CONNECT_TIMEOUT);
+	else
+		rb_connect_tcp(F, (struct sockaddr *)&server_addr, NULL, client_connected, c, CONNECT_TIMEOUT);
+}
+
+/* one scripted action by a random registered client */
+static void
+client_act(void)
+{
+	struct client *c = &clients[rand() % opt.clients];
+	double roll = rand() / (RAND_MAX + 1.0) * 100;
+	int chan;
+
+	if(c->state != CLIENT_UP)
+		return;
+
+	chan = c->chans[rand() % opt.joins];
+
+	if((roll -= opt.nick_pct) < 0)
+	{
+		c->alt_nick = !c->alt_nick;
+		client_nick(c);
+		STAT_ADD(nicks);
+	}
+	else if((roll -= opt.who_pct) < 0)
+	{
+		if(c->reply_start == 0)
+			c->reply_start = rb_hist_now();
+		conn_send(&c->conn, "WHO #ib%d", chan);
+		STAT_ADD(whos);
+	}
+	else if((roll -= opt.list_pct) < 0)
+	{
+		if(c->reply_start == 0)
+			c->reply_start = rb_hist_now();
+		conn_send(&c->conn, "LIST");
+		STAT_ADD(lists);
+	}
+	else
+	{
+		conn_send(&c->conn, "PRIVMSG #ib%d :%s", chan, message_text());
+		STAT_ADD(sent);
+	}
+}
+
+static void
+storm(void)
+{
+	int count = 0;
+
+	if(storm_pending > 0)
+		printf("storm: %d clients still reconnecting from the last one\n", storm_pending);
+
+	storm_start = rb_hist_now();
+	for(int tries = 0; count < opt.storm_count && tries < opt.clients * 2; tries++)
+	{
+		struct client *c = &clients[rand() % opt.clients];
+
+		if(c->state != CLIENT_UP)
+			continue;
+
+		conn_close(&c->conn);
+		c->state = CLIENT_DOWN;
+		c->storm = true;
+		count++;
+	}
+
+	for(int i = 0; i < opt.clients; i++)
+		if(clients[i].storm && clients[i].state == CLIENT_DOWN)
+			client_connect(&clients[i]);
+
+	storm_pending += count;
+}
+
+/* --- the fake server --------------------------------------------------- */
+
+/* SID followed by six characters, the first a letter */
+static const char *
+link_uid(int u)
+{
+	static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	static char uid[10];
+
+	snprintf(uid, sizeof uid, "%sA", fake.sid);
+	for(int i = 8; i > 3; i--, u /= 36)
+		uid[i] = chars[u % 36];
+	uid[9] = '\0';
+	return uid;
+}
+
+static int
+link_chan(int u, int k)
+{
+	return (u * opt.joins + k) % opt.channels;
+}
+
+static void
+link_burst(void)
+{
+	struct conn *conn = &fake.conn;
+	time_t now = rb_current_time();
+	char line[LINE_SIZE];
+	int len, members;
+
+	fake.burst_start = rb_hist_now();
+	fake.bursting = true;
+
+	for(int u = 0; u < opt.link_users; u++)
+		conn_send(conn, ":%s EUID ibl%d 1 %ld +i ibl %s 0 %s * * :ircbench", fake.sid, u,
+				(long)now, fake.name, link_uid(u));
+
+	/* users are spread over the channels the same way clients are */
+	for(int chan = 0; chan < opt.channels; chan++)
+	{
+		len = members = 0;
+		for(int u = 0; u < opt.link_users; u++)
+		{
+			for(int k = 0; k < opt.joins; k++)
+			{
+				if(link_chan(u, k) != chan)
+					continue;
+
+				len += snprintf(line + len, sizeof line - len, "%s%s", members ? " " : "", link_uid(u));
+				if(++members == 20)
+				{
+					conn_send(conn, ":%s SJOIN %ld #ib%d +nt :%s", fake.sid, (long)now, chan, line);
+					len = members = 0;
+				}
+				break;
+			}
+		}
+		if(members > 0)
+			conn_send(conn, ":%s SJOIN %ld #ib%d +nt :%s", fake.sid, (long)now, chan, line);
+	}
+
+	/* the PONG to this says the server has read the whole burst */
+	conn_send(conn, ":%s PING %s", fake.sid, fake.name);
+}
+
+static void
+link_handle(struct conn *conn, const char *prefix, int parc, char **parv)
+{
+	uint64_t sent;
+
+	if(!strcmp(parv[0], "PRIVMSG") && parc > 2)
+	{
+		STAT_ADD(link_delivered);
+		if((sent = message_time(parv[2])) != 0)
+			STAT_LATENCY(latency, rb_hist_now() - sent);
+	}
+	else if(!strcmp(parv[0], "PING"))
+		conn_send(conn, ":%s PONG %s :%s", fake.sid, fake.name, parc > 1 ? parv[1] : "");
+	else if(!strcmp(parv[0], "PONG") && fake.bursting)
+	{
+		fake.bursting = false;
+		printf("link: burst of %d users taken in %.1f ms\n", opt.link_users,
+				(rb_hist_now() - fake.burst_start) / 1e6);
+	}
+	else if(!strcmp(parv[0], "SERVER") && !fake.up)
+	{
+		fake.up = true;
+		if(opt.split_every > 0)
+			fake.split_at = rb_current_time() + opt.split_every;
+		link_burst();
+	}
+	else if(!strcmp(parv[0], "ERROR"))
+		fprintf(stderr, "link: ERROR %s\n", parc > 1 ? parv[1] : "");
+}
+
+static void
+link_lost(struct conn *conn)
+{
+	conn_close(conn);
+	if(fake.up)
+		printf("link: lost\n");
+	fake.up = false;
+	fake.bursting = false;
+	fake.relink_at = rb_current_time() + 1;
+}
+
+static void
+link_connected(rb_fde_t *F, int status, void *data)
+{
+	struct conn *conn = data;
+
+	if(status != RB_OK)
+	{
+		fprintf(stderr, "link: %s\n", status == RB_ERROR_SSL ?
+				rb_get_ssl_strerror(F) : rb_errstr(status));
+		link_lost(conn);
+		return;
+	}
+
+	conn_send(conn, "PASS %s TS 6 :%s", fake.password, fake.sid);
+	conn_send(conn, "CAPAB :QS EX IE KLN UNKLN ENCAP TB SERVICES EUID EOPMOD MLOCK");
+	conn_send(conn, "SERVER %s 1 :ircbench", fake.name);
+	conn_send(conn, "SVINFO 6 6 0 :%ld", (long)rb_current_time());
+	if(conn->F != NULL)
+		conn_read(F, conn);
+}
+
+static void
+link_connect(void)
+{
+	rb_fde_t *F;
+
+	fake.relink_at = 0;
+	F = rb_socket(GET_SS_FAMILY(&server_addr), SOCK_STREAM, 0, "ircbench link");
+	if(F == NULL)
+	{
+		fake.relink_at = rb_current_time() + 1;
+		return;
+	}
+
+	conn_init(&fake.conn, F);
+	fake.conn.handle = link_handle;
+	fake.conn.lost = link_lost;
+
+	if(opt.tls_cert != NULL)
+		rb_connect_tcp_ssl(F, (struct sockaddr *)&server_addr, NULL, link_connected, &fake.conn, CONNECT_TIMEOUT);
+	else
+		rb_connect_tcp(F, (struct sockaddr *)&server_addr, NULL, link_connected, &fake.conn, CONNECT_TIMEOUT);
+}
+
+/* a PRIVMSG from a random user on the fake server */
+static void
+link_act(void)
+{
+	int u = rand() % opt.link_users;
+
+	conn_send(&fake.conn, ":%s PRIVMSG #ib%d :%s", link_uid(u),
+			link_chan(u, rand() % opt.joins), message_text());
+	STAT_ADD(sent);
+}
+
+static void
+link_split(void)
+{
+	printf("link: splitting\n");
+	conn_send(&fake.conn, "SQUIT %s :ircbench split", fake.name);
+	link_lost(&fake.conn);
+}
+
+/* --- reporting --------------------------------------------------------- */
+
+struct usage
+{
+	double cpu;	/* seconds */
+	long rss;	/* kilobytes */
+};
+
+static bool
+server_usage(struct usage *u)
+{
+	char path[64], buf[1024], *p;
+	unsigned long utime, stime;
+	long rss;
+	FILE *f;
+
+	snprintf(path, sizeof path, "/proc/%d/stat", (int)opt.pid);
+	if((f = fopen(path, "r")) == NULL)
+		return false;
+	p = fgets(buf, sizeof buf, f);
+	fclose(f);
+
+	/* the command name may hold spaces; fields continue after the ')' */
+	if(p == NULL || (p = strrchr(buf, ')')) == NULL)
+		return false;
+	if(sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+			&utime, &stime, &rss) != 3)
+		return false;
+
+	u->cpu = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+	u->rss = rss * (sysconf(_SC_PAGESIZE) / 1024);
+	return true;
+}
+
+static double
+self_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void
+report(double elapsed, const char *phase)
+{
+	static struct usage last_server;
+	static double last_self;
+	static bool have_server;
+	struct usage server;
+	int up = 0;
+	double self = self_cpu();
+
+	for(int i = 0; i < opt.clients; i++)
+		if(clients[i].state == CLIENT_UP)
+			up++;
+
+	printf("%-7s %5.0fs up %6d sent %7.0f/s recv %8.0f/s p50 %7.2fms p99 %7.2fms",
+			phase, (rb_hist_now() - start_ns) / 1e9, up,
+			interval.sent / elapsed, (interval.delivered + interval.link_delivered) / elapsed,
+			lat_quantile_ms(&interval.latency, 0.5), lat_quantile_ms(&interval.latency, 0.99));
+
+	if(opt.pid != 0 && server_usage(&server))
+	{
+		if(have_server)
+			printf(" rss %6ldMB cpu %3.0f%%", server.rss / 1024,
+					(server.cpu - last_server.cpu) / elapsed * 100);
+		last_server = server;
+		have_server = true;
+	}
+	printf(" self %3.0f%%\n", (self - last_self) / elapsed * 100);
+	last_self = self;
+
+	fflush(stdout);
+	memset(&interval, 0, sizeof interval);
+}
+
+static void
+summary(double chatter)
+{
+	struct usage server;
+
+	printf("\n");
+	printf("clients:     %llu registrations, %llu connections lost\n",
+			(unsigned long long)total.registered, (unsigned long long)total.lost);
+	printf("connect:     p50 %.2fms p99 %.2fms\n",
+			lat_quantile_ms(&total.connect, 0.5), lat_quantile_ms(&total.connect, 0.99));
+	if(chatter > 0)
+	{
+		printf("messages:    %llu sent, %.0f/s\n", (unsigned long long)total.sent, total.sent / chatter);
+		printf("deliveries:  %llu to clients, %llu to the link, %.0f/s\n",
+				(unsigned long long)total.delivered, (unsigned long long)total.link_delivered,
+				(total.delivered + total.link_delivered) / chatter);
+	}
+	printf("latency:     p50 %.2fms p90 %.2fms p99 %.2fms p99.9 %.2fms\n",
+			lat_quantile_ms(&total.latency, 0.5), lat_quantile_ms(&total.latency, 0.9),
+			lat_quantile_ms(&total.latency, 0.99), lat_quantile_ms(&total.latency, 0.999));
+	printf("who/list:    %llu/%llu, p50 %.2fms p99 %.2fms\n",
+			(unsigned long long)total.whos, (unsigned long long)total.lists,
+			lat_quantile_ms(&total.reply, 0.5), lat_quantile_ms(&total.reply, 0.99));
+	printf("nicks:       %llu\n", (unsigned long long)total.nicks);
+	if(total.throttled > 0)
+		printf("throttled:   %llu messages; raise general::default_floodcount\n",
+				(unsigned long long)total.throttled);
+	if(opt.pid != 0 && server_usage(&server))
+		printf("server:      rss %ldMB, %.1fs cpu\n", server.rss / 1024, server.cpu);
+	printf("ircbench:    %.1fs cpu\n", self_cpu());
+}
+
+/* --- main -------------------------------------------------------------- */
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+		"usage: ircbench [options]\n"
+		"  -s host        server address (%s)\n"
+		"  -p port        server port (%d)\n"
+		"  -c clients     number of clients (%d)\n"
+		"  -C rate        connections per second while ramping up (%.0f)\n"
+		"  -j channels    number of channels (%d)\n"
+		"  -J joins       channels each client joins (%d)\n"
+		"  -r rate        actions per client per second (%g)\n"
+		"  -m length      length of message text (%d)\n"
+		"  -n percent     share of actions that are NICK (%g)\n"
+		"  -w percent     share of actions that are WHO (%g)\n"
+		"  -l percent     share of actions that are LIST (%g)\n"
+		"  -t seconds     how long to chatter (%d)\n"
+		"  -R count:secs  drop and reconnect count clients every secs seconds\n"
+		"  -L name:sid:password  link a fake server\n"
+		"  -u users       users on the fake server (%d)\n"
+		"  -S seconds     split and relink the fake server this often\n"
+		"  -T certfile    use TLS; librb wants a certificate even for clients\n"
+		"  -P pid         report RSS and CPU of this ircd process\n"
+		"  -i seconds     report interval (%d)\n",
+		opt.host, opt.port, opt.clients, opt.connect_rate, opt.channels, opt.joins,
+		opt.rate, opt.msglen, opt.nick_pct, opt.who_pct, opt.list_pct, opt.duration,
+		opt.link_users, opt.interval);
+	exit(64);
+}
+
+static void
+parse_args(int argc, char *argv[])
+{
+	char *p;
+	int c;
+
+	while((c = getopt(argc, argv, "s:p:c:C:j:J:r:m:n:w:l:t:R:L:u:S:T:P:i:")) != -1)
+	{
+		switch(c)
+		{
+		case 's': opt.host = optarg; break;
+		case 'p': opt.port = atoi(optarg); break;
+		case 'c': opt.clients = atoi(optarg); break;
+		case 'C': opt.connect_rate = atof(optarg); break;
+		case 'j': opt.channels = atoi(optarg); break;
+		case 'J': opt.joins = atoi(optarg); break;
+		case 'r': opt.rate = atof(optarg); break;
+		case 'm': opt.msglen = atoi(optarg); break;
+		case 'n': opt.nick_pct = atof(optarg); break;
+		case 'w': opt.who_pct = atof(optarg); break;
+		case 'l': opt.list_pct = atof(optarg); break;
+		case 't': opt.duration = atoi(optarg); break;
+		case 'R':
+			opt.storm_count = atoi(optarg);
+			if((p = strchr(optarg, ':')) == NULL)
+				usage();
+			opt.storm_every = atoi(p + 1);
+			break;
+		case 'L': opt.link = optarg; break;
+		case 'u': opt.link_users = atoi(optarg); break;
+		case 'S': opt.split_every = atoi(optarg); break;
+		case 'T': opt.tls_cert = optarg; break;
+		case 'P': opt.pid = atoi(optarg); break;
+		case 'i': opt.interval = atoi(optarg); break;
+		default: usage();
+		}
+	}
+
+	if(optind != argc || opt.clients <= 0 || opt.channels <= 0 || opt.joins <= 0 ||
+	   opt.joins > opt.channels || opt.interval <= 0 || opt.link_users <= 0)
+		usage();
+
+	if(opt.link != NULL)
+	{
+		char *s = rb_strdup(opt.link);
+
+		fake.name = s;
+		if((fake.sid = strchr(s, ':')) == NULL)
+			usage();
+		*fake.sid++ = '\0';
+		if((fake.password = strchr(fake.sid, ':')) == NULL)
+			usage();
+		*fake.password++ = '\0';
+		if(strlen(fake.sid) != 3)
+			usage();
+	}
+}
+
+static void
+on_signal(int sig)
+{
+	interrupted = 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct rlimit rl;
+	uint64_t now, last, last_report, chatter_start = 0, last_registered = 0, registered = 0;
+	double launch = 0, actions = 0, link_actions = 0;
+	int launched = 0, maxfds;
+	time_t next_storm = 0;
+	bool chatter = false;
+
+	parse_args(argc, argv);
+
+	/* every client is a descriptor */
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	maxfds = rl.rlim_cur > INT_MAX ? INT_MAX : (int)rl.rlim_cur;
+	if(opt.clients + 64 > maxfds)
+	{
+		fprintf(stderr, "ircbench: %d clients need more than the %d descriptors allowed\n",
+				opt.clients, maxfds);
+		return 1;
+	}
+
+	/* closed descriptors are only released at the end of a pass of the
+	 * loop, so a reconnect storm briefly holds twice its share */
+	rb_lib_init(NULL, NULL, NULL, 0, maxfds, 1024, 1024);
+	rb_linebuf_init(1024);
+
+	if(rb_inet_pton_sock(opt.host, (struct sockaddr_storage *)&server_addr) <= 0)
+	{
+		fprintf(stderr, "ircbench: %s is not an address\n", opt.host);
+		return 1;
+	}
+	SET_SS_PORT(&server_addr, htons(opt.port));
+
+	if(opt.tls_cert != NULL && (!rb_supports_ssl() ||
+	   !rb_setup_ssl_server(opt.tls_cert, NULL, NULL, NULL)))
+	{
+		fprintf(stderr, "ircbench: cannot set up TLS with %s\n", opt.tls_cert);
+		return 1;
+	}
+
+	clients = rb_malloc(opt.clients * sizeof *clients);
+	for(int i = 0; i < opt.clients; i++)
+	{
+		clients[i].idx = i;
+		clients[i].conn.handle = client_handle;
+		clients[i].conn.lost = client_lost;
+		clients[i].chans = rb_malloc(opt.joins * sizeof(int));
+		for(int k = 0; k < opt.joins; k++)
+			clients[i].chans[k] = (i * opt.joins + k) % opt.channels;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	srand(1);
+
+	start_ns = last = last_report = rb_hist_now();
+
+	while(!interrupted)
+	{
+		rb_select(10);
+		rb_event_run();
+
+		now = rb_hist_now();
+		double dt = (now - last) / 1e9;
+		last = now;
+
+		if(launched < opt.clients)
+		{
+			for(launch += opt.connect_rate * dt; launch >= 1 && launched < opt.clients; launch--)
+				client_connect(&clients[launched++]);
+			last_registered = now;
+		}
+		else if(!chatter)
+		{
+			/* start once everyone is in, or nobody has been for a while */
+			if(total.registered + total.lost < (uint64_t)opt.clients &&
+			   now - last_registered < RAMP_GRACE * 1000000000ULL)
+			{
+				if(total.registered != registered)
+					last_registered = now;
+				registered = total.registered;
+			}
+			else
+			{
+				chatter = true;
+				chatter_start = now;
+				if(opt.storm_count > 0 && opt.storm_every > 0)
+					next_storm = rb_current_time() + opt.storm_every;
+				if(fake.name != NULL)
+					link_connect();
+			}
+		}
+		else
+		{
+			for(actions += opt.rate * opt.clients * dt; actions >= 1; actions--)
+				client_act();
+
+			if(fake.up && !fake.bursting)
+				for(link_actions += opt.rate * opt.link_users * dt; link_actions >= 1; link_actions--)
+					link_act();
+
+			if(next_storm != 0 && rb_current_time() >= next_storm)
+			{
+				storm();
+				next_storm = rb_current_time() + opt.storm_every;
+			}
+
+			if(fake.relink_at != 0 && rb_current_time() >= fake.relink_at)
+				link_connect();
+			else if(fake.up && fake.split_at != 0 && rb_current_time() >= fake.split_at)
+				link_split();
+
+			if(now - chatter_start >= opt.duration * 1000000000ULL)
+				break;
+		}
+
+		if(now - last_report >= opt.interval * 1000000000ULL)
+		{
+			report((now - last_report) / 1e9, chatter ? "chatter" : "ramp");
+			last_report = now;
+		}
+	}
+
+	summary(chatter ? (rb_hist_now() - chatter_start) / 1e9 : 0);
+	return 0;
+}